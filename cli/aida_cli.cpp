@@ -0,0 +1,736 @@
+// Headless AiDA: opens a database through idalib and runs one AI action over a set of
+// functions, with no dialogs, writing one JSON record per function.
+//
+// idalib has no UI loop to deliver the plugin's asynchronous callbacks, so everything that
+// touches the database (context building, applying results) runs here on the main thread,
+// and only the HTTP requests of each chunk run in parallel.
+
+#include "aida_pro.hpp"
+#include "workers.hpp"
+#include <chrono>
+#include <cstdio>
+
+using json = nlohmann::json;
+
+enum exit_code_t
+{
+    EXIT_OK = 0,
+    EXIT_USAGE = 1,
+    EXIT_DATABASE = 2,
+    EXIT_NO_CLIENT = 3,
+    EXIT_PARTIAL = 4,   // the run finished but some functions failed
+};
+
+struct cli_options_t
+{
+    std::string database;
+    std::string action;
+    std::string question;
+    std::vector<std::string> func_specs;
+    bool unnamed_only = false;
+    size_t limit = 0;
+    size_t jobs = 8;
+    size_t workers = 0;
+    std::string emit_contexts;    // internal: run as a --workers worker, frames go to this pipe
+    std::string output;
+    std::string export_path;
+    std::string import_path;
+    bool json_document = false;
+    bool dry_run = false;
+    bool save = true;
+    bool verbose = false;
+    bool help = false;
+};
+
+struct cli_action_t
+{
+    const char* name;
+    const char* prompt;
+    bool struct_context;
+    bool edits;               // changes the database; skipped with --dry-run
+    bool use_settings_temperature;
+    // Applies one answer; fills the record's "applied" and returns false on a bad answer.
+    bool (*apply)(ea_t func_ea, const std::string& answer, json* record);
+};
+
+static bool apply_nothing(ea_t, const std::string&, json*)
+{
+    return true;
+}
+
+static bool apply_rename(ea_t func_ea, const std::string& answer, json* record)
+{
+    qstring name;
+    if (!ida_utils::clean_function_name(answer, &name))
+    {
+        (*record)["error"] = "The suggested name is not a valid identifier.";
+        return false;
+    }
+    if (!set_name(func_ea, name.c_str(), SN_FORCE | SN_NODUMMY | SN_NOWARN))
+    {
+        (*record)["error"] = "IDA refused the name.";
+        return false;
+    }
+    (*record)["applied"] = name.c_str();
+    return true;
+}
+
+static bool apply_comments(ea_t func_ea, const std::string& answer, json* record)
+{
+    (*record)["applied"] = ida_utils::apply_comments(func_ea, ida_utils::parse_comment_suggestions(answer));
+    return true;
+}
+
+static bool apply_rename_all(ea_t func_ea, const std::string& answer, json* record)
+{
+    (*record)["applied"] = ida_utils::apply_renames_from_ai(func_ea, answer).c_str();
+    return true;
+}
+
+static bool apply_struct(ea_t func_ea, const std::string& answer, json* record)
+{
+    // Keeps an existing type of the same name rather than asking.
+    const bool applied = ida_utils::apply_struct_from_cpp(answer, func_ea, ida_utils::STRUCT_CONFLICT_RENAME);
+    (*record)["applied"] = applied;
+    return applied;
+}
+
+static const cli_action_t cli_actions[] = {
+    { "analyze",    ANALYZE_FUNCTION_PROMPT,  false, false, true,  apply_nothing },
+    { "rename",     SUGGEST_NAME_PROMPT,      false, true,  false, apply_rename },
+    { "comments",   GENERATE_COMMENTS_PROMPT, false, true,  false, apply_comments },
+    { "rename_all", RENAME_ALL_PROMPT,        true,  true,  false, apply_rename_all },
+    { "struct",     GENERATE_STRUCT_PROMPT,   true,  true,  false, apply_struct },
+    { "hook",       GENERATE_HOOK_PROMPT,     false, false, false, apply_nothing },
+    { "query",      CUSTOM_QUERY_PROMPT,      false, false, true,  apply_nothing },
+};
+
+static void print_usage(FILE* out)
+{
+    fprintf(out,
+        "usage: aida_cli -a <action> [options] <database or binary>\n"
+        "       aida_cli --export <file.jsonl|file.bin> [selection options] <database>\n"
+        "       aida_cli --import <file> <database>\n"
+        "\n"
+        "actions: analyze, rename, comments, rename_all, struct, hook, query\n"
+        "\n"
+        "  -a, --action NAME      action to run on every selected function\n"
+        "  -q, --question TEXT    the question for the query action\n"
+        "  -f, --funcs LIST       comma-separated addresses or names (default: all non-library functions)\n"
+        "      --funcs-file PATH  addresses or names, one per line\n"
+        "      --unnamed          only functions that still have auto-generated names\n"
+        "      --limit N          stop after N functions\n"
+        "  -j, --jobs N           requests in flight at once (default 8; at most the\n"
+        "                         slot count of a local llama.cpp server)\n"
+        "  -w, --workers N        build contexts in N worker processes, each on its own copy\n"
+        "                         of the database (.i64/.idb only)\n"
+        "  -o, --output PATH      write records here instead of stdout\n"
+        "      --export PATH      write the selected functions' contexts, no AI requests;\n"
+        "                         a .bin name selects the binary format\n"
+        "      --import PATH      apply results keyed by address and MD5, then save\n"
+        "      --format FORMAT    jsonl (default, one record per line) or json (one document)\n"
+        "      --dry-run          ask the AI but change and save nothing\n"
+        "      --no-save          apply changes but do not save the database\n"
+        "  -v, --verbose          show IDA's messages\n"
+        "\n"
+        "exit codes: 0 done, 1 bad arguments, 2 database could not be opened,\n"
+        "            3 no AI provider configured, 4 done but some functions failed\n");
+}
+
+static void split_specs(const std::string& text, char sep, std::vector<std::string>* out)
+{
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, sep))
+    {
+        qstring trimmed = item.c_str();
+        trimmed.trim2();
+        if (!trimmed.empty() && trimmed[0] != '#')
+            out->push_back(trimmed.c_str());
+    }
+}
+
+static bool parse_args(int argc, char* argv[], cli_options_t* opts)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        auto value = [&](const char* what) -> const char* {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "aida_cli: %s needs %s.\n", arg.c_str(), what);
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        const char* v = nullptr;
+        if (arg == "-a" || arg == "--action")
+        {
+            if ((v = value("an action name")) == nullptr) return false;
+            opts->action = v;
+        }
+        else if (arg == "-q" || arg == "--question")
+        {
+            if ((v = value("the question")) == nullptr) return false;
+            opts->question = v;
+        }
+        else if (arg == "-f" || arg == "--funcs")
+        {
+            if ((v = value("a list of functions")) == nullptr) return false;
+            split_specs(v, ',', &opts->func_specs);
+        }
+        else if (arg == "--funcs-file")
+        {
+            if ((v = value("a file name")) == nullptr) return false;
+            std::ifstream in(v);
+            if (!in)
+            {
+                fprintf(stderr, "aida_cli: cannot read %s.\n", v);
+                return false;
+            }
+            std::stringstream ss;
+            ss << in.rdbuf();
+            split_specs(ss.str(), '\n', &opts->func_specs);
+        }
+        else if (arg == "--unnamed")
+        {
+            opts->unnamed_only = true;
+        }
+        else if (arg == "--limit")
+        {
+            if ((v = value("a count")) == nullptr) return false;
+            opts->limit = strtoul(v, nullptr, 10);
+        }
+        else if (arg == "-j" || arg == "--jobs")
+        {
+            if ((v = value("a count")) == nullptr) return false;
+            opts->jobs = std::max<size_t>(strtoul(v, nullptr, 10), 1);
+        }
+        else if (arg == "-w" || arg == "--workers")
+        {
+            if ((v = value("a count")) == nullptr) return false;
+            opts->workers = strtoul(v, nullptr, 10);
+        }
+        else if (arg == "--emit-contexts")
+        {
+            if ((v = value("a pipe")) == nullptr) return false;
+            opts->emit_contexts = v;
+        }
+        else if (arg == "--export")
+        {
+            if ((v = value("a file name")) == nullptr) return false;
+            opts->export_path = v;
+        }
+        else if (arg == "--import")
+        {
+            if ((v = value("a file name")) == nullptr) return false;
+            opts->import_path = v;
+        }
+        else if (arg == "-o" || arg == "--output")
+        {
+            if ((v = value("a file name")) == nullptr) return false;
+            opts->output = v;
+        }
+        else if (arg == "--format")
+        {
+            if ((v = value("jsonl or json")) == nullptr) return false;
+            if (strcmp(v, "json") != 0 && strcmp(v, "jsonl") != 0)
+            {
+                fprintf(stderr, "aida_cli: unknown format %s.\n", v);
+                return false;
+            }
+            opts->json_document = strcmp(v, "json") == 0;
+        }
+        else if (arg == "--dry-run")
+        {
+            opts->dry_run = true;
+            opts->save = false;
+        }
+        else if (arg == "--no-save")
+        {
+            opts->save = false;
+        }
+        else if (arg == "-v" || arg == "--verbose")
+        {
+            opts->verbose = true;
+        }
+        else if (arg == "-h" || arg == "--help")
+        {
+            opts->help = true;
+            return true;
+        }
+        else if (!arg.empty() && arg[0] == '-')
+        {
+            fprintf(stderr, "aida_cli: unknown option %s.\n", arg.c_str());
+            return false;
+        }
+        else if (opts->database.empty())
+        {
+            opts->database = arg;
+        }
+        else
+        {
+            fprintf(stderr, "aida_cli: only one database per run.\n");
+            return false;
+        }
+    }
+    const bool exchange_mode = !opts->export_path.empty() || !opts->import_path.empty();
+    return !opts->database.empty() && (exchange_mode || !opts->action.empty());
+}
+
+static std::string hex_ea(ea_t ea)
+{
+    char buf[32];
+    qsnprintf(buf, sizeof(buf), "0x%llx", (uint64)ea);
+    return buf;
+}
+
+static ea_t resolve_func(const std::string& spec)
+{
+    char* end = nullptr;
+    uint64 value = strtoull(spec.c_str(), &end, 16);
+    ea_t ea = (end != spec.c_str() && *end == '\0') ? (ea_t)value : get_name_ea(BADADDR, spec.c_str());
+    func_t* pfn = ea != BADADDR ? get_func(ea) : nullptr;
+    return pfn != nullptr ? pfn->start_ea : BADADDR;
+}
+
+static bool select_functions(const cli_options_t& opts, bool skip_user_named, std::vector<ea_t>* funcs)
+{
+    if (!opts.func_specs.empty())
+    {
+        for (const auto& spec : opts.func_specs)
+        {
+            ea_t ea = resolve_func(spec);
+            if (ea == BADADDR)
+            {
+                fprintf(stderr, "aida_cli: no function at %s.\n", spec.c_str());
+                return false;
+            }
+            funcs->push_back(ea);
+        }
+    }
+    else
+    {
+        const size_t total = get_func_qty();
+        for (size_t i = 0; i < total; ++i)
+        {
+            func_t* pfn = getn_func(i);
+            if (pfn == nullptr || (pfn->flags & (FUNC_LIB | FUNC_THUNK)) != 0)
+                continue;
+            const flags64_t flags = get_flags(pfn->start_ea);
+            if ((opts.unnamed_only || skip_user_named) && has_user_name(flags))
+                continue;
+            funcs->push_back(pfn->start_ea);
+        }
+    }
+
+    std::sort(funcs->begin(), funcs->end());
+    funcs->erase(std::unique(funcs->begin(), funcs->end()), funcs->end());
+    if (opts.limit != 0 && funcs->size() > opts.limit)
+        funcs->resize(opts.limit);
+    return true;
+}
+
+static bool build_prompt(const cli_options_t& opts, const cli_action_t& action, ea_t func_ea, std::string* prompt, std::string* error)
+{
+    json context = ida_utils::get_context_for_prompt(func_ea, action.struct_context);
+    if (!context["ok"].get<bool>())
+    {
+        *error = context["message"].get<std::string>();
+        return false;
+    }
+    if (action.prompt == GENERATE_HOOK_PROMPT)
+    {
+        qstring func_name;
+        get_func_name(&func_name, func_ea);
+        static const std::regex non_alnum_re("[^a-zA-Z0-9_]");
+        context["func_name"] = std::regex_replace(std::string(func_name.c_str()), non_alnum_re, "_");
+    }
+    if (action.prompt == CUSTOM_QUERY_PROMPT)
+        context["user_question"] = opts.question;
+    *prompt = ida_utils::format_prompt(action.prompt, context);
+    return true;
+}
+
+// Records stay valid JSON even when decompiler output carries bytes that are not UTF-8.
+static std::string dump_record(const json& record)
+{
+    return record.dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
+struct task_t
+{
+    ea_t ea = BADADDR;
+    json record;
+    std::string prompt;   // empty when there is no context to ask about
+    std::string answer;
+};
+
+static task_t new_task(const cli_action_t& action, ea_t ea)
+{
+    task_t task;
+    task.ea = ea;
+    qstring name;
+    get_func_name(&name, ea);
+    task.record = { {"ea", hex_ea(ea)}, {"name", name.c_str()}, {"action", action.name}, {"ok", false} };
+    return task;
+}
+
+static void ask(AIClient& client, const cli_options_t& opts, double temperature, const std::vector<task_t*>& tasks)
+{
+    std::vector<std::string> prompts;
+    std::vector<task_t*> asked;
+    for (task_t* task : tasks)
+    {
+        if (task->prompt.empty())
+            continue;
+        prompts.push_back(std::move(task->prompt));
+        asked.push_back(task);
+    }
+    std::vector<std::string> answers = client.generate_parallel(prompts, temperature, opts.jobs);
+    for (size_t i = 0; i < answers.size(); ++i)
+        asked[i]->answer = std::move(answers[i]);
+}
+
+// Applies the answers in function order and writes one record per task.
+static void finish_tasks(const cli_options_t& opts, const cli_action_t& action, std::vector<task_t>& tasks, FILE* out, json* document, size_t* failed)
+{
+    for (auto& task : tasks)
+    {
+        json& record = task.record;
+        if (!record.contains("error"))
+        {
+            if (task.answer.empty() || task.answer.rfind("Error:", 0) == 0)
+            {
+                record["error"] = task.answer.empty() ? "Empty response." : task.answer;
+            }
+            else
+            {
+                record["result"] = task.answer;
+                record["ok"] = (action.edits && opts.dry_run) || action.apply(task.ea, task.answer, &record);
+            }
+        }
+
+        if (!record["ok"].get<bool>())
+            (*failed)++;
+        if (opts.json_document)
+            document->push_back(std::move(record));
+        else
+            fprintf(out, "%s\n", dump_record(record).c_str());
+    }
+    fflush(out);
+}
+
+static void report_progress(size_t done, size_t total, size_t failed, std::chrono::steady_clock::time_point started)
+{
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    fprintf(stderr, "aida_cli: %d / %d done, %d failed, %.0f s elapsed.\n", (int)done, (int)total, (int)failed, secs);
+}
+
+// Worker side of --workers: build the prompts of the selected functions and send them
+// over the pipe the coordinator handed down. Runs on a snapshot, so nothing is applied or saved.
+static int emit_contexts(const cli_options_t& opts, const cli_action_t& action)
+{
+    std::vector<ea_t> funcs;
+    if (!select_functions(opts, false, &funcs))
+        return EXIT_USAGE;
+
+    FILE* frames = workers::open_frame_output(opts.emit_contexts.c_str());
+    if (frames == nullptr)
+    {
+        fprintf(stderr, "aida_cli: bad --emit-contexts pipe %s.\n", opts.emit_contexts.c_str());
+        return EXIT_USAGE;
+    }
+    int rc = EXIT_OK;
+    for (ea_t ea : funcs)
+    {
+        std::string prompt;
+        std::string error;
+        bool ok = build_prompt(opts, action, ea, &prompt, &error);
+        if (!workers::write_frame(frames, ok ? workers::FRAME_CONTEXT : workers::FRAME_ERROR, ea, ok ? prompt : error)
+            || fflush(frames) != 0)
+        {
+            rc = EXIT_USAGE; // the coordinator went away
+            break;
+        }
+    }
+    fclose(frames);
+    return rc;
+}
+
+static int run(const cli_options_t& opts, const cli_action_t& action, workers::pool_t* pool, const char* exe, FILE* out)
+{
+    std::vector<ea_t> funcs;
+    // The GUI asks before replacing a name someone chose; unattended, those are left alone.
+    if (!select_functions(opts, action.apply == apply_rename, &funcs))
+        return EXIT_USAGE;
+
+    std::unique_ptr<AIClient> client = get_ai_client(g_settings);
+    if (!client || !client->is_available())
+    {
+        fprintf(stderr, "aida_cli: the configured AI provider is not available.\n");
+        return EXIT_NO_CLIENT;
+    }
+
+    const double temperature = action.use_settings_temperature ? g_settings.temperature : 0.0;
+    // Small enough that later chunks are built from the names and comments earlier ones applied.
+    const size_t chunk_size = opts.jobs * 4;
+    const auto started = std::chrono::steady_clock::now();
+    size_t failed = 0;
+    json document = json::array();
+
+    fprintf(stderr, "aida_cli: %s on %d function(s), %d request(s) at a time%s.\n",
+        action.name, (int)funcs.size(), (int)opts.jobs, pool != nullptr ? ", contexts from worker processes" : "");
+
+    if (pool == nullptr)
+    {
+        for (size_t first = 0; first < funcs.size(); first += chunk_size)
+        {
+            const size_t last = std::min(first + chunk_size, funcs.size());
+            std::vector<task_t> tasks;
+            std::vector<task_t*> batch;
+            tasks.reserve(last - first);
+            for (size_t i = first; i < last; ++i)
+            {
+                tasks.push_back(new_task(action, funcs[i]));
+                std::string error;
+                if (!build_prompt(opts, action, funcs[i], &tasks.back().prompt, &error))
+                    tasks.back().record["error"] = error;
+                batch.push_back(&tasks.back());
+            }
+            ask(*client, opts, temperature, batch);
+            finish_tasks(opts, action, tasks, out, &document, &failed);
+            report_progress(last, funcs.size(), failed, started);
+        }
+    }
+    else
+    {
+        // Workers build the contexts; this process only asks, then applies everything in
+        // one pass once the last worker is done.
+        std::vector<task_t> tasks;
+        tasks.reserve(funcs.size());
+        for (ea_t ea : funcs)
+        {
+            tasks.push_back(new_task(action, ea));
+            tasks.back().record["error"] = "The worker exited before reaching this function.";
+        }
+
+        std::vector<std::string> args = { "-a", action.name };
+        if (!opts.question.empty())
+        {
+            args.push_back("-q");
+            args.push_back(opts.question);
+        }
+        if (!pool->start(exe, args, funcs))
+        {
+            pool->finish();
+            return EXIT_DATABASE;
+        }
+
+        size_t received = 0;
+        std::vector<workers::context_t> contexts;
+        while (pool->next(&contexts, chunk_size))
+        {
+            std::vector<task_t*> batch;
+            for (auto& ctx : contexts)
+            {
+                auto it = std::lower_bound(funcs.begin(), funcs.end(), ctx.ea);
+                if (it == funcs.end() || *it != ctx.ea)
+                    continue;
+                task_t& task = tasks[it - funcs.begin()];
+                if (ctx.ok)
+                {
+                    task.record.erase("error");
+                    task.prompt = std::move(ctx.text);
+                }
+                else
+                {
+                    task.record["error"] = ctx.text;
+                }
+                batch.push_back(&task);
+            }
+            received += contexts.size();
+            contexts.clear();
+            ask(*client, opts, temperature, batch);
+            fprintf(stderr, "aida_cli: %d / %d contexts received and asked.\n", (int)received, (int)funcs.size());
+        }
+
+        int failed_workers = pool->finish();
+        if (failed_workers != 0)
+            fprintf(stderr, "aida_cli: %d worker(s) exited with an error.\n", failed_workers);
+        finish_tasks(opts, action, tasks, out, &document, &failed);
+        report_progress(funcs.size(), funcs.size(), failed, started);
+    }
+
+    const AIClient::usage_t usage = client->usage();
+    if (opts.json_document)
+    {
+        json summary = {
+            {"database", opts.database},
+            {"action", action.name},
+            {"functions", funcs.size()},
+            {"failed", failed},
+            {"requests", usage.requests},
+            {"prompt_chars", usage.prompt_chars},
+            {"response_chars", usage.response_chars},
+            {"results", std::move(document)},
+        };
+        fprintf(out, "%s\n", dump_record(summary).c_str());
+    }
+    fprintf(stderr, "aida_cli: %d request(s), about %d prompt and %d response tokens.\n",
+        (int)usage.requests, (int)(usage.prompt_chars / 4), (int)(usage.response_chars / 4));
+
+    return failed == 0 ? EXIT_OK : EXIT_PARTIAL;
+}
+
+// --export / --import: no provider needed, the inference happens elsewhere.
+static int run_exchange(const cli_options_t& opts)
+{
+    if (!opts.import_path.empty())
+    {
+        exchange::import_stats_t stats;
+        if (!exchange::import_results(opts.import_path.c_str(), &stats))
+            return EXIT_USAGE;
+        fprintf(stderr, "aida_cli: %d record(s): %d name(s), %d comment(s), %d variable rename(s), %d struct(s); "
+            "skipped %d changed, %d unknown, %d bad.\n",
+            (int)stats.records, stats.names, stats.comments, stats.renames, stats.structs,
+            (int)stats.stale, (int)stats.missing, (int)stats.bad);
+        return stats.bad + stats.stale + stats.missing == 0 ? EXIT_OK : EXIT_PARTIAL;
+    }
+
+    std::vector<ea_t> funcs;
+    if (!select_functions(opts, false, &funcs))
+        return EXIT_USAGE;
+    const char* ext = get_file_ext(opts.export_path.c_str());
+    const bool binary = ext != nullptr && strieq(ext, "bin");
+    exchange::export_stats_t stats;
+    bool ok = exchange::export_contexts(opts.export_path.c_str(), funcs,
+        binary ? exchange::FORMAT_BINARY : exchange::FORMAT_JSONL, false, &stats,
+        [&](size_t done) {
+            if (done != 0 && done % 1000 == 0)
+                fprintf(stderr, "aida_cli: %d / %d exported.\n", (int)done, (int)funcs.size());
+            return true;
+        });
+    if (!ok)
+        return EXIT_USAGE;
+    fprintf(stderr, "aida_cli: exported %d context(s), %d function(s) without one.\n", (int)stats.written, (int)stats.skipped);
+    return EXIT_OK;
+}
+
+int main(int argc, char* argv[])
+{
+    cli_options_t opts;
+    if (!parse_args(argc, argv, &opts))
+    {
+        print_usage(stderr);
+        return EXIT_USAGE;
+    }
+    if (opts.help)
+    {
+        print_usage(stdout);
+        return EXIT_OK;
+    }
+
+    const bool exchange_mode = !opts.export_path.empty() || !opts.import_path.empty();
+    const cli_action_t* action = nullptr;
+    for (const auto& a : cli_actions)
+    {
+        if (opts.action == a.name)
+            action = &a;
+    }
+    if (action == nullptr && !exchange_mode)
+    {
+        fprintf(stderr, "aida_cli: unknown action %s.\n", opts.action.c_str());
+        print_usage(stderr);
+        return EXIT_USAGE;
+    }
+    if (action != nullptr && action->prompt == CUSTOM_QUERY_PROMPT && opts.question.empty())
+    {
+        fprintf(stderr, "aida_cli: the query action needs --question.\n");
+        return EXIT_USAGE;
+    }
+
+    if (init_library() != 0)
+    {
+        fprintf(stderr, "aida_cli: could not initialize idalib.\n");
+        return EXIT_DATABASE;
+    }
+    enable_console_messages(opts.verbose && opts.emit_contexts.empty());
+
+    if (exchange_mode)
+    {
+        // An export has to match the plugin's for the same database; no provider is needed.
+        if (!opts.export_path.empty())
+            g_settings.load_from_file();
+        if (open_database(opts.database.c_str(), true) != 0)
+        {
+            fprintf(stderr, "aida_cli: could not open %s.\n", opts.database.c_str());
+            return EXIT_DATABASE;
+        }
+        auto_wait();
+        int rc = run_exchange(opts);
+        close_database(opts.save && !opts.import_path.empty());
+        return rc;
+    }
+
+    if (!opts.emit_contexts.empty())
+    {
+        // The user's context limits (xrefs, snippet lines, prompt budget), so the prompts
+        // match an in-process run; the provider and key are the coordinator's business.
+        g_settings.load_from_file();
+        if (open_database(opts.database.c_str(), false) != 0)
+            return EXIT_DATABASE;
+        int rc = emit_contexts(opts, *action);
+        close_database(false);
+        return rc;
+    }
+
+    if (!g_settings.load_headless())
+    {
+        fprintf(stderr, "aida_cli: no usable AI provider settings; configure the plugin once or set the API key variable.\n");
+        return EXIT_NO_CLIENT;
+    }
+
+    // Snapshots are copied before this process opens (and later saves) the database.
+    std::unique_ptr<workers::pool_t> pool;
+    if (opts.workers > 0)
+    {
+        const char* ext = get_file_ext(opts.database.c_str());
+        if (ext == nullptr || (!strieq(ext, "i64") && !strieq(ext, "idb")))
+        {
+            fprintf(stderr, "aida_cli: --workers needs an analyzed .i64 or .idb database.\n");
+            return EXIT_USAGE;
+        }
+        pool = std::make_unique<workers::pool_t>();
+        if (!pool->make_snapshots(opts.database, opts.workers))
+            return EXIT_DATABASE;
+    }
+
+    if (open_database(opts.database.c_str(), true) != 0)
+    {
+        fprintf(stderr, "aida_cli: could not open %s.\n", opts.database.c_str());
+        return EXIT_DATABASE;
+    }
+    auto_wait();
+
+    FILE* out = stdout;
+    if (!opts.output.empty())
+    {
+        out = qfopen(opts.output.c_str(), "w");
+        if (out == nullptr)
+        {
+            fprintf(stderr, "aida_cli: cannot write %s.\n", opts.output.c_str());
+            close_database(false);
+            return EXIT_USAGE;
+        }
+    }
+
+    int rc = run(opts, *action, pool.get(), argv[0], out);
+    pool.reset();
+
+    if (out != stdout)
+        qfclose(out);
+    close_database(opts.save && action->edits);
+    return rc;
+}
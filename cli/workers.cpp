@@ -0,0 +1,299 @@
+#include "aida_pro.hpp"
+#include "workers.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#define popen _popen
+#define pclose _pclose
+#else
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace workers
+{
+    // Larger than any prompt the context builder produces; anything bigger is a broken stream.
+    static const uint32 MAX_PAYLOAD = 64 * 1024 * 1024;
+
+    // Files the kernel unpacks next to a packed database while it is open.
+    static const char* const UNPACKED_EXTS[] = { ".id0", ".id1", ".id2", ".nam", ".til" };
+
+    bool write_frame(FILE* fp, frame_type_t type, ea_t ea, const std::string& payload)
+    {
+        uchar header[13];
+        header[0] = (uchar)type;
+        for (int i = 0; i < 8; ++i)
+            header[1 + i] = (uchar)((uint64)ea >> (8 * i));
+        const uint32 len = (uint32)payload.size();
+        for (int i = 0; i < 4; ++i)
+            header[9 + i] = (uchar)(len >> (8 * i));
+        return fwrite(header, 1, sizeof(header), fp) == sizeof(header)
+            && fwrite(payload.data(), 1, payload.size(), fp) == payload.size();
+    }
+
+    bool read_frame(FILE* fp, frame_type_t* type, ea_t* ea, std::string* payload)
+    {
+        uchar header[13];
+        if (fread(header, 1, sizeof(header), fp) != sizeof(header))
+            return false;
+        uint64 value = 0;
+        for (int i = 7; i >= 0; --i)
+            value = (value << 8) | header[1 + i];
+        uint32 len = 0;
+        for (int i = 3; i >= 0; --i)
+            len = (len << 8) | header[9 + i];
+        if (len > MAX_PAYLOAD)
+            return false;
+
+        *type = (frame_type_t)header[0];
+        *ea = (ea_t)value;
+        payload->resize(len);
+        return len == 0 || fread(&(*payload)[0], 1, len, fp) == len;
+    }
+
+    FILE* open_frame_output(const char* arg)
+    {
+        char* end = nullptr;
+        const uint64 value = strtoull(arg, &end, 10);
+        if (end == arg || *end != '\0')
+            return nullptr;
+#ifdef _WIN32
+        const int fd = _open_osfhandle((intptr_t)value, _O_WRONLY | _O_BINARY);
+        return fd >= 0 ? _fdopen(fd, "wb") : nullptr;
+#else
+        return fdopen((int)value, "wb");
+#endif
+    }
+
+    // A pipe whose write end the next worker inherits. child_end is what the worker
+    // gets on its command line; only the read end is private to this process.
+    static bool make_frame_pipe(FILE** frames, uint64* child_end)
+    {
+#ifdef _WIN32
+        SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+        HANDLE read_end = nullptr;
+        HANDLE write_end = nullptr;
+        if (!CreatePipe(&read_end, &write_end, &sa, 0))
+            return false;
+        const int fd = SetHandleInformation(read_end, HANDLE_FLAG_INHERIT, 0)
+            ? _open_osfhandle((intptr_t)read_end, _O_RDONLY | _O_BINARY)
+            : -1;
+        if (fd < 0)
+        {
+            CloseHandle(read_end);
+            CloseHandle(write_end);
+            return false;
+        }
+        *frames = _fdopen(fd, "rb");
+        *child_end = (uint64)(uintptr_t)write_end;
+#else
+        int fds[2];
+        if (pipe(fds) != 0)
+            return false;
+        if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) != 0)
+        {
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+        *frames = fdopen(fds[0], "rb");
+        *child_end = (uint64)fds[1];
+#endif
+        return true;
+    }
+
+    // Once the worker has its copy, so that later workers do not inherit it and the
+    // reader sees end of file when this worker exits.
+    static void close_child_end(uint64 child_end)
+    {
+#ifdef _WIN32
+        CloseHandle((HANDLE)(uintptr_t)child_end);
+#else
+        close((int)child_end);
+#endif
+    }
+
+    static std::string quote_arg(const std::string& arg)
+    {
+#ifdef _WIN32
+        std::string out = "\"";
+        for (char c : arg)
+        {
+            if (c == '"')
+                out += '\\';
+            out += c;
+        }
+        return out + "\"";
+#else
+        std::string out = "'";
+        for (char c : arg)
+        {
+            if (c == '\'')
+                out += "'\\''";
+            else
+                out += c;
+        }
+        return out + "'";
+#endif
+    }
+
+    pool_t::~pool_t()
+    {
+        finish();
+    }
+
+    bool pool_t::make_snapshots(const std::string& database, size_t count)
+    {
+        char base[QMAXPATH];
+        if (qtmpnam(base, sizeof(base)) == nullptr)
+            return false;
+
+        _workers.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const char* ext = get_file_ext(database.c_str());
+            qstring path;
+            path.sprnt("%s_%d.%s", base, (int)i, ext != nullptr ? ext : "i64");
+            if (qcopyfile(database.c_str(), path.c_str()) != 0)
+            {
+                fprintf(stderr, "aida_cli: could not copy %s to %s.\n", database.c_str(), path.c_str());
+                _remove_files();
+                _workers.clear();
+                return false;
+            }
+            _workers[i].snapshot = path.c_str();
+            path.sprnt("%s_%d.funcs", base, (int)i);
+            _workers[i].shard_file = path.c_str();
+        }
+        return true;
+    }
+
+    bool pool_t::start(const std::string& exe, const std::vector<std::string>& args, const std::vector<ea_t>& funcs)
+    {
+        const size_t count = _workers.size();
+        std::vector<qstring> shards(count);
+        for (size_t i = 0; i < funcs.size(); ++i)
+            shards[i % count].cat_sprnt("0x%llx\n", (uint64)funcs[i]);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            worker_t& w = _workers[i];
+            FILE* fp = qfopen(w.shard_file.c_str(), "w");
+            if (fp == nullptr || qfwrite(fp, shards[i].c_str(), shards[i].length()) != shards[i].length())
+            {
+                if (fp != nullptr)
+                    qfclose(fp);
+                fprintf(stderr, "aida_cli: could not write %s.\n", w.shard_file.c_str());
+                return false;
+            }
+            qfclose(fp);
+
+            uint64 child_end = 0;
+            if (!make_frame_pipe(&w.frames, &child_end))
+            {
+                fprintf(stderr, "aida_cli: could not create a pipe for worker %d.\n", (int)i);
+                return false;
+            }
+
+            std::string command = quote_arg(exe) + " --emit-contexts " + std::to_string(child_end);
+            for (const auto& arg : args)
+                command += " " + quote_arg(arg);
+            command += " --funcs-file " + quote_arg(w.shard_file) + " " + quote_arg(w.snapshot) + " 1>&2";
+#ifdef _WIN32
+            // cmd.exe strips one pair of quotes around the whole line.
+            command = "\"" + command + "\"";
+#endif
+            w.process = popen(command.c_str(), "r");
+            close_child_end(child_end);
+            if (w.process == nullptr)
+            {
+                fclose(w.frames);
+                w.frames = nullptr;
+                fprintf(stderr, "aida_cli: could not start worker %d.\n", (int)i);
+                return false;
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _running++;
+            }
+            w.reader = std::thread(&pool_t::_read, this, &w);
+        }
+        return true;
+    }
+
+    void pool_t::_read(worker_t* w)
+    {
+        frame_type_t type;
+        ea_t ea;
+        std::string payload;
+        while (read_frame(w->frames, &type, &ea, &payload))
+        {
+            context_t ctx;
+            ctx.ea = ea;
+            ctx.ok = type == FRAME_CONTEXT;
+            ctx.text = std::move(payload);
+            std::lock_guard<std::mutex> lock(_mutex);
+            _ready.push_back(std::move(ctx));
+            _cv.notify_one();
+        }
+
+        fclose(w->frames);
+        int status = pclose(w->process);
+#ifndef _WIN32
+        status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+        std::lock_guard<std::mutex> lock(_mutex);
+        w->frames = nullptr;
+        w->process = nullptr;
+        w->exit_code = status;
+        _running--;
+        _cv.notify_one();
+    }
+
+    bool pool_t::next(std::vector<context_t>* out, size_t max)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this]() { return !_ready.empty() || _running == 0; });
+        if (_ready.empty())
+            return false;
+        while (!_ready.empty() && out->size() < max)
+        {
+            out->push_back(std::move(_ready.front()));
+            _ready.pop_front();
+        }
+        return true;
+    }
+
+    int pool_t::finish()
+    {
+        int failed = 0;
+        for (auto& w : _workers)
+        {
+            if (w.reader.joinable())
+                w.reader.join();
+            if (w.exit_code != 0)
+                failed++;
+        }
+        _remove_files();
+        _workers.clear();
+        return failed;
+    }
+
+    void pool_t::_remove_files()
+    {
+        for (const auto& w : _workers)
+        {
+            if (!w.shard_file.empty())
+                qunlink(w.shard_file.c_str());
+            if (w.snapshot.empty())
+                continue;
+            qunlink(w.snapshot.c_str());
+            const std::string stem = w.snapshot.substr(0, w.snapshot.rfind('.'));
+            for (const char* ext : UNPACKED_EXTS)
+                qunlink((stem + ext).c_str());
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pro.h>
+
+// Parallel context extraction for aida_cli. The kernel and the decompiler are single
+// threaded, so the coordinator gives each worker process its own copy of the database and
+// a shard of the functions. Workers send back one prompt per function over a pipe of
+// their own; their stdout is left to idalib, warning() and whatever plugins print.
+namespace workers
+{
+    enum frame_type_t : char
+    {
+        FRAME_CONTEXT = 'C',  // payload is the finished prompt
+        FRAME_ERROR = 'E',    // payload says why there is no prompt
+    };
+
+    // Frame layout: type (1 byte), ea (8 bytes LE), payload length (4 bytes LE), payload.
+    bool write_frame(FILE* fp, frame_type_t type, ea_t ea, const std::string& payload);
+    bool read_frame(FILE* fp, frame_type_t* type, ea_t* ea, std::string* payload);
+
+    // Worker side: opens the inherited pipe end named on the command line (a file
+    // descriptor, or a HANDLE value on Windows) for write_frame.
+    FILE* open_frame_output(const char* arg);
+
+    struct context_t
+    {
+        ea_t ea = BADADDR;
+        bool ok = false;
+        std::string text;     // prompt, or the error when !ok
+    };
+
+    class pool_t
+    {
+    public:
+        ~pool_t();
+
+        // Copies a packed database (.i64/.idb) once per worker. Must run before the
+        // coordinator opens the database itself.
+        bool make_snapshots(const std::string& database, size_t count);
+        // Starts one `exe --emit-contexts <pipe> <args>` per snapshot, sharding funcs round
+        // robin. The workers' stdout goes to our stderr.
+        bool start(const std::string& exe, const std::vector<std::string>& args, const std::vector<ea_t>& funcs);
+        // Waits for contexts and moves up to max of them into out. False once every
+        // worker has exited and nothing is left.
+        bool next(std::vector<context_t>* out, size_t max);
+        // Number of workers that exited with an error; the snapshots are deleted.
+        int finish();
+
+    private:
+        struct worker_t
+        {
+            FILE* process = nullptr;  // popen handle, only used to wait for the exit code
+            FILE* frames = nullptr;
+            std::thread reader;
+            std::string snapshot;
+            std::string shard_file;
+            int exit_code = 0;
+        };
+
+        std::vector<worker_t> _workers;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::deque<context_t> _ready;
+        size_t _running = 0;
+
+        void _read(worker_t* w);
+        void _remove_files();
+    };
+}
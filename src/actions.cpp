@@ -9,7 +9,10 @@ int idaapi action_handler::activate(action_activation_ctx_t* ctx)
 
 action_state_t idaapi action_handler::update(action_update_ctx_t* ctx)
 {
-    if (action_func == handle_show_settings || action_func == handle_scan_for_offsets)
+    if (action_func == handle_show_settings || action_func == handle_scan_for_offsets || action_func == handle_scan_rtti
+        || action_func == handle_unreal_reflection || action_func == handle_show_review_queue
+        || action_func == handle_global_query || action_func == handle_export_contexts
+        || action_func == handle_import_results)
         return AST_ENABLE_ALWAYS;
 
     return AST_ENABLE_ALWAYS;
@@ -41,7 +44,7 @@ void handle_rename_function(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
     const ea_t func_ea = pfn->start_ea;
 
     qstring current_name;
-    if (get_func_name(&current_name, func_ea) > 0 && is_uname(current_name.c_str()))
+    if (!g_settings.review_changes && get_func_name(&current_name, func_ea) > 0 && is_uname(current_name.c_str()))
     {
         qstring question;
         question.sprnt("HIDECANCEL\nThis function already has a user-defined name ('%s').\nDo you want to ask the AI for a new one anyway?", current_name.c_str());
@@ -61,21 +64,23 @@ void handle_rename_function(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
                     return;
                 }
 
-                qstring clean_name = suggested_name.c_str();
-                clean_name.replace("`", "");
-                clean_name.replace("'", "");
-                clean_name.replace("\"", "");
-                clean_name.trim2();
-
-                if (clean_name.length() >= MAXNAMELEN - 10)
+                qstring clean_name;
+                if (!ida_utils::clean_function_name(suggested_name, &clean_name))
                 {
-                    clean_name.resize(MAXNAMELEN - 10);
-                    msg("AiDA: Truncated long suggested name.\n");
+                    warning("AiDA: The suggested name '%s' is not a valid identifier, even after sanitization.", suggested_name.c_str());
+                    return;
                 }
 
-                if (!validate_name(&clean_name, VNT_IDENT, SN_NOCHECK))
+                if (g_settings.review_changes)
                 {
-                    warning("AiDA: The suggested name '%s' is not a valid identifier, even after sanitization.", clean_name.c_str());
+                    review_item_t item;
+                    item.kind = REVIEW_FUNC_NAME;
+                    item.func_ea = pfn_cb->start_ea;
+                    item.ea = pfn_cb->start_ea;
+                    get_func_name(&item.old_value, pfn_cb->start_ea);
+                    item.new_value = clean_name;
+                    item.confidence = estimate_rename_confidence(item.old_value, item.new_value, item.reason);
+                    review_queue_t::instance().add(std::move(item));
                     return;
                 }
 
@@ -104,119 +109,57 @@ void handle_auto_comment(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
         return;
     const ea_t func_ea = pfn->start_ea;
 
-    auto on_complete = [func_ea](const std::string& json_comments) {
+    // Outside review mode comments are applied as each one finishes streaming.
+    std::shared_ptr<ida_utils::stream_applier_t> applier;
+    AIClient::stream_callback_t on_delta;
+    if (!g_settings.review_changes)
+    {
+        applier = std::make_shared<ida_utils::stream_applier_t>(ida_utils::STREAM_COMMENTS, func_ea);
+        on_delta = [applier](const std::string& delta) { applier->feed(delta); };
+    }
+
+    auto on_complete = [func_ea, applier](const std::string& json_comments) {
         action_helpers::handle_ai_response(json_comments, "AI Comments",
-            [func_ea](const std::string& content) {
-                std::string json_str = content;
-                static const std::regex md_json_re("```(?:json)?\\s*([\\s\\S]*?)\\s*```");
-                std::smatch match;
-                if (std::regex_search(content, match, md_json_re) && match.size() > 1)
+            [func_ea, applier](const std::string& content) {
+                if (applier != nullptr)
                 {
-                    json_str = match[1].str();
+                    applier->finish();
+                    if (applier->applied() > 0)
+                        msg("AiDA: Added %d comments to function at 0x%a.\n", applier->applied(), func_ea);
+                    else
+                        msg("AiDA: AI did not provide any valid comments.\n");
+                    return;
                 }
 
                 try
                 {
-                    cfuncptr_t cfunc(nullptr);
-                    if (init_hexrays_plugin())
-                    {
-                        func_t* pfn_for_decomp = get_func(func_ea);
-                        if (pfn_for_decomp != nullptr)
-                        {
-                            try { cfunc = decompile(pfn_for_decomp); }
-                            catch (const vd_failure_t&) 
-                            {
-                                msg("AiDA: Decompilation failed for 0x%a, comments will only be added to disassembly.\n", func_ea);
-                            }
-                        }
-                    }
-
-                    auto comments = nlohmann::json::parse(json_str);
-                    if (!comments.is_array())
-                    {
-                        warning("AiDA: AI response for comments is not a JSON array.");
-                        return;
-                    }
-
-                    int count = 0;
-                    for (const auto& item : comments)
-                    {
-                        if (!item.is_object() || !item.contains("address") || !item.contains("comment"))
-                            continue;
-
-                        std::string addr_str = item["address"];
-                        std::string comment_str = item["comment"];
-
-                        ea_t ea;
-                        if (sscanf(addr_str.c_str(), "0x%llX", &ea) != 1 && sscanf(addr_str.c_str(), "%llX", &ea) != 1)
-                            continue;
-
-                        if (!is_mapped(ea))
-                            continue;
-
-                        qstring q_comment = comment_str.c_str();
-                        q_comment.trim2();
-                        if (q_comment.empty())
-                            continue;
-
-                        qstring existing_comment;
-                        get_cmt(&existing_comment, ea, false);
-
-                        qstring new_comment;
-                        if (existing_comment.empty())
-                        {
-                            new_comment = q_comment;
-                        }
-                        else
-                        {
-                            new_comment.sprnt("%s\n%s", q_comment.c_str(), existing_comment.c_str());
-                        }
-                        
-                        set_cmt(ea, new_comment.c_str(), false);
-                        count++;
-
-                        if (cfunc != nullptr)
-                        {
-                            treeloc_t loc;
-                            loc.ea = ea;
-                            loc.itp = ITP_BLOCK1;
-
-                            const char* existing_pcomment = cfunc->get_user_cmt(loc, RETRIEVE_ALWAYS);
-                            qstring new_pcomment;
-                            if (existing_pcomment == nullptr || *existing_pcomment == '\0')
-                            {
-                                new_pcomment = q_comment;
-                            }
-                            else
-                            {
-                                new_pcomment.sprnt("%s\n%s", q_comment.c_str(), existing_pcomment);
-                            }
-                            cfunc->set_user_cmt(loc, new_pcomment.c_str());
-                        }
-                    }
-
-                    if (count > 0)
+                    std::vector<ida_utils::comment_suggestion_t> comments = ida_utils::parse_comment_suggestions(content);
+                    std::vector<review_item_t> items;
+                    items.reserve(comments.size());
+                    for (const auto& c : comments)
                     {
-                        msg("AiDA: Added %d comments to function at 0x%a.\n", count, func_ea);
-                        if (cfunc != nullptr)
-                        {
-                            cfunc->save_user_cmts();
-                            cfunc->refresh_func_ctext(); 
-                        }
-                        request_refresh(IWID_DISASM);
-                    }
-                    else
-                    {
-                        msg("AiDA: AI did not provide any valid comments.\n");
+                        review_item_t item;
+                        item.kind = REVIEW_COMMENT;
+                        item.func_ea = func_ea;
+                        item.ea = c.ea;
+                        get_cmt(&item.old_value, c.ea, false);
+                        item.new_value = c.text;
+                        item.confidence = item.old_value.empty() ? 0.7 : 0.5;
+                        items.push_back(std::move(item));
                     }
+                    review_queue_t::instance().add(std::move(items));
                 }
                 catch (const nlohmann::json::parse_error& e)
                 {
                     warning("AiDA: Failed to parse AI response as JSON: %s", e.what());
                 }
+                catch (const std::runtime_error& e)
+                {
+                    warning("AiDA: %s", e.what());
+                }
             });
     };
-    plugin->ai_client->generate_comments(func_ea, on_complete);
+    plugin->ai_client->generate_comments(func_ea, on_complete, on_delta);
 }
 
 void handle_generate_struct(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
@@ -229,12 +172,118 @@ void handle_generate_struct(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
     auto on_complete = [func_ea](const std::string& struct_cpp) {
         action_helpers::handle_ai_response(struct_cpp, "Generated Struct",
             [func_ea](const std::string& content) {
+                if (g_settings.review_changes)
+                {
+                    review_item_t item;
+                    item.kind = REVIEW_STRUCT;
+                    item.func_ea = func_ea;
+                    item.ea = func_ea;
+                    std::smatch m;
+                    static const std::regex name_re(R"(struct\s+([A-Za-z_]\w*))");
+                    if (std::regex_search(content, m, name_re))
+                        item.new_value = m[1].str().c_str();
+                    item.old_value = get_named_type(get_idati(), item.new_value.c_str(), NTF_TYPE) != nullptr ? "(replaces existing)" : "(new)";
+                    item.reason = "Double-click to jump to the function; the full definition is applied as generated.";
+                    item.payload = content;
+                    review_queue_t::instance().add(std::move(item));
+                    return;
+                }
                 ida_utils::apply_struct_from_cpp(content, func_ea);
             });
     };
     plugin->ai_client->generate_struct(func_ea, on_complete);
 }
 
+void handle_reconstruct_class(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
+{
+    rtti::class_info_t cls;
+    rtti::vtable_t vt;
+    if (!rtti::find_vtable(ctx->cur_ea, &cls, &vt))
+    {
+        warning("AiDA: Place the cursor on a vtable or inside one of its virtual methods.");
+        return;
+    }
+
+    qstring class_info;
+    if (!cls.name.empty())
+    {
+        class_info.sprnt("Class `%s` (from MSVC RTTI)", cls.name.c_str());
+        if (!cls.bases.empty())
+        {
+            class_info.append(", derived from ");
+            for (size_t i = 0; i < cls.bases.size(); ++i)
+                class_info.cat_sprnt("%s`%s`", i == 0 ? "" : ", ", cls.bases[i].name.c_str());
+        }
+        if (vt.offset != 0)
+            class_info.cat_sprnt("; this vtable serves the subobject at +0x%X", vt.offset);
+        class_info.append(".");
+    }
+
+    const ea_t vtable_ea = vt.ea;
+    const std::vector<ea_t> methods = vt.methods;
+    msg("AiDA: Reconstructing %s from the vtable at 0x%a (%d slot(s)) in one request.\n",
+        cls.name.empty() ? "an unnamed class" : cls.name.c_str(), vtable_ea, (int)methods.size());
+
+    auto on_complete = [vtable_ea, methods](const std::string& response) {
+        action_helpers::handle_ai_response(response, "Reconstructed Class",
+            [vtable_ea, methods](const std::string& content) {
+                ida_utils::class_suggestion_t suggestion;
+                if (!ida_utils::parse_class_suggestion(content, &suggestion))
+                {
+                    warning("AiDA: The class reconstruction response contained neither a struct nor method list.");
+                    msg("--- Response ---\n%s\n----------------\n", content.c_str());
+                    return;
+                }
+
+                if (g_settings.review_changes)
+                {
+                    std::vector<review_item_t> items;
+                    if (!suggestion.struct_code.empty())
+                    {
+                        review_item_t item;
+                        item.kind = REVIEW_STRUCT;
+                        item.func_ea = methods.front();
+                        item.ea = vtable_ea;
+                        std::smatch m;
+                        static const std::regex name_re(R"(struct\s+([A-Za-z_]\w*))");
+                        if (std::regex_search(suggestion.struct_code, m, name_re))
+                            item.new_value = m[1].str().c_str();
+                        item.old_value = get_named_type(get_idati(), item.new_value.c_str(), NTF_TYPE) != nullptr ? "(replaces existing)" : "(new)";
+                        item.reason = "Class layout from every virtual method of the vtable.";
+                        item.payload = "```cpp\n" + suggestion.struct_code + "\n```";
+                        items.push_back(std::move(item));
+                    }
+                    for (const auto& method : suggestion.methods)
+                    {
+                        if (method.slot < 0 || (size_t)method.slot >= methods.size() || method.name.empty())
+                            continue;
+                        review_item_t item;
+                        item.kind = REVIEW_FUNC_NAME;
+                        item.func_ea = methods[method.slot];
+                        item.ea = methods[method.slot];
+                        get_func_name(&item.old_value, item.ea);
+                        item.new_value = method.name;
+                        item.reason.sprnt("vtable slot %d: %s", method.slot, method.prototype.c_str());
+                        item.confidence = estimate_rename_confidence(item.old_value, item.new_value, method.prototype);
+                        items.push_back(std::move(item));
+                    }
+                    // Prototypes are not part of the review queue; they are applied only in direct mode.
+                    review_queue_t::instance().add(std::move(items));
+                    return;
+                }
+
+                qstring summary = ida_utils::apply_class_suggestion(suggestion, methods);
+                qstring title;
+                title.sprnt("Class reconstruction for 0x%a", vtable_ea);
+                show_text_in_viewer(title.c_str(), (suggestion.struct_code + "\n\n" + summary.c_str()).c_str());
+            });
+    };
+
+    show_wait_box("HIDECANCEL\nAiDA: Collecting %d virtual method(s)...", (int)methods.size());
+    plugin->ai_client->reconstruct_class(vtable_ea, methods, class_info.c_str(), on_complete);
+    hide_wait_box();
+}
+
 void handle_generate_hook(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
 {
     func_t* pfn = ida_utils::get_function_for_item(ctx->cur_ea);
@@ -255,6 +304,114 @@ void handle_generate_hook(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
     plugin->ai_client->generate_hook(func_ea, on_complete);
 }
 
+void handle_generate_signature(action_activation_ctx_t* ctx, aida_plugin_t* /*plugin*/)
+{
+    func_t* pfn = get_func(ctx->cur_ea);
+    const ea_t target = pfn != nullptr ? pfn->start_ea : get_item_head(ctx->cur_ea);
+
+    show_wait_box("HIDECANCEL\nAiDA: Generating signature...");
+    scanner::image_t image;
+    scanner::signature_t sig;
+    bool ok = image.load() && scanner::make_unique_signature(&sig, image, target);
+    hide_wait_box();
+
+    if (!ok)
+    {
+        warning("AiDA: Could not build a unique signature for 0x%a.", target);
+        return;
+    }
+
+    std::string pattern = sig.pattern.to_string();
+    if (sig.kind == scanner::SIG_DIRECT)
+        msg("AiDA: Signature for 0x%a: %s\n", target, pattern.c_str());
+    else
+        msg("AiDA: Signature for 0x%a via reference at 0x%a (rel32 at +%d, instruction size %d): %s\n",
+            target, sig.match_ea, sig.operand_offset, sig.insn_size, pattern.c_str());
+
+    if (ida_utils::set_clipboard_text(pattern.c_str()))
+        msg("AiDA: Signature copied to clipboard.\n");
+}
+
+void handle_generate_signatures_batch(action_activation_ctx_t* /*ctx*/, aida_plugin_t* /*plugin*/)
+{
+    static const char form[] =
+        "Generate Signatures\n\n"
+        "<#Pattern constants only#~C~++ header:R>\n"
+        "<#Pattern constants plus MinHook typedefs and hook helper#~M~inHook scaffolding:R>>\n"
+        "<#Skip functions that still have auto-generated names#~N~amed functions only:C>>\n";
+
+    ushort format = 0;
+    ushort options = 1;
+    if (ask_form(form, &format, &options) <= 0)
+        return;
+    const bool named_only = (options & 1) != 0;
+
+    const char* path = ask_file(true, "*.h", "Save signatures as");
+    if (path == nullptr)
+        return;
+    qstring out_path = path;
+
+    show_wait_box("AiDA: Loading executable segments...");
+    scanner::image_t image;
+    if (!image.load())
+    {
+        hide_wait_box();
+        warning("AiDA: No executable segments to scan.");
+        return;
+    }
+
+    std::vector<scanner::signature_t> signatures;
+    const size_t total = get_func_qty();
+    size_t attempted = 0;
+    size_t failed = 0;
+    bool cancelled = false;
+    for (size_t i = 0; i < total; ++i)
+    {
+        func_t* pfn = getn_func(i);
+        if (pfn == nullptr || (pfn->flags & (FUNC_LIB | FUNC_THUNK)) != 0)
+            continue;
+        if (named_only && !has_user_name(get_flags(pfn->start_ea)))
+            continue;
+
+        if ((attempted & 63) == 0)
+        {
+            if (user_cancelled())
+            {
+                cancelled = true;
+                break;
+            }
+            replace_wait_box("AiDA: Signing functions... %llu / %llu", (uint64)i, (uint64)total);
+        }
+
+        attempted++;
+        scanner::signature_t sig;
+        if (scanner::make_unique_signature(&sig, image, pfn->start_ea))
+            signatures.push_back(std::move(sig));
+        else
+            failed++;
+    }
+    hide_wait_box();
+
+    std::string text = scanner::format_signatures(signatures,
+        format == 0 ? scanner::SIG_FORMAT_CPP_HEADER : scanner::SIG_FORMAT_MINHOOK);
+
+    FILE* fp = qfopen(out_path.c_str(), "wb");
+    if (fp == nullptr)
+    {
+        warning("AiDA: Failed to open %s for writing.", out_path.c_str());
+        return;
+    }
+    file_janitor_t fj(fp);
+    if (qfwrite(fp, text.c_str(), text.length()) != text.length())
+    {
+        warning("AiDA: Failed to write signatures to %s", out_path.c_str());
+        return;
+    }
+
+    msg("AiDA: Wrote %d signature(s) to %s (%d function(s) had no unique signature)%s.\n",
+        (int)signatures.size(), out_path.c_str(), (int)failed, cancelled ? ", cancelled early" : "");
+}
+
 void handle_custom_query(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
 {
     func_t* pfn = ida_utils::get_function_for_item(ctx->cur_ea);
@@ -277,6 +434,168 @@ void handle_custom_query(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
     }
 }
 
+// One whole-binary query while its map and reduce steps are in flight.
+struct global_query_job_t
+{
+    aida_plugin_t* plugin = nullptr;
+    std::string question;
+    std::set<std::string> keywords;
+    std::vector<global_query::shard_t> shards;
+    size_t func_count = 0;
+    size_t cached_shards = 0;
+    size_t failed_shards = 0;
+    std::vector<global_query::candidate_t> candidates;
+    AIClient::usage_t usage_before;
+};
+
+static void report_global_query(std::shared_ptr<global_query_job_t> job, const std::string& content)
+{
+    AIClient::usage_t before = job->usage_before;
+    AIClient::usage_t now = job->plugin->ai_client->usage();
+    if (now.requests < before.requests) // the client was re-created meanwhile
+        before = AIClient::usage_t();
+
+    qstring footer;
+    footer.sprnt("\n\n---\nSearched %d function(s) in %d shard(s): %d answered from the cache, %d failed.\n",
+        (int)job->func_count, (int)job->shards.size(), (int)job->cached_shards, (int)job->failed_shards);
+    footer.cat_sprnt("Cost: %d request(s), about %d prompt and %d response tokens (estimated at 4 characters per token).\n",
+        (int)(now.requests - before.requests),
+        (int)((now.prompt_chars - before.prompt_chars) / 4),
+        (int)((now.response_chars - before.response_chars) / 4));
+    footer.append("Shortlist:\n");
+    for (const auto& cand : job->candidates)
+    {
+        qstring name;
+        get_func_name(&name, cand.ea);
+        footer.cat_sprnt("  0x%a %s (%d/10) %s\n", cand.ea, name.c_str(), cand.score, cand.reason.c_str());
+    }
+
+    qstring title;
+    title.sprnt("AI Binary Query: %s", job->question.c_str());
+    show_text_in_viewer(title.c_str(), content + footer.c_str());
+}
+
+static void run_global_reduce(std::shared_ptr<global_query_job_t> job)
+{
+    auto& candidates = job->candidates;
+    std::stable_sort(candidates.begin(), candidates.end(),
+        [](const auto& a, const auto& b) { return a.score > b.score; });
+    const size_t shortlist = (size_t)std::max(g_settings.query_shortlist_size, 1);
+    if (candidates.size() > shortlist)
+        candidates.resize(shortlist);
+
+    if (candidates.empty())
+    {
+        msg("AiDA: None of %d function(s) looked relevant to \"%s\"%s.\n", (int)job->func_count, job->question.c_str(),
+            job->failed_shards != 0 ? " (some map requests failed)" : "");
+        return;
+    }
+
+    // The shortlist shares the prompt budget like the methods of a reconstructed class do.
+    static const size_t MIN_FUNC_CHARS = 1500;
+    const size_t budget = (size_t)std::max(g_settings.max_prompt_tokens, 1) * 3 / 4;
+    const size_t per_func = std::max(MIN_FUNC_CHARS, budget / candidates.size());
+
+    show_wait_box("HIDECANCEL\nAiDA: Decompiling %d shortlisted function(s)...", (int)candidates.size());
+    std::string context;
+    for (const auto& cand : candidates)
+    {
+        qstring name;
+        get_func_name(&name, cand.ea);
+        auto code = ida_utils::get_function_code(cand.ea, per_func);
+        qstring header;
+        header.sprnt("// 0x%llx %s\n// First pass: %d/10, %s\n", (uint64)cand.ea, name.c_str(), cand.score,
+            cand.reason.empty() ? "no reason given" : cand.reason.c_str());
+        context.append(header.c_str()).append(code.first).append("\n\n");
+    }
+    hide_wait_box();
+
+    msg("AiDA: Asking about the %d best candidate(s) for \"%s\"...\n", (int)candidates.size(), job->question.c_str());
+    job->plugin->ai_client->query_reduce(job->question, context, job->func_count,
+        [job](const std::string& answer) {
+            action_helpers::handle_ai_response(answer, "AI Binary Query",
+                [job](const std::string& content) { report_global_query(job, content); });
+        });
+}
+
+void handle_global_query(action_activation_ctx_t* /*ctx*/, aida_plugin_t* plugin)
+{
+    qstring question;
+    if (!ask_str(&question, HIST_SRCH, "Ask AI about the whole binary:") || question.empty())
+        return;
+
+    auto job = std::make_shared<global_query_job_t>();
+    job->plugin = plugin;
+    job->question = question.c_str();
+    job->keywords = global_query::question_keywords(job->question);
+
+    const size_t shard_chars = std::min((size_t)std::max(g_settings.query_shard_tokens, 256) * 4,
+                                        (size_t)std::max(g_settings.max_prompt_tokens, 1));
+    if (!global_query::build_shards(&job->shards, &job->func_count, shard_chars))
+    {
+        msg("AiDA: Binary query cancelled.\n");
+        return;
+    }
+    if (job->shards.empty())
+    {
+        warning("AiDA: There are no functions to query.");
+        return;
+    }
+
+    // A question made only of stop words would match any other such question.
+    auto& cache = global_query::map_cache_t::instance();
+    const bool use_cache = !job->keywords.empty();
+    if (use_cache)
+        cache.load();
+
+    std::vector<size_t> pending;
+    std::vector<std::string> texts;
+    for (size_t i = 0; i < job->shards.size(); ++i)
+    {
+        std::vector<global_query::candidate_t> cached;
+        if (use_cache && cache.lookup(job->keywords, job->shards[i].hash, &cached))
+        {
+            job->cached_shards++;
+            job->candidates.insert(job->candidates.end(), cached.begin(), cached.end());
+            continue;
+        }
+        pending.push_back(i);
+        texts.push_back(job->shards[i].text);
+    }
+
+    job->usage_before = plugin->ai_client->usage();
+    msg("AiDA: Querying %d function(s) in %d shard(s), %d from the cache.\n",
+        (int)job->func_count, (int)job->shards.size(), (int)job->cached_shards);
+    if (pending.empty())
+    {
+        run_global_reduce(job);
+        return;
+    }
+
+    plugin->ai_client->query_map(job->question, texts, job->func_count,
+        [job, pending, use_cache](const std::vector<std::string>& answers) {
+            auto& cache = global_query::map_cache_t::instance();
+            for (size_t i = 0; i < pending.size() && i < answers.size(); ++i)
+            {
+                const auto& shard = job->shards[pending[i]];
+                if (answers[i].empty() || answers[i].rfind("Error:", 0) == 0)
+                {
+                    job->failed_shards++;
+                    continue;
+                }
+                std::vector<global_query::candidate_t> found = global_query::parse_map_answer(answers[i], shard);
+                if (use_cache)
+                    cache.store(job->keywords, shard.hash, found);
+                job->candidates.insert(job->candidates.end(), found.begin(), found.end());
+            }
+            if (use_cache)
+                cache.save();
+            if (job->failed_shards != 0)
+                msg("AiDA: %d of %d map request(s) failed; their functions were skipped.\n", (int)job->failed_shards, (int)pending.size());
+            run_global_reduce(job);
+        });
+}
+
 void handle_copy_context(action_activation_ctx_t* ctx, aida_plugin_t* /*plugin*/)
 {
     func_t* pfn = ida_utils::get_function_for_item(ctx->cur_ea);
@@ -306,6 +625,88 @@ void handle_copy_context(action_activation_ctx_t* ctx, aida_plugin_t* /*plugin*/
     }
 }
 
+void handle_export_contexts(action_activation_ctx_t* /*ctx*/, aida_plugin_t* /*plugin*/)
+{
+    static const char form[] =
+        "Export Contexts\n\n"
+        "<#One JSON object per line#~J~SON Lines:R>\n"
+        "<#Length-prefixed records keyed by address and MD5#~B~inary:R>>\n"
+        "<#Skip functions that already have user-defined names#~U~nnamed functions only:C>\n"
+        "<#Add struct member usage (slower)#Include ~s~truct context:C>>\n";
+
+    ushort format = 0;
+    ushort options = 0;
+    if (ask_form(form, &format, &options) <= 0)
+        return;
+    const bool unnamed_only = (options & 1) != 0;
+    const bool struct_context = (options & 2) != 0;
+
+    const char* path = ask_file(true, format == 0 ? "*.jsonl" : "*.bin", "Export contexts to");
+    if (path == nullptr)
+        return;
+    qstring out_path = path;
+
+    std::vector<ea_t> funcs;
+    const size_t total = get_func_qty();
+    for (size_t i = 0; i < total; ++i)
+    {
+        func_t* pfn = getn_func(i);
+        if (pfn == nullptr || (pfn->flags & (FUNC_LIB | FUNC_THUNK)) != 0)
+            continue;
+        if (unnamed_only && has_user_name(get_flags(pfn->start_ea)))
+            continue;
+        funcs.push_back(pfn->start_ea);
+    }
+
+    show_wait_box("AiDA: Exporting contexts...");
+    exchange::export_stats_t stats;
+    bool cancelled = false;
+    bool ok = exchange::export_contexts(out_path.c_str(), funcs,
+        format == 0 ? exchange::FORMAT_JSONL : exchange::FORMAT_BINARY, struct_context, &stats,
+        [&](size_t done) {
+            if ((done & 15) != 0)
+                return true;
+            if (user_cancelled())
+            {
+                cancelled = true;
+                return false;
+            }
+            replace_wait_box("AiDA: Exporting contexts... %llu / %llu", (uint64)done, (uint64)funcs.size());
+            return true;
+        });
+    hide_wait_box();
+
+    if (ok)
+        msg("AiDA: Exported %d context(s) to %s (%d function(s) had no context)%s.\n",
+            (int)stats.written, out_path.c_str(), (int)stats.skipped, cancelled ? ", cancelled early" : "");
+}
+
+void handle_import_results(action_activation_ctx_t* /*ctx*/, aida_plugin_t* /*plugin*/)
+{
+    const char* path = ask_file(false, "*.jsonl;*.bin", "Import results from");
+    if (path == nullptr)
+        return;
+    qstring in_path = path;
+
+    show_wait_box("AiDA: Importing results...");
+    exchange::import_stats_t stats;
+    bool ok = exchange::import_results(in_path.c_str(), &stats,
+        [](size_t done) {
+            if (user_cancelled())
+                return false;
+            replace_wait_box("AiDA: Importing results... %llu record(s)", (uint64)done);
+            return true;
+        });
+    hide_wait_box();
+
+    if (!ok)
+        return;
+    msg("AiDA: Imported %d record(s) from %s: %d name(s), %d comment(s), %d variable rename(s), %d struct(s). "
+        "Skipped %d changed function(s), %d unknown address(es), %d bad record(s).\n",
+        (int)stats.records, in_path.c_str(), stats.names, stats.comments, stats.renames, stats.structs,
+        (int)stats.stale, (int)stats.missing, (int)stats.bad);
+}
+
 void handle_rename_all(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
 {
     func_t* pfn = ida_utils::get_function_for_item(ctx->cur_ea);
@@ -313,10 +714,42 @@ void handle_rename_all(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
         return;
     const ea_t func_ea = pfn->start_ea;
 
-    auto on_complete = [func_ea](const std::string& rename_suggestions) {
+    std::shared_ptr<ida_utils::stream_applier_t> applier;
+    AIClient::stream_callback_t on_delta;
+    if (!g_settings.review_changes)
+    {
+        applier = std::make_shared<ida_utils::stream_applier_t>(ida_utils::STREAM_RENAMES, func_ea);
+        on_delta = [applier](const std::string& delta) { applier->feed(delta); };
+    }
+
+    auto on_complete = [func_ea, applier](const std::string& rename_suggestions) {
         action_helpers::handle_ai_response(rename_suggestions, "Rename Suggestions",
-            [func_ea](const std::string& content) {
-                qstring summary = ida_utils::apply_renames_from_ai(func_ea, content);
+            [func_ea, applier](const std::string& content) {
+                if (applier == nullptr)
+                {
+                    std::vector<ida_utils::rename_suggestion_t> renames = ida_utils::parse_rename_suggestions(content);
+                    std::vector<review_item_t> items;
+                    items.reserve(renames.size());
+                    for (const auto& r : renames)
+                    {
+                        review_item_t item;
+                        item.kind = REVIEW_RENAME;
+                        item.func_ea = func_ea;
+                        item.ea = func_ea;
+                        item.old_value = r.original_name;
+                        item.new_value = r.new_name;
+                        item.reason = r.reason;
+                        item.confidence = estimate_rename_confidence(r.original_name, r.new_name, r.reason);
+                        items.push_back(std::move(item));
+                    }
+                    if (items.empty())
+                        msg("AiDA: No valid renames suggested by AI.\n");
+                    review_queue_t::instance().add(std::move(items));
+                    return;
+                }
+
+                applier->finish();
+                const qstring& summary = applier->summary();
                 if (summary.empty())
                 {
                     msg("AiDA: No valid renames suggested by AI or nothing to rename.\n");
@@ -326,23 +759,288 @@ void handle_rename_all(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
                 qstring title;
                 title.sprnt("Renaming summary for 0x%a", func_ea);
                 show_text_in_viewer(title.c_str(), summary.c_str());
-
-                if (init_hexrays_plugin())
-                {
-                    mark_cfunc_dirty(func_ea, true);
-                }
-                request_refresh(IWID_DISASM | IWID_PSEUDOCODE);
             });
     };
-    plugin->ai_client->rename_all(func_ea, on_complete);
+    plugin->ai_client->rename_all(func_ea, on_complete, on_delta);
+}
+
+// Targets the signatures could not resolve, each with the functions the AI should look at.
+struct locate_job_t
+{
+    aida_plugin_t* plugin;
+    std::vector<std::pair<std::string, std::vector<ea_t>>> targets;
+    size_t next = 0;
+};
+
+static void run_next_locate(std::shared_ptr<locate_job_t> job);
+
+static int idaapi locate_delay_cb(void* ud)
+{
+    auto* job = static_cast<std::shared_ptr<locate_job_t>*>(ud);
+    run_next_locate(*job);
+    delete job;
+    return -1;
 }
 
-void handle_scan_for_offsets(action_activation_ctx_t* /*ctx*/, aida_plugin_t* /*plugin*/)
+// Each candidate function's answer is one vote, and an answer of "none" counts against
+// every address. An address is named only when more than half of all the candidates
+// agree on it, so a single confused answer cannot name the wrong global.
+static void report_locate_votes(const std::string& target, const std::vector<ea_t>& funcs, const std::vector<ea_t>& found)
+{
+    std::map<ea_t, int> votes;
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+        if (found[i] == BADADDR || !is_mapped(found[i]))
+            continue;
+        votes[found[i]]++;
+        msg("AiDA: %s: function 0x%a points at 0x%a.\n", target.c_str(), funcs[i], found[i]);
+    }
+
+    if (votes.empty())
+    {
+        msg("AiDA: AI could not locate %s in %d candidate function(s).\n", target.c_str(), (int)funcs.size());
+        return;
+    }
+
+    auto best = votes.begin();
+    for (auto it = std::next(votes.begin()); it != votes.end(); ++it)
+    {
+        if (it->second > best->second)
+            best = it;
+    }
+
+    if (best->second * 2 <= (int)funcs.size())
+    {
+        msg("AiDA: No majority for %s: best guess 0x%a has %d of %d answer(s) (%d address(es) named); leaving it unnamed.\n",
+            target.c_str(), best->first, best->second, (int)funcs.size(), (int)votes.size());
+        return;
+    }
+
+    msg("AiDA: AI located %s at 0x%a (%d of %d answer(s) agree).\n", target.c_str(), best->first, best->second, (int)funcs.size());
+    if (!has_user_name(get_flags(best->first)))
+        set_name(best->first, target.c_str(), SN_NOWARN | SN_NOCHECK);
+}
+
+static void run_next_locate(std::shared_ptr<locate_job_t> job)
+{
+    while (job->next < job->targets.size())
+    {
+        const auto& [target, funcs] = job->targets[job->next++];
+        if (funcs.empty() || !job->plugin->ai_client)
+        {
+            msg("AiDA: %s: no candidate functions to analyze.\n", target.c_str());
+            continue;
+        }
+
+        msg("AiDA: Asking the AI about %s in %d candidate function(s)...\n", target.c_str(), (int)funcs.size());
+        job->plugin->ai_client->locate_global_pointer_batch(funcs, target,
+            [job, target = target, funcs = funcs](const std::vector<ea_t>& found) {
+                report_locate_votes(target, funcs, found);
+
+                int delay_ms = (int)(g_settings.bulk_processing_delay * 1000);
+                register_timer(std::max(delay_ms, 1), locate_delay_cb, new std::shared_ptr<locate_job_t>(job));
+            });
+        return;
+    }
+}
+
+void handle_scan_for_offsets(action_activation_ctx_t* /*ctx*/, aida_plugin_t* plugin)
 {
     msg("====================================================\n");
     msg("--- Starting Unreal Engine Pointer Scan ---\n");
-    warning("Scan for Engine Pointers is not yet implemented in the C++ version.");
-    // unreal::scan_for_unreal_patterns(plugin->ai_client, g_settings); COMING SOON!!!
+
+    show_wait_box("HIDECANCEL\nAiDA: Scanning executable segments...");
+    scanner::image_t image;
+    std::vector<scanner::scan_hit_t> hits;
+    if (image.load())
+        hits = scanner::scan_unreal_globals(image);
+    hide_wait_box();
+
+    if (image.empty())
+    {
+        warning("AiDA: No executable segments to scan.");
+        return;
+    }
+
+    std::map<qstring, std::map<ea_t, int>> votes;
+    std::map<qstring, ea_t> unresolved;
+    qstring report;
+    report.sprnt("Scanned %llu bytes of code, %d pattern hit(s).\n\n", (uint64)image.size(), (int)hits.size());
+    for (const auto& hit : hits)
+    {
+        if (hit.resolved_ea != BADADDR)
+        {
+            votes[hit.target][hit.resolved_ea]++;
+            report.cat_sprnt("%-9s 0x%a -> 0x%a  (%s)\n", hit.target.c_str(), hit.match_ea, hit.resolved_ea, hit.description.c_str());
+        }
+        else
+        {
+            unresolved.emplace(hit.target, hit.match_ea);
+            report.cat_sprnt("%-9s 0x%a -> ?  (%s)\n", hit.target.c_str(), hit.match_ea, hit.description.c_str());
+        }
+    }
+
+    auto job = std::make_shared<locate_job_t>();
+    job->plugin = plugin;
+    report.append("\n");
+    for (const char* target : { "GWorld", "GNames", "GObjects" })
+    {
+        auto it = votes.find(target);
+        if (it != votes.end())
+        {
+            // Several patterns usually hit the same global; take the address most of them agree on.
+            auto best = std::max_element(it->second.begin(), it->second.end(),
+                [](const auto& a, const auto& b) { return a.second < b.second; });
+            report.cat_sprnt("%s = 0x%a (%d hit(s) agree)\n", target, best->first, best->second);
+            msg("AiDA: %s = 0x%a\n", target, best->first);
+            if (!has_user_name(get_flags(best->first)))
+                set_name(best->first, target, SN_NOWARN | SN_NOCHECK);
+            continue;
+        }
+
+        // The function a pattern hit in (if any) goes first, then the best statically ranked ones.
+        std::vector<ea_t> funcs;
+        auto site = unresolved.find(target);
+        if (site != unresolved.end())
+        {
+            if (func_t* pfn = get_func(site->second))
+                funcs.push_back(pfn->start_ea);
+        }
+
+        show_wait_box("HIDECANCEL\nAiDA: Ranking candidate functions for %s...", target);
+        std::vector<scanner::root_candidate_t> ranked = scanner::rank_root_functions(target,
+            std::max(g_settings.max_root_func_scan_count, 0), std::max(g_settings.max_root_func_candidates, 0));
+        hide_wait_box();
+
+        for (const auto& cand : ranked)
+        {
+            if (funcs.size() >= (size_t)std::max(g_settings.max_root_func_candidates, 1))
+                break;
+            if (std::find(funcs.begin(), funcs.end(), cand.func_ea) == funcs.end())
+                funcs.push_back(cand.func_ea);
+        }
+
+        if (funcs.empty())
+        {
+            report.cat_sprnt("%s = not found\n", target);
+            continue;
+        }
+
+        report.cat_sprnt("%s = unresolved, asking the AI about %d function(s):\n", target, (int)funcs.size());
+        if (site != unresolved.end())
+            report.cat_sprnt("    0x%a  (pattern hit at 0x%a)\n", funcs.front(), site->second);
+        for (const auto& cand : ranked)
+        {
+            if (std::find(funcs.begin(), funcs.end(), cand.func_ea) == funcs.end())
+                continue;
+            if (site != unresolved.end() && cand.func_ea == funcs.front())
+                continue;
+            report.cat_sprnt("    0x%a  score %d, %d string ref(s), best global 0x%a\n",
+                cand.func_ea, cand.score, cand.string_hits, cand.best_global);
+        }
+        job->targets.emplace_back(target, std::move(funcs));
+    }
+
+    show_text_in_viewer("Engine Pointer Scan", report.c_str());
+
+    if (!job->targets.empty())
+    {
+        if (!plugin->ai_client)
+            msg("AiDA: No AI provider configured, leaving %d target(s) unresolved.\n", (int)job->targets.size());
+        else
+            run_next_locate(job);
+    }
+}
+
+void handle_scan_rtti(action_activation_ctx_t* /*ctx*/, aida_plugin_t* /*plugin*/)
+{
+    show_wait_box("HIDECANCEL\nAiDA: Scanning for MSVC RTTI...");
+    std::vector<rtti::class_info_t> classes;
+    rtti::scan_stats_t stats;
+    bool ok = rtti::scan(&classes, &stats);
+    if (ok)
+    {
+        replace_wait_box("HIDECANCEL\nAiDA: Naming %d vtable(s)...", (int)stats.vtables);
+        rtti::apply_names(classes, &stats);
+    }
+    hide_wait_box();
+
+    if (!ok)
+        return;
+    if (classes.empty())
+    {
+        msg("AiDA: No MSVC RTTI found.\n");
+        return;
+    }
+
+    qstring report;
+    report.sprnt("%d class(es), %d locator(s), %d vtable(s). Named %d vtable(s) and %d method(s).\n\n",
+        (int)classes.size(), (int)stats.locators, (int)stats.vtables, (int)stats.named_vtables, (int)stats.named_methods);
+    for (const auto& cls : classes)
+    {
+        report.cat_sprnt("%s", cls.name.c_str());
+        if (!cls.bases.empty())
+        {
+            report.append(" : ");
+            for (size_t i = 0; i < cls.bases.size(); ++i)
+                report.cat_sprnt("%s%s", i == 0 ? "" : ", ", cls.bases[i].name.c_str());
+        }
+        report.append("\n");
+        for (const auto& vt : cls.vtables)
+            report.cat_sprnt("    vtable 0x%a (+0x%X): %d method(s)\n", vt.ea, vt.offset, (int)vt.methods.size());
+    }
+    msg("AiDA: RTTI scan found %d class(es); named %d vtable(s) and %d method(s).\n",
+        (int)classes.size(), (int)stats.named_vtables, (int)stats.named_methods);
+    show_text_in_viewer("RTTI Classes", report.c_str());
+}
+
+void handle_unreal_reflection(action_activation_ctx_t* /*ctx*/, aida_plugin_t* /*plugin*/)
+{
+    // The engine pointer scan names these; ask only for what it did not find.
+    ea_t gnames = get_name_ea(BADADDR, "GNames");
+    ea_t gobjects = get_name_ea(BADADDR, "GObjects");
+    if (gnames == BADADDR || gobjects == BADADDR)
+    {
+        static const char form[] =
+            "Unreal Engine Reflection\n\n"
+            "Addresses of the engine globals (run 'Scan for Engine Pointers' to find them).\n\n"
+            "<~G~Names   :$::32::>\n"
+            "<G~O~bjects :$::32::>\n";
+        if (ask_form(form, &gnames, &gobjects) <= 0)
+            return;
+    }
+
+    show_wait_box("AiDA: Walking GObjects and GNames...");
+    unreal::walk_result_t result;
+    qstring error;
+    bool ok = unreal::walk(gnames, gobjects, &result, &error);
+    size_t named = 0;
+    if (ok)
+    {
+        replace_wait_box("HIDECANCEL\nAiDA: Naming %d native function(s)...", (int)result.natives.size());
+        named = unreal::apply_names(result);
+    }
+    hide_wait_box();
+
+    if (!ok)
+    {
+        warning("AiDA: %s", error.c_str());
+        return;
+    }
+
+    qstring report;
+    report.sprnt("Names:   %s\nObjects: %s\nUFunction::Func at +0x%X\n\n", result.names_layout.c_str(), result.objects_layout.c_str(), result.func_offset);
+    report.cat_sprnt("%d object(s), %d class(es), %d function(s), %d native thunk(s); named %d.\n\n",
+        (int)result.objects, (int)result.classes, (int)result.functions, (int)result.natives.size(), (int)named);
+    for (const auto& rf : result.natives)
+        report.cat_sprnt("0x%a  %s::exec%s  (%s)\n", rf.func, rf.owner.c_str(), rf.name.c_str(), rf.package.c_str());
+    msg("AiDA: Unreal reflection named %d of %d native function(s).\n", (int)named, (int)result.natives.size());
+    show_text_in_viewer("Unreal Reflection", report.c_str());
+}
+
+void handle_show_review_queue(action_activation_ctx_t* /*ctx*/, aida_plugin_t* /*plugin*/)
+{
+    review_queue_t::instance().show();
 }
 
 void handle_show_settings(action_activation_ctx_t* /*ctx*/, aida_plugin_t* plugin)
@@ -21,11 +21,20 @@ void handle_rename_function(action_activation_ctx_t* ctx, aida_plugin_t* plugin)
 void handle_auto_comment(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
 void handle_generate_struct(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
 void handle_generate_hook(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
+void handle_reconstruct_class(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
 void handle_custom_query(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
+void handle_global_query(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
 void handle_copy_context(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
+void handle_export_contexts(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
+void handle_import_results(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
 void handle_scan_for_offsets(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
+void handle_scan_rtti(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
+void handle_unreal_reflection(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
 void handle_show_settings(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
 void handle_rename_all(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
+void handle_generate_signature(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
+void handle_generate_signatures_batch(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
+void handle_show_review_queue(action_activation_ctx_t* ctx, aida_plugin_t* plugin);
 
 namespace action_helpers {
 void handle_ai_response(const std::string& result, const qstring& title_prefix,
@@ -0,0 +1,293 @@
+#include "aida_pro.hpp"
+#include <algorithm>
+
+namespace agent
+{
+    // Keeps one tool result from crowding out the rest of the conversation.
+    static const size_t MAX_RESULT_CHARS = 16000;
+    static const int MAX_XREFS = 40;
+    static const int MAX_STRING_HITS = 30;
+    static const int MAX_STRING_FUNCS = 3;
+
+    const std::vector<tool_spec_t>& tool_specs()
+    {
+        static const std::vector<tool_spec_t> specs = {
+            {
+                "get_function",
+                "Decompiled code and prototype of the function containing an address.",
+                {
+                    {"type", "object"},
+                    {"properties", { {"ea", { {"type", "string"}, {"description", "Address in hex (0x...) or a symbol name."} }} }},
+                    {"required", {"ea"}},
+                },
+            },
+            {
+                "decompile_callee",
+                "Decompiled code of a function called by the function under analysis, by the name it has in that code.",
+                {
+                    {"type", "object"},
+                    {"properties", { {"name", { {"type", "string"}, {"description", "Callee name as it appears in the code, e.g. sub_140012340."} }} }},
+                    {"required", {"name"}},
+                },
+            },
+            {
+                "get_xrefs_to",
+                "Code and data references to an address: the referencing function and instruction for each.",
+                {
+                    {"type", "object"},
+                    {"properties", { {"ea", { {"type", "string"}, {"description", "Address in hex (0x...) or a symbol name."} }} }},
+                    {"required", {"ea"}},
+                },
+            },
+            {
+                "get_struct",
+                "C definition of a structure, union or enum from the database's local types.",
+                {
+                    {"type", "object"},
+                    {"properties", { {"name", { {"type", "string"}, {"description", "Type name."} }} }},
+                    {"required", {"name"}},
+                },
+            },
+            {
+                "search_strings",
+                "Case-insensitive search of the string literals in the binary; returns each match with the functions that use it.",
+                {
+                    {"type", "object"},
+                    {"properties", { {"text", { {"type", "string"}, {"description", "Substring to look for."} }} }},
+                    {"required", {"text"}},
+                },
+            },
+        };
+        return specs;
+    }
+
+    static std::string arg_string(const tool_call_t& call, const char* key)
+    {
+        if (!call.args.is_object() || !call.args.contains(key))
+            return "";
+        const auto& value = call.args[key];
+        if (value.is_string())
+            return value.get<std::string>();
+        if (value.is_number_unsigned() || value.is_number_integer())
+        {
+            qstring hex;
+            hex.sprnt("0x%llx", value.get<uint64>());
+            return hex.c_str();
+        }
+        return "";
+    }
+
+    static ea_t resolve_ea(const std::string& text)
+    {
+        if (text.empty())
+            return BADADDR;
+        char* end = nullptr;
+        uint64 value = strtoull(text.c_str(), &end, 16);
+        if (end != text.c_str() && *end == '\0' && is_mapped((ea_t)value))
+            return (ea_t)value;
+        return get_name_ea(BADADDR, text.c_str());
+    }
+
+    static std::string clip(std::string text)
+    {
+        if (text.length() > MAX_RESULT_CHARS)
+        {
+            text.resize(MAX_RESULT_CHARS);
+            text += "\n// ... truncated";
+        }
+        return text;
+    }
+
+    static std::string describe_function(ea_t ea)
+    {
+        func_t* pfn = get_func(ea);
+        if (pfn == nullptr)
+            return "No function contains this address.";
+
+        qstring name;
+        get_func_name(&name, pfn->start_ea);
+        qstring header;
+        header.sprnt("// 0x%llx %s\n", (uint64)pfn->start_ea, name.c_str());
+        tinfo_t tif;
+        qstring proto;
+        if (get_tinfo(&tif, pfn->start_ea) && tif.print(&proto, name.c_str(), PRTYPE_1LINE))
+            header.cat_sprnt("// %s\n", proto.c_str());
+
+        auto code = ida_utils::get_function_code(pfn->start_ea, MAX_RESULT_CHARS);
+        return header.c_str() + code.first;
+    }
+
+    static std::string tool_get_function(const tool_call_t& call)
+    {
+        ea_t ea = resolve_ea(arg_string(call, "ea"));
+        if (ea == BADADDR)
+            return "Unknown address or name.";
+        return describe_function(ea);
+    }
+
+    static std::string tool_decompile_callee(ea_t func_ea, const tool_call_t& call)
+    {
+        const std::string wanted = arg_string(call, "name");
+        if (wanted.empty())
+            return "No callee name given.";
+
+        // The name as the model read it in the code, so look among the callees first.
+        ea_t target = BADADDR;
+        if (func_t* pfn = get_func(func_ea))
+        {
+            func_item_iterator_t fii(pfn);
+            for (bool ok = fii.first(); ok && target == BADADDR; ok = fii.next_code())
+            {
+                xrefblk_t xb;
+                for (bool ok_ref = xb.first_from(fii.current(), XREF_NOFLOW); ok_ref; ok_ref = xb.next_from())
+                {
+                    if (!xb.iscode || (xb.type != fl_CN && xb.type != fl_CF))
+                        continue;
+                    qstring name;
+                    qstring short_name;
+                    get_func_name(&name, xb.to);
+                    get_short_name(&short_name, xb.to);
+                    if (wanted == name.c_str() || wanted == short_name.c_str())
+                    {
+                        target = xb.to;
+                        break;
+                    }
+                }
+            }
+        }
+        if (target == BADADDR)
+            target = resolve_ea(wanted);
+        if (target == BADADDR)
+            return "No function named " + wanted + ".";
+        return describe_function(target);
+    }
+
+    static std::string tool_get_xrefs_to(const tool_call_t& call)
+    {
+        ea_t ea = resolve_ea(arg_string(call, "ea"));
+        if (ea == BADADDR)
+            return "Unknown address or name.";
+        if (func_t* pfn = get_func(ea))
+            ea = pfn->start_ea;
+
+        qstring out;
+        int count = 0;
+        xrefblk_t xb;
+        for (bool ok = xb.first_to(ea, XREF_NOFLOW); ok; ok = xb.next_to())
+        {
+            if (count++ == MAX_XREFS)
+            {
+                out.append("// ... more references omitted\n");
+                break;
+            }
+            qstring func_name = "(no function)";
+            if (func_t* caller = get_func(xb.from))
+                get_func_name(&func_name, caller->start_ea);
+            qstring line;
+            generate_disasm_line(&line, xb.from, GENDSM_REMOVE_TAGS);
+            out.cat_sprnt("0x%llx in %s: %s\n", (uint64)xb.from, func_name.c_str(), line.c_str());
+        }
+        return out.empty() ? "No references." : out.c_str();
+    }
+
+    static std::string tool_get_struct(const tool_call_t& call)
+    {
+        const std::string name = arg_string(call, "name");
+        tinfo_t tif;
+        if (name.empty() || !tif.get_named_type(get_idati(), name.c_str()))
+            return "No local type named " + name + ".";
+        qstring decl;
+        if (!tif.print(&decl, name.c_str(), PRTYPE_MULTI | PRTYPE_TYPE | PRTYPE_DEF | PRTYPE_SEMI))
+            return "Could not print type " + name + ".";
+        return clip(decl.c_str());
+    }
+
+    static std::string tool_search_strings(const tool_call_t& call)
+    {
+        qstring needle = ida_utils::qstring_tolower(arg_string(call, "text").c_str());
+        if (needle.empty())
+            return "No search text given.";
+
+        if (get_strlist_qty() == 0)
+            build_strlist();
+
+        qstring out;
+        int hits = 0;
+        const size_t qty = get_strlist_qty();
+        for (size_t i = 0; i < qty && hits < MAX_STRING_HITS; ++i)
+        {
+            string_info_t si;
+            qstring text;
+            if (!get_strlist_item(&si, i) || get_strlit_contents(&text, si.ea, si.length, si.type) <= 0)
+                continue;
+            if (strstr(ida_utils::qstring_tolower(text).c_str(), needle.c_str()) == nullptr)
+                continue;
+
+            ++hits;
+            out.cat_sprnt("0x%llx \"%s\"", (uint64)si.ea, text.c_str());
+            int funcs = 0;
+            xrefblk_t xb;
+            for (bool ok = xb.first_to(si.ea, XREF_DATA); ok && funcs < MAX_STRING_FUNCS; ok = xb.next_to())
+            {
+                func_t* pfn = get_func(xb.from);
+                if (pfn == nullptr)
+                    continue;
+                qstring func_name;
+                get_func_name(&func_name, pfn->start_ea);
+                out.cat_sprnt("%s 0x%llx %s", funcs++ == 0 ? " used in" : ",", (uint64)pfn->start_ea, func_name.c_str());
+            }
+            out.append("\n");
+        }
+        return out.empty() ? "No matching strings." : clip(out.c_str());
+    }
+
+    static std::string run_tool(ea_t func_ea, const tool_call_t& call)
+    {
+        try
+        {
+            if (call.name == "get_function")
+                return tool_get_function(call);
+            if (call.name == "decompile_callee")
+                return tool_decompile_callee(func_ea, call);
+            if (call.name == "get_xrefs_to")
+                return tool_get_xrefs_to(call);
+            if (call.name == "get_struct")
+                return tool_get_struct(call);
+            if (call.name == "search_strings")
+                return tool_search_strings(call);
+            return "Unknown tool " + call.name + ".";
+        }
+        catch (const std::exception& e)
+        {
+            return std::string("Tool failed: ") + e.what();
+        }
+    }
+
+    struct tools_request_t : public exec_request_t
+    {
+        ea_t func_ea;
+        const std::vector<tool_call_t>& calls;
+        std::vector<std::string> results;
+
+        tools_request_t(ea_t ea, const std::vector<tool_call_t>& c) : func_ea(ea), calls(c) {}
+
+        ssize_t idaapi execute() override
+        {
+            for (const auto& call : calls)
+            {
+                results.push_back(run_tool(func_ea, call));
+                ida_utils::sanitize_utf8(&results.back());
+            }
+            return 0;
+        }
+    };
+
+    std::vector<std::string> run_tools(ea_t func_ea, const std::vector<tool_call_t>& calls)
+    {
+        tools_request_t req(func_ea, calls);
+        // The tools only read, so a batch does not wait for the write lock behind analysis.
+        execute_sync(req, MFF_READ);
+        req.results.resize(calls.size(), "Tool did not run.");
+        return req.results;
+    }
+}
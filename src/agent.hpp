@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <ida.hpp>
+#include <nlohmann/json.hpp>
+
+namespace agent
+{
+    // A tool the model can call, in a provider-neutral shape; each client wraps these in
+    // its own declaration format. parameters is a JSON schema object.
+    struct tool_spec_t
+    {
+        std::string name;
+        std::string description;
+        nlohmann::json parameters;
+    };
+
+    struct tool_call_t
+    {
+        std::string id;        // provider call id, echoed back with the result
+        std::string name;
+        nlohmann::json args;
+    };
+
+    // One model turn. message is the provider's own assistant message, appended to the
+    // conversation as-is so nothing the provider needs for the next turn is lost.
+    struct reply_t
+    {
+        std::string text;
+        std::vector<tool_call_t> calls;
+        nlohmann::json message;
+    };
+
+    const std::vector<tool_spec_t>& tool_specs();
+
+    // Runs every call of one turn in a single hop to the main thread and returns the
+    // results in call order. Safe to call from a worker thread only.
+    std::vector<std::string> run_tools(ea_t func_ea, const std::vector<tool_call_t>& calls);
+}
@@ -1,4 +1,5 @@
 #include "aida_pro.hpp"
+#include <string_view>
 using json = nlohmann::json;
 
 
@@ -89,10 +90,15 @@ static int idaapi timer_cb(void* ud)
     else
     {
         int elapsed = client->_elapsed_secs.load();
-        msg("AiDA: Request for %s is in progress... elapsed time: %d second%s.\n",
+        int total = client->_batch_total.load();
+        qstring progress;
+        if (total > 0)
+            progress.sprnt(", %d of %d requests done", client->_batch_done.load(), total);
+        msg("AiDA: Request for %s is in progress... elapsed time: %d second%s%s.\n",
             client->_current_request_type.c_str(),
             elapsed,
-            elapsed == 1 ? "" : "s");
+            elapsed == 1 ? "" : "s",
+            progress.c_str());
     }
 
     client->_elapsed_secs++;
@@ -115,19 +121,43 @@ AIClient::~AIClient()
 void AIClient::cancel_current_request()
 {
     _cancelled = true;
-    std::shared_ptr<httplib::Client> client_to_stop;
+    std::vector<std::shared_ptr<httplib::Client>> clients_to_stop;
     {
         std::lock_guard<std::mutex> lock(_http_client_mutex);
-        client_to_stop = _http_client;
+        clients_to_stop = _http_clients;
     }
 
-    if (client_to_stop)
+    for (const auto& client : clients_to_stop)
     {
-        client_to_stop->stop();
+        client->stop();
     }
+    http2::wake();
 }
 
-void AIClient::_generate(const std::string& prompt_text, callback_t callback, double temperature, const qstring& request_type)
+std::shared_ptr<httplib::Client> AIClient::_open_client(const std::string& host)
+{
+    auto client = std::make_shared<httplib::Client>(host.c_str());
+    std::lock_guard<std::mutex> lock(_http_client_mutex);
+    _http_clients.push_back(client);
+    return client;
+}
+
+void AIClient::_close_client(const std::shared_ptr<httplib::Client>& client)
+{
+    std::lock_guard<std::mutex> lock(_http_client_mutex);
+    _http_clients.erase(std::remove(_http_clients.begin(), _http_clients.end(), client), _http_clients.end());
+}
+
+AIClient::usage_t AIClient::usage() const
+{
+    usage_t u;
+    u.requests = _requests_sent.load();
+    u.prompt_chars = _prompt_chars.load();
+    u.response_chars = _response_chars.load();
+    return u;
+}
+
+void AIClient::_start_worker(std::function<std::string()> work, callback_t callback, const qstring& request_type, int batch_total)
 {
     std::lock_guard<std::mutex> lock(_worker_thread_mutex);
     if (_worker_thread.joinable())
@@ -140,16 +170,18 @@ void AIClient::_generate(const std::string& prompt_text, callback_t callback, do
     _is_request_active = false;
     _current_request_type = request_type;
     _elapsed_secs = 0;
+    _batch_total = batch_total;
+    _batch_done = 0;
 
     qtimer_t timer = register_timer(1000, timer_cb, this);
 
     auto req = new ai_request_t(callback, timer, request_type, _validity_token);
 
-    auto worker_func = [this, prompt_text, temperature, req, validity_token = this->_validity_token]() {
+    auto worker_func = [this, work = std::move(work), req, validity_token = this->_validity_token]() {
         std::string result;
         try
         {
-            result = this->_blocking_generate(prompt_text, temperature);
+            result = work();
         }
         catch (const std::exception& e)
         {
@@ -174,102 +206,445 @@ void AIClient::_generate(const std::string& prompt_text, callback_t callback, do
         execute_sync(*req, MFF_NOWAIT);
     };
 
-    _worker_thread = std::thread(worker_func);
+    _worker_thread = std::thread(std::move(worker_func));
+}
+
+void AIClient::_generate(std::string prompt_text, callback_t callback, double temperature, const qstring& request_type, stream_callback_t on_delta)
+{
+    _start_worker([this, prompt_text = std::move(prompt_text), temperature, on_delta]() {
+        return _blocking_generate(prompt_text, temperature, on_delta);
+    }, callback, request_type);
+}
+
+std::vector<std::string> AIClient::generate_parallel(const std::vector<std::string>& prompts, double temperature, size_t parallel, std::function<void(size_t done)> on_progress)
+{
+    std::vector<std::string> results(prompts.size());
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex progress_mutex;
+    auto run = [&]() {
+        for (size_t i = next++; i < prompts.size() && !_cancelled.load(); i = next++)
+        {
+            try
+            {
+                results[i] = _blocking_generate(prompts[i], temperature);
+            }
+            catch (const std::exception& e)
+            {
+                results[i] = std::string("Error: Exception in worker thread: ") + e.what();
+            }
+            _batch_done++;
+            size_t finished = ++done;
+            if (on_progress)
+            {
+                std::lock_guard<std::mutex> lock(progress_mutex);
+                on_progress(finished);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    size_t threads = std::min(prompts.size(), std::max<size_t>(parallel, 1));
+    // More requests than the server has slots would only queue there.
+    if (const size_t slots = _parallel_slots())
+        threads = std::min(threads, slots);
+    for (size_t t = 1; t < threads; ++t)
+        pool.emplace_back(run);
+    run();
+    for (auto& th : pool)
+        th.join();
+    return results;
+}
+
+void AIClient::_generate_batch(std::vector<std::string> prompts, batch_callback_t callback, double temperature, const qstring& request_type)
+{
+    // Enough to hide the latency of a handful of requests without tripping provider rate limits.
+    static const size_t MAX_PARALLEL_REQUESTS = 4;
+
+    auto results = std::make_shared<std::vector<std::string>>();
+    const int total = (int)prompts.size();
+    auto work = [this, prompts = std::move(prompts), temperature, results]() {
+        // A local server has no rate limit, so it gets as many requests as it has slots.
+        const size_t slots = _parallel_slots();
+        *results = generate_parallel(prompts, temperature, slots != 0 ? slots : MAX_PARALLEL_REQUESTS);
+        return std::string();
+    };
+
+    _start_worker(std::move(work), [callback, results](const std::string&) { callback(*results); }, request_type, total);
 }
 
 std::string AIClient::_http_post_request(
     const std::string& host,
     const std::string& path,
     const httplib::Headers& headers,
-    const std::string& body,
+    std::string body,
     std::function<std::string(const json&)> response_parser)
 {
     std::shared_ptr<httplib::Client> current_client;
     try
     {
+        int status = 0;
+        std::string response_body;
+        if (_use_http2(host))
         {
-            std::lock_guard<std::mutex> lock(_http_client_mutex);
-            _http_client = std::make_shared<httplib::Client>(host.c_str());
-            current_client = _http_client;
+            http2::result_t res = http2::post(host + path, headers, std::move(body), nullptr,
+                [this]() { return !_cancelled.load(); });
+            if (_cancelled || res.cancelled)
+                return "Error: Operation cancelled.";
+            if (!res.error.empty())
+                return "Error: HTTP request failed: " + res.error;
+            status = res.status;
+            response_body = std::move(res.body);
         }
+        else
+        {
+            current_client = _open_client(host);
+
+            current_client->set_default_headers(headers);
+            current_client->set_read_timeout(600); // 10 minutes
+            current_client->set_connection_timeout(10);
+
+            // Built by hand rather than through Post(), which would copy the body once more.
+            httplib::Request req;
+            req.method = "POST";
+            req.path = path;
+            req.set_header("Content-Type", "application/json");
+            req.body = std::move(body);
+            req.upload_progress = [this](uint64_t, uint64_t) {
+                return !_cancelled.load();
+            };
+            auto res = current_client->send(req);
 
-        current_client->set_default_headers(headers);
-        current_client->set_read_timeout(600); // 10 minutes
-        current_client->set_connection_timeout(10);
+            _close_client(current_client);
 
-        auto res = current_client->Post(
-            path.c_str(),
-            body.c_str(),
-            body.length(),
-            "application/json",
-            [this](uint64_t, uint64_t) {
-                return !_cancelled.load();
-            });
+            if (_cancelled)
+                return "Error: Operation cancelled.";
 
+            if (!res)
+            {
+                auto err = res.error();
+                if (err == httplib::Error::Canceled) {
+                    return "Error: Operation cancelled.";
+                }
+                return "Error: HTTP request failed: " + httplib::to_string(err);
+            }
+            status = res->status;
+            response_body = std::move(res->body);
+        }
+
+        if (status != 200)
         {
-            std::lock_guard<std::mutex> lock(_http_client_mutex);
-            _http_client.reset();
+            qstring error_details = "No details in response body.";
+            if (!response_body.empty())
+            {
+                try
+                {
+                    error_details = json::parse(response_body).dump(2).c_str();
+                }
+                catch (const json::parse_error&)
+                {
+                    error_details = response_body.c_str();
+                }
+            }
+            msg("AiDA: API Error. Host: %s, Status: %d\nResponse body: %s\n", host.c_str(), status, error_details.c_str());
+            return "Error: API returned status " + std::to_string(status);
         }
+        json jres = json::parse(response_body);
+        return response_parser(jres);
+    }
+    catch (const std::exception& e)
+    {
+        _close_client(current_client);
+        warning("AI Assistant: API call to %s failed: %s\n", host.c_str(), e.what());
+        return std::string("Error: API call failed. Details: ") + e.what();
+    }
+}
 
-        if (_cancelled)
-            return "Error: Operation cancelled.";
+std::string AIClient::_http_stream_request(
+    const std::string& host,
+    const std::string& path,
+    const httplib::Headers& headers,
+    std::string body,
+    stream_callback_t on_delta)
+{
+    std::shared_ptr<httplib::Client> current_client;
+    try
+    {
+        int status = 0;
+        std::string error_body;
+        std::string pending; // bytes of an event line that has not been terminated yet
+        std::string full_text;
+        std::string stream_error;
+
+        httplib::Headers stream_headers = headers;
+        if (stream_headers.find("Content-Type") == stream_headers.end())
+            stream_headers.emplace("Content-Type", "application/json");
+        stream_headers.emplace("Accept", "text/event-stream");
+
+        auto on_data = [&](const char* data, size_t data_length) {
+            if (_cancelled.load())
+                return false;
+            if (status != 200)
+            {
+                error_body.append(data, data_length);
+                return true;
+            }
+
+            pending.append(data, data_length);
+            size_t start = 0;
+            size_t nl;
+            while ((nl = pending.find('\n', start)) != std::string::npos)
+            {
+                std::string_view line(pending.data() + start, nl - start);
+                start = nl + 1;
+
+                if (!line.empty() && line.back() == '\r')
+                    line.remove_suffix(1);
+                if (line.substr(0, 5) != "data:")
+                    continue;
+                line.remove_prefix(5);
+                while (!line.empty() && line.front() == ' ')
+                    line.remove_prefix(1);
+                if (line.empty() || line == "[DONE]")
+                    continue;
+
+                json event = json::parse(line.begin(), line.end(), nullptr, false);
+                if (event.is_discarded())
+                    continue;
+
+                try
+                {
+                    std::string delta = _parse_stream_event(event);
+                    if (!delta.empty())
+                    {
+                        full_text += delta;
+                        on_delta(delta);
+                    }
+                }
+                catch (const std::runtime_error& e)
+                {
+                    stream_error = e.what();
+                    return false;
+                }
+            }
+            pending.erase(0, start);
+            return true;
+        };
 
-        if (!res)
+        std::string transport_error;
+        bool transport_cancelled = false;
+        if (_use_http2(host))
         {
-            auto err = res.error();
-            if (err == httplib::Error::Canceled) {
-                return "Error: Operation cancelled.";
+            http2::result_t res = http2::post(host + path, stream_headers, std::move(body),
+                [&](int response_status, const char* data, size_t data_length) {
+                    status = response_status;
+                    return on_data(data, data_length);
+                },
+                [this]() { return !_cancelled.load(); });
+            transport_cancelled = res.cancelled;
+            transport_error = res.error;
+            status = res.status;
+        }
+        else
+        {
+            current_client = _open_client(host);
+
+            current_client->set_read_timeout(600); // 10 minutes
+            current_client->set_connection_timeout(10);
+
+            httplib::Request req;
+            req.method = "POST";
+            req.path = path;
+            req.headers = std::move(stream_headers);
+            req.body = std::move(body);
+            req.response_handler = [&status](const httplib::Response& res) {
+                status = res.status;
+                return true;
+            };
+            req.content_receiver = [&](const char* data, size_t data_length, uint64_t, uint64_t) {
+                return on_data(data, data_length);
+            };
+
+            auto res = current_client->send(req);
+
+            _close_client(current_client);
+
+            if (!res)
+            {
+                auto err = res.error();
+                if (err == httplib::Error::Canceled)
+                    transport_cancelled = true;
+                else
+                    transport_error = httplib::to_string(err);
             }
-            return "Error: HTTP request failed: " + httplib::to_string(err);
         }
-        if (res->status != 200)
+
+        if (!stream_error.empty())
+        {
+            msg("AiDA: %s\n", stream_error.c_str());
+            return "Error: " + stream_error;
+        }
+
+        if (_cancelled || transport_cancelled)
+            return "Error: Operation cancelled.";
+
+        if (!transport_error.empty())
+            return "Error: HTTP request failed: " + transport_error;
+        if (status != 200)
         {
             qstring error_details = "No details in response body.";
-            if (!res->body.empty())
+            if (!error_body.empty())
             {
                 try
                 {
-                    error_details = json::parse(res->body).dump(2).c_str();
+                    error_details = json::parse(error_body).dump(2).c_str();
                 }
                 catch (const json::parse_error&)
                 {
-                    error_details = res->body.c_str();
+                    error_details = error_body.c_str();
                 }
             }
-            msg("AiDA: API Error. Host: %s, Status: %d\nResponse body: %s\n", host.c_str(), res->status, error_details.c_str());
-            return "Error: API returned status " + std::to_string(res->status);
+            msg("AiDA: API Error. Host: %s, Status: %d\nResponse body: %s\n", host.c_str(), status, error_details.c_str());
+            return "Error: API returned status " + std::to_string(status);
         }
-        json jres = json::parse(res->body);
-        return response_parser(jres);
+        if (full_text.empty())
+            return "Error: Streamed response contained no text.";
+        return full_text;
     }
     catch (const std::exception& e)
     {
-        {
-            std::lock_guard<std::mutex> lock(_http_client_mutex);
-            _http_client.reset();
-        }
+        _close_client(current_client);
         warning("AI Assistant: API call to %s failed: %s\n", host.c_str(), e.what());
         return std::string("Error: API call failed. Details: ") + e.what();
     }
 }
 
-std::string AIClient::_blocking_generate(const std::string& prompt_text, double temperature)
+// Stands in for the prompt in the envelope; no provider field can contain it by accident.
+static const char PROMPT_SLOT[] = "\x7f" "AIDA_PROMPT_SLOT" "\x7f";
+
+// Serializes the small envelope, then splices the prompt, escaped, into its slot. The body
+// is sized once up front, and the prompt is never copied into a json value or re-dumped.
+static std::string build_request_body(const json& envelope, const std::string& prompt)
+{
+    const std::string shell = envelope.dump();
+    const size_t slot = shell.find(PROMPT_SLOT);
+    if (slot == std::string::npos)
+        throw std::runtime_error("Request envelope has no prompt slot.");
+    const size_t slot_len = sizeof(PROMPT_SLOT) - 1;
+
+    std::string body;
+    body.reserve(shell.size() - slot_len + ida_utils::json_escaped_length(prompt.data(), prompt.size()));
+    body.append(shell, 0, slot);
+    ida_utils::append_json_escaped(&body, prompt.data(), prompt.size());
+    body.append(shell, slot + slot_len, std::string::npos);
+    return body;
+}
+
+std::string AIClient::_blocking_generate(const std::string& prompt_text, double temperature, stream_callback_t on_delta)
 {
     if (!is_available())
         return "Error: AI client is not initialized. Check API key.";
 
-    auto payload = _get_api_payload(prompt_text, temperature);
+    return _send_generate(_get_api_payload(PROMPT_SLOT, temperature), prompt_text, on_delta);
+}
+
+std::string AIClient::_send_generate(json payload, const std::string& prompt_text, stream_callback_t on_delta)
+{
     auto headers = _get_api_headers();
     auto host = _get_api_host();
+
+    _requests_sent++;
+    _prompt_chars += prompt_text.size();
+
+    const bool stream = on_delta && _settings.stream_responses;
+    if (stream)
+        _set_stream_payload(payload);
+    std::string body = build_request_body(payload, prompt_text);
+
+    if (stream)
+    {
+        std::string streamed = _http_stream_request(host, _get_stream_path(_model_name), headers, std::move(body), on_delta);
+        _response_chars += streamed.size();
+        return streamed;
+    }
+
     auto path = _get_api_path(_model_name);
     auto parser = [this](const json& jres) { return _parse_api_response(jres); };
 
-    return _http_post_request(host, path, headers, payload.dump(), parser);
+    std::string result = _http_post_request(host, path, headers, std::move(body), parser);
+    _response_chars += result.size();
+    // Without streaming the whole body arrives as one delta so callers have a single apply path.
+    if (on_delta && result.rfind("Error:", 0) != 0)
+        on_delta(result);
+    return result;
+}
+
+bool AIClient::_use_agent() const
+{
+    return _settings.agent_mode && _supports_tools();
+}
+
+bool AIClient::_use_http2(const std::string& host) const
+{
+    // Only TLS connections negotiate h2. A plain http:// server (the Copilot proxy, a local
+    // llama.cpp) would get HTTP/1.1 through curl, capped at the transport's connections per
+    // host; httplib opens one connection per request instead.
+    return _settings.http2 && strnieq(host.c_str(), "https://", 8) && http2::available();
+}
+
+void AIClient::_generate_agent(ea_t func_ea, std::string prompt_text, callback_t callback, double temperature, const qstring& request_type)
+{
+    prompt_text += AGENT_TOOLS_PROMPT;
+    _start_worker([this, func_ea, prompt = std::move(prompt_text), temperature]() {
+        return _blocking_agent(func_ea, prompt, temperature);
+    }, callback, request_type);
+}
+
+std::string AIClient::_blocking_agent(ea_t func_ea, const std::string& prompt_text, double temperature)
+{
+    if (!is_available())
+        return "Error: AI client is not initialized. Check API key.";
+
+    const auto host = _get_api_host();
+    const auto path = _get_api_path(_model_name);
+    const auto headers = _get_api_headers();
+    const int max_turns = std::max(_settings.agent_max_turns, 1);
+
+    json messages = _agent_messages(prompt_text);
+    for (int turn = 1; ; ++turn)
+    {
+        // The last turn withholds the tools so the model has to answer with what it has.
+        const bool allow_calls = turn < max_turns;
+        std::string body = _get_agent_payload(messages, allow_calls, temperature).dump();
+        _requests_sent++;
+        _prompt_chars += body.size();
+
+        agent::reply_t reply;
+        std::string error = _http_post_request(host, path, headers, std::move(body),
+            [this, &reply](const json& jres) {
+                reply = _parse_agent_response(jres);
+                return std::string();
+            });
+        if (!error.empty())
+            return error;
+        _response_chars += reply.text.size();
+
+        if (reply.calls.empty())
+            return reply.text;
+        if (!allow_calls)
+            return "Error: The model was still calling tools after " + std::to_string(max_turns) + " turns.";
+        if (_cancelled)
+            return "Error: Operation cancelled.";
+
+        std::vector<std::string> results = agent::run_tools(func_ea, reply.calls);
+        _append_tool_results(messages, reply, results);
+    }
 }
 
 void AIClient::analyze_function(ea_t ea, callback_t callback)
 {
-    json context = ida_utils::get_context_for_prompt(ea);
+    const bool use_agent = _use_agent();
+    json context = ida_utils::get_context_for_prompt(ea, false, 0, use_agent);
     if (!context["ok"].get<bool>())
     {
         callback(context["message"].get<std::string>());
@@ -277,19 +652,26 @@ void AIClient::analyze_function(ea_t ea, callback_t callback)
     }
     std::string prompt = ida_utils::format_prompt(ANALYZE_FUNCTION_PROMPT, context);
 
-    _generate(prompt, callback, _settings.temperature, "function analysis");
+    if (use_agent)
+        _generate_agent(ea, std::move(prompt), callback, _settings.temperature, "function analysis");
+    else
+        _generate(std::move(prompt), callback, _settings.temperature, "function analysis");
 }
 
 void AIClient::suggest_name(ea_t ea, callback_t callback)
 {
-    json context = ida_utils::get_context_for_prompt(ea);
+    const bool use_agent = _use_agent();
+    json context = ida_utils::get_context_for_prompt(ea, false, 0, use_agent);
     if (!context["ok"].get<bool>())
     {
         callback(context["message"].get<std::string>());
         return;
     }
     std::string prompt = ida_utils::format_prompt(SUGGEST_NAME_PROMPT, context);
-    _generate(prompt, callback, 0.0, "name suggestion");
+    if (use_agent)
+        _generate_agent(ea, std::move(prompt), callback, 0.0, "name suggestion");
+    else
+        _generate(std::move(prompt), callback, 0.0, "name suggestion");
 }
 
 void AIClient::generate_struct(ea_t ea, callback_t callback)
@@ -301,7 +683,7 @@ void AIClient::generate_struct(ea_t ea, callback_t callback)
         return;
     }
     std::string prompt = ida_utils::format_prompt(GENERATE_STRUCT_PROMPT, context);
-    _generate(prompt, callback, 0.0, "struct generation");
+    _generate(std::move(prompt), callback, 0.0, "struct generation");
 }
 
 void AIClient::generate_hook(ea_t ea, callback_t callback)
@@ -322,10 +704,10 @@ void AIClient::generate_hook(ea_t ea, callback_t callback)
     context["func_name"] = clean_func_name;
 
     std::string prompt = ida_utils::format_prompt(GENERATE_HOOK_PROMPT, context);
-    _generate(prompt, callback, 0.0, "hook generation");
+    _generate(std::move(prompt), callback, 0.0, "hook generation");
 }
 
-void AIClient::generate_comments(ea_t ea, callback_t callback)
+void AIClient::generate_comments(ea_t ea, callback_t callback, stream_callback_t on_delta)
 {
     json context = ida_utils::get_context_for_prompt(ea);
     if (!context["ok"].get<bool>())
@@ -334,12 +716,13 @@ void AIClient::generate_comments(ea_t ea, callback_t callback)
         return;
     }
     std::string prompt = ida_utils::format_prompt(GENERATE_COMMENTS_PROMPT, context);
-    _generate(prompt, callback, 0.0, "comment generation");
+    _generate(std::move(prompt), callback, 0.0, "comment generation", on_delta);
 }
 
 void AIClient::custom_query(ea_t ea, const std::string& question, callback_t callback)
 {
-    json context = ida_utils::get_context_for_prompt(ea);
+    const bool use_agent = _use_agent();
+    json context = ida_utils::get_context_for_prompt(ea, false, 0, use_agent);
     if (!context["ok"].get<bool>())
     {
         callback(context["message"].get<std::string>());
@@ -347,47 +730,117 @@ void AIClient::custom_query(ea_t ea, const std::string& question, callback_t cal
     }
     context["user_question"] = question;
     std::string prompt = ida_utils::format_prompt(CUSTOM_QUERY_PROMPT, context);
-    _generate(prompt, callback, _settings.temperature, "custom query");
+    if (use_agent)
+        _generate_agent(ea, std::move(prompt), callback, _settings.temperature, "custom query");
+    else
+        _generate(std::move(prompt), callback, _settings.temperature, "custom query");
 }
 
-void AIClient::locate_global_pointer(ea_t ea, const std::string& target_name, addr_callback_t callback)
+// Builds the locate prompt for one function. Returns false (and leaves the prompt empty)
+// when the function has nothing the target could be loaded from.
+static bool build_locate_prompt(ea_t ea, const std::string& target_name, std::string* prompt, std::vector<scanner::rip_candidate_t>* candidates)
 {
     json context = ida_utils::get_context_for_prompt(ea, false, 16000);
     if (!context["ok"].get<bool>())
+        return false;
+    // The model only picks from addresses computed here, so its answer can be checked.
+    *candidates = scanner::collect_rip_candidates(ea);
+    if (candidates->empty())
     {
-        callback(BADADDR);
-        return;
+        msg("AI Assistant: No RIP-relative loads in the function at 0x%a, skipping %s.\n", ea, target_name.c_str());
+        return false;
     }
     context["target_name"] = target_name;
-    std::string prompt = ida_utils::format_prompt(LOCATE_GLOBAL_POINTER_PROMPT, context);
+    context["rip_candidates"] = scanner::format_rip_candidates(*candidates);
+    *prompt = ida_utils::format_prompt(LOCATE_GLOBAL_POINTER_PROMPT, context);
+    return true;
+}
 
-    auto on_result = [callback, target_name](const std::string& result) {
-        if (!result.empty() && result.find("Error:") == std::string::npos && result.find("None") == std::string::npos)
-        {
-            try
-            {
-                static const std::regex backtick_re("`");
-                std::string clean_result = std::regex_replace(result, backtick_re, "");
-                clean_result.erase(0, clean_result.find_first_not_of(" \t\n\r"));
-                clean_result.erase(clean_result.find_last_not_of(" \t\n\r") + 1);
-                ea_t addr = std::stoull(clean_result, nullptr, 16);
-                callback(addr);
-            }
-            catch (const std::exception&)
-            {
-                msg("AI Assistant: AI returned a non-address value for %s: %s\n", target_name.c_str(), result.c_str());
-                callback(BADADDR);
-            }
-        }
-        else
+static ea_t parse_locate_answer(const std::string& result, const std::vector<scanner::rip_candidate_t>& candidates, const std::string& target_name)
+{
+    if (result.empty() || result.find("Error:") != std::string::npos || result.find("None") != std::string::npos)
+        return BADADDR;
+
+    static const std::regex answer_re(R"(\b(0x[0-9A-Fa-f]+)\b|\b(\d{1,6})\b)");
+    std::smatch m;
+    if (!std::regex_search(result, m, answer_re))
+    {
+        msg("AI Assistant: AI returned no candidate for %s: %s\n", target_name.c_str(), result.c_str());
+        return BADADDR;
+    }
+
+    if (m[1].matched)
+    {
+        // Some models still answer with an address; accept it only if it is one of ours.
+        ea_t addr = std::stoull(m[1].str(), nullptr, 16);
+        for (const auto& c : candidates)
         {
-            callback(BADADDR);
+            if (c.target == addr)
+                return addr;
         }
+        msg("AI Assistant: AI returned 0x%a for %s, which is not a decoded candidate. Ignoring it.\n", addr, target_name.c_str());
+        return BADADDR;
+    }
+
+    size_t index = std::stoul(m[2].str());
+    if (index < 1 || index > candidates.size())
+    {
+        msg("AI Assistant: AI picked candidate %d for %s, but only %d exist.\n", (int)index, target_name.c_str(), (int)candidates.size());
+        return BADADDR;
+    }
+    return candidates[index - 1].target;
+}
+
+void AIClient::locate_global_pointer(ea_t ea, const std::string& target_name, addr_callback_t callback)
+{
+    std::string prompt;
+    std::vector<scanner::rip_candidate_t> candidates;
+    if (!build_locate_prompt(ea, target_name, &prompt, &candidates))
+    {
+        callback(BADADDR);
+        return;
+    }
+
+    auto on_result = [callback, target_name, candidates](const std::string& result) {
+        callback(parse_locate_answer(result, candidates, target_name));
     };
-    _generate(prompt, on_result, 0.0, "global pointer location");
+    _generate(std::move(prompt), on_result, 0.0, "global pointer location");
 }
 
-void AIClient::rename_all(ea_t ea, callback_t callback)
+void AIClient::locate_global_pointer_batch(const std::vector<ea_t>& func_eas, const std::string& target_name, addr_list_callback_t callback)
+{
+    // Functions that cannot be asked about keep BADADDR; only the rest become requests.
+    std::vector<std::string> prompts;
+    std::vector<size_t> slots;
+    std::vector<std::vector<scanner::rip_candidate_t>> candidates;
+    for (size_t i = 0; i < func_eas.size(); ++i)
+    {
+        std::string prompt;
+        std::vector<scanner::rip_candidate_t> cands;
+        if (!build_locate_prompt(func_eas[i], target_name, &prompt, &cands))
+            continue;
+        prompts.push_back(std::move(prompt));
+        slots.push_back(i);
+        candidates.push_back(std::move(cands));
+    }
+
+    if (prompts.empty())
+    {
+        callback(std::vector<ea_t>(func_eas.size(), BADADDR));
+        return;
+    }
+
+    size_t count = func_eas.size();
+    auto on_results = [callback, target_name, count, slots, candidates](const std::vector<std::string>& results) {
+        std::vector<ea_t> found(count, BADADDR);
+        for (size_t i = 0; i < results.size(); ++i)
+            found[slots[i]] = parse_locate_answer(results[i], candidates[i], target_name);
+        callback(found);
+    };
+    _generate_batch(std::move(prompts), on_results, 0.0, "global pointer location");
+}
+
+void AIClient::rename_all(ea_t ea, callback_t callback, stream_callback_t on_delta)
 {
     json context = ida_utils::get_context_for_prompt(ea, true);
     if (!context["ok"].get<bool>())
@@ -396,7 +849,47 @@ void AIClient::rename_all(ea_t ea, callback_t callback)
         return;
     }
     std::string prompt = ida_utils::format_prompt(RENAME_ALL_PROMPT, context);
-    _generate(prompt, callback, 0.0, "renaming");
+    _generate(std::move(prompt), callback, 0.0, "renaming", on_delta);
+}
+
+void AIClient::reconstruct_class(ea_t vtable_ea, const std::vector<ea_t>& methods, const std::string& class_info, callback_t callback)
+{
+    json context = ida_utils::get_class_context_for_prompt(vtable_ea, methods, class_info);
+    std::string prompt = ida_utils::format_prompt(RECONSTRUCT_CLASS_PROMPT, context);
+    _generate(std::move(prompt), callback, 0.0, "class reconstruction");
+}
+
+void AIClient::query_map(const std::string& question, const std::vector<std::string>& shards, size_t func_count, text_list_callback_t callback)
+{
+    // Per shard; the reduce step caps the merged shortlist anyway.
+    static const int MAX_HITS_PER_SHARD = 8;
+
+    std::vector<std::string> prompts;
+    prompts.reserve(shards.size());
+    for (const auto& shard : shards)
+    {
+        json context = {
+            {"user_question", question},
+            {"func_count", std::to_string(std::count(shard.begin(), shard.end(), '\n'))},
+            {"max_hits", std::to_string(MAX_HITS_PER_SHARD)},
+            {"digest", shard},
+        };
+        prompts.push_back(ida_utils::format_prompt(QUERY_MAP_PROMPT, context));
+    }
+    qstring request_type;
+    request_type.sprnt("binary query map step (%d shard(s), %d function(s))", (int)shards.size(), (int)func_count);
+    _generate_batch(std::move(prompts), callback, 0.0, request_type);
+}
+
+void AIClient::query_reduce(const std::string& question, const std::string& candidates, size_t func_count, callback_t callback)
+{
+    json context = {
+        {"user_question", question},
+        {"func_count", std::to_string(func_count)},
+        {"candidates", candidates},
+    };
+    std::string prompt = ida_utils::format_prompt(QUERY_REDUCE_PROMPT, context);
+    _generate(std::move(prompt), callback, _settings.temperature, "binary query reduce step");
 }
 
 GeminiClient::GeminiClient(const settings_t& settings) : AIClient(settings)
@@ -482,6 +975,94 @@ std::string GeminiClient::_parse_api_response(const json& jres) const
     return parts[0].value("text", "Error: 'text' field not found in API response.");
 }
 
+std::string GeminiClient::_get_stream_path(const std::string& model_name) const { return "/v1beta/models/" + model_name + ":streamGenerateContent?alt=sse&key=" + _settings.gemini_api_key; }
+void GeminiClient::_set_stream_payload(json&) const {}
+
+json GeminiClient::_agent_messages(const std::string& prompt_text) const
+{
+    return json::array({ {{"role", "user"}, {"parts", {{{"text", prompt_text}}}}} });
+}
+
+json GeminiClient::_get_agent_payload(const json& messages, bool allow_calls, double temperature) const
+{
+    json payload = _get_api_payload(std::string(), temperature);
+    payload["contents"] = messages;
+    json declarations = json::array();
+    for (const auto& spec : agent::tool_specs())
+        declarations.push_back({ {"name", spec.name}, {"description", spec.description}, {"parameters", spec.parameters} });
+    payload["tools"] = json::array({ {{"functionDeclarations", declarations}} });
+    payload["toolConfig"] = { {"functionCallingConfig", {{"mode", allow_calls ? "AUTO" : "NONE"}}} };
+    return payload;
+}
+
+agent::reply_t GeminiClient::_parse_agent_response(const json& jres) const
+{
+    agent::reply_t reply;
+    const auto candidates = jres.value("candidates", json::array());
+    if (!candidates.empty() && candidates[0].is_object())
+    {
+        const auto content = candidates[0].value("content", json::object());
+        for (const auto& part : content.value("parts", json::array()))
+        {
+            if (!part.is_object() || !part.contains("functionCall"))
+                continue;
+            const auto& fc = part["functionCall"];
+            agent::tool_call_t call;
+            call.id = fc.value("id", "");
+            call.name = fc.value("name", "");
+            call.args = fc.value("args", json::object());
+            reply.calls.push_back(std::move(call));
+        }
+        if (!reply.calls.empty())
+        {
+            reply.message = content;
+            return reply;
+        }
+    }
+    reply.text = _parse_api_response(jres);
+    return reply;
+}
+
+void GeminiClient::_append_tool_results(json& messages, const agent::reply_t& reply, const std::vector<std::string>& results) const
+{
+    messages.push_back(reply.message);
+    json parts = json::array();
+    for (size_t i = 0; i < reply.calls.size(); ++i)
+    {
+        json response = { {"name", reply.calls[i].name}, {"response", {{"result", results[i]}}} };
+        if (!reply.calls[i].id.empty())
+            response["id"] = reply.calls[i].id;
+        parts.push_back({ {"functionResponse", response} });
+    }
+    messages.push_back({ {"role", "user"}, {"parts", parts} });
+}
+
+std::string GeminiClient::_parse_stream_event(const json& event) const
+{
+    if (event.contains("error"))
+    {
+        const auto& err = event["error"];
+        throw std::runtime_error("Gemini API Error: " + (err.is_object() ? err.value("message", err.dump()) : err.dump()));
+    }
+
+    const auto candidates = event.value("candidates", json::array());
+    if (candidates.empty() || !candidates[0].is_object())
+    {
+        if (event.contains("promptFeedback") && event["promptFeedback"].contains("blockReason"))
+            throw std::runtime_error("Prompt was blocked by API for reason: " + event["promptFeedback"]["blockReason"].get<std::string>());
+        return "";
+    }
+
+    std::string delta;
+    const auto content = candidates[0].value("content", json::object());
+    for (const auto& part : content.value("parts", json::array()))
+    {
+        if (part.is_object() && part.contains("text") && part["text"].is_string())
+            delta += part["text"].get<std::string>();
+    }
+    return delta;
+}
+
 OpenAIClient::OpenAIClient(const settings_t& settings) : AIClient(settings)
 {
     _model_name = _settings.openai_model_name;
@@ -589,6 +1170,111 @@ std::string OpenAIClient::_parse_api_response(const json& jres) const
     return message.value("content", "Error: 'content' field not found in API response.");
 }
 
+// Chat-completions chunks carry the text in choices[0].delta.content.
+static std::string parse_chat_completion_chunk(const json& event, const char* provider)
+{
+    if (event.contains("error"))
+    {
+        const auto& err = event["error"];
+        throw std::runtime_error(std::string(provider) + " API Error: " + (err.is_object() ? err.value("message", err.dump()) : err.dump()));
+    }
+
+    const auto choices = event.value("choices", json::array());
+    if (choices.empty() || !choices[0].is_object())
+        return "";
+
+    const auto delta = choices[0].value("delta", json::object());
+    if (!delta.is_object() || !delta.contains("content") || !delta["content"].is_string())
+        return "";
+    return delta["content"].get<std::string>();
+}
+
+// Tool calling in the chat-completions format, shared by OpenAI, OpenRouter and Copilot.
+static json chat_agent_messages(const std::string& prompt_text)
+{
+    return json::array({
+        {{"role", "system"}, {"content", BASE_PROMPT}},
+        {{"role", "user"}, {"content", prompt_text}},
+    });
+}
+
+static void set_chat_agent_payload(json& payload, const json& messages, bool allow_calls)
+{
+    payload["messages"] = messages;
+    json tools = json::array();
+    for (const auto& spec : agent::tool_specs())
+    {
+        tools.push_back({ {"type", "function"},
+            {"function", {{"name", spec.name}, {"description", spec.description}, {"parameters", spec.parameters}}} });
+    }
+    payload["tools"] = tools;
+    payload["tool_choice"] = allow_calls ? "auto" : "none";
+}
+
+static bool parse_chat_tool_calls(const json& jres, agent::reply_t* reply)
+{
+    const auto choices = jres.value("choices", json::array());
+    if (choices.empty() || !choices[0].is_object())
+        return false;
+    const auto message = choices[0].value("message", json::object());
+    const auto calls = message.value("tool_calls", json::array());
+    if (!calls.is_array() || calls.empty())
+        return false;
+
+    for (const auto& call : calls)
+    {
+        const auto function = call.value("function", json::object());
+        agent::tool_call_t tc;
+        tc.id = call.value("id", "");
+        tc.name = function.value("name", "");
+        // The arguments arrive as a JSON document inside a string.
+        const auto args = function.value("arguments", json());
+        tc.args = args.is_string() ? json::parse(args.get<std::string>(), nullptr, false) : args;
+        if (!tc.args.is_object())
+            tc.args = json::object();
+        reply->calls.push_back(std::move(tc));
+    }
+    reply->message = message;
+    return true;
+}
+
+static void append_chat_tool_results(json& messages, const agent::reply_t& reply, const std::vector<std::string>& results)
+{
+    messages.push_back(reply.message);
+    for (size_t i = 0; i < reply.calls.size(); ++i)
+        messages.push_back({ {"role", "tool"}, {"tool_call_id", reply.calls[i].id}, {"content", results[i]} });
+}
+
+std::string OpenAIClient::_parse_stream_event(const json& event) const
+{
+    return parse_chat_completion_chunk(event, "OpenAI");
+}
+
+json OpenAIClient::_agent_messages(const std::string& prompt_text) const
+{
+    return chat_agent_messages(prompt_text);
+}
+
+json OpenAIClient::_get_agent_payload(const json& messages, bool allow_calls, double temperature) const
+{
+    json payload = _get_api_payload(std::string(), temperature);
+    set_chat_agent_payload(payload, messages, allow_calls);
+    return payload;
+}
+
+agent::reply_t OpenAIClient::_parse_agent_response(const json& jres) const
+{
+    agent::reply_t reply;
+    if (!parse_chat_tool_calls(jres, &reply))
+        reply.text = _parse_api_response(jres);
+    return reply;
+}
+
+void OpenAIClient::_append_tool_results(json& messages, const agent::reply_t& reply, const std::vector<std::string>& results) const
+{
+    append_chat_tool_results(messages, reply, results);
+}
+
 OpenRouterClient::OpenRouterClient(const settings_t& settings) : OpenAIClient(settings)
 {
     _model_name = _settings.openrouter_model_name;
@@ -755,6 +1441,80 @@ std::string AnthropicClient::_parse_api_response(const json& jres) const
     return result_text;
 }
 
+std::string AnthropicClient::_parse_stream_event(const json& event) const
+{
+    const std::string type = event.value("type", "");
+    if (type == "error")
+    {
+        const auto err = event.value("error", json::object());
+        throw std::runtime_error("Anthropic API Error: " + err.value("message", event.dump()));
+    }
+
+    // Thinking and tool-input deltas are not part of the answer text.
+    if (type != "content_block_delta")
+        return "";
+    const auto delta = event.value("delta", json::object());
+    if (delta.value("type", "") != "text_delta")
+        return "";
+    return delta.value("text", "");
+}
+
+json AnthropicClient::_agent_messages(const std::string& prompt_text) const
+{
+    return json::array({ {{"role", "user"}, {"content", prompt_text}} });
+}
+
+json AnthropicClient::_get_agent_payload(const json& messages, bool allow_calls, double temperature) const
+{
+    json payload = _get_api_payload(std::string(), temperature);
+    payload["messages"] = messages;
+    json tools = json::array();
+    for (const auto& spec : agent::tool_specs())
+        tools.push_back({ {"name", spec.name}, {"description", spec.description}, {"input_schema", spec.parameters} });
+    payload["tools"] = tools;
+    payload["tool_choice"] = { {"type", allow_calls ? "auto" : "none"} };
+    return payload;
+}
+
+agent::reply_t AnthropicClient::_parse_agent_response(const json& jres) const
+{
+    agent::reply_t reply;
+    if (jres.value("stop_reason", "") != "tool_use")
+    {
+        reply.text = _parse_api_response(jres);
+        return reply;
+    }
+
+    const auto content = jres.value("content", json::array());
+    for (const auto& block : content)
+    {
+        if (!block.is_object() || block.value("type", "") != "tool_use")
+            continue;
+        agent::tool_call_t call;
+        call.id = block.value("id", "");
+        call.name = block.value("name", "");
+        call.args = block.value("input", json::object());
+        reply.calls.push_back(std::move(call));
+    }
+    if (reply.calls.empty())
+    {
+        reply.text = _parse_api_response(jres);
+        return reply;
+    }
+    // Thinking blocks stay in the message; the API wants them back with the tool results.
+    reply.message = { {"role", "assistant"}, {"content", content} };
+    return reply;
+}
+
+void AnthropicClient::_append_tool_results(json& messages, const agent::reply_t& reply, const std::vector<std::string>& results) const
+{
+    messages.push_back(reply.message);
+    json blocks = json::array();
+    for (size_t i = 0; i < reply.calls.size(); ++i)
+        blocks.push_back({ {"type", "tool_result"}, {"tool_use_id", reply.calls[i].id}, {"content", results[i]} });
+    messages.push_back({ {"role", "user"}, {"content", blocks} });
+}
+
 CopilotClient::CopilotClient(const settings_t& settings) : AIClient(settings)
 {
     _model_name = _settings.copilot_model_name;
@@ -827,6 +1587,277 @@ std::string CopilotClient::_parse_api_response(const json& jres) const
     return message.value("content", "Error: 'content' field not found in API response.");
 }
 
+std::string CopilotClient::_parse_stream_event(const json& event) const
+{
+    return parse_chat_completion_chunk(event, "Copilot");
+}
+
+json CopilotClient::_agent_messages(const std::string& prompt_text) const
+{
+    return chat_agent_messages(prompt_text);
+}
+
+json CopilotClient::_get_agent_payload(const json& messages, bool allow_calls, double temperature) const
+{
+    json payload = _get_api_payload(std::string(), temperature);
+    set_chat_agent_payload(payload, messages, allow_calls);
+    return payload;
+}
+
+agent::reply_t CopilotClient::_parse_agent_response(const json& jres) const
+{
+    agent::reply_t reply;
+    if (!parse_chat_tool_calls(jres, &reply))
+        reply.text = _parse_api_response(jres);
+    return reply;
+}
+
+void CopilotClient::_append_tool_results(json& messages, const agent::reply_t& reply, const std::vector<std::string>& results) const
+{
+    append_chat_tool_results(messages, reply, results);
+}
+
+// Discovery runs on the worker thread, but a server that does not answer should fail the
+// request quickly rather than after the 10 s connect timeout of a real request.
+static const int LOCAL_DISCOVERY_TIMEOUT_SECS = 3;
+// Per slot, enough of its last prompt to rank slots by shared prefix.
+static const size_t MAX_SLOT_PREFIX = 64 * 1024;
+// Shorter shared prefixes (a common template opening) are not worth evicting a warm slot for.
+static const size_t MIN_SLOT_AFFINITY = 256;
+
+LocalClient::LocalClient(const settings_t& settings) : AIClient(settings)
+{
+    _model_name = _settings.local_model_name;
+}
+
+bool LocalClient::is_available() const
+{
+    return !_settings.local_server_address.empty();
+}
+
+std::string LocalClient::_get_api_host() const { return _settings.local_server_address; }
+std::string LocalClient::_get_api_path(const std::string&) const { return "/v1/chat/completions"; }
+httplib::Headers LocalClient::_get_api_headers() const { return {{"Content-Type", "application/json"}}; }
+json LocalClient::_get_api_payload(const std::string& prompt_text, double temperature) const
+{
+    json payload = {
+        {"messages", {
+            {{"role", "system"}, {"content", BASE_PROMPT}},
+            {{"role", "user"}, {"content", prompt_text}}
+        }},
+        {"temperature", temperature}
+    };
+    // llama.cpp serves whatever it loaded and ignores the name; vLLM requires it.
+    if (!_model_name.empty())
+        payload["model"] = _model_name;
+    // Keep the evaluated prompt in the slot, so the next request only evaluates what differs.
+    if (_llama_cpp)
+        payload["cache_prompt"] = true;
+    return payload;
+}
+
+std::string LocalClient::_parse_api_response(const json& jres) const
+{
+    if (jres.contains("error"))
+    {
+        const auto& err = jres["error"];
+        std::string error_msg = "Local server error: " + (err.is_object() ? err.value("message", err.dump()) : err.dump());
+        msg("AiDA: %s\n", error_msg.c_str());
+        return "Error: " + error_msg;
+    }
+
+    const auto choices = jres.value("choices", json::array());
+    if (choices.empty() || !choices[0].is_object())
+    {
+        msg("AiDA: Invalid local server response: 'choices' array is missing or empty.\nResponse body: %s\n", jres.dump(2).c_str());
+        return "Error: Received invalid 'choices' array from API.";
+    }
+
+    const auto& first_choice = choices[0];
+    std::string finish_reason = first_choice.value("finish_reason", "UNKNOWN");
+    if (finish_reason != "stop")
+    {
+        // "length" here usually means the server's context size (-c) is too small for the prompt.
+        msg("AiDA: Local server returned a non-STOP finish reason: %s\n", finish_reason.c_str());
+        return "Error: API request finished unexpectedly. Reason: " + finish_reason;
+    }
+
+    const auto message = first_choice.value("message", json::object());
+    if (!message.is_object())
+    {
+        msg("AiDA: Invalid local server response: 'message' object is missing or invalid.\nResponse body: %s\n", jres.dump(2).c_str());
+        return "Error: Received invalid 'message' object from API.";
+    }
+
+    return message.value("content", "Error: 'content' field not found in API response.");
+}
+
+std::string LocalClient::_parse_stream_event(const json& event) const
+{
+    return parse_chat_completion_chunk(event, "Local server");
+}
+
+bool LocalClient::_discover(std::string* error)
+{
+    std::lock_guard<std::mutex> lock(_discover_mutex);
+    if (_discovered)
+        return true;
+
+    const std::string host = _get_api_host();
+    httplib::Client cli(host.c_str());
+    cli.set_connection_timeout(LOCAL_DISCOVERY_TIMEOUT_SECS);
+    cli.set_read_timeout(LOCAL_DISCOVERY_TIMEOUT_SECS);
+
+    // llama.cpp answers 503 until the model is loaded; vLLM answers 200 once it serves.
+    auto health = cli.Get("/health");
+    if (!health)
+    {
+        *error = "Local server at " + host + " is not reachable (" + httplib::to_string(health.error()) + ").";
+        return false;
+    }
+    if (health->status == 503)
+    {
+        *error = "Local server at " + host + " is still loading its model.";
+        return false;
+    }
+
+    // Only llama.cpp has /props. total_slots is its --parallel: each slot has its own
+    // context and prompt cache, and requests beyond that number wait in its queue.
+    size_t slots = 0;
+    auto props = cli.Get("/props");
+    if (props && props->status == 200)
+    {
+        json j = json::parse(props->body, nullptr, false);
+        if (j.is_object() && j.contains("total_slots") && j["total_slots"].is_number_unsigned())
+        {
+            slots = j["total_slots"].get<size_t>();
+            _llama_cpp = true;
+        }
+    }
+
+    if (_model_name.empty())
+    {
+        auto models = cli.Get("/v1/models");
+        if (models && models->status == 200)
+        {
+            json j = json::parse(models->body, nullptr, false);
+            if (j.is_object() && j.contains("data") && j["data"].is_array() && !j["data"].empty() && j["data"][0].is_object())
+                _model_name = j["data"][0].value("id", "");
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> slot_lock(_slot_mutex);
+        _slots.assign(slots, slot_t());
+    }
+    _discovered = true;
+
+    msg("AI Assistant: Local server at %s is up; model: %s, slots: %s.\n",
+        host.c_str(),
+        _model_name.empty() ? "(server default)" : _model_name.c_str(),
+        slots != 0 ? std::to_string(slots).c_str() : "not reported");
+    return true;
+}
+
+size_t LocalClient::_parallel_slots()
+{
+    std::string error;
+    if (!_discover(&error))
+        return 0;
+    std::lock_guard<std::mutex> lock(_slot_mutex);
+    return _slots.size();
+}
+
+int LocalClient::_acquire_slot(const std::string& prompt_text)
+{
+    std::unique_lock<std::mutex> lock(_slot_mutex);
+    if (_slots.empty())
+        return -1;
+
+    for (;;)
+    {
+        // The idle slot sharing the longest prefix with the prompt; failing that, the one
+        // idle longest, whose cache is the least likely to be wanted again.
+        int best = -1;
+        size_t best_shared = 0;
+        for (size_t i = 0; i < _slots.size(); ++i)
+        {
+            const slot_t& slot = _slots[i];
+            if (slot.busy)
+                continue;
+            const size_t n = std::min(slot.prefix.size(), prompt_text.size());
+            size_t shared = std::mismatch(slot.prefix.begin(), slot.prefix.begin() + n, prompt_text.begin()).first - slot.prefix.begin();
+            if (shared < MIN_SLOT_AFFINITY)
+                shared = 0;
+            if (best < 0 || shared > best_shared || (shared == best_shared && slot.last_used < _slots[best].last_used))
+            {
+                best = (int)i;
+                best_shared = shared;
+            }
+        }
+        if (best >= 0)
+        {
+            _slots[best].busy = true;
+            return best;
+        }
+        if (_cancelled.load())
+            return -2;
+        _slot_cv.wait_for(lock, std::chrono::milliseconds(250));
+    }
+}
+
+void LocalClient::_release_slot(int slot, const std::string& prompt_text, bool evaluated)
+{
+    if (slot < 0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_slot_mutex);
+        slot_t& s = _slots[slot];
+        s.busy = false;
+        // After a failure the slot's cache is unknown; rank it as cold.
+        if (evaluated)
+            s.prefix.assign(prompt_text, 0, std::min(prompt_text.size(), MAX_SLOT_PREFIX));
+        else
+            s.prefix.clear();
+        s.last_used = ++_slot_clock;
+    }
+    _slot_cv.notify_one();
+}
+
+std::string LocalClient::_blocking_generate(const std::string& prompt_text, double temperature, stream_callback_t on_delta)
+{
+    if (!is_available())
+        return "Error: AI client is not initialized. Check the local server address.";
+
+    std::string error;
+    if (!_discover(&error))
+    {
+        msg("AI Assistant: %s\n", error.c_str());
+        return "Error: " + error;
+    }
+
+    const int slot = _acquire_slot(prompt_text);
+    if (slot == -2)
+        return "Error: Operation cancelled.";
+
+    json payload = _get_api_payload(PROMPT_SLOT, temperature);
+    if (slot >= 0)
+        payload["id_slot"] = slot;
+
+    std::string result;
+    try
+    {
+        result = _send_generate(std::move(payload), prompt_text, on_delta);
+    }
+    catch (...)
+    {
+        _release_slot(slot, prompt_text, false);
+        throw;
+    }
+    _release_slot(slot, prompt_text, result.rfind("Error:", 0) != 0);
+    return result;
+}
+
 std::unique_ptr<AIClient> get_ai_client(const settings_t& settings)
 {
     qstring provider = ida_utils::qstring_tolower(settings.api_provider.c_str());
@@ -853,9 +1884,24 @@ std::unique_ptr<AIClient> get_ai_client(const settings_t& settings)
     {
         return std::make_unique<CopilotClient>(settings);
     }
+    else if (provider == "local")
+    {
+        return std::make_unique<LocalClient>(settings);
+    }
     else
     {
         warning("AI Assistant: Unknown AI provider '%s' in settings. No AI features will be available.", provider.c_str());
         return nullptr;
     }
-}
\ No newline at end of file
+}
+
+// Here rather than in aida.cpp so that aida_cli, which links everything but the
+// plugin entry point, can still run the settings dialog code that calls it.
+void aida_plugin_t::reinit_ai_client()
+{
+    ai_client = get_ai_client(g_settings);
+    if (!ai_client || !ai_client->is_available())
+    {
+        msg("AI Assistant: No AI client is available. AI features will be limited.\n");
+    }
+}
@@ -7,18 +7,24 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <chrono>
 
 #include <ida.hpp>
 #include <kernwin.hpp>
 namespace httplib { class Client; }
 #include "settings.hpp"
+#include "agent.hpp"
 
 class AIClientBase
 {
 public:
     using callback_t = std::function<void(const std::string&)>;
     using addr_callback_t = std::function<void(ea_t)>;
+    using addr_list_callback_t = std::function<void(const std::vector<ea_t>&)>;
+    using text_list_callback_t = std::function<void(const std::vector<std::string>&)>;
+    // Receives response text as it arrives, on the request's worker thread.
+    using stream_callback_t = std::function<void(const std::string&)>;
 
     virtual ~AIClientBase() = default;
 
@@ -26,11 +32,20 @@ public:
     virtual void analyze_function(ea_t ea, callback_t callback) = 0;
     virtual void suggest_name(ea_t ea, callback_t callback) = 0;
     virtual void generate_struct(ea_t ea, callback_t callback) = 0;
-    virtual void generate_comments(ea_t ea, callback_t callback) = 0;
+    virtual void generate_comments(ea_t ea, callback_t callback, stream_callback_t on_delta = nullptr) = 0;
     virtual void generate_hook(ea_t ea, callback_t callback) = 0;
     virtual void custom_query(ea_t ea, const std::string& question, callback_t callback) = 0;
     virtual void locate_global_pointer(ea_t ea, const std::string& target_name, addr_callback_t callback) = 0;
-    virtual void rename_all(ea_t ea, callback_t callback) = 0;
+    // Asks about several functions at once; the callback gets one address per function
+    // (BADADDR where nothing was found), in the same order.
+    virtual void locate_global_pointer_batch(const std::vector<ea_t>& func_eas, const std::string& target_name, addr_list_callback_t callback) = 0;
+    virtual void rename_all(ea_t ea, callback_t callback, stream_callback_t on_delta = nullptr) = 0;
+    // One request for a whole class: every method of the vtable, its constructors and the merged member accesses.
+    virtual void reconstruct_class(ea_t vtable_ea, const std::vector<ea_t>& methods, const std::string& class_info, callback_t callback) = 0;
+    // Whole-binary query. The map step sends one request per digest shard (in parallel) and
+    // reports the raw answers in shard order; the reduce step answers over the shortlist's code.
+    virtual void query_map(const std::string& question, const std::vector<std::string>& shards, size_t func_count, text_list_callback_t callback) = 0;
+    virtual void query_reduce(const std::string& question, const std::string& candidates, size_t func_count, callback_t callback) = 0;
 };
 
 class AIClient : public AIClientBase
@@ -42,18 +57,40 @@ public:
     void analyze_function(ea_t ea, callback_t callback) override;
     void suggest_name(ea_t ea, callback_t callback) override;
     void generate_struct(ea_t ea, callback_t callback) override;
-    void generate_comments(ea_t ea, callback_t callback) override;
+    void generate_comments(ea_t ea, callback_t callback, stream_callback_t on_delta = nullptr) override;
     void generate_hook(ea_t ea, callback_t callback) override;
     void custom_query(ea_t ea, const std::string& question, callback_t callback) override;
     void locate_global_pointer(ea_t ea, const std::string& target_name, addr_callback_t callback) override;
-    void rename_all(ea_t ea, callback_t callback) override;
+    void locate_global_pointer_batch(const std::vector<ea_t>& func_eas, const std::string& target_name, addr_list_callback_t callback) override;
+    void rename_all(ea_t ea, callback_t callback, stream_callback_t on_delta = nullptr) override;
+    void reconstruct_class(ea_t vtable_ea, const std::vector<ea_t>& methods, const std::string& class_info, callback_t callback) override;
+    void query_map(const std::string& question, const std::vector<std::string>& shards, size_t func_count, text_list_callback_t callback) override;
+    void query_reduce(const std::string& question, const std::string& candidates, size_t func_count, callback_t callback) override;
 
     void cancel_current_request();
 
+    // Sends the prompts on up to `parallel` threads and returns the answers in prompt order,
+    // blocking the caller. For headless runs, which have no UI loop to deliver callbacks;
+    // nothing here touches the database, so the caller may hold the main thread.
+    std::vector<std::string> generate_parallel(const std::vector<std::string>& prompts, double temperature, size_t parallel, std::function<void(size_t done)> on_progress = nullptr);
+
+    // Running totals since the client was created; the difference of two snapshots is the
+    // cost of whatever ran in between. Sizes are in characters, not provider tokens.
+    struct usage_t
+    {
+        size_t requests = 0;
+        size_t prompt_chars = 0;
+        size_t response_chars = 0;
+    };
+    usage_t usage() const;
+
     std::atomic<bool> _task_done{false};
     std::atomic<bool> _is_request_active{false};
     qstring _current_request_type;
     std::atomic<int> _elapsed_secs{0};
+    // Progress of a parallel batch, for the status timer; 0 total for single requests.
+    std::atomic<int> _batch_total{0};
+    std::atomic<int> _batch_done{0};
 
 protected:
     const settings_t& _settings;
@@ -62,26 +99,75 @@ protected:
     std::thread _worker_thread;
     std::mutex _worker_thread_mutex;
 
-    std::shared_ptr<httplib::Client> _http_client;
+    // Every client with a request in flight, so cancelling stops parallel requests too.
+    std::vector<std::shared_ptr<httplib::Client>> _http_clients;
     std::mutex _http_client_mutex;
 
     std::atomic<bool> _cancelled{false};
 
-    void _generate(const std::string& prompt_text, callback_t callback, double temperature, const qstring& request_type);
-    std::string _blocking_generate(const std::string& prompt_text, double temperature);
+    std::atomic<size_t> _requests_sent{0};
+    std::atomic<size_t> _prompt_chars{0};
+    std::atomic<size_t> _response_chars{0};
+
+    using batch_callback_t = std::function<void(const std::vector<std::string>&)>;
+
+    std::shared_ptr<httplib::Client> _open_client(const std::string& host);
+    void _close_client(const std::shared_ptr<httplib::Client>& client);
+    void _start_worker(std::function<std::string()> work, callback_t callback, const qstring& request_type, int batch_total = 0);
+    // Prompts are taken by value; callers move them in so a large one is never copied.
+    void _generate(std::string prompt_text, callback_t callback, double temperature, const qstring& request_type, stream_callback_t on_delta = nullptr);
+    // Runs the prompts in parallel and reports all results together, in prompt order.
+    void _generate_batch(std::vector<std::string> prompts, batch_callback_t callback, double temperature, const qstring& request_type);
+    virtual std::string _blocking_generate(const std::string& prompt_text, double temperature, stream_callback_t on_delta = nullptr);
+    // The send half of _blocking_generate, for overrides that adjust the envelope first.
+    std::string _send_generate(nlohmann::json payload, const std::string& prompt_text, stream_callback_t on_delta);
+    // Requests the server can work on at once; generate_parallel never runs more. 0 = unknown.
+    virtual size_t _parallel_slots() { return 0; }
+    // Agent mode: a small prompt, then as many tool-call turns as the model needs (up to
+    // agent_max_turns). Tools run on the main thread; func_ea is the function under analysis.
+    bool _use_agent() const;
+    // HTTP/2 when it is compiled in and enabled and host is https://; otherwise one httplib
+    // connection per request.
+    bool _use_http2(const std::string& host) const;
+    void _generate_agent(ea_t func_ea, std::string prompt_text, callback_t callback, double temperature, const qstring& request_type);
+    std::string _blocking_agent(ea_t func_ea, const std::string& prompt_text, double temperature);
     std::string _http_post_request(
         const std::string& host,
         const std::string& path,
         const httplib::Headers& headers,
-        const std::string& body,
+        std::string body,
         std::function<std::string(const nlohmann::json&)> response_parser);
+    std::string _http_stream_request(
+        const std::string& host,
+        const std::string& path,
+        const httplib::Headers& headers,
+        std::string body,
+        stream_callback_t on_delta);
 protected:
     virtual std::string _get_api_host() const = 0;
     virtual std::string _get_api_path(const std::string& model_name) const = 0;
     virtual httplib::Headers _get_api_headers() const = 0;
+    // The request envelope. _blocking_generate passes PROMPT_SLOT as prompt_text and writes
+    // the escaped prompt into its place in the serialized body, so the prompt text must go
+    // into exactly one string value, unchanged.
     virtual nlohmann::json _get_api_payload(const std::string& prompt_text, double temperature) const = 0;
     virtual std::string _parse_api_response(const nlohmann::json& response) const = 0;
 
+    // Streaming (server-sent events). _parse_stream_event returns the text delta carried by
+    // one event and throws std::runtime_error if the event reports an error.
+    virtual std::string _get_stream_path(const std::string& model_name) const { return _get_api_path(model_name); }
+    virtual void _set_stream_payload(nlohmann::json& payload) const { payload["stream"] = true; }
+    virtual std::string _parse_stream_event(const nlohmann::json& event) const = 0;
+
+    // Tool calling. Providers that keep these defaults never enter agent mode and get the
+    // full context instead.
+    virtual bool _supports_tools() const { return false; }
+    virtual nlohmann::json _agent_messages(const std::string& /*prompt_text*/) const { return nlohmann::json::array(); }
+    virtual nlohmann::json _get_agent_payload(const nlohmann::json& /*messages*/, bool /*allow_calls*/, double /*temperature*/) const { return {}; }
+    // Either the tool calls of the turn or, when there are none, the answer text (or an "Error: ..." string).
+    virtual agent::reply_t _parse_agent_response(const nlohmann::json& /*response*/) const { return {}; }
+    virtual void _append_tool_results(nlohmann::json& /*messages*/, const agent::reply_t& /*reply*/, const std::vector<std::string>& /*results*/) const {}
+
 private:
     std::shared_ptr<void> _validity_token;
     
@@ -99,6 +185,14 @@ protected:
     httplib::Headers _get_api_headers() const override;
     nlohmann::json _get_api_payload(const std::string& prompt_text, double temperature) const override;
     std::string _parse_api_response(const nlohmann::json& response) const override;
+    std::string _get_stream_path(const std::string& model_name) const override;
+    void _set_stream_payload(nlohmann::json& payload) const override;
+    std::string _parse_stream_event(const nlohmann::json& event) const override;
+    bool _supports_tools() const override { return true; }
+    nlohmann::json _agent_messages(const std::string& prompt_text) const override;
+    nlohmann::json _get_agent_payload(const nlohmann::json& messages, bool allow_calls, double temperature) const override;
+    agent::reply_t _parse_agent_response(const nlohmann::json& response) const override;
+    void _append_tool_results(nlohmann::json& messages, const agent::reply_t& reply, const std::vector<std::string>& results) const override;
 };
 
 class OpenAIClient : public AIClient
@@ -112,6 +206,12 @@ protected:
     httplib::Headers _get_api_headers() const override;
     nlohmann::json _get_api_payload(const std::string& prompt_text, double temperature) const override;
     std::string _parse_api_response(const nlohmann::json& response) const override;
+    std::string _parse_stream_event(const nlohmann::json& event) const override;
+    bool _supports_tools() const override { return true; }
+    nlohmann::json _agent_messages(const std::string& prompt_text) const override;
+    nlohmann::json _get_agent_payload(const nlohmann::json& messages, bool allow_calls, double temperature) const override;
+    agent::reply_t _parse_agent_response(const nlohmann::json& response) const override;
+    void _append_tool_results(nlohmann::json& messages, const agent::reply_t& reply, const std::vector<std::string>& results) const override;
 };
 
 class OpenRouterClient : public OpenAIClient
@@ -136,6 +236,12 @@ protected:
     httplib::Headers _get_api_headers() const override;
     nlohmann::json _get_api_payload(const std::string& prompt_text, double temperature) const override;
     std::string _parse_api_response(const nlohmann::json& response) const override;
+    std::string _parse_stream_event(const nlohmann::json& event) const override;
+    bool _supports_tools() const override { return true; }
+    nlohmann::json _agent_messages(const std::string& prompt_text) const override;
+    nlohmann::json _get_agent_payload(const nlohmann::json& messages, bool allow_calls, double temperature) const override;
+    agent::reply_t _parse_agent_response(const nlohmann::json& response) const override;
+    void _append_tool_results(nlohmann::json& messages, const agent::reply_t& reply, const std::vector<std::string>& results) const override;
 };
 
 class CopilotClient : public AIClient
@@ -149,6 +255,54 @@ protected:
     httplib::Headers _get_api_headers() const override;
     nlohmann::json _get_api_payload(const std::string& prompt_text, double temperature) const override;
     std::string _parse_api_response(const nlohmann::json& response) const override;
+    std::string _parse_stream_event(const nlohmann::json& event) const override;
+    bool _supports_tools() const override { return true; }
+    nlohmann::json _agent_messages(const std::string& prompt_text) const override;
+    nlohmann::json _get_agent_payload(const nlohmann::json& messages, bool allow_calls, double temperature) const override;
+    agent::reply_t _parse_agent_response(const nlohmann::json& response) const override;
+    void _append_tool_results(nlohmann::json& messages, const agent::reply_t& reply, const std::vector<std::string>& results) const override;
+};
+
+// llama.cpp server, vLLM or any other OpenAI-compatible server on the local machine or
+// network. A llama.cpp server's slots are leased out so a prompt goes to the slot whose
+// cached prompt shares the longest prefix with it and only the differing tail is evaluated.
+class LocalClient : public AIClient
+{
+public:
+    LocalClient(const settings_t& settings);
+    bool is_available() const override;
+protected:
+    std::string _blocking_generate(const std::string& prompt_text, double temperature, stream_callback_t on_delta = nullptr) override;
+    size_t _parallel_slots() override;
+    std::string _get_api_host() const override;
+    std::string _get_api_path(const std::string& model_name) const override;
+    httplib::Headers _get_api_headers() const override;
+    nlohmann::json _get_api_payload(const std::string& prompt_text, double temperature) const override;
+    std::string _parse_api_response(const nlohmann::json& response) const override;
+    std::string _parse_stream_event(const nlohmann::json& event) const override;
+private:
+    struct slot_t
+    {
+        bool busy = false;
+        std::string prefix;     // start of the last prompt the slot evaluated
+        uint64_t last_used = 0;
+    };
+
+    std::mutex _discover_mutex;
+    bool _discovered = false;
+    bool _llama_cpp = false;    // the server understands cache_prompt and id_slot
+
+    std::mutex _slot_mutex;
+    std::condition_variable _slot_cv;
+    std::vector<slot_t> _slots;
+    uint64_t _slot_clock = 0;
+
+    // Health, slot count and model name, asked once the server is up. False with *error set
+    // while it is unreachable or still loading; the next request asks again.
+    bool _discover(std::string* error);
+    // Waits for an idle slot and takes it: -1 when the server has no slots, -2 when cancelled.
+    int _acquire_slot(const std::string& prompt_text);
+    void _release_slot(int slot, const std::string& prompt_text, bool evaluated);
 };
 
 std::unique_ptr<AIClient> get_ai_client(const settings_t& settings);
\ No newline at end of file
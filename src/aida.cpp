@@ -7,25 +7,28 @@ aida_plugin_t::aida_plugin_t()
     reinit_ai_client();
     register_actions();
     hook_to_notification_point(HT_UI, ui_callback, this);
+    if (!g_settings.rpc_listen.empty())
+    {
+        rpc_server = std::make_unique<rpc::server_t>();
+        rpc_server->start(g_settings.rpc_listen);
+    }
     msg("--- AI Assistant Plugin Loaded Successfully ---\n");
 }
 
 aida_plugin_t::~aida_plugin_t()
 {
+    // Before anything it calls into goes away.
+    rpc_server.reset();
     unhook_from_notification_point(HT_UI, ui_callback, this);
     unregister_actions();
+    // Drops the pending repaint timer, whose callback lives in this module.
+    ida_utils::flush_refresh();
+    // The client's requests may be streams on the shared HTTP/2 transport; it goes first.
+    ai_client.reset();
+    http2::shutdown();
     msg("--- AI Assistant Plugin has been unloaded ---\n");
 }
 
-void aida_plugin_t::reinit_ai_client()
-{
-    ai_client = get_ai_client(g_settings);
-    if (!ai_client || !ai_client->is_available())
-    {
-        msg("AI Assistant: No AI client is available. AI features will be limited.\n");
-    }
-}
-
 bool idaapi aida_plugin_t::run(size_t /*arg*/)
 {
     info("AI Assistant is active. Use the right-click context menu in a code view or Tools->AI Assistant.");
@@ -46,11 +49,20 @@ void aida_plugin_t::register_actions()
         {"ai_assistant:rename", "Suggest new name...", handle_rename_function, "Ctrl+Alt+S"},
         {"ai_assistant:comment", "Add AI-generated comments", handle_auto_comment, "Ctrl+Alt+C"},
         {"ai_assistant:gen_struct", "Generate struct from function", handle_generate_struct, "Ctrl+Alt+G"},
+        {"ai_assistant:reconstruct_class", "Reconstruct class from vtable", handle_reconstruct_class, ""},
         {"ai_assistant:gen_hook", "Generate MinHook C++ snippet", handle_generate_hook, "Ctrl+Alt+H"},
+        {"ai_assistant:gen_signature", "Generate unique signature", handle_generate_signature, ""},
+        {"ai_assistant:gen_signatures_batch", "Generate signatures for all functions...", handle_generate_signatures_batch, ""},
         {"ai_assistant:custom_query", "Custom query...", handle_custom_query, "Ctrl+Alt+Q"},
+        {"ai_assistant:global_query", "Query whole binary...", handle_global_query, ""},
         {"ai_assistant:copy_context", "Copy Context", handle_copy_context, "Ctrl+Alt+X"},
+        {"ai_assistant:export_contexts", "Export contexts...", handle_export_contexts, ""},
+        {"ai_assistant:import_results", "Import results...", handle_import_results, ""},
         {"ai_assistant:rename_all", "Rename variables/functions...", handle_rename_all, "Ctrl+Alt+R"},
-        {"ai_assistant:scan_for_offsets", "Scan for Engine Pointers (Coming Soon!)", handle_scan_for_offsets, ""},
+        {"ai_assistant:scan_for_offsets", "Scan for Engine Pointers", handle_scan_for_offsets, ""},
+        {"ai_assistant:scan_rtti", "Scan RTTI and name classes", handle_scan_rtti, ""},
+        {"ai_assistant:ue_reflection", "Apply Unreal reflection names...", handle_unreal_reflection, ""},
+        {"ai_assistant:review_queue", "Review queued changes...", handle_show_review_queue, ""},
         {"ai_assistant:settings", "Settings...", handle_show_settings, "Ctrl+Alt+O"},
     };
 
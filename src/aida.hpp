@@ -8,11 +8,13 @@
 #include <loader.hpp>
 
 class AIClient;
+namespace rpc { class server_t; }
 
 class aida_plugin_t : public plugmod_t
 {
 public:
     std::unique_ptr<AIClient> ai_client;
+    std::unique_ptr<rpc::server_t> rpc_server;
     qstrvec_t actions_list;
 
     aida_plugin_t();
@@ -91,8 +91,17 @@
 
 #include "settings.hpp"
 #include "prompts.hpp"
+#include "agent.hpp"
 #include "ai_client.hpp"
+#include "http2.hpp"
 #include "ida_utils.hpp"
+#include "review_queue.hpp"
+#include "global_query.hpp"
+#include "exchange.hpp"
+#include "scanner.hpp"
+#include "rtti.hpp"
+#include "unreal.hpp"
+#include "rpc_server.hpp"
 #include "ui.hpp"
 #include "actions.hpp"
 #include "aida.hpp"
\ No newline at end of file
@@ -0,0 +1,329 @@
+#include "aida_pro.hpp"
+#include <algorithm>
+
+using json = nlohmann::json;
+
+namespace exchange
+{
+    static const char BINARY_MAGIC[8] = { 'A', 'I', 'D', 'A', 'C', 'T', 'X', '1' };
+
+    // Records per undo step on import; large enough to amortise the undo point, small
+    // enough that one bad batch is cheap to undo by hand.
+    static const size_t IMPORT_BATCH = 256;
+
+    // Anything larger in a binary file is corruption, not a record.
+    static const uint32 MAX_RECORD = 256 * 1024 * 1024;
+
+    static void md5_function(ea_t func_ea, uchar digest[16])
+    {
+        MD5_CTX md5;
+        MD5Init(&md5);
+        func_t* pfn = get_func(func_ea);
+        if (pfn != nullptr)
+        {
+            bytevec_t bytes;
+            func_tail_iterator_t fti(pfn);
+            for (bool ok = fti.main(); ok; ok = fti.next())
+            {
+                const range_t& chunk = fti.chunk();
+                bytes.resize(chunk.size());
+                ssize_t got = get_bytes(bytes.begin(), chunk.size(), chunk.start_ea, GMB_READALL);
+                if (got > 0)
+                    MD5Update(&md5, bytes.begin(), got);
+            }
+        }
+        MD5Final(digest, &md5);
+    }
+
+    static std::string to_hex(const uchar* data, size_t size)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(size * 2);
+        for (size_t i = 0; i < size; ++i)
+        {
+            out += digits[data[i] >> 4];
+            out += digits[data[i] & 15];
+        }
+        return out;
+    }
+
+    std::string fingerprint(ea_t func_ea)
+    {
+        uchar digest[16];
+        md5_function(func_ea, digest);
+        return to_hex(digest, sizeof(digest));
+    }
+
+    static void put_le(uchar* out, uint64 value, int size)
+    {
+        for (int i = 0; i < size; ++i)
+            out[i] = (uchar)(value >> (8 * i));
+    }
+
+    static uint64 get_le(const uchar* in, int size)
+    {
+        uint64 value = 0;
+        for (int i = size - 1; i >= 0; --i)
+            value = (value << 8) | in[i];
+        return value;
+    }
+
+    bool export_contexts(const char* path, const std::vector<ea_t>& funcs, format_t format, bool struct_context, export_stats_t* stats, progress_t progress)
+    {
+        FILE* fp = qfopen(path, "wb");
+        if (fp == nullptr)
+        {
+            warning("AiDA: Failed to open %s for writing.", path);
+            return false;
+        }
+        file_janitor_t fj(fp);
+
+        if (format == FORMAT_BINARY && qfwrite(fp, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != sizeof(BINARY_MAGIC))
+            return false;
+
+        for (size_t i = 0; i < funcs.size(); ++i)
+        {
+            if (progress && !progress(i))
+                break;
+
+            const ea_t ea = funcs[i];
+            json context = ida_utils::get_context_for_prompt(ea, struct_context);
+            if (!context.value("ok", false))
+            {
+                stats->skipped++;
+                continue;
+            }
+            context.erase("ok");
+
+            uchar digest[16];
+            md5_function(ea, digest);
+            qstring name;
+            get_func_name(&name, ea);
+            char ea_text[32];
+            qsnprintf(ea_text, sizeof(ea_text), "0x%llx", (uint64)ea);
+            json record = {
+                {"ea", ea_text},
+                {"name", name.c_str()},
+                {"md5", to_hex(digest, sizeof(digest))},
+                {"context", std::move(context)},
+            };
+            // Decompiler output can carry bytes that are not UTF-8; keep the file parseable.
+            const std::string text = record.dump(-1, ' ', false, json::error_handler_t::replace);
+
+            bool ok;
+            if (format == FORMAT_BINARY)
+            {
+                uchar header[28];
+                put_le(header, (uint64)ea, 8);
+                memcpy(header + 8, digest, sizeof(digest));
+                put_le(header + 24, text.size(), 4);
+                ok = qfwrite(fp, header, sizeof(header)) == sizeof(header)
+                    && qfwrite(fp, text.data(), text.size()) == (ssize_t)text.size();
+            }
+            else
+            {
+                ok = qfwrite(fp, text.data(), text.size()) == (ssize_t)text.size()
+                    && qfwrite(fp, "\n", 1) == 1;
+            }
+            if (!ok)
+            {
+                warning("AiDA: Failed to write to %s.", path);
+                return false;
+            }
+            stats->written++;
+        }
+        return true;
+    }
+
+    // Pulls one record at a time so the file never has to fit in memory.
+    class record_reader_t
+    {
+    public:
+        explicit record_reader_t(FILE* fp) : _fp(fp)
+        {
+            char magic[sizeof(BINARY_MAGIC)];
+            _binary = qfread(_fp, magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0;
+            if (!_binary)
+                qfseek(_fp, 0, SEEK_SET);
+        }
+
+        // False at the end of the file or on a truncated binary record; truncated() tells
+        // the two apart.
+        bool next(std::string* text)
+        {
+            if (!_binary)
+            {
+                qstring line;
+                while (qgetline(&line, _fp) >= 0)
+                {
+                    line.trim2();
+                    if (!line.empty())
+                    {
+                        *text = line.c_str();
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            uchar header[28];
+            const ssize_t got = qfread(_fp, header, sizeof(header));
+            if (got != sizeof(header))
+            {
+                _truncated = got > 0;
+                return false;
+            }
+            uint32 size = (uint32)get_le(header + 24, 4);
+            if (size > MAX_RECORD)
+            {
+                _truncated = true;
+                return false;
+            }
+            text->resize(size);
+            _truncated = size != 0 && qfread(_fp, &(*text)[0], size) != (ssize_t)size;
+            return !_truncated;
+        }
+
+        bool truncated() const { return _truncated; }
+
+    private:
+        FILE* _fp;
+        bool _binary = false;
+        bool _truncated = false;
+    };
+
+    static ea_t record_ea(const json& record)
+    {
+        if (!record.contains("ea"))
+            return BADADDR;
+        const json& value = record["ea"];
+        if (value.is_number_unsigned() || value.is_number_integer())
+            return (ea_t)value.get<uint64>();
+        if (!value.is_string())
+            return BADADDR;
+        const std::string text = value.get<std::string>();
+        char* end = nullptr;
+        uint64 ea = strtoull(text.c_str(), &end, 16);
+        return !text.empty() && *end == '\0' ? (ea_t)ea : BADADDR;
+    }
+
+    static void apply_record(const json& record, import_stats_t* stats)
+    {
+        const ea_t ea = record_ea(record);
+        func_t* pfn = ea != BADADDR ? get_func(ea) : nullptr;
+        if (pfn == nullptr || pfn->start_ea != ea)
+        {
+            stats->missing++;
+            return;
+        }
+        // Without the fingerprint there is no telling which version of the function it was for.
+        if (!record.contains("md5") || !record["md5"].is_string())
+        {
+            stats->bad++;
+            return;
+        }
+        if (ida_utils::qstring_tolower(record["md5"].get<std::string>().c_str()) != fingerprint(ea).c_str())
+        {
+            stats->stale++;
+            return;
+        }
+
+        if (record.contains("name") && record["name"].is_string())
+        {
+            qstring current;
+            get_func_name(&current, ea);
+            qstring name;
+            if (ida_utils::clean_function_name(record["name"].get<std::string>(), &name)
+                && name != current
+                && set_name(ea, name.c_str(), SN_FORCE | SN_NODUMMY | SN_NOWARN))
+            {
+                stats->names++;
+            }
+        }
+
+        if (record.contains("comments") && record["comments"].is_array())
+        {
+            std::vector<ida_utils::comment_suggestion_t> comments;
+            for (const auto& item : record["comments"])
+            {
+                ida_utils::comment_suggestion_t comment;
+                if (ida_utils::parse_comment_item(item, &comment))
+                    comments.push_back(std::move(comment));
+            }
+            stats->comments += ida_utils::apply_comments(ea, comments);
+        }
+
+        if (record.contains("renames") && record["renames"].is_string())
+        {
+            std::vector<ida_utils::rename_suggestion_t> renames = ida_utils::parse_rename_suggestions(record["renames"].get<std::string>());
+            if (!renames.empty())
+            {
+                std::vector<bool> applied;
+                ida_utils::apply_renames(ea, renames, &applied);
+                stats->renames += (int)std::count(applied.begin(), applied.end(), true);
+            }
+        }
+
+        if (record.contains("struct") && record["struct"].is_string())
+        {
+            std::string code = record["struct"].get<std::string>();
+            if (code.find("```") == std::string::npos)
+                code = "```cpp\n" + code + "\n```";
+            if (ida_utils::apply_struct_from_cpp(code, ea, ida_utils::STRUCT_CONFLICT_RENAME))
+                stats->structs++;
+        }
+    }
+
+    bool import_results(const char* path, import_stats_t* stats, progress_t progress)
+    {
+        FILE* fp = qfopen(path, "rb");
+        if (fp == nullptr)
+        {
+            warning("AiDA: Failed to open %s.", path);
+            return false;
+        }
+        file_janitor_t fj(fp);
+        record_reader_t reader(fp);
+
+        std::string text;
+        bool more = true;
+        while (more)
+        {
+            if (progress && !progress(stats->records))
+                break;
+
+            ida_utils::undo_batch_t batch("AiDA: import results");
+            for (size_t n = 0; n < IMPORT_BATCH; ++n)
+            {
+                if (!reader.next(&text))
+                {
+                    more = false;
+                    break;
+                }
+                stats->records++;
+                json record = json::parse(text, nullptr, false);
+                if (record.is_discarded() || !record.is_object())
+                {
+                    stats->bad++;
+                    continue;
+                }
+                try
+                {
+                    apply_record(record, stats);
+                }
+                catch (const std::exception&)
+                {
+                    stats->bad++;
+                }
+            }
+        }
+        ida_utils::flush_refresh();
+        if (reader.truncated())
+        {
+            warning("AiDA: %s is truncated at record %llu; the records before it were applied.", path, (uint64)stats->records + 1);
+            return false;
+        }
+        return true;
+    }
+}
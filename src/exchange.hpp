@@ -0,0 +1,53 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <ida.hpp>
+
+// Bulk context export and result import, so inference can run outside IDA.
+namespace exchange
+{
+    enum format_t
+    {
+        FORMAT_JSONL,    // one JSON object per line
+        FORMAT_BINARY,   // "AIDACTX1", then per record: ea (u64 LE), md5 (16 bytes), length (u32 LE), the same JSON
+    };
+
+    // Hex MD5 of the function's bytes, all chunks in address order. Results carry it back
+    // so nothing is applied to a function that changed after its context was exported.
+    std::string fingerprint(ea_t func_ea);
+
+    // Returns false from the progress callback to stop early.
+    using progress_t = std::function<bool(size_t done)>;
+
+    struct export_stats_t
+    {
+        size_t written = 0;
+        size_t skipped = 0;  // no context (e.g. decompilation failed)
+    };
+
+    // Writes {ea, name, md5, context} per function, where context has the fields the
+    // prompt templates use. Streams: only one function's context is held at a time.
+    bool export_contexts(const char* path, const std::vector<ea_t>& funcs, format_t format, bool struct_context, export_stats_t* stats, progress_t progress = nullptr);
+
+    struct import_stats_t
+    {
+        size_t records = 0;
+        size_t stale = 0;     // md5 differs from the function's current bytes
+        size_t missing = 0;   // no function at ea
+        size_t bad = 0;       // unparsable record, or one without an md5
+        int names = 0;
+        int comments = 0;
+        int renames = 0;
+        int structs = 0;
+    };
+
+    // Reads records of the form {ea, md5, name?, comments?, renames?, struct?} from JSONL or
+    // the binary format above (detected by its magic) and applies them in batches, each one
+    // undo step. comments uses the comment-generation item format, renames the rename-all
+    // text format, struct C++ code. Returns false if the file cannot be read or a binary
+    // record is cut short; the records before that one stay applied.
+    bool import_results(const char* path, import_stats_t* stats, progress_t progress = nullptr);
+}
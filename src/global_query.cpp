@@ -0,0 +1,383 @@
+#include "aida_pro.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace global_query
+{
+    static const size_t MAX_NAME_LEN = 80;
+    static const size_t MAX_CALLEES = 8;
+    static const size_t MAX_STRINGS = 6;
+    static const size_t MAX_STRING_LEN = 60;
+    static const size_t MAX_GLOBALS = 4;
+    static const size_t MAX_COMMENT_LEN = 120;
+    static const size_t MAX_CACHE_ENTRIES = 4096;
+    // Share of keywords two questions must have in common (Jaccard) to reuse a map result.
+    static const double MIN_QUESTION_OVERLAP = 0.6;
+    static const char CACHE_NODE[] = "$ aida map cache";
+    static const uchar CACHE_TAG = 'C';
+
+    // FNV-1a; stable across runs, unlike std::hash, because the cache outlives the session.
+    static uint64 hash_text(const std::string& text)
+    {
+        uint64 h = 0xCBF29CE484222325ULL;
+        for (unsigned char c : text)
+        {
+            h ^= c;
+            h *= 0x100000001B3ULL;
+        }
+        return h;
+    }
+
+    // Digests are one line per function, so line breaks in names and strings are flattened.
+    static void append_clipped(std::string* out, const qstring& text, size_t max_len)
+    {
+        for (size_t i = 0; i < text.length() && i < max_len; ++i)
+        {
+            char c = text[i];
+            out->push_back(c == '\n' || c == '\r' || c == '\t' ? ' ' : c);
+        }
+        if (text.length() > max_len)
+            out->append("...");
+    }
+
+    static void append_list(std::string* out, const char* label, const std::vector<qstring>& items, bool quoted)
+    {
+        if (items.empty())
+            return;
+        out->append(" | ").append(label).append(": ");
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            if (i != 0)
+                out->append(", ");
+            if (quoted)
+                out->push_back('"');
+            append_clipped(out, items[i], quoted ? MAX_STRING_LEN : MAX_NAME_LEN);
+            if (quoted)
+                out->push_back('"');
+        }
+    }
+
+    static std::string digest_function(func_t* pfn)
+    {
+        qstring name;
+        if (get_short_name(&name, pfn->start_ea) <= 0)
+            get_func_name(&name, pfn->start_ea);
+
+        std::string line;
+        char buf[64];
+        qsnprintf(buf, sizeof(buf), "0x%llx ", (uint64)pfn->start_ea);
+        line = buf;
+        append_clipped(&line, name, MAX_NAME_LEN);
+        qsnprintf(buf, sizeof(buf), " size=0x%llx", (uint64)(pfn->end_ea - pfn->start_ea));
+        line += buf;
+
+        // Dummy sub_XXXX callees say nothing a summary could use, so only named ones are listed.
+        std::vector<qstring> callees;
+        std::vector<qstring> strings;
+        std::vector<qstring> globals;
+        std::set<ea_t> seen;
+        func_item_iterator_t fii(pfn);
+        for (bool ok = fii.first(); ok; ok = fii.next_code())
+        {
+            const ea_t from = fii.current();
+            xrefblk_t xb;
+            for (bool ok_ref = xb.first_from(from, XREF_NOFLOW); ok_ref; ok_ref = xb.next_from())
+            {
+                if (!seen.insert(xb.to).second)
+                    continue;
+                flags64_t flags = get_flags(xb.to);
+                // Imports are reached through a data reference to the IAT slot.
+                insn_t insn;
+                bool is_call = xb.iscode ? (xb.type == fl_CN || xb.type == fl_CF)
+                                         : decode_insn(&insn, from) > 0 && is_call_insn(insn);
+                if (is_call)
+                {
+                    qstring callee;
+                    if (callees.size() < MAX_CALLEES && !has_dummy_name(flags) && get_short_name(&callee, xb.to) > 0)
+                        callees.push_back(callee);
+                }
+                else if (xb.iscode)
+                {
+                    continue;
+                }
+                else if (is_strlit(flags))
+                {
+                    qstring text;
+                    if (strings.size() < MAX_STRINGS && get_strlit_contents(&text, xb.to, -1, get_str_type(xb.to)) > 0)
+                        strings.push_back(text);
+                }
+                else if (has_user_name(flags) && globals.size() < MAX_GLOBALS)
+                {
+                    qstring global;
+                    if (get_short_name(&global, xb.to) > 0)
+                        globals.push_back(global);
+                }
+            }
+        }
+        append_list(&line, "calls", callees, false);
+        append_list(&line, "strings", strings, true);
+        append_list(&line, "globals", globals, false);
+
+        qstring cmt;
+        if (get_func_cmt(&cmt, pfn, false) > 0 || get_func_cmt(&cmt, pfn, true) > 0)
+        {
+            line.append(" | cmt: ");
+            append_clipped(&line, cmt, MAX_COMMENT_LEN);
+        }
+        line.push_back('\n');
+        return line;
+    }
+
+    bool build_shards(std::vector<shard_t>* shards, size_t* func_count, size_t max_chars, bool show_progress)
+    {
+        shards->clear();
+        *func_count = 0;
+        max_chars = std::max<size_t>(max_chars, 1024);
+
+        const size_t qty = get_func_qty();
+        if (show_progress)
+            show_wait_box("AiDA: Summarizing %d function(s)...", (int)qty);
+        bool cancelled = false;
+        shard_t current;
+        for (size_t i = 0; i < qty; ++i)
+        {
+            if (show_progress && (i & 0x1FF) == 0)
+            {
+                if (user_cancelled())
+                {
+                    cancelled = true;
+                    break;
+                }
+                replace_wait_box("AiDA: Summarizing functions... %d of %d", (int)i, (int)qty);
+            }
+
+            func_t* pfn = getn_func(i);
+            if (pfn == nullptr || (pfn->flags & (FUNC_LIB | FUNC_THUNK)) != 0)
+                continue;
+
+            std::string line = digest_function(pfn);
+            if (line.length() > max_chars)
+                line = line.substr(0, max_chars - 4) + "...\n";
+            if (!current.text.empty() && current.text.length() + line.length() > max_chars)
+            {
+                current.hash = hash_text(current.text);
+                shards->push_back(std::move(current));
+                current = shard_t();
+            }
+            current.funcs.push_back(pfn->start_ea);
+            current.text += line;
+            ++*func_count;
+        }
+        if (!current.text.empty())
+        {
+            current.hash = hash_text(current.text);
+            shards->push_back(std::move(current));
+        }
+        if (show_progress)
+            hide_wait_box();
+        return !cancelled;
+    }
+
+    static ea_t parse_ea(const nlohmann::json& value)
+    {
+        if (value.is_number_unsigned() || value.is_number_integer())
+            return (ea_t)value.get<uint64>();
+        if (!value.is_string())
+            return BADADDR;
+        const std::string text = value.get<std::string>();
+        char* end = nullptr;
+        uint64 ea = strtoull(text.c_str(), &end, 16);
+        return end != text.c_str() ? (ea_t)ea : BADADDR;
+    }
+
+    std::vector<candidate_t> parse_map_answer(const std::string& text, const shard_t& shard)
+    {
+        std::vector<candidate_t> out;
+        std::set<ea_t> taken;
+        auto add = [&](ea_t ea, int score, std::string reason) {
+            // funcs is in address order, as get_func_qty() enumerates them.
+            if (!std::binary_search(shard.funcs.begin(), shard.funcs.end(), ea) || !taken.insert(ea).second)
+                return;
+            candidate_t cand;
+            cand.ea = ea;
+            cand.score = std::clamp(score, 1, 10);
+            cand.reason = std::move(reason);
+            out.push_back(std::move(cand));
+        };
+
+        const size_t open = text.find('[');
+        const size_t close = text.rfind(']');
+        if (open != std::string::npos && close != std::string::npos && close > open)
+        {
+            nlohmann::json items = nlohmann::json::parse(text.begin() + open, text.begin() + close + 1, nullptr, false);
+            if (items.is_array())
+            {
+                for (const auto& item : items)
+                {
+                    if (!item.is_object() || !item.contains("ea"))
+                        continue;
+                    int score = item.contains("score") && item["score"].is_number() ? item["score"].get<int>() : 5;
+                    std::string reason = item.contains("why") && item["why"].is_string() ? item["why"].get<std::string>() : "";
+                    add(parse_ea(item["ea"]), score, std::move(reason));
+                }
+                return out;
+            }
+        }
+
+        // Not JSON after all; take whatever digest addresses the text mentions.
+        static const std::regex addr_re(R"(\b0x([0-9A-Fa-f]+)\b)");
+        for (auto it = std::sregex_iterator(text.begin(), text.end(), addr_re); it != std::sregex_iterator(); ++it)
+            add((ea_t)strtoull((*it)[1].str().c_str(), nullptr, 16), 5, "");
+        return out;
+    }
+
+    std::set<std::string> question_keywords(const std::string& question)
+    {
+        static const std::set<std::string> stopwords = {
+            "the", "and", "are", "any", "for", "from", "how", "into", "its", "that", "this", "what",
+            "when", "where", "which", "who", "why", "does", "with", "there", "their", "they", "all",
+            "can", "get", "has", "have", "was", "were", "will", "find", "show", "list", "function",
+            "functions", "code", "binary", "game", "about", "one", "some",
+        };
+
+        std::set<std::string> words;
+        std::string word;
+        auto flush = [&]() {
+            // Crude plural folding so "pointers" and "pointer" count as the same word.
+            if (word.length() > 3 && word.back() == 's' && word[word.length() - 2] != 's')
+                word.pop_back();
+            if (word.length() >= 3 && stopwords.count(word) == 0)
+                words.insert(word);
+            word.clear();
+        };
+        for (unsigned char c : question)
+        {
+            if (std::isalnum(c) || c == '_')
+                word.push_back((char)std::tolower(c));
+            else
+                flush();
+        }
+        flush();
+        return words;
+    }
+
+    static double keyword_overlap(const std::set<std::string>& a, const std::set<std::string>& b)
+    {
+        if (a.empty() || b.empty())
+            return a == b ? 1.0 : 0.0;
+        size_t common = 0;
+        for (const auto& w : a)
+            common += b.count(w);
+        return (double)common / (double)(a.size() + b.size() - common);
+    }
+
+    map_cache_t& map_cache_t::instance()
+    {
+        static map_cache_t cache;
+        return cache;
+    }
+
+    void map_cache_t::load()
+    {
+        // Reloaded per query: the plugin can outlive the database the cache belongs to.
+        _entries.clear();
+        netnode node(CACHE_NODE);
+        if (node == BADNODE)
+            return;
+        qstring blob;
+        if (node.getblob(&blob, 0, CACHE_TAG) <= 0)
+            return;
+
+        nlohmann::json j = nlohmann::json::parse(blob.c_str(), nullptr, false);
+        if (!j.is_array())
+            return;
+        // A stale or hand-edited blob loses the entries it breaks, not the query.
+        for (const auto& item : j)
+        {
+            if (!item.is_object()
+                || !item.contains("hash") || !item["hash"].is_number_unsigned()
+                || !item.contains("keywords") || !item["keywords"].is_array()
+                || !item.contains("candidates") || !item["candidates"].is_array())
+            {
+                continue;
+            }
+            entry_t entry;
+            entry.shard_hash = item["hash"].get<uint64>();
+            try
+            {
+                for (const auto& w : item["keywords"])
+                {
+                    if (w.is_string())
+                        entry.keywords.insert(w.get<std::string>());
+                }
+                for (const auto& c : item["candidates"])
+                {
+                    if (!c.is_object())
+                        continue;
+                    candidate_t cand;
+                    cand.ea = (ea_t)c.value("ea", (uint64)BADADDR);
+                    cand.score = c.value("score", 5);
+                    cand.reason = c.value("why", "");
+                    entry.candidates.push_back(std::move(cand));
+                }
+            }
+            catch (const nlohmann::json::exception&)
+            {
+                continue;
+            }
+            _entries.push_back(std::move(entry));
+        }
+    }
+
+    void map_cache_t::save() const
+    {
+        nlohmann::json j = nlohmann::json::array();
+        for (const auto& entry : _entries)
+        {
+            nlohmann::json candidates = nlohmann::json::array();
+            for (const auto& cand : entry.candidates)
+                candidates.push_back({ {"ea", (uint64)cand.ea}, {"score", cand.score}, {"why", cand.reason} });
+            j.push_back({ {"hash", entry.shard_hash}, {"keywords", entry.keywords}, {"candidates", candidates} });
+        }
+        const std::string blob = j.dump();
+        netnode node(CACHE_NODE, 0, true);
+        node.delblob(0, CACHE_TAG);
+        node.setblob(blob.data(), blob.size() + 1, 0, CACHE_TAG);
+    }
+
+    bool map_cache_t::lookup(const std::set<std::string>& keywords, uint64 shard_hash, std::vector<candidate_t>* out) const
+    {
+        const entry_t* best = nullptr;
+        double best_overlap = MIN_QUESTION_OVERLAP;
+        for (const auto& entry : _entries)
+        {
+            if (entry.shard_hash != shard_hash)
+                continue;
+            double overlap = keyword_overlap(keywords, entry.keywords);
+            if (overlap >= best_overlap)
+            {
+                best = &entry;
+                best_overlap = overlap;
+            }
+        }
+        if (best == nullptr)
+            return false;
+        *out = best->candidates;
+        return true;
+    }
+
+    void map_cache_t::store(const std::set<std::string>& keywords, uint64 shard_hash, const std::vector<candidate_t>& candidates)
+    {
+        _entries.erase(std::remove_if(_entries.begin(), _entries.end(), [&](const entry_t& e) {
+            return e.shard_hash == shard_hash && e.keywords == keywords;
+        }), _entries.end());
+
+        entry_t entry;
+        entry.shard_hash = shard_hash;
+        entry.keywords = keywords;
+        entry.candidates = candidates;
+        _entries.push_back(std::move(entry));
+        if (_entries.size() > MAX_CACHE_ENTRIES)
+            _entries.erase(_entries.begin(), _entries.begin() + (_entries.size() - MAX_CACHE_ENTRIES));
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <ida.hpp>
+
+namespace global_query
+{
+    // A run of function digests small enough for one map request.
+    struct shard_t
+    {
+        std::vector<ea_t> funcs;
+        std::string text;
+        uint64 hash = 0; // of text; keys the map cache, so any rename in the shard invalidates it
+    };
+
+    // A function the map phase thinks is relevant to the question.
+    struct candidate_t
+    {
+        ea_t ea = BADADDR;
+        int score = 0;      // 1..10 as rated by the map request
+        std::string reason;
+    };
+
+    // Cuts a one-line digest of every function that is not a library function or a thunk
+    // (name, size, callees, referenced strings and named globals, function comment) into
+    // shards of at most max_chars. Needs the database, so it runs on the main thread;
+    // returns false if the user cancelled the wait box.
+    bool build_shards(std::vector<shard_t>* shards, size_t* func_count, size_t max_chars, bool show_progress = true);
+
+    // The candidates a map response names, restricted to the functions of its shard.
+    std::vector<candidate_t> parse_map_answer(const std::string& text, const shard_t& shard);
+
+    // Lowercased content words of a question, used to recognise similar questions.
+    std::set<std::string> question_keywords(const std::string& question);
+
+    // Map results per shard, persisted in the database. A result is reused for any question
+    // whose keywords overlap the cached question's enough, not only for the same wording.
+    // load() at the start of a query and save() after its map phase.
+    class map_cache_t
+    {
+    public:
+        static map_cache_t& instance();
+
+        void load();
+        void save() const;
+        bool lookup(const std::set<std::string>& keywords, uint64 shard_hash, std::vector<candidate_t>* out) const;
+        void store(const std::set<std::string>& keywords, uint64 shard_hash, const std::vector<candidate_t>& candidates);
+
+    private:
+        struct entry_t
+        {
+            uint64 shard_hash = 0;
+            std::set<std::string> keywords;
+            std::vector<candidate_t> candidates;
+        };
+
+        map_cache_t() = default;
+
+        std::vector<entry_t> _entries; // oldest first
+    };
+}
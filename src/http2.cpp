@@ -0,0 +1,361 @@
+#include "aida_pro.hpp"
+
+#ifdef AIDA_HTTP2
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <curl/curl.h>
+#endif
+
+namespace http2
+{
+#ifdef AIDA_HTTP2
+    // Each connection carries up to ~100 streams; the second covers requests made while the
+    // first one is still being set up.
+    static const long MAX_HOST_CONNECTIONS = 2;
+    // The limits of the httplib path: 10 s to connect, 10 minutes without data.
+    static const long CONNECT_TIMEOUT_SECS = 10;
+    static const long IDLE_TIMEOUT_SECS = 600;
+    // A stream with this much body its caller has not read yet is paused. It stops taking
+    // data, so once its window is used up the server holds back that stream and no other.
+    static const size_t MAX_BUFFERED = 1024 * 1024;
+
+    struct transfer_t
+    {
+        CURL* easy = nullptr;
+        curl_slist* headers = nullptr;
+        std::string body;       // CURLOPT_POSTFIELDS does not copy it
+        bool streaming = false;
+        keep_going_t keep_going;
+        char error[CURL_ERROR_SIZE] = {};
+
+        // Shared between the transport thread and the caller, under transport_t::_mutex.
+        std::condition_variable cv;
+        result_t result;
+        std::string inbox;
+        bool paused = false;
+        bool resume = false;
+        bool abort = false;
+        bool done = false;
+    };
+
+    class transport_t
+    {
+    public:
+        ~transport_t() { stop(); }
+
+        result_t run(transfer_t* t, const receiver_t& on_data);
+        void wake();
+        void stop();
+
+    private:
+        std::mutex _mutex;
+        CURLM* _multi = nullptr;
+        std::thread _thread;
+        bool _stopping = false;
+        std::vector<transfer_t*> _pending;  // submitted, not on the multi handle yet
+        std::vector<transfer_t*> _active;   // transport thread only
+
+        bool _start();
+        void _loop();
+        void _finish(transfer_t* t, CURLcode code, const char* reason = nullptr);
+
+        static size_t _on_write(char* data, size_t size, size_t count, void* user);
+        static int _on_progress(void* user, curl_off_t, curl_off_t, curl_off_t, curl_off_t);
+    };
+
+    static transport_t g_transport;
+
+    // Called with _mutex held.
+    bool transport_t::_start()
+    {
+        if (_stopping)
+            return false;
+        if (_multi != nullptr)
+            return true;
+
+        static std::once_flag curl_init;
+        std::call_once(curl_init, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+        _multi = curl_multi_init();
+        if (_multi == nullptr)
+            return false;
+        curl_multi_setopt(_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, MAX_HOST_CONNECTIONS);
+        _thread = std::thread(&transport_t::_loop, this);
+        return true;
+    }
+
+    result_t transport_t::run(transfer_t* t, const receiver_t& on_data)
+    {
+        curl_easy_setopt(t->easy, CURLOPT_WRITEFUNCTION, &transport_t::_on_write);
+        curl_easy_setopt(t->easy, CURLOPT_WRITEDATA, t);
+        curl_easy_setopt(t->easy, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(t->easy, CURLOPT_XFERINFOFUNCTION, &transport_t::_on_progress);
+        curl_easy_setopt(t->easy, CURLOPT_XFERINFODATA, t);
+        curl_easy_setopt(t->easy, CURLOPT_PRIVATE, t);
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_start())
+        {
+            curl_easy_cleanup(t->easy);
+            curl_slist_free_all(t->headers);
+            t->result.error = "HTTP/2 transport is not running.";
+            return std::move(t->result);
+        }
+        _pending.push_back(t);
+        curl_multi_wakeup(_multi);
+
+        // Body chunks are handed to the receiver here, on the caller's thread, so a slow
+        // receiver holds up its own stream and nothing else.
+        for (;;)
+        {
+            t->cv.wait(lock, [t]() { return t->done || !t->inbox.empty(); });
+            if (t->inbox.empty())
+                break;
+
+            std::string chunk;
+            chunk.swap(t->inbox);
+            if (t->abort)
+                continue;
+            if (t->paused)
+            {
+                t->paused = false;
+                t->resume = true;
+                curl_multi_wakeup(_multi);
+            }
+            const int status = t->result.status;
+            lock.unlock();
+            const bool more = on_data(status, chunk.data(), chunk.size());
+            lock.lock();
+            if (!more)
+            {
+                t->abort = true;
+                curl_multi_wakeup(_multi);
+            }
+        }
+        return std::move(t->result);
+    }
+
+    void transport_t::wake()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_multi != nullptr)
+            curl_multi_wakeup(_multi);
+    }
+
+    void transport_t::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+            if (_multi != nullptr)
+                curl_multi_wakeup(_multi);
+        }
+        if (_thread.joinable())
+            _thread.join();
+        // The transport outlives the plugin instance (PLUGIN_MULTI: one per database), so
+        // the next request after a stop starts it again.
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = false;
+    }
+
+    void transport_t::_loop()
+    {
+        for (;;)
+        {
+            std::vector<transfer_t*> added;
+            std::vector<transfer_t*> resumed;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_stopping)
+                    break;
+                added.swap(_pending);
+                for (transfer_t* t : _active)
+                {
+                    if (t->resume)
+                    {
+                        t->resume = false;
+                        resumed.push_back(t);
+                    }
+                }
+            }
+            // Outside the lock: unpausing delivers the held data through _on_write at once.
+            for (transfer_t* t : added)
+            {
+                curl_multi_add_handle(_multi, t->easy);
+                _active.push_back(t);
+            }
+            for (transfer_t* t : resumed)
+                curl_easy_pause(t->easy, CURLPAUSE_CONT);
+
+            int running = 0;
+            curl_multi_perform(_multi, &running);
+            int left = 0;
+            while (CURLMsg* m = curl_multi_info_read(_multi, &left))
+            {
+                if (m->msg != CURLMSG_DONE)
+                    continue;
+                char* priv = nullptr;
+                curl_easy_getinfo(m->easy_handle, CURLINFO_PRIVATE, &priv);
+                _finish((transfer_t*)priv, m->data.result);
+            }
+            curl_multi_poll(_multi, nullptr, 0, 1000, nullptr);
+        }
+
+        std::vector<transfer_t*> rest;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            rest.swap(_pending);
+        }
+        rest.insert(rest.end(), _active.begin(), _active.end());
+        for (transfer_t* t : rest)
+            _finish(t, CURLE_ABORTED_BY_CALLBACK, "HTTP/2 transport stopped.");
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        curl_multi_cleanup(_multi);
+        _multi = nullptr;
+    }
+
+    void transport_t::_finish(transfer_t* t, CURLcode code, const char* reason)
+    {
+        curl_multi_remove_handle(_multi, t->easy);
+        _active.erase(std::remove(_active.begin(), _active.end(), t), _active.end());
+
+        long status = 0;
+        curl_easy_getinfo(t->easy, CURLINFO_RESPONSE_CODE, &status);
+        std::string error;
+        if (reason != nullptr)
+            error = reason;
+        else if (code != CURLE_OK)
+            error = t->error[0] != '\0' ? t->error : curl_easy_strerror(code);
+        const bool cancelled = code != CURLE_OK && t->keep_going && !t->keep_going();
+        curl_easy_cleanup(t->easy);
+        curl_slist_free_all(t->headers);
+
+        // The caller may return and free t as soon as done is set and the lock is released.
+        std::lock_guard<std::mutex> lock(_mutex);
+        t->result.status = (int)status;
+        t->result.error = std::move(error);
+        t->result.cancelled = cancelled;
+        t->done = true;
+        t->cv.notify_one();
+    }
+
+    size_t transport_t::_on_write(char* data, size_t size, size_t count, void* user)
+    {
+        transfer_t* t = (transfer_t*)user;
+        const size_t len = size * count;
+        std::lock_guard<std::mutex> lock(g_transport._mutex);
+        if (t->abort)
+            return 0;
+        if (t->result.status == 0)
+        {
+            long status = 0;
+            curl_easy_getinfo(t->easy, CURLINFO_RESPONSE_CODE, &status);
+            t->result.status = (int)status;
+        }
+        if (!t->streaming)
+        {
+            t->result.body.append(data, len);
+            return len;
+        }
+        if (t->inbox.size() >= MAX_BUFFERED)
+        {
+            t->paused = true;
+            return CURL_WRITEFUNC_PAUSE;
+        }
+        t->inbox.append(data, len);
+        t->cv.notify_one();
+        return len;
+    }
+
+    int transport_t::_on_progress(void* user, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+    {
+        transfer_t* t = (transfer_t*)user;
+        if (t->keep_going && !t->keep_going())
+            return 1;
+        std::lock_guard<std::mutex> lock(g_transport._mutex);
+        return t->abort ? 1 : 0;
+    }
+
+    bool available()
+    {
+        const curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+        return info != nullptr && (info->features & CURL_VERSION_HTTP2) != 0;
+    }
+
+    result_t post(const std::string& url, const httplib::Headers& headers, std::string body, receiver_t on_data, keep_going_t keep_going)
+    {
+        transfer_t t;
+        t.body = std::move(body);
+        t.streaming = on_data != nullptr;
+        t.keep_going = std::move(keep_going);
+        t.easy = curl_easy_init();
+        if (t.easy == nullptr)
+        {
+            t.result.error = "curl_easy_init failed.";
+            return t.result;
+        }
+
+        for (const auto& [name, value] : headers)
+            t.headers = curl_slist_append(t.headers, (name + ": " + value).c_str());
+        if (headers.find("Content-Type") == headers.end())
+            t.headers = curl_slist_append(t.headers, "Content-Type: application/json");
+        // Otherwise libcurl waits for a 100 Continue before sending a large body.
+        t.headers = curl_slist_append(t.headers, "Expect:");
+
+        CURL* e = t.easy;
+        curl_easy_setopt(e, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(e, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        // Wait for a connection that can multiplex rather than opening another one.
+        curl_easy_setopt(e, CURLOPT_PIPEWAIT, 1L);
+        curl_easy_setopt(e, CURLOPT_POST, 1L);
+        curl_easy_setopt(e, CURLOPT_POSTFIELDS, t.body.data());
+        curl_easy_setopt(e, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)t.body.size());
+        curl_easy_setopt(e, CURLOPT_HTTPHEADER, t.headers);
+        curl_easy_setopt(e, CURLOPT_CONNECTTIMEOUT, CONNECT_TIMEOUT_SECS);
+        curl_easy_setopt(e, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(e, CURLOPT_LOW_SPEED_TIME, IDLE_TIMEOUT_SECS);
+        curl_easy_setopt(e, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(e, CURLOPT_ERRORBUFFER, t.error);
+        // Same override the curl tool honours, for TLS-inspecting proxies.
+        qstring ca_bundle;
+        if (qgetenv("CURL_CA_BUNDLE", &ca_bundle) && !ca_bundle.empty())
+            curl_easy_setopt(e, CURLOPT_CAINFO, ca_bundle.c_str());
+
+        return g_transport.run(&t, on_data);
+    }
+
+    void wake()
+    {
+        g_transport.wake();
+    }
+
+    void shutdown()
+    {
+        g_transport.stop();
+    }
+#else
+    bool available()
+    {
+        return false;
+    }
+
+    result_t post(const std::string&, const httplib::Headers&, std::string, receiver_t, keep_going_t)
+    {
+        result_t result;
+        result.error = "Built without HTTP/2 support.";
+        return result;
+    }
+
+    void wake()
+    {
+    }
+
+    void shutdown()
+    {
+    }
+#endif
+}
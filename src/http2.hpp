@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <httplib.h>
+
+// Optional HTTP/2 transport on libcurl, compiled in with the AIDA_HTTP2 CMake option. Every
+// request in the process goes through one multi handle, so concurrent requests to a host
+// become streams on one or two connections instead of a TCP and TLS handshake each.
+namespace http2
+{
+    struct result_t
+    {
+        int status = 0;
+        std::string body;       // empty when a receiver took the body
+        std::string error;      // set when the exchange did not complete
+        bool cancelled = false; // keep_going returned false
+    };
+
+    // Gets the body as it arrives, on the thread that called post(). Returning false resets
+    // the stream.
+    using receiver_t = std::function<bool(int status, const char* data, size_t len)>;
+    // Polled by the transport while the stream runs; false resets just this stream.
+    using keep_going_t = std::function<bool()>;
+
+    // False when built without AIDA_HTTP2 or when libcurl has no HTTP/2 support.
+    bool available();
+
+    // Blocks until the exchange is over. Any number of threads may call it at once; their
+    // streams share connections. Servers that do not negotiate h2 get HTTP/1.1.
+    result_t post(const std::string& url, const httplib::Headers& headers, std::string body, receiver_t on_data = nullptr, keep_going_t keep_going = nullptr);
+
+    // Makes the transport poll keep_going of every stream now rather than within a second.
+    void wake();
+
+    // Fails whatever is still running and stops the transport thread. For plugin unload;
+    // the next post() starts it again.
+    void shutdown();
+}
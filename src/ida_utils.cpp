@@ -3,9 +3,27 @@
 #endif
 #include "aida_pro.hpp"
 #include <set>
+#include <tuple>
+#include <unordered_map>
+#include <algorithm>
+#include <iterator>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IDA_UTILS_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace ida_utils
 {
+    // Longest single field a context may carry; past this it is a data blob, not context.
+    static const size_t MAX_CONTEXT_FIELD = 1024 * 1024;
+    // One referenced string literal; embedded resources and tables can run to megabytes.
+    static const size_t MAX_STRLIT_CHARS = 1024;
+
     struct decomp_request_t : public exec_request_t
     {
         std::pair<std::string, std::string> result;
@@ -24,18 +42,6 @@ namespace ida_utils
         }
     };
 
-    struct match_info {
-        size_t start;
-        size_t len;
-        qstring replacement;
-
-        bool operator<(const match_info& other) const {
-            if (start != other.start)
-                return start < other.start;
-            return len > other.len;
-        }
-    };
-
     static qstring create_markup_replacement(ea_t ea, const std::string& text_to_markup, int color_code)
     {
         qstring replacement;
@@ -49,110 +55,160 @@ namespace ida_utils
         return replacement;
     }
 
-    std::string markup_text_with_addresses(const std::string& text)
+    // The auto-name prefixes IDA puts in front of an address, e.g. sub_140001000.
+    static const char* const AUTO_NAME_PREFIXES[] = {
+        "sub", "loc", "j_sub", "case", "def", "byte", "word", "dword", "qword", "xmmword", "ymmword",
+        "zmmword", "tbyte", "asc", "str", "stru", "arr", "off", "seg", "ptr", "unk", "align",
+    };
+
+    static const char* const ENTRY_NAMES[] = { "start", "WinMain", "main" };
+
+    address_markup_t::address_markup_t()
+    {
+        const int qty = get_segm_qty();
+        ranges.reserve(qty);
+        for (int i = 0; i < qty; ++i)
+        {
+            if (segment_t* seg = getnseg(i))
+                ranges.emplace_back(seg->start_ea, seg->end_ea);
+        }
+        std::sort(ranges.begin(), ranges.end());
+
+        for (const char* name : ENTRY_NAMES)
+        {
+            ea_t ea = get_name_ea(BADADDR, name);
+            if (ea != BADADDR)
+                entry_names.emplace_back(name, ea);
+        }
+    }
+
+    bool address_markup_t::contains(ea_t ea) const
     {
-        std::vector<match_info> matches;
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), std::make_pair(ea, BADADDR));
+        return it != ranges.begin() && ea < std::prev(it)->second;
+    }
 
-        static const std::regex pattern(
-            "\\b(sub|loc|j_sub|case|def|byte|word|dword|qword|xmmword|ymmword|zmmword|tbyte|asc|str|stru|arr|off|seg|ptr|unk|align)_([0-9A-Fa-f]+)\\b",
-            std::regex_constants::icase);
+    // Word characters as in a regex \b, so "sub_140001000:" still ends at the colon.
+    static inline bool is_token_char(char c)
+    {
+        return qisalnum(c) || c == '_';
+    }
 
-        auto words_begin = std::sregex_iterator(text.begin(), text.end(), pattern);
-        auto words_end = std::sregex_iterator();
+    static inline int hex_digit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
 
-        for (std::sregex_iterator i = words_begin; i != words_end; ++i)
+    // At most 16 digits, all of them hex.
+    static bool parse_hex(const char* p, size_t len, ea_t* out)
+    {
+        if (len == 0 || len > 16)
+            return false;
+        uint64 value = 0;
+        for (size_t i = 0; i < len; ++i)
         {
-            std::smatch match = *i;
-            std::string full_match_str = match.str(0);
-            std::string hex_str = match.str(2);
+            int d = hex_digit(p[i]);
+            if (d < 0)
+                return false;
+            value = (value << 4) | (uint64)d;
+        }
+        *out = (ea_t)value;
+        return true;
+    }
 
-            ea_t ea = BADADDR;
-            try { ea = std::stoull(hex_str, nullptr, 16); }
-            catch (...) { continue; }
+    static bool is_auto_name_prefix(const char* p, size_t len)
+    {
+        for (const char* prefix : AUTO_NAME_PREFIXES)
+        {
+            size_t i = 0;
+            while (i < len && prefix[i] != '\0' && qtolower(p[i]) == prefix[i])
+                ++i;
+            if (i == len && prefix[i] == '\0')
+                return true;
+        }
+        return false;
+    }
 
-            if (is_mapped(ea))
+    // The address a whole word names, with the colour to show it in, or BADADDR.
+    static ea_t classify_token(const char* p, size_t len, const address_markup_t& space, int* color)
+    {
+        ea_t ea = BADADDR;
+        if (len >= 9 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        {
+            if (parse_hex(p + 2, len - 2, &ea) && space.contains(ea))
             {
-                match_info mi;
-                mi.start = match.position(0);
-                mi.len = match.length(0);
-                mi.replacement = create_markup_replacement(ea, full_match_str, COLOR_CNAME);
-                matches.push_back(mi);
+                *color = COLOR_DREF;
+                return ea;
             }
+            return BADADDR;
         }
 
-        const char* special_names[] = { "start", "WinMain", "main" };
-        for (const char* name : special_names)
+        const char* underscore = nullptr;
+        for (const char* q = p + len; q != p; --q)
         {
-            ea_t ea = get_name_ea(BADADDR, name);
-            if (ea != BADADDR)
+            if (q[-1] == '_')
             {
-                std::string s_name(name);
-                size_t pos = text.find(s_name, 0);
-                while (pos != std::string::npos)
-                {
-                    bool pre_ok = (pos == 0) || !is_word_char(text[pos - 1]);
-                    bool post_ok = (pos + s_name.length() >= text.length()) || !is_word_char(text[pos + s_name.length()]);
-                    if (pre_ok && post_ok)
-                    {
-                        match_info mi;
-                        mi.start = pos;
-                        mi.len = s_name.length();
-                        mi.replacement = create_markup_replacement(ea, s_name, COLOR_CNAME);
-                        matches.push_back(mi);
-                    }
-                    pos = text.find(s_name, pos + 1);
-                }
+                underscore = q - 1;
+                break;
             }
         }
-
-        static const std::regex hex_pattern("\\b(0x[0-9A-Fa-f]{7,16})\\b", std::regex_constants::icase);
-        auto hex_begin = std::sregex_iterator(text.begin(), text.end(), hex_pattern);
-        auto hex_end = std::sregex_iterator();
-
-        for (std::sregex_iterator i = hex_begin; i != hex_end; ++i)
+        if (underscore != nullptr)
         {
-            std::smatch match = *i;
-            std::string hex_str = match.str(1);
-
-            ea_t ea = BADADDR;
-            try { ea = std::stoull(hex_str, nullptr, 16); }
-            catch (...) { continue; }
-
-            if (is_mapped(ea))
+            const size_t prefix_len = underscore - p;
+            if (is_auto_name_prefix(p, prefix_len) && parse_hex(underscore + 1, len - prefix_len - 1, &ea) && space.contains(ea))
             {
-                match_info mi;
-                mi.start = match.position(0);
-                mi.len = match.length(0);
-                mi.replacement = create_markup_replacement(ea, hex_str, COLOR_DREF);
-                matches.push_back(mi);
+                *color = COLOR_CNAME;
+                return ea;
             }
+            return BADADDR;
         }
 
-        std::sort(matches.begin(), matches.end());
-        std::vector<match_info> final_matches;
-        if (!matches.empty())
+        for (const auto& entry : space.entry_names)
         {
-            final_matches.push_back(matches[0]);
-            for (size_t i = 1; i < matches.size(); ++i)
+            if (entry.first.length() == len && memcmp(entry.first.c_str(), p, len) == 0)
             {
-                if (matches[i].start >= (final_matches.back().start + final_matches.back().len))
-                {
-                    final_matches.push_back(matches[i]);
-                }
+                *color = COLOR_CNAME;
+                return entry.second;
             }
         }
+        return BADADDR;
+    }
 
-        qstring result;
-        size_t last_pos = 0;
-        for (const auto& mi : final_matches)
+    std::string markup_line_with_addresses(const char* text, size_t len, const address_markup_t& space)
+    {
+        std::string out;
+        size_t copied = 0;
+        size_t i = 0;
+        while (i < len)
         {
-            result.append(text.c_str() + last_pos, mi.start - last_pos);
-            result.append(mi.replacement);
-            last_pos = mi.start + mi.len;
-        }
-        result.append(text.c_str() + last_pos);
+            if (!is_token_char(text[i]))
+            {
+                ++i;
+                continue;
+            }
+            size_t end = i;
+            while (end < len && is_token_char(text[end]))
+                ++end;
 
-        return result.c_str();
+            int color = COLOR_CNAME;
+            ea_t ea = classify_token(text + i, end - i, space, &color);
+            if (ea != BADADDR)
+            {
+                if (out.empty())
+                    out.reserve(len + 64);
+                out.append(text + copied, i - copied);
+                out.append(create_markup_replacement(ea, std::string(text + i, end - i), color).c_str());
+                copied = end;
+            }
+            i = end;
+        }
+        if (copied == 0)
+            return std::string(text, len);
+        out.append(text + copied, len - copied);
+        return out;
     }
 
     static std::string truncate_string(const std::string& s, size_t max_len)
@@ -519,206 +575,1632 @@ namespace ida_utils
         return output.c_str();
     }
 
-    nlohmann::json get_context_for_prompt(ea_t ea, bool include_struct_context, size_t max_len)
+    enum flow_seed_kind_t
     {
-        func_t* pfn = get_func(ea);
-        if (pfn == nullptr)
-        {
-            qstring err_msg;
-            err_msg.sprnt("No function found at address 0x%llx.", ea);
-            return { {"ok", false}, {"message", err_msg.c_str()} };
-        }
+        SEED_ARG,       // the object is argument #arg_pos of func_ea
+        SEED_CALL_ARG,  // func_ea passes the object to callee_ea as argument #arg_pos
+        SEED_CALL_RET,  // func_ea receives the object as the return value of callee_ea
+    };
 
-        auto code_pair = get_function_code(ea, max_len);
-        if (code_pair.second == "Error")
+    struct flow_seed_t
+    {
+        flow_seed_kind_t kind;
+        ea_t func_ea;
+        ea_t callee_ea;
+        int arg_pos;
+        int64 delta;
+        int depth;
+
+        bool operator<(const flow_seed_t& other) const
         {
-            return { {"ok", false}, {"message", code_pair.first} };
+            return std::tie(func_ea, kind, callee_ea, arg_pos, delta)
+                 < std::tie(other.func_ea, other.kind, other.callee_ea, other.arg_pos, other.delta);
         }
+    };
 
-        qstring ea_hex_str;
-        ea_hex_str.sprnt("%llx", ea);
+    static const int MAX_EVIDENCE_SAMPLES = 3;
 
-        nlohmann::json context = {
-            {"ok", true},
-            {"code", code_pair.first},
-            {"language", code_pair.second},
-            {"func_ea_hex", ea_hex_str.c_str()},
-            {"xrefs_to", get_code_xrefs_to(ea, g_settings)},
-            {"xrefs_from", get_code_xrefs_from(ea, g_settings)},
-        };
+    static const cexpr_t* skip_casts(const cexpr_t* e)
+    {
+        while (e != nullptr && e->op == cot_cast)
+            e = e->x;
+        return e;
+    }
 
-        tinfo_t func_tif;
-        if (get_tinfo(&func_tif, ea))
-        {
-            qstring func_proto;
-            func_tif.print(&func_proto, "", 0, 0, PRTYPE_1LINE | PRTYPE_NOARGS);
-            context["func_prototype"] = func_proto.c_str();
-        }
-        else
+    static bool is_call_to(const cexpr_t* call, ea_t callee_ea)
+    {
+        const cexpr_t* callee = skip_casts(call->x);
+        return callee != nullptr && callee->op == cot_obj && callee->obj_ea == callee_ea;
+    }
+
+    // Resolves 'var', 'var + N', '&var->m' and '&var[N]' into the variable index and a byte offset.
+    static bool get_var_offset(const cexpr_t* e, int* var_idx, int64* offset)
+    {
+        e = skip_casts(e);
+        if (e == nullptr)
+            return false;
+
+        switch (e->op)
         {
-            context["func_prototype"] = "// Could not retrieve function prototype.";
-        }
+        case cot_var:
+            *var_idx = e->v.idx;
+            *offset = 0;
+            return true;
 
-        context["local_vars"] = "// Decompilation failed or not available.";
-        context["decompiler_warnings"] = "// No decompiler warnings.";
-        if (include_struct_context)
+        case cot_add:
+        case cot_sub:
         {
-            context["struct_context"] = "// Decompilation failed or not available.";
+            if (e->y == nullptr || e->y->op != cot_num)
+                return false;
+            int64 base;
+            if (!get_var_offset(e->x, var_idx, &base))
+                return false;
+            int64 scale = 1;
+            if (e->x->type.is_ptr())
+            {
+                int objsize = e->x->type.get_ptrarr_objsize();
+                if (objsize > 0)
+                    scale = objsize;
+            }
+            int64 delta = (int64)e->y->numval() * scale;
+            *offset = e->op == cot_add ? base + delta : base - delta;
+            return true;
         }
 
-        if (init_hexrays_plugin())
+        case cot_ref:
         {
-            try
+            const cexpr_t* x = e->x;
+            if (x->op == cot_memptr)
             {
-                mba_ranges_t mbr(pfn);
-                cfuncptr_t cfunc = decompile(mbr);
-                if (cfunc)
-                {
-                    lvars_t* lvars = cfunc->get_lvars();
-                    if (lvars && !lvars->empty())
-                    {
-                        qstring lvars_str;
-                        for (const auto& lv : *lvars)
-                        {
-                            lvars_str.cat_sprnt("// %s %s; // location: %s, size: %d\n",
-                                lv.type().dstr(),
-                                lv.name.c_str(),
-                                lv.location.dstr(),
-                                lv.width);
-                        }
-                        context["local_vars"] = lvars_str.c_str();
-                    }
-                    else
-                    {
-                        context["local_vars"] = "// No local variables found.";
-                    }
+                int64 base;
+                if (!get_var_offset(x->x, var_idx, &base))
+                    return false;
+                *offset = base + x->m;
+                return true;
+            }
+            if (x->op == cot_idx && x->y->op == cot_num)
+            {
+                int64 base;
+                if (!get_var_offset(x->x, var_idx, &base))
+                    return false;
+                int objsize = x->x->type.get_ptrarr_objsize();
+                *offset = base + (int64)x->y->numval() * (objsize > 0 ? objsize : 1);
+                return true;
+            }
+            return false;
+        }
 
-                    hexwarns_t& warns = cfunc->get_warnings();
-                    if (!warns.empty())
-                    {
-                        qstring warns_str;
-                        for (const auto& warn : warns)
-                        {
-                            warns_str.append(warn.text.c_str());
-                            warns_str.append("\n");
-                        }
-                        context["decompiler_warnings"] = warns_str.c_str();
-                    }
+        default:
+            return false;
+        }
+    }
 
-                    if (include_struct_context)
-                    {
-                        tinfo_t struct_tif;
-                        lvar_t* this_lvar = nullptr;
-                        if (lvars)
-                        {
-                            for (auto& lv : *lvars)
-                            {
-                                if (lv.is_thisarg())
-                                {
-                                    this_lvar = &lv;
-                                    break;
-                                }
-                            }
-                            if (this_lvar == nullptr)
-                            {
-                                for (auto& lv : *lvars)
-                                {
-                                    if (lv.is_arg_var() && lv.type().is_ptr() && lv.type().get_pointed_object().is_udt())
-                                    {
-                                        this_lvar = &lv;
-                                        break;
-                                    }
-                                }
-                            }
-                        }
-                        if (this_lvar && this_lvar->type().is_ptr())
-                        {
-                            struct_tif = this_lvar->type().get_pointed_object();
-                        }
+    static bool get_tracked_offset(const cexpr_t* e, const std::map<int, int64>& tracked, int64* offset)
+    {
+        int var_idx;
+        int64 rel;
+        if (!get_var_offset(e, &var_idx, &rel))
+            return false;
+        auto it = tracked.find(var_idx);
+        if (it == tracked.end())
+            return false;
+        *offset = it->second + rel;
+        return true;
+    }
 
-                        if (struct_tif.is_udt())
-                        {
-                            std::string usage_context = get_struct_usage_context(ea);
-                            std::string data_xref_context = get_data_xrefs_for_struct(struct_tif, g_settings);
-                            context["struct_context"] = usage_context + "\n\n" + data_xref_context;
-                        }
-                        else
-                        {
-                            context["struct_context"] = "// No struct context could be determined for this function.";
-                        }
-                    }
-                }
-            }
-            catch (const vd_failure_t&) {}
+    // Finds the local variables holding the object: the seed itself plus simple copies of it.
+    struct alias_visitor_t : public ctree_visitor_t
+    {
+        const flow_seed_t& seed;
+        std::map<int, int64>& tracked;
+        bool changed = false;
+
+        alias_visitor_t(const flow_seed_t& s, std::map<int, int64>& t)
+            : ctree_visitor_t(CV_FAST), seed(s), tracked(t) {}
+
+        void track(int idx, int64 delta)
+        {
+            if (tracked.emplace(idx, delta).second)
+                changed = true;
         }
 
-        qstring string_xrefs_str = "// No string literals referenced.\n";
-        std::set<qstring> found_strings;
-        func_item_iterator_t fii(pfn);
-        for (bool ok = fii.first(); ok; ok = fii.next_head())
+        int idaapi visit_expr(cexpr_t* e) override
         {
-            xrefblk_t xb;
-            for (bool ok_ref = xb.first_from(fii.current(), XREF_DATA); ok_ref; ok_ref = xb.next_from())
+            if (e->op == cot_call && seed.kind == SEED_CALL_ARG && is_call_to(e, seed.callee_ea))
             {
-                flags64_t s_flags = get_flags(xb.to);
-                if (is_strlit(s_flags))
+                int idx;
+                int64 off;
+                if (e->a != nullptr && seed.arg_pos < (int)e->a->size()
+                    && get_var_offset(&(*e->a)[seed.arg_pos], &idx, &off))
                 {
-                    int32 strtype = get_str_type(xb.to);
-                    qstring s;
-                    if (get_strlit_contents(&s, xb.to, -1, strtype) > 0)
-                    {
-                        if (found_strings.find(s) == found_strings.end())
-                        {
-                            if (found_strings.empty()) string_xrefs_str.clear();
-                            string_xrefs_str.cat_sprnt("\"%s\"\n", s.c_str());
-                            found_strings.insert(s);
-                        }
-                    }
+                    track(idx, seed.delta - off);
+                }
+            }
+            else if (e->op == cot_asg)
+            {
+                const cexpr_t* dst = skip_casts(e->x);
+                if (dst == nullptr || dst->op != cot_var)
+                    return 0;
+
+                const cexpr_t* src = skip_casts(e->y);
+                if (seed.kind == SEED_CALL_RET && src->op == cot_call && is_call_to(src, seed.callee_ea))
+                {
+                    track(dst->v.idx, seed.delta);
+                }
+                else
+                {
+                    int64 off;
+                    if (get_tracked_offset(e->y, tracked, &off))
+                        track(dst->v.idx, off);
                 }
             }
+            return 0;
         }
-        context["string_xrefs"] = string_xrefs_str.c_str();
-        return context;
-    }
+    };
 
-    std::string format_prompt(const char* prompt_template, const nlohmann::json& context)
+    struct evidence_visitor_t : public ctree_visitor_t
     {
-        std::string result = prompt_template;
-        for (auto const& [key, val] : context.items())
-        {
-            std::string placeholder = "{" + key + "}";
-            if (val.is_string())
+        cfunc_t* cfunc;
+        const std::map<int, int64>& tracked;
+        struct_evidence_t& evidence;
+        std::vector<flow_seed_t>& next_seeds;
+        int depth;
+        bool returns_object = false;
+        int64 return_delta = 0;
+        std::map<ea_t, std::string> stringified_insns;
+
+        evidence_visitor_t(cfunc_t* cf, const std::map<int, int64>& t, struct_evidence_t& ev, std::vector<flow_seed_t>& seeds, int d)
+            : ctree_visitor_t(CV_PARENTS), cfunc(cf), tracked(t), evidence(ev), next_seeds(seeds), depth(d) {}
+
+        const std::string& stringify_parent_insn(const cexpr_t* e)
+        {
+            const citem_t* insn = nullptr;
+            for (ssize_t i = parents.size() - 1; i >= 0; --i)
             {
-                size_t pos = result.find(placeholder);
-                while (pos != std::string::npos)
+                if (!parents[i]->is_expr())
                 {
-                    result.replace(pos, placeholder.length(), val.get<std::string>());
-                    pos = result.find(placeholder, pos + val.get<std::string>().length());
+                    insn = parents[i];
+                    break;
                 }
             }
-        }
-        return result;
-    }
 
-    void apply_struct_from_cpp(const std::string& cpp_code, ea_t ea)
-    {
-        std::string struct_code;
-        std::smatch match_md;
-        if (std::regex_search(cpp_code, match_md, std::regex("```(?:cpp)?\\s*([\\s\\S]*?)\\s*```")))
-        {
-            struct_code = match_md[1].str();
-        }
-        else
-        {
-            if (cpp_code.find("struct") != std::string::npos)
+            ea_t key = insn != nullptr ? insn->ea : e->ea;
+            auto it = stringified_insns.find(key);
+            if (it != stringified_insns.end())
+                return it->second;
+
+            qstring line;
+            if (insn != nullptr)
             {
-                struct_code = cpp_code;
+                qstring_printer_t pr(cfunc, line, false);
+                ((cinsn_t*)insn)->print(0, pr);
             }
             else
             {
-                warning("AiDA: AI response did not contain a C++ struct definition.\n"
-                        "Full response:\n%s", cpp_code.c_str());
-                return;
+                e->print1(&line, cfunc);
+            }
+            tag_remove(&line);
+            line.trim2();
+            return stringified_insns[key] = line.c_str();
+        }
+
+        uint32 classify_access(const cexpr_t* e) const
+        {
+            if (parents.empty() || !parents.back()->is_expr())
+                return FA_READ;
+
+            const cexpr_t* parent = (const cexpr_t*)parents.back();
+            if (is_assignment(parent->op) && parent->x == e)
+                return parent->op == cot_asg ? FA_WRITE : (FA_READ | FA_WRITE);
+            if (is_prepost(parent->op))
+                return FA_READ | FA_WRITE;
+            if (parent->op == cot_call && parent->x == e)
+                return FA_CALL;
+            if (parent->op == cot_ref)
+                return FA_ADDR;
+            return FA_READ;
+        }
+
+        void record(const cexpr_t* e, int64 offset, int size, uint32 access)
+        {
+            if (offset < 0)
+                return;
+
+            field_evidence_t& field = evidence.fields[offset];
+            if (size > 0)
+                field.sizes.insert(size);
+            field.access |= access;
+            field.funcs.insert(cfunc->entry_ea);
+            if (field.samples.size() < MAX_EVIDENCE_SAMPLES)
+            {
+                qstring sample;
+                sample.sprnt("0x%llx: %s", e->ea, stringify_parent_insn(e).c_str());
+                if (std::find(field.samples.begin(), field.samples.end(), sample.c_str()) == field.samples.end())
+                    field.samples.push_back(sample.c_str());
+            }
+        }
+
+        int idaapi visit_insn(cinsn_t* i) override
+        {
+            if (i->op == cit_return && i->creturn != nullptr)
+            {
+                int64 off;
+                if (get_tracked_offset(&i->creturn->expr, tracked, &off))
+                {
+                    returns_object = true;
+                    return_delta = off;
+                }
+            }
+            return 0;
+        }
+
+        int idaapi visit_expr(cexpr_t* e) override
+        {
+            int64 off;
+            switch (e->op)
+            {
+            case cot_ptr:
+                if (get_tracked_offset(e->x, tracked, &off))
+                    record(e, off, e->ptrsize > 0 ? e->ptrsize : (int)e->type.get_size(), classify_access(e));
+                break;
+
+            case cot_memptr:
+                if (get_tracked_offset(e->x, tracked, &off))
+                    record(e, off + e->m, e->ptrsize > 0 ? e->ptrsize : (int)e->type.get_size(), classify_access(e));
+                break;
+
+            case cot_idx:
+                if (e->y->op == cot_num && get_tracked_offset(e->x, tracked, &off))
+                {
+                    int objsize = e->x->type.get_ptrarr_objsize();
+                    if (objsize <= 0)
+                        objsize = 1;
+                    record(e, off + (int64)e->y->numval() * objsize, objsize, classify_access(e));
+                }
+                break;
+
+            case cot_call:
+            {
+                if (e->a == nullptr)
+                    break;
+                const cexpr_t* callee = skip_casts(e->x);
+                ea_t callee_ea = (callee != nullptr && callee->op == cot_obj) ? callee->obj_ea : BADADDR;
+                for (size_t i = 0; i < e->a->size(); ++i)
+                {
+                    if (!get_tracked_offset(&(*e->a)[i], tracked, &off))
+                        continue;
+                    if (off != 0)
+                        record(&(*e->a)[i], off, 0, FA_ADDR);
+                    if (callee_ea != BADADDR && get_func(callee_ea) != nullptr)
+                        next_seeds.push_back({ SEED_ARG, callee_ea, BADADDR, (int)i, off, depth + 1 });
+                }
+                break;
+            }
+
+            default:
+                break;
+            }
+            return 0;
+        }
+    };
+
+    static void collect_callers(ea_t func_ea, std::set<ea_t>& callers)
+    {
+        xrefblk_t xb;
+        for (bool ok = xb.first_to(func_ea, XREF_ALL); ok; ok = xb.next_to())
+        {
+            if (!xb.iscode || (xb.type != fl_CN && xb.type != fl_CF))
+                continue;
+            func_t* caller = get_func(xb.from);
+            if (caller != nullptr)
+                callers.insert(caller->start_ea);
+        }
+    }
+
+    static void process_flow_seed(
+        const flow_seed_t& seed,
+        const settings_t& settings,
+        struct_evidence_t& evidence,
+        std::vector<flow_seed_t>& next_seeds)
+    {
+        func_t* pfn = get_func(seed.func_ea);
+        if (pfn == nullptr)
+            return;
+
+        cfuncptr_t cfunc(nullptr);
+        try
+        {
+            cfunc = decompile(pfn);
+        }
+        catch (const vd_failure_t&)
+        {
+            return;
+        }
+        if (cfunc == nullptr)
+            return;
+
+        lvars_t* lvars = cfunc->get_lvars();
+        if (lvars == nullptr)
+            return;
+
+        std::map<int, int64> tracked;
+        if (seed.kind == SEED_ARG)
+        {
+            if (seed.arg_pos < 0 || seed.arg_pos >= (int)cfunc->argidx.size())
+                return;
+            tracked[cfunc->argidx[seed.arg_pos]] = seed.delta;
+        }
+
+        alias_visitor_t aliases(seed, tracked);
+        for (int pass = 0; pass < 3; ++pass)
+        {
+            aliases.changed = false;
+            aliases.apply_to(&cfunc->body, nullptr);
+            if (!aliases.changed)
+                break;
+        }
+        if (tracked.empty())
+            return;
+
+        evidence.visited_funcs.insert(pfn->start_ea);
+        for (const auto& [idx, delta] : tracked)
+        {
+            if (idx < 0 || idx >= (int)lvars->size())
+                continue;
+            flow_site_t site;
+            site.func_ea = pfn->start_ea;
+            site.ll = (*lvars)[idx];
+            site.lvar_name = (*lvars)[idx].name;
+            site.lvar_type = (*lvars)[idx].type();
+            site.delta = delta;
+            evidence.sites.push_back(site);
+        }
+
+        evidence_visitor_t visitor(cfunc, tracked, evidence, next_seeds, seed.depth);
+        visitor.apply_to(&cfunc->body, nullptr);
+
+        if (seed.depth + 1 >= settings.xref_analysis_depth)
+            return;
+
+        std::set<ea_t> callers;
+        collect_callers(pfn->start_ea, callers);
+        for (ea_t caller_ea : callers)
+        {
+            for (const auto& [idx, delta] : tracked)
+            {
+                auto it = std::find(cfunc->argidx.begin(), cfunc->argidx.end(), idx);
+                if (it != cfunc->argidx.end())
+                {
+                    int pos = (int)(it - cfunc->argidx.begin());
+                    next_seeds.push_back({ SEED_CALL_ARG, caller_ea, pfn->start_ea, pos, delta, seed.depth + 1 });
+                }
+            }
+            if (visitor.returns_object)
+                next_seeds.push_back({ SEED_CALL_RET, caller_ea, pfn->start_ea, -1, visitor.return_delta, seed.depth + 1 });
+        }
+    }
+
+    int find_object_arg(cfunc_t* cfunc, bool objects_only)
+    {
+        lvars_t* lvars = cfunc->get_lvars();
+        if (lvars == nullptr)
+            return -1;
+
+        auto find_arg = [&](auto pred) -> int {
+            for (size_t i = 0; i < cfunc->argidx.size(); ++i)
+            {
+                const lvar_t& lv = (*lvars)[cfunc->argidx[i]];
+                if (pred(lv))
+                    return (int)i;
+            }
+            return -1;
+        };
+
+        int pos = find_arg([](const lvar_t& lv) { return lv.is_thisarg(); });
+        if (pos < 0)
+            pos = find_arg([](const lvar_t& lv) { return lv.type().is_ptr() && lv.type().get_pointed_object().is_udt(); });
+        if (pos >= 0 || objects_only)
+            return pos;
+        pos = find_arg([](const lvar_t& lv) { return lv.type().is_ptr(); });
+        if (pos < 0)
+            pos = find_arg([](const lvar_t& lv) { return lv.width == (inf_is_64bit() ? 8 : 4); });
+        return pos;
+    }
+
+    struct_evidence_t collect_struct_evidence(ea_t func_ea, int arg_pos, const settings_t& settings)
+    {
+        struct_evidence_t evidence;
+        if (!init_hexrays_plugin() || arg_pos < 0)
+            return evidence;
+
+        func_t* pfn = get_func(func_ea);
+        if (pfn == nullptr)
+            return evidence;
+
+        const size_t max_funcs = std::max<size_t>(8, (size_t)settings.xref_context_count * std::max(1, settings.xref_analysis_depth) * 2);
+
+        std::set<flow_seed_t> seen;
+        std::vector<flow_seed_t> queue = { { SEED_ARG, pfn->start_ea, BADADDR, arg_pos, 0, 0 } };
+        for (size_t head = 0; head < queue.size() && evidence.visited_funcs.size() < max_funcs; ++head)
+        {
+            flow_seed_t seed = queue[head];
+            if (seed.depth > settings.xref_analysis_depth || !seen.insert(seed).second)
+                continue;
+
+            std::vector<flow_seed_t> next_seeds;
+            process_flow_seed(seed, settings, evidence, next_seeds);
+            for (const auto& next : next_seeds)
+            {
+                if (next.depth <= settings.xref_analysis_depth && seen.find(next) == seen.end())
+                    queue.push_back(next);
+            }
+        }
+        return evidence;
+    }
+
+    std::string format_struct_evidence(const struct_evidence_t& evidence)
+    {
+        if (evidence.fields.empty())
+            return "// No member accesses could be collected for this object.";
+
+        qstring output;
+        output.sprnt("// Aggregated member accesses for this object across %d function(s).\n", (int)evidence.visited_funcs.size());
+        output.append("// The object flows through:\n");
+        for (const auto& site : evidence.sites)
+        {
+            qstring func_name;
+            get_func_name(&func_name, site.func_ea);
+            if (site.delta == 0)
+                output.cat_sprnt("//   %s (0x%llx): %s\n", func_name.c_str(), site.func_ea, site.lvar_name.c_str());
+            else
+                output.cat_sprnt("//   %s (0x%llx): %s (points to base%+lld)\n", func_name.c_str(), site.func_ea, site.lvar_name.c_str(), site.delta);
+        }
+
+        output.append("// Offset map (offset: size(s), access, functions):\n");
+        for (const auto& [offset, field] : evidence.fields)
+        {
+            qstring sizes;
+            for (int size : field.sizes)
+                sizes.cat_sprnt("%s%d", sizes.empty() ? "" : "/", size);
+            if (sizes.empty())
+                sizes = "?";
+
+            qstring access;
+            if (field.access & FA_READ)  access.append('R');
+            if (field.access & FA_WRITE) access.append('W');
+            if (field.access & FA_CALL)  access.append('C');
+            if (field.access & FA_ADDR)  access.append('&');
+
+            output.cat_sprnt("//   0x%04llX: size %s, access %s, seen in %d function(s)\n",
+                offset, sizes.c_str(), access.c_str(), (int)field.funcs.size());
+            for (const auto& sample : field.samples)
+                output.cat_sprnt("//     usage: %s\n", sample.c_str());
+        }
+        return output.c_str();
+    }
+
+    nlohmann::json get_context_for_prompt(ea_t ea, bool include_struct_context, size_t max_len, bool lazy_xrefs)
+    {
+        func_t* pfn = get_func(ea);
+        if (pfn == nullptr)
+        {
+            qstring err_msg;
+            err_msg.sprnt("No function found at address 0x%llx.", ea);
+            return { {"ok", false}, {"message", err_msg.c_str()} };
+        }
+
+        auto code_pair = get_function_code(ea, max_len);
+        if (code_pair.second == "Error")
+        {
+            return { {"ok", false}, {"message", code_pair.first} };
+        }
+
+        qstring ea_hex_str;
+        ea_hex_str.sprnt("%llx", ea);
+
+        nlohmann::json context = {
+            {"ok", true},
+            {"code", code_pair.first},
+            {"language", code_pair.second},
+            {"func_ea_hex", ea_hex_str.c_str()},
+        };
+        if (lazy_xrefs)
+        {
+            context["xrefs_to"] = "// Not included. Call get_xrefs_to with this function's address to see its callers.";
+            context["xrefs_from"] = "// Not included. The calls are in the code above; call decompile_callee to read one.";
+        }
+        else
+        {
+            context["xrefs_to"] = get_code_xrefs_to(ea, g_settings);
+            context["xrefs_from"] = get_code_xrefs_from(ea, g_settings);
+        }
+
+        tinfo_t func_tif;
+        if (get_tinfo(&func_tif, ea))
+        {
+            qstring func_proto;
+            func_tif.print(&func_proto, "", 0, 0, PRTYPE_1LINE | PRTYPE_NOARGS);
+            context["func_prototype"] = func_proto.c_str();
+        }
+        else
+        {
+            context["func_prototype"] = "// Could not retrieve function prototype.";
+        }
+
+        std::string class_context = unreal::function_context(ea) + rtti::class_context(ea);
+        context["class_context"] = class_context.empty() ? "// No RTTI class information for this function." : class_context;
+
+        context["local_vars"] = "// Decompilation failed or not available.";
+        context["decompiler_warnings"] = "// No decompiler warnings.";
+        if (include_struct_context)
+        {
+            context["struct_context"] = "// Decompilation failed or not available.";
+        }
+
+        if (init_hexrays_plugin())
+        {
+            try
+            {
+                mba_ranges_t mbr(pfn);
+                cfuncptr_t cfunc = decompile(mbr);
+                if (cfunc)
+                {
+                    lvars_t* lvars = cfunc->get_lvars();
+                    if (lvars && !lvars->empty())
+                    {
+                        qstring lvars_str;
+                        for (const auto& lv : *lvars)
+                        {
+                            lvars_str.cat_sprnt("// %s %s; // location: %s, size: %d\n",
+                                lv.type().dstr(),
+                                lv.name.c_str(),
+                                lv.location.dstr(),
+                                lv.width);
+                        }
+                        context["local_vars"] = lvars_str.c_str();
+                    }
+                    else
+                    {
+                        context["local_vars"] = "// No local variables found.";
+                    }
+
+                    hexwarns_t& warns = cfunc->get_warnings();
+                    if (!warns.empty())
+                    {
+                        qstring warns_str;
+                        for (const auto& warn : warns)
+                        {
+                            warns_str.append(warn.text.c_str());
+                            warns_str.append("\n");
+                        }
+                        context["decompiler_warnings"] = warns_str.c_str();
+                    }
+
+                    if (include_struct_context)
+                    {
+                        tinfo_t struct_tif;
+                        lvar_t* this_lvar = nullptr;
+                        if (lvars)
+                        {
+                            for (auto& lv : *lvars)
+                            {
+                                if (lv.is_thisarg())
+                                {
+                                    this_lvar = &lv;
+                                    break;
+                                }
+                            }
+                            if (this_lvar == nullptr)
+                            {
+                                for (auto& lv : *lvars)
+                                {
+                                    if (lv.is_arg_var() && lv.type().is_ptr() && lv.type().get_pointed_object().is_udt())
+                                    {
+                                        this_lvar = &lv;
+                                        break;
+                                    }
+                                }
+                            }
+                        }
+                        if (this_lvar && this_lvar->type().is_ptr())
+                        {
+                            struct_tif = this_lvar->type().get_pointed_object();
+                        }
+
+                        std::string struct_context;
+                        if (struct_tif.is_udt())
+                        {
+                            std::string usage_context = get_struct_usage_context(ea);
+                            std::string data_xref_context = get_data_xrefs_for_struct(struct_tif, g_settings);
+                            struct_context = usage_context + "\n\n" + data_xref_context;
+                        }
+
+                        int object_arg = find_object_arg(cfunc);
+                        if (object_arg >= 0)
+                        {
+                            struct_evidence_t evidence = collect_struct_evidence(ea, object_arg, g_settings);
+                            if (!evidence.fields.empty())
+                            {
+                                if (!struct_context.empty())
+                                    struct_context += "\n\n";
+                                struct_context += format_struct_evidence(evidence);
+                            }
+                        }
+
+                        if (struct_context.empty())
+                            struct_context = "// No struct context could be determined for this function.";
+                        context["struct_context"] = struct_context;
+                    }
+                }
+            }
+            catch (const vd_failure_t&) {}
+        }
+
+        qstring string_xrefs_str = "// No string literals referenced.\n";
+        std::set<qstring> found_strings;
+        func_item_iterator_t fii(pfn);
+        for (bool ok = fii.first(); ok; ok = fii.next_head())
+        {
+            xrefblk_t xb;
+            for (bool ok_ref = xb.first_from(fii.current(), XREF_DATA); ok_ref; ok_ref = xb.next_from())
+            {
+                flags64_t s_flags = get_flags(xb.to);
+                if (is_strlit(s_flags))
+                {
+                    int32 strtype = get_str_type(xb.to);
+                    qstring s;
+                    if (get_strlit_contents(&s, xb.to, -1, strtype) > 0)
+                    {
+                        if (found_strings.find(s) == found_strings.end())
+                        {
+                            if (found_strings.empty()) string_xrefs_str.clear();
+                            std::string literal(s.c_str(), s.length());
+                            sanitize_utf8(&literal, MAX_STRLIT_CHARS);
+                            string_xrefs_str.cat_sprnt("\"%s\"\n", literal.c_str());
+                            found_strings.insert(s);
+                        }
+                    }
+                }
+            }
+        }
+        context["string_xrefs"] = string_xrefs_str.c_str();
+        sanitize_context(&context, MAX_CONTEXT_FIELD);
+        return context;
+    }
+
+    void merge_struct_evidence(struct_evidence_t* into, const struct_evidence_t& from)
+    {
+        static const size_t MAX_SAMPLES = 4;
+        for (const auto& [offset, field] : from.fields)
+        {
+            field_evidence_t& dst = into->fields[offset];
+            dst.sizes.insert(field.sizes.begin(), field.sizes.end());
+            dst.access |= field.access;
+            dst.funcs.insert(field.funcs.begin(), field.funcs.end());
+            for (const auto& sample : field.samples)
+            {
+                if (dst.samples.size() >= MAX_SAMPLES)
+                    break;
+                dst.samples.push_back(sample);
+            }
+        }
+        into->sites.insert(into->sites.end(), from.sites.begin(), from.sites.end());
+        into->visited_funcs.insert(from.visited_funcs.begin(), from.visited_funcs.end());
+    }
+
+    // Everything one request needs to rebuild a class: each virtual method, the functions
+    // that install the vtable (constructors/destructors) and the member accesses of all of them.
+    nlohmann::json get_class_context_for_prompt(ea_t vtable_ea, const std::vector<ea_t>& methods, const std::string& class_info)
+    {
+        static const size_t MAX_CTORS = 4;
+        static const size_t MIN_METHOD_CHARS = 800;
+
+        std::vector<ea_t> ctors;
+        xrefblk_t xb;
+        for (bool ok = xb.first_to(vtable_ea, XREF_DATA); ok && ctors.size() < MAX_CTORS; ok = xb.next_to())
+        {
+            func_t* pfn = get_func(xb.from);
+            if (pfn != nullptr && std::find(ctors.begin(), ctors.end(), pfn->start_ea) == ctors.end())
+                ctors.push_back(pfn->start_ea);
+        }
+
+        // Methods and constructors share most of the budget; a method listed in several
+        // slots is decompiled once.
+        std::map<ea_t, std::vector<int>> slots_of;
+        for (size_t i = 0; i < methods.size(); ++i)
+            slots_of[methods[i]].push_back((int)i);
+        const size_t budget = (size_t)std::max(g_settings.max_prompt_tokens, 1) * 3 / 4;
+        const size_t per_func = std::max(MIN_METHOD_CHARS, budget / std::max<size_t>(1, slots_of.size() + ctors.size()));
+
+        // Only the functions themselves: the class is the union of what its methods touch.
+        settings_t local_settings = g_settings;
+        local_settings.xref_analysis_depth = 0;
+        struct_evidence_t evidence;
+
+        auto add_evidence = [&](ea_t func_ea) {
+            merge_struct_evidence(&evidence, collect_struct_evidence(func_ea, 0, local_settings));
+        };
+
+        qstring methods_str;
+        std::set<ea_t> done;
+        for (size_t i = 0; i < methods.size(); ++i)
+        {
+            ea_t func_ea = methods[i];
+            qstring name;
+            get_func_name(&name, func_ea);
+            if (!done.insert(func_ea).second)
+            {
+                methods_str.cat_sprnt("// slot %d: same function as slot %d (%s)\n\n", (int)i, slots_of[func_ea].front(), name.c_str());
+                continue;
+            }
+            auto code = get_function_code(func_ea, per_func);
+            methods_str.cat_sprnt("// slot %d: 0x%llx %s\n%s\n\n", (int)i, (uint64)func_ea, name.c_str(), code.first.c_str());
+            add_evidence(func_ea);
+        }
+
+        qstring ctors_str;
+        for (ea_t func_ea : ctors)
+        {
+            qstring name;
+            get_func_name(&name, func_ea);
+            auto code = get_function_code(func_ea, per_func);
+            ctors_str.cat_sprnt("// 0x%llx %s\n%s\n\n", (uint64)func_ea, name.c_str(), code.first.c_str());
+            if (done.insert(func_ea).second)
+                add_evidence(func_ea);
+        }
+        if (ctors_str.empty())
+            ctors_str = "// No function references the vtable directly.\n";
+
+        qstring vtable_hex;
+        vtable_hex.sprnt("%llx", (uint64)vtable_ea);
+        nlohmann::json context = {
+            {"ok", true},
+            {"vtable_ea_hex", vtable_hex.c_str()},
+            {"slot_count", std::to_string(methods.size())},
+            {"class_context", class_info.empty() ? "// No RTTI for this vtable; infer the class name from the code." : class_info},
+            {"methods", methods_str.c_str()},
+            {"ctors", ctors_str.c_str()},
+            {"struct_context", format_struct_evidence(evidence)},
+        };
+        sanitize_context(&context, MAX_CONTEXT_FIELD);
+        return context;
+    }
+
+    bool parse_class_suggestion(const std::string& text, class_suggestion_t* out)
+    {
+        static const std::regex cpp_re("```(?:cpp|c\\+\\+|c)\\s*([\\s\\S]*?)\\s*```");
+        static const std::regex json_re("```json\\s*([\\s\\S]*?)\\s*```");
+
+        std::smatch match;
+        if (std::regex_search(text, match, cpp_re))
+            out->struct_code = match[1].str();
+
+        std::string json_str;
+        if (std::regex_search(text, match, json_re))
+        {
+            json_str = match[1].str();
+        }
+        else
+        {
+            size_t begin = text.find('[');
+            size_t end = text.rfind(']');
+            if (begin != std::string::npos && end != std::string::npos && end > begin)
+                json_str = text.substr(begin, end - begin + 1);
+        }
+
+        nlohmann::json items = nlohmann::json::parse(json_str, nullptr, false);
+        if (items.is_array())
+        {
+            for (const auto& item : items)
+            {
+                if (!item.is_object() || !item.contains("slot") || !item["slot"].is_number_integer())
+                    continue;
+                method_suggestion_t m;
+                m.slot = item["slot"].get<int>();
+                if (item.contains("name") && item["name"].is_string())
+                    m.name = item["name"].get<std::string>().c_str();
+                if (item.contains("prototype") && item["prototype"].is_string())
+                    m.prototype = item["prototype"].get<std::string>().c_str();
+                out->methods.push_back(std::move(m));
+            }
+        }
+        return !out->struct_code.empty() || !out->methods.empty();
+    }
+
+    qstring apply_class_suggestion(const class_suggestion_t& suggestion, const std::vector<ea_t>& methods)
+    {
+        qstring summary;
+        undo_batch_t batch("AiDA: apply reconstructed class");
+
+        // The struct goes in first so the prototypes below can refer to it.
+        if (!suggestion.struct_code.empty() && !methods.empty())
+            apply_struct_from_cpp("```cpp\n" + suggestion.struct_code + "\n```", methods.front(), STRUCT_CONFLICT_OVERWRITE);
+
+        std::set<ea_t> done;
+        for (const method_suggestion_t& m : suggestion.methods)
+        {
+            if (m.slot < 0 || (size_t)m.slot >= methods.size())
+                continue;
+            ea_t func_ea = methods[m.slot];
+            if (!done.insert(func_ea).second)
+                continue;
+
+            qstring old_name;
+            get_func_name(&old_name, func_ea);
+            // Names from the RTTI scan are placeholders too.
+            bool placeholder = !has_user_name(get_flags(func_ea)) || old_name.find("::vfunc_") != qstring::npos;
+            if (!m.name.empty() && placeholder && set_name(func_ea, m.name.c_str(), SN_NOWARN | SN_NOCHECK | SN_FORCE))
+                summary.cat_sprnt("slot %d: %s -> %s\n", m.slot, old_name.c_str(), m.name.c_str());
+
+            if (m.prototype.empty())
+                continue;
+            qstring decl = m.prototype;
+            if (decl.last() != ';')
+                decl.append(';');
+            tinfo_t tif;
+            qstring decl_name;
+            if (parse_decl(&tif, &decl_name, nullptr, decl.c_str(), PT_SIL) && tif.is_func() && apply_tinfo(func_ea, tif, TINFO_DEFINITE))
+                summary.cat_sprnt("slot %d: type %s\n", m.slot, m.prototype.c_str());
+            else
+                summary.cat_sprnt("slot %d: could not apply prototype '%s'\n", m.slot, m.prototype.c_str());
+        }
+
+        schedule_refresh(BADADDR, IWID_DISASM | IWID_PSEUDOCODE | IWID_FUNCS | IWID_NAMES);
+        return summary;
+    }
+
+    std::string format_prompt(const char* prompt_template, const nlohmann::json& context)
+    {
+        // One pass into a buffer sized up front: contexts run to megabytes, and replacing
+        // placeholders in place moves the whole tail of the prompt for each one.
+        const size_t template_len = strlen(prompt_template);
+        size_t reserve = template_len;
+        for (const auto& val : context)
+        {
+            if (val.is_string())
+                reserve += val.get_ref<const std::string&>().size();
+        }
+        std::string result;
+        result.reserve(reserve);
+
+        const char* p = prompt_template;
+        const char* end = prompt_template + template_len;
+        while (p < end)
+        {
+            const char* open = std::find(p, end, '{');
+            result.append(p, open);
+            if (open == end)
+                break;
+            const char* close = std::find(open + 1, end, '}');
+            auto it = close != end ? context.find(std::string(open + 1, close)) : context.end();
+            if (it == context.end() || !it->is_string())
+            {
+                // Not a placeholder, e.g. the JSON examples in the templates.
+                result += '{';
+                p = open + 1;
+                continue;
+            }
+            result.append(it->get_ref<const std::string&>());
+            p = close + 1;
+        }
+        // Contexts are clean already; this covers what the user typed and model answers fed back in.
+        sanitize_utf8(&result);
+        return result;
+    }
+
+    static bool is_bad_control(uchar c)
+    {
+        return (c < 0x20 && c != '\t' && c != '\n' && c != '\r') || c == 0x7F;
+    }
+
+    // Length of the well-formed sequence at p, or 0. Rejects overlong forms, surrogates
+    // and code points past U+10FFFF, as the JSON serializer does.
+    static size_t utf8_sequence_length(const uchar* p, size_t n)
+    {
+        const uchar c = p[0];
+        size_t len;
+        if (c >= 0xC2 && c <= 0xDF)
+            len = 2;
+        else if (c >= 0xE0 && c <= 0xEF)
+            len = 3;
+        else if (c >= 0xF0 && c <= 0xF4)
+            len = 4;
+        else
+            return 0;
+        if (n < len)
+            return 0;
+        for (size_t i = 1; i < len; ++i)
+        {
+            if ((p[i] & 0xC0) != 0x80)
+                return 0;
+        }
+        if ((c == 0xE0 && p[1] < 0xA0) || (c == 0xED && p[1] > 0x9F)
+            || (c == 0xF0 && p[1] < 0x90) || (c == 0xF4 && p[1] > 0x8F))
+        {
+            return 0;
+        }
+        return len;
+    }
+
+#ifdef IDA_UTILS_SSE2
+    // True when all 16 bytes are printable ASCII, tab, LF or CR.
+    static bool is_plain_block(const uchar* p)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)p);
+        // Bytes with the high bit set compare as negative, so this also flags non-ASCII.
+        const __m128i low = _mm_cmplt_epi8(v, _mm_set1_epi8(0x20));
+        const __m128i allowed = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        const __m128i bad = _mm_or_si128(_mm_andnot_si128(allowed, low), _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F)));
+        return _mm_movemask_epi8(bad) == 0;
+    }
+#endif
+
+    // Length of the leading run that needs no repair. Plain ASCII goes 16 bytes at a
+    // time; a block that is not plain is walked byte by byte, then back to the fast loop.
+    static size_t clean_prefix(const uchar* p, size_t n)
+    {
+        size_t i = 0;
+        while (i < n)
+        {
+#ifdef IDA_UTILS_SSE2
+            while (i + 16 <= n && is_plain_block(p + i))
+                i += 16;
+#endif
+            const size_t stop = std::min(n, i + 16);
+            while (i < stop)
+            {
+                if (p[i] < 0x80)
+                {
+                    if (is_bad_control(p[i]))
+                        return i;
+                    ++i;
+                    continue;
+                }
+                const size_t len = utf8_sequence_length(p + i, n - i);
+                if (len == 0)
+                    return i;
+                i += len;
+            }
+        }
+        return i;
+    }
+
+    bool sanitize_utf8(std::string* text, size_t max_len)
+    {
+        const uchar* p = (const uchar*)text->data();
+        const size_t n = text->size();
+        size_t i = clean_prefix(p, n);
+        bool changed = false;
+        if (i < n)
+        {
+            static const char hex[] = "0123456789abcdef";
+            std::string out;
+            out.reserve(n + 16);
+            out.append((const char*)p, i);
+            while (i < n && (max_len == 0 || out.size() <= max_len))
+            {
+                // Stray bytes stay visible to the model, e.g. a Latin-1 0xE9 becomes \xe9.
+                out += "\\x";
+                out += hex[p[i] >> 4];
+                out += hex[p[i] & 15];
+                ++i;
+                const size_t run = clean_prefix(p + i, n - i);
+                out.append((const char*)p + i, run);
+                i += run;
+            }
+            *text = std::move(out);
+            changed = true;
+        }
+        if (max_len != 0 && text->size() > max_len)
+        {
+            size_t cut = max_len;
+            while (cut > 0 && ((uchar)(*text)[cut] & 0xC0) == 0x80)
+                --cut;
+            text->resize(cut);
+            text->append("...[truncated]");
+            changed = true;
+        }
+        return changed;
+    }
+
+    void sanitize_context(nlohmann::json* context, size_t max_len)
+    {
+        for (auto& item : *context)
+        {
+            if (item.is_string())
+                sanitize_utf8(&item.get_ref<std::string&>(), max_len);
+            else if (item.is_structured())
+                sanitize_context(&item, max_len);
+        }
+    }
+
+    // Bytes a JSON string escapes: 1 for the two-character forms, 5 for \u00XX.
+    static size_t json_escape_extra(uchar c)
+    {
+        switch (c)
+        {
+        case '"': case '\\': case '\b': case '\f': case '\n': case '\r': case '\t':
+            return 1;
+        default:
+            return c < 0x20 ? 5 : 0;
+        }
+    }
+
+#ifdef IDA_UTILS_SSE2
+    static inline unsigned lowest_bit(unsigned m)
+    {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanForward(&idx, m);
+        return (unsigned)idx;
+#else
+        return (unsigned)__builtin_ctz(m);
+#endif
+    }
+#endif
+
+#ifdef IDA_UTILS_SSE2
+    // Bit i set when p[i] needs escaping in a JSON string: '"', '\\' or a control byte.
+    static unsigned json_special_mask(const uchar* p)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)p);
+        // Unsigned v <= 0x1F, so UTF-8 bytes pass through.
+        const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v);
+        const __m128i quote = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+        return (unsigned)_mm_movemask_epi8(_mm_or_si128(control, quote));
+    }
+#endif
+
+    static char* write_json_escape(char* dst, uchar c)
+    {
+        static const char hex[] = "0123456789abcdef";
+        *dst++ = '\\';
+        switch (c)
+        {
+        case '"': *dst++ = '"'; break;
+        case '\\': *dst++ = '\\'; break;
+        case '\b': *dst++ = 'b'; break;
+        case '\f': *dst++ = 'f'; break;
+        case '\n': *dst++ = 'n'; break;
+        case '\r': *dst++ = 'r'; break;
+        case '\t': *dst++ = 't'; break;
+        default:
+            *dst++ = 'u';
+            *dst++ = '0';
+            *dst++ = '0';
+            *dst++ = hex[c >> 4];
+            *dst++ = hex[c & 15];
+            break;
+        }
+        return dst;
+    }
+
+    size_t json_escaped_length(const char* text, size_t len)
+    {
+        const uchar* p = (const uchar*)text;
+        size_t extra = 0;
+        size_t i = 0;
+#ifdef IDA_UTILS_SSE2
+        for (; i + 16 <= len; i += 16)
+        {
+            for (unsigned bits = json_special_mask(p + i); bits != 0; bits &= bits - 1)
+                extra += json_escape_extra(p[i + lowest_bit(bits)]);
+        }
+#endif
+        for (; i < len; ++i)
+            extra += json_escape_extra(p[i]);
+        return len + extra;
+    }
+
+    void append_json_escaped(std::string* out, const char* text, size_t len)
+    {
+        const uchar* p = (const uchar*)text;
+        const size_t start = out->size();
+        out->resize(start + json_escaped_length(text, len));
+        char* dst = &(*out)[start];
+        size_t i = 0;
+#ifdef IDA_UTILS_SSE2
+        // Each block goes out in the pieces between the bytes that need escaping.
+        for (; i + 16 <= len; i += 16)
+        {
+            size_t done = 0;
+            for (unsigned bits = json_special_mask(p + i); bits != 0; bits &= bits - 1)
+            {
+                const size_t k = lowest_bit(bits);
+                memcpy(dst, p + i + done, k - done);
+                dst = write_json_escape(dst + (k - done), p[i + k]);
+                done = k + 1;
+            }
+            memcpy(dst, p + i + done, 16 - done);
+            dst += 16 - done;
+        }
+#endif
+        for (; i < len; ++i)
+        {
+            if (json_escape_extra(p[i]) == 0)
+                *dst++ = (char)p[i];
+            else
+                dst = write_json_escape(dst, p[i]);
+        }
+    }
+
+    struct lvar_type_modifier_t : public user_lvar_modifier_t
+    {
+        std::vector<std::pair<lvar_locator_t, tinfo_t>> changes;
+
+        bool idaapi modify_lvars(lvar_uservec_t* lvinf) override
+        {
+            for (const auto& [ll, tif] : changes)
+            {
+                lvar_saved_info_t* info = lvinf->find_info(ll);
+                if (info == nullptr)
+                {
+                    lvar_saved_info_t lsi;
+                    lsi.ll = ll;
+                    lvinf->lvvec.push_back(lsi);
+                    info = &lvinf->lvvec.back();
+                }
+                info->type = tif;
+            }
+            return !changes.empty();
+        }
+    };
+
+    int propagate_struct_type(ea_t func_ea, int arg_pos, const tinfo_t& ptr_tif, qstring* summary)
+    {
+        struct_evidence_t evidence = collect_struct_evidence(func_ea, arg_pos, g_settings);
+        if (evidence.sites.empty())
+            return 0;
+
+        qstring new_type_name;
+        ptr_tif.get_pointed_object().get_type_name(&new_type_name);
+
+        std::map<ea_t, lvar_type_modifier_t> per_func;
+        for (const auto& site : evidence.sites)
+        {
+            if (site.delta != 0)
+                continue;
+
+            // Never replace a struct type that somebody already chose for this variable.
+            if (site.func_ea != func_ea && site.lvar_type.is_ptr() && site.lvar_type.get_pointed_object().is_udt())
+            {
+                qstring existing_name;
+                site.lvar_type.get_pointed_object().get_type_name(&existing_name);
+                if (existing_name != new_type_name)
+                    continue;
+            }
+            if (site.lvar_type.equals_to(ptr_tif))
+                continue;
+
+            per_func[site.func_ea].changes.emplace_back(site.ll, ptr_tif);
+            if (summary != nullptr)
+            {
+                qstring func_name;
+                get_func_name(&func_name, site.func_ea);
+                summary->cat_sprnt("  %s (0x%llx): %s\n", func_name.c_str(), site.func_ea, site.lvar_name.c_str());
+            }
+        }
+
+        if (per_func.empty())
+            return 0;
+
+        qstring label;
+        label.sprnt("AiDA: apply %s", ptr_tif.dstr());
+        undo_batch_t batch(label.c_str());
+
+        int applied = 0;
+        for (auto& [ea, modifier] : per_func)
+        {
+            if (modify_user_lvars(ea, modifier))
+            {
+                applied += (int)modifier.changes.size();
+                schedule_refresh(ea, IWID_PSEUDOCODE);
+            }
+            else
+            {
+                msg("AiDA: Failed to update variable types in function at 0x%llx.\n", ea);
+            }
+        }
+
+        return applied;
+    }
+
+    struct layout_member_t
+    {
+        qstring name;
+        tinfo_t type;
+        int64 offset;
+        int64 size;
+        int udm_index = -1;   // the parsed member this one came from; -1 for added ones
+    };
+
+    struct layout_report_t
+    {
+        qstrvec_t fixes;
+        qstrvec_t ambiguous;
+    };
+
+    // Only the filler make_padding and the prompts name pad_/gap_ may be resized or split; a
+    // real `char Name[N]` buffer or an unk* field keeps the layout the model gave it.
+    static bool is_padding_member(const layout_member_t& m)
+    {
+        return m.name.starts_with("pad_") || m.name.starts_with("gap_");
+    }
+
+    static bool is_byte_array(const layout_member_t& m)
+    {
+        return m.type.is_array() && m.type.get_array_element().get_size() == 1;
+    }
+
+    static void report_byte_array_access(layout_report_t& report, const layout_member_t& m, int64 offset, int size)
+    {
+        qstring problem;
+        problem.sprnt("access at 0x%llX (size %d) lands inside char array '%s' (0x%llX, %lld bytes)", offset, size, m.name.c_str(), m.offset, m.size);
+        report.ambiguous.push_back(problem);
+    }
+
+    static tinfo_t make_int_type(int size)
+    {
+        const char* decl = size == 1 ? "__int8" : size == 2 ? "__int16" : size == 4 ? "__int32" : "__int64";
+        tinfo_t tif;
+        tif.parse(decl);
+        return tif;
+    }
+
+    static layout_member_t make_padding(int64 offset, int64 size)
+    {
+        layout_member_t pad;
+        pad.name.sprnt("pad_%04llX", offset);
+        pad.type.create_array(tinfo_t(BTF_CHAR), (uint32)size);
+        pad.offset = offset;
+        pad.size = size;
+        return pad;
+    }
+
+    static layout_member_t make_field(int64 offset, int size)
+    {
+        layout_member_t field;
+        field.name.sprnt("field_%llX", offset);
+        field.type = make_int_type(size);
+        field.offset = offset;
+        field.size = size;
+        return field;
+    }
+
+    // Member offsets the model wrote into its comments, e.g. "__int32 Health; // 0x0090".
+    static std::map<std::string, int64> get_declared_offsets(const std::string& struct_code)
+    {
+        std::map<std::string, int64> declared;
+        static const std::regex member_re("([A-Za-z_][A-Za-z0-9_]*)\\s*(?:\\[[^\\]]*\\])?\\s*;\\s*//\\s*(?:offset\\s*:?\\s*)?\\+?0x([0-9A-Fa-f]+)");
+        for (auto it = std::sregex_iterator(struct_code.begin(), struct_code.end(), member_re); it != std::sregex_iterator(); ++it)
+        {
+            try { declared[(*it)[1].str()] = (int64)std::stoull((*it)[2].str(), nullptr, 16); }
+            catch (...) {}
+        }
+        return declared;
+    }
+
+    // Compares the parsed layout with the observed member accesses and the offsets the model declared.
+    // Padding and plain integer members are repaired when the evidence leaves only one possible layout;
+    // everything else is reported as ambiguous.
+    static bool repair_struct_layout(
+        std::vector<layout_member_t>& members,
+        const struct_evidence_t& evidence,
+        const std::map<std::string, int64>& declared,
+        layout_report_t& report)
+    {
+        bool changed = false;
+
+        // Step 1: resize padding so members land at the offsets the model itself declared.
+        for (size_t i = 1; i < members.size(); ++i)
+        {
+            auto it = declared.find(members[i].name.c_str());
+            if (it == declared.end() || it->second == members[i].offset)
+                continue;
+
+            int64 delta = it->second - members[i].offset;
+            layout_member_t& prev = members[i - 1];
+            if (!is_padding_member(prev) || prev.size + delta <= 0)
+            {
+                qstring problem;
+                problem.sprnt("'%s' is declared at 0x%llX but laid out at 0x%llX", members[i].name.c_str(), it->second, members[i].offset);
+                report.ambiguous.push_back(problem);
+                continue;
+            }
+
+            prev.size += delta;
+            prev.type.create_array(tinfo_t(BTF_CHAR), (uint32)prev.size);
+            for (size_t j = i; j < members.size(); ++j)
+                members[j].offset += delta;
+
+            qstring fix;
+            fix.sprnt("resized '%s' by %+lld bytes so '%s' lands at 0x%llX", prev.name.c_str(), delta, members[i].name.c_str(), it->second);
+            report.fixes.push_back(fix);
+            changed = true;
+        }
+
+        // Step 2: make sure every observed access hits the start of a member of the right size.
+        for (const auto& [offset, field] : evidence.fields)
+        {
+            if (field.sizes.empty())
+                continue;
+
+            int size = *field.sizes.rbegin();
+            bool unique_size = field.sizes.size() == 1;
+
+            auto owner = std::find_if(members.begin(), members.end(), [offset = offset](const layout_member_t& m) {
+                return offset >= m.offset && offset < m.offset + m.size;
+            });
+
+            if (owner == members.end())
+            {
+                int64 end = members.empty() ? 0 : members.back().offset + members.back().size;
+                if (offset < end || !unique_size || offset % size != 0)
+                {
+                    qstring problem;
+                    problem.sprnt("access at 0x%llX (size %d) is not covered by any member", offset, size);
+                    report.ambiguous.push_back(problem);
+                    continue;
+                }
+                if (offset > end)
+                    members.push_back(make_padding(end, offset - end));
+                members.push_back(make_field(offset, size));
+
+                qstring fix;
+                fix.sprnt("appended '%s' (%d bytes) at 0x%llX past the end of the struct", members.back().name.c_str(), size, offset);
+                report.fixes.push_back(fix);
+                changed = true;
+                continue;
+            }
+
+            if (is_padding_member(*owner))
+            {
+                if (!unique_size || offset % size != 0 || offset + size > owner->offset + owner->size)
+                {
+                    qstring problem;
+                    problem.sprnt("access at 0x%llX (size%s %d) falls inside padding '%s'", offset, unique_size ? "" : "s up to", size, owner->name.c_str());
+                    report.ambiguous.push_back(problem);
+                    continue;
+                }
+
+                layout_member_t pad = *owner;
+                std::vector<layout_member_t> split;
+                if (offset > pad.offset)
+                    split.push_back(make_padding(pad.offset, offset - pad.offset));
+                split.push_back(make_field(offset, size));
+                if (offset + size < pad.offset + pad.size)
+                    split.push_back(make_padding(offset + size, pad.offset + pad.size - offset - size));
+
+                size_t pos = owner - members.begin();
+                members.erase(owner);
+                members.insert(members.begin() + pos, split.begin(), split.end());
+
+                qstring fix;
+                fix.sprnt("split '%s' to expose a %d-byte member at 0x%llX", pad.name.c_str(), size, offset);
+                report.fixes.push_back(fix);
+                changed = true;
+                continue;
+            }
+
+            if (owner->offset != offset)
+            {
+                if (is_byte_array(*owner))
+                {
+                    report_byte_array_access(report, *owner, offset, size);
+                    continue;
+                }
+                if (owner->type.is_array() || owner->type.is_udt())
+                    continue; // element or sub-object access
+                qstring problem;
+                problem.sprnt("access at 0x%llX hits the middle of '%s' (0x%llX, %lld bytes)", offset, owner->name.c_str(), owner->offset, owner->size);
+                report.ambiguous.push_back(problem);
+                continue;
+            }
+
+            if (is_byte_array(*owner) && size > 1)
+            {
+                report_byte_array_access(report, *owner, offset, size);
+                continue;
+            }
+
+            if (owner->size == size || !unique_size || owner->type.is_ptr() || owner->type.is_udt() || owner->type.is_array() || owner->type.is_floating())
+            {
+                if (owner->size != size && !owner->type.is_udt() && !owner->type.is_array())
+                {
+                    qstring problem;
+                    problem.sprnt("'%s' is %lld bytes but accessed as %d bytes at 0x%llX", owner->name.c_str(), owner->size, size, offset);
+                    report.ambiguous.push_back(problem);
+                }
+                continue;
+            }
+
+            if (size < owner->size)
+            {
+                // Shrink an integer member and keep the layout with a trailing pad.
+                int64 old_size = owner->size;
+                owner->type = make_int_type(size);
+                owner->size = size;
+                size_t pos = owner - members.begin();
+                members.insert(members.begin() + pos + 1, make_padding(offset + size, old_size - size));
+
+                qstring fix;
+                fix.sprnt("shrank '%s' at 0x%llX from %lld to %d bytes", members[pos].name.c_str(), offset, old_size, size);
+                report.fixes.push_back(fix);
+                changed = true;
+                continue;
+            }
+
+            // Grow an integer member over following padding only.
+            size_t pos = owner - members.begin();
+            size_t last = pos;
+            while (last + 1 < members.size() && members[last].offset + members[last].size < offset + size && is_padding_member(members[last + 1]))
+                ++last;
+            int64 covered_end = members[last].offset + members[last].size;
+            if (covered_end < offset + size)
+            {
+                qstring problem;
+                problem.sprnt("'%s' is %lld bytes but accessed as %d bytes at 0x%llX", owner->name.c_str(), owner->size, size, offset);
+                report.ambiguous.push_back(problem);
+                continue;
+            }
+
+            qstring name = owner->name;
+            int64 old_size = owner->size;
+            members.erase(members.begin() + pos, members.begin() + last + 1);
+            layout_member_t grown = make_field(offset, size);
+            grown.name = name;
+            members.insert(members.begin() + pos, grown);
+            if (covered_end > offset + size)
+                members.insert(members.begin() + pos + 1, make_padding(offset + size, covered_end - offset - size));
+
+            qstring fix;
+            fix.sprnt("grew '%s' at 0x%llX from %lld to %d bytes", name.c_str(), offset, old_size, size);
+            report.fixes.push_back(fix);
+            changed = true;
+        }
+
+        return changed;
+    }
+
+    // Builds the repaired struct from the parsed one rather than from printed C, so packing,
+    // base classes and member attributes survive. Fails if the result would not put every
+    // member at its repaired offset.
+    static bool build_struct_layout(const udt_type_data_t& parsed, const std::vector<layout_member_t>& members, tinfo_t* out)
+    {
+        udt_type_data_t udt = parsed;   // keeps pack, sda, effalign and the taudt bits
+        udt.clear();
+        for (const auto& m : members)
+        {
+            udm_t udm = m.udm_index >= 0 ? parsed[m.udm_index] : udm_t();
+            udm.name = m.name;
+            udm.type = m.type;
+            udm.offset = (uint64)m.offset * 8;
+            udm.size = (uint64)m.size * 8;
+            udt.push_back(udm);
+        }
+        const int64 end = members.empty() ? 0 : members.back().offset + members.back().size;
+        udt.total_size = std::max<size_t>(parsed.total_size, (size_t)end);
+        udt.unpadded_size = (size_t)end;
+        if (!out->create_udt(udt))
+            return false;
+
+        udt_type_data_t check;
+        if (!out->get_udt_details(&check) || check.size() != members.size())
+            return false;
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            if ((int64)(check[i].offset / 8) != members[i].offset)
+                return false;
+        }
+        return true;
+    }
+
+    // Validates the freshly parsed struct against the collected evidence and replaces it with a repaired layout.
+    static void validate_struct_layout(til_t* idati, const std::string& struct_name, const std::string& struct_code, ea_t ea)
+    {
+        tinfo_t struct_tif;
+        udt_type_data_t udt;
+        if (!struct_tif.get_named_type(idati, struct_name.c_str()) || !struct_tif.get_udt_details(&udt) || udt.is_union)
+            return;
+
+        std::vector<layout_member_t> members;
+        for (size_t i = 0; i < udt.size(); ++i)
+        {
+            const udm_t& udm = udt[i];
+            if (udm.is_bitfield())
+                return;
+            members.push_back({ udm.name, udm.type, (int64)(udm.offset / 8), (int64)(udm.size / 8), (int)i });
+        }
+
+        struct_evidence_t evidence;
+        func_t* pfn = get_func(ea);
+        if (pfn != nullptr && init_hexrays_plugin())
+        {
+            try
+            {
+                cfuncptr_t cfunc = decompile(pfn);
+                if (cfunc != nullptr)
+                    evidence = collect_struct_evidence(pfn->start_ea, find_object_arg(cfunc), g_settings);
+            }
+            catch (const vd_failure_t&) {}
+        }
+
+        layout_report_t report;
+        bool changed = repair_struct_layout(members, evidence, get_declared_offsets(struct_code), report);
+
+        for (const auto& fix : report.fixes)
+            msg("AiDA: Layout fix in '%s': %s.\n", struct_name.c_str(), fix.c_str());
+
+        if (changed)
+        {
+            tinfo_t fixed_tif;
+            if (!build_struct_layout(udt, members, &fixed_tif))
+            {
+                msg("AiDA: The repaired layout for '%s' does not hold under its packing, keeping the AI version.\n", struct_name.c_str());
+            }
+            else if (fixed_tif.set_named_type(idati, struct_name.c_str(), NTF_REPLACE) == TERR_OK)
+            {
+                qstring fixed_code;
+                fixed_tif.print(&fixed_code, struct_name.c_str(), PRTYPE_MULTI | PRTYPE_TYPE | PRTYPE_DEF | PRTYPE_SEMI | PRTYPE_PRAGMA);
+                msg("--- AiDA: Repaired layout for '%s' ---\n%s\n----------------------------------------\n", struct_name.c_str(), fixed_code.c_str());
+            }
+            else
+            {
+                msg("AiDA: Could not store the repaired layout for '%s', keeping the AI version.\n", struct_name.c_str());
+            }
+        }
+
+        if (!report.ambiguous.empty())
+        {
+            msg("AiDA: %d layout issue(s) in '%s' could not be fixed automatically:\n", (int)report.ambiguous.size(), struct_name.c_str());
+            for (const auto& problem : report.ambiguous)
+                msg("AiDA:   - %s\n", problem.c_str());
+            msg("AiDA: Consider regenerating the struct if these members matter.\n");
+        }
+        else if (!evidence.fields.empty())
+        {
+            msg("AiDA: Layout of '%s' matches all %d observed member accesses.\n", struct_name.c_str(), (int)evidence.fields.size());
+        }
+    }
+
+    // A warning() dialog for a user at the keyboard. With error set (RPC, batch runs) the
+    // reason goes to the Output window and *error instead, so nothing waits for a click.
+    AS_PRINTF(2, 3) static void report_failure(std::string* error, const char* format, ...)
+    {
+        qstring text;
+        va_list va;
+        va_start(va, format);
+        text.vsprnt(format, va);
+        va_end(va);
+        if (error == nullptr)
+        {
+            warning("%s", text.c_str());
+            return;
+        }
+        msg("%s\n", text.c_str());
+        *error = text.c_str();
+    }
+
+    bool apply_struct_from_cpp(const std::string& cpp_code, ea_t ea, struct_conflict_t on_conflict, std::string* error)
+    {
+        std::string struct_code;
+        std::smatch match_md;
+        if (std::regex_search(cpp_code, match_md, std::regex("```(?:cpp)?\\s*([\\s\\S]*?)\\s*```")))
+        {
+            struct_code = match_md[1].str();
+        }
+        else
+        {
+            if (cpp_code.find("struct") != std::string::npos)
+            {
+                struct_code = cpp_code;
+            }
+            else
+            {
+                report_failure(error, "AiDA: AI response did not contain a C++ struct definition.\n"
+                        "Full response:\n%s", cpp_code.c_str());
+                return false;
             }
         }
 
@@ -728,28 +2210,32 @@ namespace ida_utils
         std::smatch match_name;
         if (!std::regex_search(struct_code, match_name, std::regex("struct\\s+([a-zA-Z_][a-zA-Z0-9_]*)")))
         {
-            warning("AiDA: Could not find a valid struct name in the AI-generated code.");
+            report_failure(error, "AiDA: Could not find a valid struct name in the AI-generated code.");
             msg("--- Invalid Code Snippet ---\n%s\n----------------------------\n", struct_code.c_str());
-            return;
+            return false;
         }
         std::string original_struct_name = match_name[1].str();
         std::string final_struct_name = original_struct_name;
 
+        undo_batch_t batch("AiDA: apply struct");
         til_t* idati = get_idati();
         if (get_type_ordinal(idati, final_struct_name.c_str()) != 0)
         {
-            qstring question;
-            question.sprnt("A struct named '%s' already exists. What would you like to do?", final_struct_name.c_str());
-            
-            int choice = ask_buttons("~O~verwrite", "~R~ename", "~C~ancel", ASKBTN_CANCEL, question.c_str());
+            int choice = on_conflict == STRUCT_CONFLICT_OVERWRITE ? ASKBTN_YES : ASKBTN_NO;
+            if (on_conflict == STRUCT_CONFLICT_ASK)
+            {
+                qstring question;
+                question.sprnt("A struct named '%s' already exists. What would you like to do?", final_struct_name.c_str());
+                choice = ask_buttons("~O~verwrite", "~R~ename", "~C~ancel", ASKBTN_CANCEL, question.c_str());
+            }
 
             if (choice == ASKBTN_YES)
             {
                 msg("AiDA: Struct '%s' already exists, overwriting.\n", final_struct_name.c_str());
                 if (!del_named_type(idati, final_struct_name.c_str(), NTF_TYPE))
                 {
-                    warning("AiDA: Failed to delete existing struct '%s'. Aborting overwrite.", final_struct_name.c_str());
-                    return;
+                    report_failure(error, "AiDA: Failed to delete existing struct '%s'. Aborting overwrite.", final_struct_name.c_str());
+                    return false;
                 }
             }
             else if (choice == ASKBTN_NO)
@@ -766,7 +2252,7 @@ namespace ida_utils
             else
             {
                 msg("AiDA: Struct creation cancelled by user.\n");
-                return;
+                return false;
             }
         }
 
@@ -779,12 +2265,14 @@ namespace ida_utils
 
         if (parse_decls(idati, struct_code.c_str(), msg, HTI_DCL) != 0)
         {
-            warning("AiDA: Failed to parse the C++ struct. See the Output window for details and the code that was attempted.");
-            return;
+            report_failure(error, "AiDA: Failed to parse the C++ struct. See the Output window for details and the code that was attempted.");
+            return false;
         }
 
         msg("AiDA: Struct '%s' created/updated successfully.\n", final_struct_name.c_str());
 
+        validate_struct_layout(idati, final_struct_name, struct_code, ea);
+
         uint32 ordinal = get_type_ordinal(idati, final_struct_name.c_str());
         if (ordinal != 0)
         {
@@ -795,13 +2283,13 @@ namespace ida_utils
         if (pfn == nullptr)
         {
             msg("AiDA: No function at 0x%llx to apply type to.\n", ea);
-            return;
+            return true;
         }
 
         if (!init_hexrays_plugin())
         {
             msg("AiDA: Hex-Rays decompiler not available. Cannot automatically apply type to function arguments.\n");
-            return;
+            return true;
         }
 
         try
@@ -809,73 +2297,51 @@ namespace ida_utils
             cfuncptr_t cfunc = decompile(pfn);
             if (cfunc == nullptr)
             {
-                warning("AiDA: Could not decompile function at 0x%llx to apply type.", ea);
-                return;
+                report_failure(error, "AiDA: Could not decompile function at 0x%llx to apply type.", ea);
+                return true;
             }
 
-            lvars_t* lvars = cfunc->get_lvars();
-            lvar_t* target_lvar = nullptr;
-
-            if (lvars)
+            // Retyping spreads to every caller and callee, so only an argument that is already
+            // known to be an object qualifies.
+            int object_arg = find_object_arg(cfunc, true);
+            if (object_arg < 0)
             {
-                for (auto& lv : *lvars)
-                {
-                    if (lv.is_thisarg())
-                    {
-                        target_lvar = &lv;
-                        break;
-                    }
-                }
-                if (target_lvar == nullptr)
-                {
-                    for (auto& lv : *lvars)
-                    {
-                        if (lv.is_arg_var() && lv.type().is_ptr())
-                        {
-                            target_lvar = &lv;
-                            break;
-                        }
-                    }
-                }
+                msg("AiDA: Could not find a suitable argument to apply the new struct type to.\n");
+                return true;
             }
 
-            if (target_lvar)
-            {
-                qstring new_type_str;
-                new_type_str.sprnt("%s*", final_struct_name.c_str());
+            qstring new_type_str;
+            new_type_str.sprnt("%s*", final_struct_name.c_str());
 
-                tinfo_t tif;
-                if (tif.parse(new_type_str.c_str()))
-                {
-                    lvar_saved_info_t lsi;
-                    lsi.ll = *target_lvar;
-                    lsi.type = tif;
+            tinfo_t tif;
+            if (!tif.parse(new_type_str.c_str()))
+            {
+                report_failure(error, "AiDA: Failed to build type '%s'.", new_type_str.c_str());
+                return true;
+            }
 
-                    if (modify_user_lvar_info(pfn->start_ea, MLI_TYPE, lsi))
-                    {
-                        msg("AiDA: Applied type '%s' to argument '%s'.\n", new_type_str.c_str(), target_lvar->name.c_str());
-                        mark_cfunc_dirty(pfn->start_ea, true);
-                    }
-                    else
-                    {
-                        warning("AiDA: Failed to apply type '%s' to lvar '%s'.", new_type_str.c_str(), target_lvar->name.c_str());
-                    }
-                }
+            qstring summary;
+            int applied = propagate_struct_type(pfn->start_ea, object_arg, tif, &summary);
+            if (applied > 0)
+            {
+                msg("AiDA: Applied type '%s' to %d variable(s):\n%s", new_type_str.c_str(), applied, summary.c_str());
             }
             else
             {
-                msg("AiDA: Could not find a suitable argument to apply the new struct type to.\n");
+                report_failure(error, "AiDA: Failed to apply type '%s' to any variable.", new_type_str.c_str());
             }
         }
         catch (const vd_failure_t&)
         {
-            warning("AiDA: Decompilation failed, cannot automatically apply type.");
+            report_failure(error, "AiDA: Decompilation failed, cannot automatically apply type.");
         }
         catch (const std::exception& e)
         {
-            warning("AiDA: An unexpected error occurred during type application: %s", e.what());
+            report_failure(error, "AiDA: An unexpected error occurred during type application: %s", e.what());
         }
+        return true;
     }
+
     bool is_word_char(char c)
     {
         return qisalnum(c) || c == '_' || c == ':';
@@ -972,6 +2438,26 @@ namespace ida_utils
         return lower_s;
     }
 
+    bool clean_function_name(const std::string& suggested, qstring* out)
+    {
+        qstring clean_name = suggested.c_str();
+        clean_name.replace("`", "");
+        clean_name.replace("'", "");
+        clean_name.replace("\"", "");
+        clean_name.trim2();
+
+        if (clean_name.length() >= MAXNAMELEN - 10)
+        {
+            clean_name.resize(MAXNAMELEN - 10);
+            msg("AiDA: Truncated long suggested name.\n");
+        }
+
+        if (!validate_name(&clean_name, VNT_IDENT, SN_NOCHECK))
+            return false;
+        *out = clean_name;
+        return true;
+    }
+
     bool get_address_from_line_pos(ea_t* out_ea, const char* /*line*/, int /*x*/)
     {
         TWidget* view = get_current_viewer();
@@ -1030,313 +2516,642 @@ namespace ida_utils
             return false;
         }
 
-        struct clipboard_closer_t
+        struct clipboard_closer_t
+        {
+            ~clipboard_closer_t() { CloseClipboard(); }
+        } closer;
+
+        if (!EmptyClipboard())
+        {
+            warning("AiDA: Could not empty clipboard.");
+            return false;
+        }
+
+        qwstring wtext;
+        if (!utf8_utf16(&wtext, text.c_str()))
+        {
+            warning("AiDA: Failed to convert text to UTF-16 for clipboard.");
+            return false;
+        }
+
+        size_t wlen = wtext.length();
+        HGLOBAL hg = GlobalAlloc(GMEM_MOVEABLE, (wlen + 1) * sizeof(wchar16_t));
+        if (hg == nullptr)
+        {
+            warning("AiDA: GlobalAlloc failed for clipboard.");
+            return false;
+        }
+
+        wchar16_t* locked_mem = (wchar16_t*)GlobalLock(hg);
+        if (locked_mem == nullptr)
+        {
+            warning("AiDA: GlobalLock failed for clipboard.");
+            GlobalFree(hg);
+            return false;
+        }
+
+        memcpy(locked_mem, wtext.c_str(), (wlen + 1) * sizeof(wchar16_t));
+        GlobalUnlock(hg);
+
+        if (SetClipboardData(CF_UNICODETEXT, hg) == nullptr)
+        {
+            warning("AiDA: SetClipboardData failed.");
+            GlobalFree(hg);
+            return false;
+        }
+
+        return true;
+#elif defined(__LINUX__) || defined(__linux__)
+#ifdef fwrite
+#undef fwrite
+#endif
+        // Try wl-copy (Wayland) first, then xclip (X11)
+        const char* commands[] = { "wl-copy", "xclip -selection clipboard" };
+        for (const char* cmd : commands) {
+            FILE* pipe = popen(cmd, "w");
+            if (pipe) {
+                fwrite(text.c_str(), 1, text.length(), pipe);
+                pclose(pipe);
+                return true; 
+            }
+        }
+        warning("AiDA: Could not find 'wl-copy' or 'xclip' to set clipboard.");
+        return false;
+#else
+        warning("AiDA: Clipboard copy not implemented for this platform.");
+        return false;
+#endif
+    }
+
+    std::string format_context_for_clipboard(const nlohmann::json& context)
+    {
+        std::stringstream ss;
+
+        ss << "Function: " << context.value("func_ea_hex", "N/A") << "\n";
+        ss << "Prototype: " << context.value("func_prototype", "// N/A") << "\n\n";
+
+        ss << "--- Decompiled " << context.value("language", "Code") << " ---\n";
+        ss << context.value("code", "// No code available.") << "\n\n";
+
+        ss << "--- Local Variables ---\n";
+        ss << context.value("local_vars", "// No local variables found.") << "\n\n";
+
+        ss << "--- String Literals Referenced ---\n";
+        ss << context.value("string_xrefs", "// No string literals referenced.") << "\n\n";
+
+        ss << "--- Callers (Functions that call this one) ---\n";
+        ss << context.value("xrefs_to", "// No callers found.") << "\n\n";
+
+        ss << "--- Callees (Functions this one calls) ---\n";
+        ss << context.value("xrefs_from", "// No callees found.") << "\n\n";
+
+        if (context.contains("struct_context")) {
+            ss << "--- Struct Member Usage & Data Cross-References ---\n";
+            ss << context.value("struct_context", "// No struct context available.") << "\n\n";
+        }
+
+        ss << "--- Decompiler Warnings ---\n";
+        ss << context.value("decompiler_warnings", "// No decompiler warnings.") << "\n";
+
+        return ss.str();
+    }
+
+    int undo_batch_t::depth = 0;
+
+    undo_batch_t::undo_batch_t(const char* label, bool new_step)
+    {
+        if (depth++ == 0 && new_step)
+            create_undo_point("aida:batch", label);
+    }
+
+    undo_batch_t::~undo_batch_t()
+    {
+        --depth;
+    }
+
+    static int g_refresh_widgets = 0;
+    static qtimer_t g_refresh_timer = nullptr;
+
+    static int idaapi refresh_timer_cb(void* /*ud*/)
+    {
+        g_refresh_timer = nullptr;
+        flush_refresh();
+        return -1; // one-shot
+    }
+
+    void schedule_refresh(ea_t func_ea, int widgets)
+    {
+        // The decompiler cache is dropped now, so the next decompile (a later CLI chunk, the
+        // next streamed batch) sees the change. Only the repaint waits for the timer, which
+        // never fires under idalib.
+        if (func_ea != BADADDR && init_hexrays_plugin())
+            mark_cfunc_dirty(func_ea, false);
+        g_refresh_widgets |= widgets;
+
+        if (g_refresh_timer == nullptr)
+            g_refresh_timer = register_timer(100, refresh_timer_cb, nullptr);
+    }
+
+    void flush_refresh()
+    {
+        if (g_refresh_timer != nullptr)
+        {
+            unregister_timer(g_refresh_timer);
+            g_refresh_timer = nullptr;
+        }
+        if (g_refresh_widgets == 0)
+            return;
+
+        request_refresh(g_refresh_widgets);
+        g_refresh_widgets = 0;
+    }
+
+    bool parse_comment_item(const nlohmann::json& item, comment_suggestion_t* out)
+    {
+        if (!item.is_object() || !item.contains("address") || !item.contains("comment"))
+            return false;
+        if (!item["address"].is_string() || !item["comment"].is_string())
+            return false;
+
+        std::string addr_str = item["address"];
+        std::string comment_str = item["comment"];
+
+        ea_t ea;
+        if (sscanf(addr_str.c_str(), "0x%llX", &ea) != 1 && sscanf(addr_str.c_str(), "%llX", &ea) != 1)
+            return false;
+
+        qstring q_comment = comment_str.c_str();
+        q_comment.trim2();
+        if (q_comment.empty())
+            return false;
+
+        out->ea = ea;
+        out->text = q_comment;
+        return true;
+    }
+
+    std::vector<comment_suggestion_t> parse_comment_suggestions(const std::string& text)
+    {
+        std::string json_str = text;
+        static const std::regex md_json_re("```(?:json)?\\s*([\\s\\S]*?)\\s*```");
+        std::smatch match;
+        if (std::regex_search(text, match, md_json_re) && match.size() > 1)
+        {
+            json_str = match[1].str();
+        }
+
+        std::vector<comment_suggestion_t> suggestions;
+        auto comments = nlohmann::json::parse(json_str);
+        if (!comments.is_array())
+            throw std::runtime_error("AI response for comments is not a JSON array.");
+
+        suggestions.reserve(comments.size());
+        for (const auto& item : comments)
+        {
+            comment_suggestion_t suggestion;
+            if (parse_comment_item(item, &suggestion))
+                suggestions.push_back(std::move(suggestion));
+        }
+        return suggestions;
+    }
+
+    // Maps every statement of the function to the tree location a user comment attaches to.
+    struct comment_anchor_visitor_t : public ctree_visitor_t
+    {
+        std::map<ea_t, item_preciser_t> anchors;
+
+        comment_anchor_visitor_t() : ctree_visitor_t(CV_INSNS) {}
+
+        int idaapi visit_insn(cinsn_t* i) override
+        {
+            if (i->ea == BADADDR || anchors.count(i->ea) != 0)
+                return 0;
+
+            switch (i->op)
+            {
+            case cit_expr:
+            case cit_return:
+            case cit_goto:
+            case cit_break:
+            case cit_continue:
+            case cit_asm:
+                anchors[i->ea] = ITP_SEMI;
+                break;
+            default:
+                anchors[i->ea] = ITP_BLOCK1;
+                break;
+            }
+            return 0;
+        }
+    };
+
+    static bool resolve_comment_anchor(cfunc_t* cfunc, const std::map<ea_t, item_preciser_t>& anchors, ea_t ea, treeloc_t* loc)
+    {
+        auto it = anchors.find(ea);
+        if (it == anchors.end())
+        {
+            // Instructions folded into a larger statement map to that statement.
+            eamap_t& eamap = cfunc->get_eamap();
+            auto em = eamap.find(ea);
+            if (em != eamap.end() && !em->second.empty())
+                it = anchors.find(em->second[0]->ea);
+        }
+        if (it == anchors.end())
+        {
+            // Fall back to the closest preceding statement.
+            it = anchors.upper_bound(ea);
+            if (it == anchors.begin())
+                return false;
+            --it;
+        }
+        loc->ea = it->first;
+        loc->itp = it->second;
+        return true;
+    }
+
+    int apply_comments(ea_t func_ea, const std::vector<comment_suggestion_t>& comments)
+    {
+        if (comments.empty())
+            return 0;
+
+        cfuncptr_t cfunc(nullptr);
+        func_t* pfn = get_func(func_ea);
+        if (pfn != nullptr && init_hexrays_plugin())
+        {
+            try { cfunc = decompile(pfn); }
+            catch (const vd_failure_t&)
+            {
+                msg("AiDA: Decompilation failed for 0x%a, comments will only be added to disassembly.\n", func_ea);
+            }
+        }
+
+        // Group first so repeated addresses produce one comment and one database write.
+        std::map<ea_t, qstring> disasm_comments;
+        for (const auto& c : comments)
+        {
+            if (!is_mapped(c.ea))
+                continue;
+            qstring& text = disasm_comments[c.ea];
+            if (!text.empty())
+                text.append('\n');
+            text.append(c.text);
+        }
+        if (disasm_comments.empty())
+            return 0;
+
+        undo_batch_t batch("AiDA: apply comments");
+
+        std::map<treeloc_t, qstring> pseudo_comments;
+        if (cfunc != nullptr)
+        {
+            comment_anchor_visitor_t anchors;
+            anchors.apply_to(&cfunc->body, nullptr);
+
+            for (const auto& [ea, text] : disasm_comments)
+            {
+                treeloc_t loc;
+                if (!resolve_comment_anchor(cfunc, anchors.anchors, ea, &loc))
+                    continue;
+                qstring& merged = pseudo_comments[loc];
+                if (!merged.empty())
+                    merged.append('\n');
+                merged.append(text);
+            }
+        }
+
+        int count = 0;
+        for (const auto& [ea, text] : disasm_comments)
+        {
+            qstring existing_comment;
+            get_cmt(&existing_comment, ea, false);
+
+            if (existing_comment.empty())
+            {
+                set_cmt(ea, text.c_str(), false);
+            }
+            else
+            {
+                qstring new_comment;
+                new_comment.reserve(text.length() + existing_comment.length() + 1);
+                new_comment.append(text);
+                new_comment.append('\n');
+                new_comment.append(existing_comment);
+                set_cmt(ea, new_comment.c_str(), false);
+            }
+            count++;
+        }
+
+        if (cfunc != nullptr && !pseudo_comments.empty())
+        {
+            for (const auto& [loc, text] : pseudo_comments)
+            {
+                const char* existing_pcomment = cfunc->get_user_cmt(loc, RETRIEVE_ALWAYS);
+                if (existing_pcomment == nullptr || *existing_pcomment == '\0')
+                {
+                    cfunc->set_user_cmt(loc, text.c_str());
+                }
+                else
+                {
+                    qstring new_pcomment;
+                    new_pcomment.reserve(text.length() + qstrlen(existing_pcomment) + 1);
+                    new_pcomment.append(text);
+                    new_pcomment.append('\n');
+                    new_pcomment.append(existing_pcomment);
+                    cfunc->set_user_cmt(loc, new_pcomment.c_str());
+                }
+            }
+            cfunc->save_user_cmts();
+        }
+
+        schedule_refresh(cfunc != nullptr ? func_ea : BADADDR, IWID_DISASM | IWID_PSEUDOCODE);
+        return count;
+    }
+
+    std::vector<rename_suggestion_t> parse_rename_suggestions(const std::string& text)
+    {
+        std::string rename_block;
+        std::smatch match_md;
+        if (std::regex_search(text, match_md, std::regex("```(?:cpp)?\\s*([\\s\\S]*?)\\s*```")))
         {
-            ~clipboard_closer_t() { CloseClipboard(); }
-        } closer;
-
-        if (!EmptyClipboard())
+            rename_block = match_md[1].str();
+        }
+        else
         {
-            warning("AiDA: Could not empty clipboard.");
-            return false;
+            rename_block = text;
         }
 
-        qwstring wtext;
-        if (!utf8_utf16(&wtext, text.c_str()))
+        std::vector<rename_suggestion_t> suggestions;
+        std::stringstream ss(rename_block);
+        std::string line;
+        while (std::getline(ss, line))
         {
-            warning("AiDA: Failed to convert text to UTF-16 for clipboard.");
-            return false;
+            rename_suggestion_t suggestion;
+            if (parse_rename_line(line, &suggestion))
+                suggestions.push_back(std::move(suggestion));
         }
+        return suggestions;
+    }
 
-        size_t wlen = wtext.length();
-        HGLOBAL hg = GlobalAlloc(GMEM_MOVEABLE, (wlen + 1) * sizeof(wchar16_t));
-        if (hg == nullptr)
-        {
-            warning("AiDA: GlobalAlloc failed for clipboard.");
+    bool parse_rename_line(const std::string& line, rename_suggestion_t* out)
+    {
+        if (line.rfind("//", 0) != 0) // Must start with //
             return false;
-        }
 
-        wchar16_t* locked_mem = (wchar16_t*)GlobalLock(hg);
-        if (locked_mem == nullptr)
-        {
-            warning("AiDA: GlobalLock failed for clipboard.");
-            GlobalFree(hg);
+        size_t arrow_pos = line.find("->");
+        if (arrow_pos == std::string::npos)
             return false;
-        }
 
-        memcpy(locked_mem, wtext.c_str(), (wlen + 1) * sizeof(wchar16_t));
-        GlobalUnlock(hg);
+        std::string left_part_str = line.substr(2, arrow_pos - 2);
+        std::string right_part_str = line.substr(arrow_pos + 2);
 
-        if (SetClipboardData(CF_UNICODETEXT, hg) == nullptr)
+        qstring reason;
+        size_t comment_pos = right_part_str.find("//");
+        if (comment_pos != std::string::npos)
         {
-            warning("AiDA: SetClipboardData failed.");
-            GlobalFree(hg);
-            return false;
+            reason = right_part_str.substr(comment_pos + 2).c_str();
+            reason.trim2();
+            right_part_str = right_part_str.substr(0, comment_pos);
         }
 
-        return true;
-#elif defined(__LINUX__) || defined(__linux__)
-#ifdef fwrite
-#undef fwrite
-#endif
-        // Try wl-copy (Wayland) first, then xclip (X11)
-        const char* commands[] = { "wl-copy", "xclip -selection clipboard" };
-        for (const char* cmd : commands) {
-            FILE* pipe = popen(cmd, "w");
-            if (pipe) {
-                fwrite(text.c_str(), 1, text.length(), pipe);
-                pclose(pipe);
-                return true; 
-            }
-        }
-        warning("AiDA: Could not find 'wl-copy' or 'xclip' to set clipboard.");
-        return false;
-#else
-        warning("AiDA: Clipboard copy not implemented for this platform.");
-        return false;
-#endif
-    }
+        qstring q_left(left_part_str.c_str());
+        q_left.trim2();
+        if (q_left.ends_with(";"))
+            q_left.remove_last();
+        q_left.trim2();
 
-    std::string format_context_for_clipboard(const nlohmann::json& context)
-    {
-        std::stringstream ss;
+        qstring q_right(right_part_str.c_str());
+        q_right.trim2();
+        if (q_right.ends_with(";"))
+            q_right.remove_last();
+        q_right.trim2();
 
-        ss << "Function: " << context.value("func_ea_hex", "N/A") << "\n";
-        ss << "Prototype: " << context.value("func_prototype", "// N/A") << "\n\n";
+        // Heuristics to extract name from a C-style declaration
+        auto sanitize_name = [](qstring& s) {
+            // For functions: int func(...) -> func
+            ssize_t paren = s.find('(');
+            if (paren != -1)
+                s.resize(paren);
 
-        ss << "--- Decompiled " << context.value("language", "Code") << " ---\n";
-        ss << context.value("code", "// No code available.") << "\n\n";
+            // For arrays: int arr[...] -> arr
+            ssize_t bracket = s.find('[');
+            if (bracket != -1)
+                s.resize(bracket);
 
-        ss << "--- Local Variables ---\n";
-        ss << context.value("local_vars", "// No local variables found.") << "\n\n";
+            s.trim2();
 
-        ss << "--- String Literals Referenced ---\n";
-        ss << context.value("string_xrefs", "// No string literals referenced.") << "\n\n";
+            // For variables/types: type var -> var
+            // Also handles pointers: type * var -> var
+            ssize_t pos = s.rfind(' ');
+            if (pos == -1)
+                pos = s.rfind('*');
 
-        ss << "--- Callers (Functions that call this one) ---\n";
-        ss << context.value("xrefs_to", "// No callers found.") << "\n\n";
+            if (pos != -1)
+                s = s.substr(pos + 1);
 
-        ss << "--- Callees (Functions this one calls) ---\n";
-        ss << context.value("xrefs_from", "// No callees found.") << "\n\n";
+            s.trim2();
+        };
 
-        if (context.contains("struct_context")) {
-            ss << "--- Struct Member Usage & Data Cross-References ---\n";
-            ss << context.value("struct_context", "// No struct context available.") << "\n\n";
-        }
+        qstring original_name = q_left;
+        qstring new_name = q_right;
+        sanitize_name(original_name);
+        sanitize_name(new_name);
 
-        ss << "--- Decompiler Warnings ---\n";
-        ss << context.value("decompiler_warnings", "// No decompiler warnings.") << "\n";
+        if (original_name.empty() || new_name.empty() || original_name == new_name)
+            return false;
 
-        return ss.str();
+        out->original_name = original_name;
+        out->new_name = new_name;
+        out->reason = reason;
+        return true;
     }
 
-    qstring apply_renames_from_ai(ea_t func_ea, const std::string& cpp_code)
+    struct lvar_rename_modifier_t : public user_lvar_modifier_t
     {
-        if (!init_hexrays_plugin())
+        std::vector<std::pair<lvar_locator_t, qstring>> changes;
+
+        bool idaapi modify_lvars(lvar_uservec_t* lvinf) override
         {
-            warning("AiDA: Renaming requires the Hex-Rays decompiler.");
-            return "";
+            for (const auto& [ll, name] : changes)
+            {
+                lvar_saved_info_t* info = lvinf->find_info(ll);
+                if (info == nullptr)
+                {
+                    lvar_saved_info_t lsi;
+                    lsi.ll = ll;
+                    lvinf->lvvec.push_back(lsi);
+                    info = &lvinf->lvvec.back();
+                }
+                info->name = name;
+            }
+            return !changes.empty();
         }
+    };
 
-        func_t* pfn = get_func(func_ea);
-        if (pfn == nullptr)
+    qstring apply_renames(ea_t func_ea, const std::vector<rename_suggestion_t>& renames, std::vector<bool>* results, std::string* error)
+    {
+        if (results != nullptr)
+            results->assign(renames.size(), false);
+
+        if (!init_hexrays_plugin())
         {
-            warning("AiDA: Function at 0x%llx not found for renaming.", func_ea);
+            report_failure(error, "AiDA: Renaming requires the Hex-Rays decompiler.");
             return "";
         }
 
-        cfuncptr_t cfunc = decompile(pfn);
-        if (cfunc == nullptr)
+        func_t* pfn = get_func(func_ea);
+        if (pfn == nullptr)
         {
-            warning("AiDA: Decompilation failed for function at 0x%llx.", func_ea);
+            report_failure(error, "AiDA: Function at 0x%llx not found for renaming.", func_ea);
             return "";
         }
 
-        std::string rename_block;
-        std::smatch match_md;
-        if (std::regex_search(cpp_code, match_md, std::regex("```(?:cpp)?\\s*([\\s\\S]*?)\\s*```")))
+        cfuncptr_t cfunc(nullptr);
+        try
         {
-            rename_block = match_md[1].str();
+            cfunc = decompile(pfn);
         }
-        else
+        catch (const vd_failure_t&) {}
+        if (cfunc == nullptr)
         {
-            rename_block = cpp_code;
+            report_failure(error, "AiDA: Decompilation failed for function at 0x%llx.", func_ea);
+            return "";
         }
 
-        std::stringstream ss(rename_block);
-        std::string line;
         qstring summary;
         int renamed_count = 0;
+        int refresh_mask = 0;
 
-        while (std::getline(ss, line))
+        undo_batch_t batch("AiDA: apply renames");
+
+        // Local variables: one name index, one batched lvar update.
+        std::unordered_map<std::string, int> lvar_index;
+        lvars_t* lvars = cfunc->get_lvars();
+        if (lvars != nullptr)
         {
-            if (line.rfind("//", 0) != 0) // Must start with //
-                continue;
+            lvar_index.reserve(lvars->size());
+            for (size_t i = 0; i < lvars->size(); ++i)
+                lvar_index.emplace((*lvars)[i].name.c_str(), (int)i);
+        }
 
-            size_t arrow_pos = line.find("->");
-            if (arrow_pos == std::string::npos)
+        lvar_rename_modifier_t lvar_changes;
+        std::vector<size_t> lvar_items;
+        std::set<std::string> taken_lvar_names;
+        std::vector<const rename_suggestion_t*> global_renames;
+        for (const auto& rename : renames)
+        {
+            auto it = lvar_index.find(rename.original_name.c_str());
+            if (it == lvar_index.end())
+            {
+                global_renames.push_back(&rename);
                 continue;
+            }
 
-            std::string left_part_str = line.substr(2, arrow_pos - 2);
-            std::string right_part_str = line.substr(arrow_pos + 2);
-
-            size_t comment_pos = right_part_str.find("//");
-            if (comment_pos != std::string::npos)
-                right_part_str = right_part_str.substr(0, comment_pos);
-            
-            qstring q_left(left_part_str.c_str());
-            q_left.trim2();
-            if (q_left.ends_with(";"))
-                q_left.remove_last();
-            q_left.trim2();
-
-            qstring q_right(right_part_str.c_str());
-            q_right.trim2();
-            if (q_right.ends_with(";"))
-                q_right.remove_last();
-            q_right.trim2();
-
-
-            // Heuristics to extract name from a C-style declaration
-            auto sanitize_name = [](qstring& s) {
-                // For functions: int func(...) -> func
-                ssize_t paren = s.find('(');
-                if (paren != -1)
-                    s.resize(paren);
-                
-                // For arrays: int arr[...] -> arr
-                ssize_t bracket = s.find('[');
-                if (bracket != -1)
-                    s.resize(bracket);
-
-                s.trim2();
-
-                // For variables/types: type var -> var
-                // Also handles pointers: type * var -> var
-                ssize_t pos = s.rfind(' ');
-                if (pos == -1)
-                    pos = s.rfind('*');
-                
-                if (pos != -1)
-                    s = s.substr(pos + 1);
-                
-                s.trim2();
-            };
-
-            qstring original_name = q_left;
-            qstring new_name = q_right;
-            sanitize_name(original_name);
-            sanitize_name(new_name);
-
-            if (original_name.empty() || new_name.empty() || original_name == new_name)
+            auto clash = lvar_index.find(rename.new_name.c_str());
+            if ((clash != lvar_index.end() && clash->second != it->second) || !taken_lvar_names.insert(rename.new_name.c_str()).second)
+            {
+                msg("AiDA: Failed to rename local variable '%s' to '%s': name already in use.\n", rename.original_name.c_str(), rename.new_name.c_str());
                 continue;
+            }
+            lvar_changes.changes.emplace_back((*lvars)[it->second], rename.new_name);
+            lvar_items.push_back(&rename - renames.data());
+            summary.cat_sprnt("Local variable: %s -> %s\n", rename.original_name.c_str(), rename.new_name.c_str());
+        }
 
-            bool renamed = false;
-            lvars_t* lvars = cfunc->get_lvars();
-            if (lvars)
+        if (!lvar_changes.changes.empty())
+        {
+            if (modify_user_lvars(func_ea, lvar_changes))
             {
-                for (lvar_t& lv : *lvars)
-                {
-                    if (lv.name == original_name)
-                    {
-                        lvar_saved_info_t lsi;
-                        lsi.ll = lv; // copy locator
-                        lsi.name = new_name;
-                        if (modify_user_lvar_info(func_ea, MLI_NAME, lsi))
-                        {
-                            summary.cat_sprnt("Local variable: %s -> %s\n", original_name.c_str(), new_name.c_str());
-                            renamed = true;
-                            renamed_count++;
-                        }
-                        else
-                        {
-                            msg("AiDA: Failed to rename local variable '%s' to '%s'.\n", original_name.c_str(), new_name.c_str());
-                        }
-                        break;
-                    }
-                }
+                renamed_count += (int)lvar_changes.changes.size();
+                refresh_mask |= IWID_PSEUDOCODE;
+                if (results != nullptr)
+                    for (size_t i : lvar_items)
+                        (*results)[i] = true;
             }
+            else
+            {
+                msg("AiDA: Failed to apply %d local variable renames.\n", (int)lvar_changes.changes.size());
+                summary.clear();
+            }
+        }
 
-            if (!renamed)
+        // Global names: everything this function references, collected once.
+        std::set<ea_t> referenced;
+        if (!global_renames.empty())
+        {
+            func_item_iterator_t fii(pfn);
+            for (bool ok = fii.first(); ok; ok = fii.next_head())
             {
-                ea_t addr = get_name_ea(func_ea, original_name.c_str());
-                if (addr != BADADDR)
-                {
-                    bool is_local_to_func = func_contains(pfn, addr);
-                    bool name_is_relevant = is_local_to_func;
+                xrefblk_t xb;
+                for (bool ok_ref = xb.first_from(fii.current(), XREF_ALL); ok_ref; ok_ref = xb.next_from())
+                    referenced.insert(xb.to);
+            }
+        }
 
-                    if (!name_is_relevant)
-                    {
-                        xrefblk_t xb;
-                        for (bool ok = xb.first_to(addr, XREF_ALL); ok; ok = xb.next_to())
-                        {
-                            if (func_contains(pfn, xb.from))
-                            {
-                                name_is_relevant = true;
-                                break;
-                            }
-                        }
-                    }
+        til_t* til = get_idati();
+        for (const rename_suggestion_t* rename : global_renames)
+        {
+            const qstring& original_name = rename->original_name;
+            const qstring& new_name = rename->new_name;
 
-                    if (name_is_relevant)
-                    {
-                        if (set_name(addr, new_name.c_str(), SN_FORCE | SN_NODUMMY))
-                        {
-                            summary.cat_sprnt("%s: %s -> %s (at 0x%llx)\n",
-                                is_local_to_func ? "Local label" : "Global name",
-                                original_name.c_str(), new_name.c_str(), addr);
-                            renamed = true;
-                            renamed_count++;
-                        }
-                        else
-                        {
-                            msg("AiDA: Failed to rename '%s' to '%s'.\n", original_name.c_str(), new_name.c_str());
-                        }
-                    }
-                }
-            }
-            
-            if (!renamed)
+            ea_t addr = get_name_ea(func_ea, original_name.c_str());
+            if (addr != BADADDR)
             {
-                segment_t* seg = get_segm_by_name(original_name.c_str());
-                if (seg != nullptr)
+                bool is_local_to_func = func_contains(pfn, addr);
+                if (is_local_to_func || referenced.count(addr) != 0)
                 {
-                    if (set_segm_name(seg, new_name.c_str()) != 0)
+                    // SN_NOWARN keeps a bad name from raising IDA's own dialog when nobody is there.
+                    if (set_name(addr, new_name.c_str(), SN_FORCE | SN_NODUMMY | (error != nullptr ? SN_NOWARN : 0)))
                     {
-                        summary.cat_sprnt("Segment: %s -> %s\n", original_name.c_str(), new_name.c_str());
-                        renamed = true;
+                        summary.cat_sprnt("%s: %s -> %s (at 0x%llx)\n",
+                            is_local_to_func ? "Local label" : "Global name",
+                            original_name.c_str(), new_name.c_str(), addr);
                         renamed_count++;
-                        request_refresh(IWID_SEGS | IWID_DISASM);
+                        refresh_mask |= IWID_DISASM | IWID_PSEUDOCODE;
+                        if (results != nullptr)
+                            (*results)[rename - renames.data()] = true;
                     }
                     else
                     {
-                        msg("AiDA: Failed to rename segment '%s' to '%s'.\n", original_name.c_str(), new_name.c_str());
+                        msg("AiDA: Failed to rename '%s' to '%s'.\n", original_name.c_str(), new_name.c_str());
                     }
+                    continue;
                 }
             }
 
-            if (!renamed)
+            segment_t* seg = get_segm_by_name(original_name.c_str());
+            if (seg != nullptr)
             {
-                til_t* til = get_idati();
-                tinfo_t tif;
-                if (tif.get_named_type(til, original_name.c_str()))
+                if (set_segm_name(seg, new_name.c_str()) != 0)
                 {
-                    if (tif.is_udt() || tif.is_enum())
-                    {
-                        if (tif.rename_type(new_name.c_str()) == TERR_OK)
-                        {
-                            summary.cat_sprnt("%s: %s -> %s\n",
-                                tif.is_udt() ? "Struct/Union" : "Enum",
-                                original_name.c_str(), new_name.c_str());
-                            renamed = true;
-                            renamed_count++;
-                            request_refresh(IWID_TILS | IWID_TICSR);
-                        }
-                        else
-                        {
-                            msg("AiDA: Failed to rename type '%s' to '%s'.\n", original_name.c_str(), new_name.c_str());
-                        }
-                    }
+                    summary.cat_sprnt("Segment: %s -> %s\n", original_name.c_str(), new_name.c_str());
+                    renamed_count++;
+                    refresh_mask |= IWID_SEGS | IWID_DISASM;
+                    if (results != nullptr)
+                        (*results)[rename - renames.data()] = true;
+                }
+                else
+                {
+                    msg("AiDA: Failed to rename segment '%s' to '%s'.\n", original_name.c_str(), new_name.c_str());
+                }
+                continue;
+            }
+
+            tinfo_t tif;
+            if (tif.get_named_type(til, original_name.c_str()) && (tif.is_udt() || tif.is_enum()))
+            {
+                if (tif.rename_type(new_name.c_str()) == TERR_OK)
+                {
+                    summary.cat_sprnt("%s: %s -> %s\n",
+                        tif.is_udt() ? "Struct/Union" : "Enum",
+                        original_name.c_str(), new_name.c_str());
+                    renamed_count++;
+                    refresh_mask |= IWID_TILS | IWID_TICSR | IWID_PSEUDOCODE;
+                    if (results != nullptr)
+                        (*results)[rename - renames.data()] = true;
+                }
+                else
+                {
+                    msg("AiDA: Failed to rename type '%s' to '%s'.\n", original_name.c_str(), new_name.c_str());
                 }
             }
         }
@@ -1344,8 +3159,191 @@ namespace ida_utils
         if (renamed_count > 0)
         {
             msg("AiDA: Applied %d renames.\n", renamed_count);
+            schedule_refresh(func_ea, refresh_mask);
         }
 
         return summary;
     }
-}
\ No newline at end of file
+
+    qstring apply_renames_from_ai(ea_t func_ea, const std::string& cpp_code, std::string* error)
+    {
+        return apply_renames(func_ea, parse_rename_suggestions(cpp_code), nullptr, error);
+    }
+
+    void json_object_scanner_t::feed(const std::string& chunk, std::vector<std::string>* out)
+    {
+        for (char c : chunk)
+        {
+            if (_depth == 0)
+            {
+                if (c != '{')
+                    continue;
+                _current.clear();
+            }
+            _current.push_back(c);
+
+            if (_in_string)
+            {
+                if (_escaped)
+                    _escaped = false;
+                else if (c == '\\')
+                    _escaped = true;
+                else if (c == '"')
+                    _in_string = false;
+                continue;
+            }
+
+            if (c == '"')
+            {
+                _in_string = true;
+            }
+            else if (c == '{')
+            {
+                _depth++;
+            }
+            else if (c == '}' && --_depth == 0)
+            {
+                out->push_back(std::move(_current));
+                _current.clear();
+            }
+        }
+    }
+
+    void line_scanner_t::feed(const std::string& chunk, std::vector<std::string>* out)
+    {
+        size_t start = 0;
+        size_t nl;
+        while ((nl = chunk.find('\n', start)) != std::string::npos)
+        {
+            _partial.append(chunk, start, nl - start);
+            out->push_back(std::move(_partial));
+            _partial.clear();
+            start = nl + 1;
+        }
+        _partial.append(chunk, start, std::string::npos);
+    }
+
+    void line_scanner_t::finish(std::vector<std::string>* out)
+    {
+        if (!_partial.empty())
+            out->push_back(std::move(_partial));
+        _partial.clear();
+    }
+
+    struct stream_applier_t::drain_request_t : public exec_request_t
+    {
+        std::shared_ptr<stream_applier_t> applier;
+
+        explicit drain_request_t(std::shared_ptr<stream_applier_t> a) : applier(std::move(a)) {}
+
+        ssize_t idaapi execute() override
+        {
+            applier->drain();
+            delete this;
+            return 0;
+        }
+    };
+
+    void stream_applier_t::feed(const std::string& delta)
+    {
+        std::vector<std::string> pieces;
+        if (_kind == STREAM_COMMENTS)
+            _objects.feed(delta, &pieces);
+        else
+            _lines.feed(delta, &pieces);
+
+        if (!pieces.empty())
+            _queue(std::move(pieces));
+    }
+
+    void stream_applier_t::finish()
+    {
+        std::vector<std::string> pieces;
+        if (_kind == STREAM_RENAMES)
+            _lines.finish(&pieces);
+        if (!pieces.empty())
+            _queue(std::move(pieces));
+        drain();
+    }
+
+    void stream_applier_t::_queue(std::vector<std::string>&& pieces)
+    {
+        std::vector<comment_suggestion_t> comments;
+        std::vector<rename_suggestion_t> renames;
+        for (auto& piece : pieces)
+        {
+            if (_kind == STREAM_COMMENTS)
+            {
+                nlohmann::json item = nlohmann::json::parse(piece, nullptr, false);
+                comment_suggestion_t comment;
+                if (!item.is_discarded() && parse_comment_item(item, &comment))
+                    comments.push_back(std::move(comment));
+            }
+            else
+            {
+                size_t first = piece.find_first_not_of(" \t\r");
+                if (first == std::string::npos)
+                    continue;
+                piece.erase(0, first);
+                while (!piece.empty() && piece.back() == '\r')
+                    piece.pop_back();
+                rename_suggestion_t rename;
+                if (parse_rename_line(piece, &rename))
+                    renames.push_back(std::move(rename));
+            }
+        }
+        if (comments.empty() && renames.empty())
+            return;
+
+        bool post = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::move(comments.begin(), comments.end(), std::back_inserter(_pending_comments));
+            std::move(renames.begin(), renames.end(), std::back_inserter(_pending_renames));
+            if (!_drain_posted)
+                post = _drain_posted = true;
+        }
+
+        // Items arriving while a drain is already queued ride along with it.
+        if (post)
+            execute_sync(*new drain_request_t(shared_from_this()), MFF_NOWAIT);
+    }
+
+    void stream_applier_t::drain()
+    {
+        std::vector<comment_suggestion_t> comments;
+        std::vector<rename_suggestion_t> renames;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            comments.swap(_pending_comments);
+            renames.swap(_pending_renames);
+            _drain_posted = false;
+        }
+        if (comments.empty() && renames.empty())
+            return;
+
+        // The first piece of the response opens its undo step and later pieces join it, so one
+        // undo takes back the whole response.
+        undo_batch_t batch(_kind == STREAM_COMMENTS ? "AiDA: apply streamed comments" : "AiDA: apply streamed renames", !_undo_step_made);
+        _undo_step_made = true;
+
+        if (!comments.empty())
+        {
+            int count = apply_comments(_func_ea, comments);
+            _applied += count;
+            if (count > 0)
+                msg("AiDA: Applied %d streamed comment(s) at 0x%a.\n", count, _func_ea);
+        }
+
+        if (!renames.empty())
+        {
+            qstring batch_summary = apply_renames(_func_ea, renames);
+            for (const char* p = batch_summary.c_str(); *p != '\0'; ++p)
+            {
+                if (*p == '\n')
+                    _applied++;
+            }
+            _summary.append(batch_summary);
+        }
+    }
+}
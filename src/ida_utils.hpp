@@ -2,16 +2,177 @@
 
 #include <string>
 #include <utility>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
 
 #include <ida.hpp>
 #include <typeinf.hpp>
+#include <hexrays.hpp>
 #include <nlohmann/json.hpp>
 
 struct settings_t;
 
 namespace ida_utils
 {
-    std::string markup_text_with_addresses(const std::string& text);
+    enum field_access_t : uint32
+    {
+        FA_READ  = 1 << 0,
+        FA_WRITE = 1 << 1,
+        FA_CALL  = 1 << 2, // called through (vtable slot or function pointer)
+        FA_ADDR  = 1 << 3, // address taken / passed on as a sub-object
+    };
+
+    struct field_evidence_t
+    {
+        std::set<int> sizes;
+        uint32 access = 0;
+        std::set<ea_t> funcs;
+        std::vector<std::string> samples;
+    };
+
+    // A place where the tracked object pointer lives in some function.
+    // delta is the offset of the pointed-to address from the object base.
+    struct flow_site_t
+    {
+        ea_t func_ea = BADADDR;
+        lvar_locator_t ll;
+        qstring lvar_name;
+        tinfo_t lvar_type;
+        int64 delta = 0;
+    };
+
+    enum struct_conflict_t
+    {
+        STRUCT_CONFLICT_ASK,
+        STRUCT_CONFLICT_OVERWRITE,
+        STRUCT_CONFLICT_RENAME,
+    };
+
+    // Groups database edits into one undo step; nested batches join the outermost one. With
+    // new_step false the edits extend the last undo step instead, for a result applied in pieces.
+    class undo_batch_t
+    {
+    public:
+        explicit undo_batch_t(const char* label, bool new_step = true);
+        ~undo_batch_t();
+        undo_batch_t(const undo_batch_t&) = delete;
+        undo_batch_t& operator=(const undo_batch_t&) = delete;
+    private:
+        static int depth;
+    };
+
+    struct rename_suggestion_t
+    {
+        qstring original_name;
+        qstring new_name;
+        qstring reason;
+    };
+
+    struct comment_suggestion_t
+    {
+        ea_t ea = BADADDR;
+        qstring text;
+    };
+
+    // Cuts complete top-level JSON objects out of streamed text; anything between objects is ignored.
+    class json_object_scanner_t
+    {
+    public:
+        void feed(const std::string& chunk, std::vector<std::string>* out);
+    private:
+        std::string _current;
+        int _depth = 0;
+        bool _in_string = false;
+        bool _escaped = false;
+    };
+
+    class line_scanner_t
+    {
+    public:
+        void feed(const std::string& chunk, std::vector<std::string>* out);
+        void finish(std::vector<std::string>* out);
+    private:
+        std::string _partial;
+    };
+
+    enum stream_kind_t
+    {
+        STREAM_COMMENTS,
+        STREAM_RENAMES,
+    };
+
+    // Applies comments or renames while a response is still streaming.
+    // feed() runs on the request's worker thread; whatever has been parsed by the time
+    // the UI thread gets to it is applied as one batch.
+    class stream_applier_t : public std::enable_shared_from_this<stream_applier_t>
+    {
+    public:
+        stream_applier_t(stream_kind_t kind, ea_t func_ea) : _kind(kind), _func_ea(func_ea) {}
+
+        void feed(const std::string& delta);
+        void finish();
+        void drain();
+
+        int applied() const { return _applied; }
+        const qstring& summary() const { return _summary; }
+
+    private:
+        struct drain_request_t;
+
+        stream_kind_t _kind;
+        ea_t _func_ea;
+        json_object_scanner_t _objects;
+        line_scanner_t _lines;
+
+        std::mutex _mutex;
+        std::vector<comment_suggestion_t> _pending_comments;
+        std::vector<rename_suggestion_t> _pending_renames;
+        bool _drain_posted = false;
+
+        int _applied = 0;
+        qstring _summary;
+        bool _undo_step_made = false;
+
+        void _queue(std::vector<std::string>&& pieces);
+    };
+
+    struct struct_evidence_t
+    {
+        std::map<int64, field_evidence_t> fields;
+        std::vector<flow_site_t> sites;
+        std::set<ea_t> visited_funcs;
+    };
+
+    struct method_suggestion_t
+    {
+        int slot = -1;
+        qstring name;
+        qstring prototype; // "ret __fastcall fn(args)"; the placeholder name is ignored
+    };
+
+    struct class_suggestion_t
+    {
+        std::string struct_code;
+        std::vector<method_suggestion_t> methods;
+    };
+
+    // Segment ranges and entry point names, read once so that marking up a long text does
+    // not ask the kernel about every token.
+    struct address_markup_t
+    {
+        std::vector<std::pair<ea_t, ea_t>> ranges;  // sorted [start, end)
+        std::vector<std::pair<std::string, ea_t>> entry_names;
+
+        address_markup_t();
+        bool contains(ea_t ea) const;
+    };
+
+    // Tags auto-names (sub_XXXX, loc_XXXX, ...), 0x literals of 7+ digits and the entry point
+    // names in one pass, so double-clicking them in a viewer jumps to the address.
+    std::string markup_line_with_addresses(const char* text, size_t len, const address_markup_t& space);
     using get_code_callback_t = std::function<void(const std::pair<std::string, std::string>&)>;
     void get_function_code(ea_t ea, get_code_callback_t callback, size_t max_len = 0, bool force_assembly = false);
     std::pair<std::string, std::string> get_function_code(ea_t ea, size_t max_len = 0, bool force_assembly = false);
@@ -19,14 +180,53 @@ namespace ida_utils
     std::string get_code_xrefs_from(ea_t ea, const settings_t& settings);
     std::string get_struct_usage_context(ea_t ea);
     std::string get_data_xrefs_for_struct(const tinfo_t& struct_tif, const settings_t& settings);
-    nlohmann::json get_context_for_prompt(ea_t ea, bool include_struct_context = false, size_t max_len = 0);
+    // The argument that holds the object: `this`, then a udt pointer. For evidence gathering
+    // any pointer (or pointer-width integer) will do; objects_only stops there, for retyping.
+    int find_object_arg(cfunc_t* cfunc, bool objects_only = false);
+    struct_evidence_t collect_struct_evidence(ea_t func_ea, int arg_pos, const settings_t& settings);
+    std::string format_struct_evidence(const struct_evidence_t& evidence);
+    int propagate_struct_type(ea_t func_ea, int arg_pos, const tinfo_t& ptr_tif, qstring* summary = nullptr);
+    // lazy_xrefs leaves the caller/callee context out for agent mode, where the model fetches it with tools.
+    nlohmann::json get_context_for_prompt(ea_t ea, bool include_struct_context = false, size_t max_len = 0, bool lazy_xrefs = false);
+    void merge_struct_evidence(struct_evidence_t* into, const struct_evidence_t& from);
+    nlohmann::json get_class_context_for_prompt(ea_t vtable_ea, const std::vector<ea_t>& methods, const std::string& class_info);
+    bool parse_class_suggestion(const std::string& text, class_suggestion_t* out);
+    qstring apply_class_suggestion(const class_suggestion_t& suggestion, const std::vector<ea_t>& methods);
     std::string format_context_for_clipboard(const nlohmann::json& context);
     bool set_clipboard_text(const qstring& text);
-    void apply_struct_from_cpp(const std::string& cpp_code, ea_t ea);
+    // True once the struct is in the type library, whether or not an argument could be retyped.
+    // With error set, failures are logged and the last reason stored there instead of raising
+    // a warning() dialog; for callers with nobody at the keyboard.
+    bool apply_struct_from_cpp(const std::string& cpp_code, ea_t ea, struct_conflict_t on_conflict = STRUCT_CONFLICT_ASK, std::string* error = nullptr);
     std::string format_prompt(const char* prompt_template, const nlohmann::json& context);
+    // Makes text safe to serialize: invalid UTF-8 and control bytes other than tab/LF/CR
+    // become \xNN escapes, and anything past max_len (0 = no limit) is cut at a character
+    // boundary. Clean text is left untouched. Returns whether anything changed.
+    bool sanitize_utf8(std::string* text, size_t max_len = 0);
+    // sanitize_utf8 over every string value, nested ones included.
+    void sanitize_context(nlohmann::json* context, size_t max_len = 0);
+    // Escapes text for the inside of a JSON string literal (no quotes) straight into out,
+    // which grows exactly once. Bytes >= 0x80 are copied as they are, so text should
+    // already be valid UTF-8.
+    void append_json_escaped(std::string* out, const char* text, size_t len);
+    size_t json_escaped_length(const char* text, size_t len);
     bool is_word_char(char c);
     func_t* get_function_for_item(ea_t ea);
     qstring qstring_tolower(const qstring& s);
+    // Strips quoting from a model's function name suggestion and checks it is a valid identifier.
+    bool clean_function_name(const std::string& suggested, qstring* out);
     bool get_address_from_line_pos(ea_t* out_ea, const char* line, int x);
-    qstring apply_renames_from_ai(ea_t func_ea, const std::string& cpp_code);
+    // Marks func_ea's decompilation dirty at once and coalesces the widget repaints of a burst
+    // of edits into one, 100 ms later. flush_refresh repaints now and drops the pending timer.
+    void schedule_refresh(ea_t func_ea, int widgets);
+    void flush_refresh();
+    bool parse_comment_item(const nlohmann::json& item, comment_suggestion_t* out);
+    std::vector<comment_suggestion_t> parse_comment_suggestions(const std::string& text);
+    int apply_comments(ea_t func_ea, const std::vector<comment_suggestion_t>& comments);
+    bool parse_rename_line(const std::string& line, rename_suggestion_t* out);
+    std::vector<rename_suggestion_t> parse_rename_suggestions(const std::string& text);
+    // Returns the summary of what was renamed; results, if given, gets one flag per rename.
+    // error works as for apply_struct_from_cpp.
+    qstring apply_renames(ea_t func_ea, const std::vector<rename_suggestion_t>& renames, std::vector<bool>* results = nullptr, std::string* error = nullptr);
+    qstring apply_renames_from_ai(ea_t func_ea, const std::string& cpp_code, std::string* error = nullptr);
 }
\ No newline at end of file
@@ -41,6 +41,9 @@ Analyze the provided function and its context from a game. Produce a detailed, s
 {func_prototype}
 ```
 
+**Class Context (from MSVC RTTI):**
+{class_context}
+
 **Target Function's Decompiled {language} Code:**
 ```cpp
 // Function at address: {func_ea_hex}
@@ -79,9 +82,13 @@ The name should be suitable for a function in a reversed game engine SDK.
 Return ONLY the suggested name and nothing else.
 
 Good examples: `UHealthComponent::ApplyDamage`, `APlayerController::ServerUpdateCamera`, `GetLocalPlayerController`.
+If the class context below names the class this function is a virtual method of, use that exact class name as the `Class::` prefix.
 
 --- CONTEXT ---
 
+**Class Context (from MSVC RTTI):**
+{class_context}
+
 **Target Function's Decompiled {language} Code:**
 ```cpp
 // Function at address: {func_ea_hex}
@@ -128,6 +135,10 @@ struct APlayerCharacter
 
 --- CONTEXT ---
 
+**Class Context (from MSVC RTTI):**
+{class_context}
+If a class is named here, use it as the struct name.
+
 **Target Function's Decompiled C++ Code:**
 ```cpp
 {code}
@@ -135,6 +146,7 @@ struct APlayerCharacter
 
 **Struct Member Usage & Data Cross-References:**
 The following context shows how members of the struct are used, both within this function and globally across the program. This is the most important information for determining member types and names.
+When an aggregated offset map is present, it merges the member accesses of every function the object flows through (callers and callees). Reconstruct ONE struct that covers every offset in that map, using the listed access sizes for the member types.
 ```cpp
 {struct_context}
 ```
@@ -252,6 +264,48 @@ Focus on aspects relevant to game hacking. Use the provided context to inform yo
 --- END CONTEXT ---
 )V0G0N";
 
+const char* const AGENT_TOOLS_PROMPT = R"V0G0N(
+
+**Tools:** The context above is deliberately small. Call the tools to fetch more when the task needs it:
+`get_function`, `decompile_callee`, `get_xrefs_to`, `get_struct` and `search_strings`.
+Fetch only what you need, ask for several things in one turn when you can, and then answer
+in exactly the format requested above.
+)V0G0N";
+
+const char* const QUERY_MAP_PROMPT = R"V0G0N(
+You are triaging a large binary for a reverse engineer. Below is a one-line digest of {func_count} of its functions:
+address, name, size, the named functions it calls, and the strings and named globals it references.
+
+**User Question:** {user_question}
+
+Pick the functions from this digest that are most likely to matter for the question, at most {max_hits}.
+Judge by names, strings, imports and comments; a function that only calls a relevant one is less interesting than the one itself.
+
+Reply with ONLY a JSON array, one object per function, best first:
+[{"ea": "0x140001000", "score": 8, "why": "sends the packet built from the heartbeat string"}]
+`score` is 1 (barely related) to 10 (certainly the answer). Reply with [] if nothing in the digest is relevant.
+Never list an address that is not in the digest.
+
+--- DIGEST ---
+{digest}
+--- END DIGEST ---
+)V0G0N";
+
+const char* const QUERY_REDUCE_PROMPT = R"V0G0N(
+Answer the user's question about a whole binary in a direct, technical manner. Focus on aspects relevant to game hacking.
+A first pass over short summaries of all {func_count} functions shortlisted the candidates below; that pass only saw
+names and strings and can be wrong. Base your answer on the code itself.
+
+Cite every function you mention by its address (0x...). If none of the candidates answers the question,
+say so and say what to look for instead.
+
+**User Question:** {user_question}
+
+--- CANDIDATES ---
+{candidates}
+--- END CANDIDATES ---
+)V0G0N";
+
 const char* const LOCATE_GLOBAL_POINTER_PROMPT = R"V0G0N(
 You are an expert in x86-64 assembly, specifically for Unreal Engine games.
 Your task is to analyze the provided function to find the single instruction that loads the address of the global pointer for `{target_name}`.
@@ -276,11 +330,13 @@ This is used in most modern games. The pointer is decrypted by a function call.
      ```
 3. The instruction that loads the address of the encrypted data is the one that reveals the location.
 
+**Candidate Instructions:**
+Every RIP-relative `LEA`/`MOV` load in this function has already been decoded and its absolute target computed. Loads into RCX/RDI that are followed by a call to a small function are marked as pattern B. Do not compute any addresses yourself.
+{rip_candidates}
 **Your Task:**
-1. Analyze the decompiled code and find the single instruction (`LEA` or `MOV`) that fits either **Pattern A** or **Pattern B** to locate the `{target_name}` data.
-2. From that instruction, calculate and extract the final, absolute address of the `{target_name}` pointer data. The address is calculated as `address_of_the_next_instruction + rip_offset`.
-3. **Return ONLY the final calculated absolute address as a single hexadecimal value.** For example: `0x14AD3FE80`.
-4. If you cannot determine the address with high confidence from either pattern, return the single word "None".
+1. Analyze the decompiled code and decide which candidate instruction fits either **Pattern A** or **Pattern B** for `{target_name}`.
+2. **Return ONLY the number of that candidate**, without brackets. For example: `3`.
+3. If no candidate fits with high confidence, return the single word "None".
 
 ---
 Function Decompilation:
@@ -317,6 +373,9 @@ You MUST provide the output within a single C++ code block. Each line must follo
 
 --- CONTEXT ---
 
+**Class Context (from MSVC RTTI):**
+{class_context}
+
 **Target Function's Decompiled {language} Code:**
 ```cpp
 // Function at address: {func_ea_hex}
@@ -347,4 +406,40 @@ You MUST provide the output within a single C++ code block. Each line must follo
 {decompiler_warnings}
 ```
 --- END CONTEXT ---
-)V0G0N";
\ No newline at end of file
+)V0G0N";
+const char* const RECONSTRUCT_CLASS_PROMPT = R"V0G0N(
+You are an expert reverse engineer specializing in C++ game engines. Reconstruct the complete C++ class behind the vtable at 0x{vtable_ea_hex} ({slot_count} slots) from ALL of its virtual methods and the functions that install the vtable, in one pass.
+
+**Analysis Steps:**
+1.  **Class Identity:** Use the class context if it names the class. Otherwise infer a PascalCase name from what the methods do. Use underscores instead of `::` in the struct name.
+2.  **Layout:** Build ONE struct covering every member offset seen in the aggregated offset map and in the methods. The vtable pointer is `__int64 __vftable;` at offset `0x0`. Use IDA's integer types (`__int8`, `__int16`, `__int32`, `__int64`), and fill every gap with a `char pad_XXXX[size];` member. Comment each member with its byte offset.
+3.  **Constructors/Destructors:** The functions that install the vtable show which members are initialized and usually reveal the object size.
+4.  **Methods:** For each slot, give a descriptive `ClassName::MethodName` (`ClassName::~ClassName` for the destructor). Also give a prototype in the form `return_type __fastcall fn(ClassName *this, ...)`. Always use the literal name `fn` in the prototype, and use only types that exist in the struct you wrote or are built in.
+
+**Output Format:**
+Return exactly two code blocks and nothing else:
+1. A ```cpp block with the struct definition.
+2. A ```json block with an array of one object per slot: `{"slot": 0, "name": "ClassName::MethodName", "prototype": "void __fastcall fn(ClassName *this)"}`.
+Leave out a slot only if you cannot say anything about it.
+
+--- CONTEXT ---
+
+**Class Context:**
+{class_context}
+
+**Functions Installing the VTable (constructors/destructors):**
+```cpp
+{ctors}
+```
+
+**Virtual Methods by Slot:**
+```cpp
+{methods}
+```
+
+**Aggregated Member Accesses of `this` Across All Methods:**
+```cpp
+{struct_context}
+```
+--- END CONTEXT ---
+)V0G0N";
@@ -0,0 +1,279 @@
+#include "aida_pro.hpp"
+#include <algorithm>
+
+static const char REVIEW_TITLE[] = "AI Assistant: Review Changes";
+
+static const char* state_name(review_state_t state)
+{
+    switch (state)
+    {
+    case REVIEW_PENDING:  return "Pending";
+    case REVIEW_APPROVED: return "Approved";
+    case REVIEW_REJECTED: return "Rejected";
+    case REVIEW_APPLIED:  return "Applied";
+    case REVIEW_FAILED:   return "Failed";
+    }
+    return "?";
+}
+
+static const char* kind_name(review_kind_t kind)
+{
+    switch (kind)
+    {
+    case REVIEW_FUNC_NAME: return "Function name";
+    case REVIEW_RENAME:    return "Rename";
+    case REVIEW_COMMENT:   return "Comment";
+    case REVIEW_STRUCT:    return "Struct";
+    }
+    return "?";
+}
+
+static qstring one_line(const qstring& s)
+{
+    qstring out = s;
+    out.replace("\r", "");
+    out.replace("\n", " | ");
+    return out;
+}
+
+struct review_chooser_t : public chooser_multi_t
+{
+    static const int WIDTHS[];
+    static const char* const HEADER[];
+
+    review_chooser_t()
+        : chooser_multi_t(CH_KEEP | CH_CAN_INS | CH_CAN_DEL | CH_CAN_EDIT | CH_CAN_REFRESH, 8, WIDTHS, HEADER, REVIEW_TITLE)
+    {
+        popup_names[POPUP_INS] = "Apply approved";
+        popup_names[POPUP_DEL] = "Reject";
+        popup_names[POPUP_EDIT] = "Approve";
+        popup_names[POPUP_REFRESH] = "Clear applied/rejected";
+    }
+
+    const void* get_obj_id(size_t* len) const override
+    {
+        *len = sizeof(REVIEW_TITLE);
+        return REVIEW_TITLE;
+    }
+
+    size_t idaapi get_count() const override { return review_queue_t::instance().size(); }
+
+    void idaapi get_row(
+        qstrvec_t* out,
+        int* /*out_icon*/,
+        chooser_item_attrs_t* out_attrs,
+        size_t n) const override
+    {
+        const review_item_t& item = review_queue_t::instance().at(n);
+
+        qstring func_name;
+        if (item.func_ea != BADADDR)
+            get_func_name(&func_name, item.func_ea);
+
+        qstring address;
+        address.sprnt("%a", item.ea);
+        qstring confidence;
+        confidence.sprnt("%d%%", (int)(item.confidence * 100 + 0.5));
+
+        out->push_back(state_name(item.state));
+        out->push_back(kind_name(item.kind));
+        out->push_back(address);
+        out->push_back(func_name);
+        out->push_back(one_line(item.old_value));
+        out->push_back(one_line(item.new_value));
+        out->push_back(confidence);
+        out->push_back(one_line(item.reason));
+
+        if (out_attrs != nullptr)
+        {
+            if (item.state == REVIEW_APPROVED)
+                out_attrs->flags |= CHITEM_BOLD;
+            else if (item.state == REVIEW_REJECTED)
+                out_attrs->flags |= CHITEM_STRIKE | CHITEM_GRAY;
+            else if (item.state == REVIEW_APPLIED)
+                out_attrs->flags |= CHITEM_GRAY;
+        }
+    }
+
+    cbres_t idaapi ins(sizevec_t* /*sel*/) override
+    {
+        review_queue_t::instance().apply_approved();
+        return ALL_CHANGED;
+    }
+
+    cbres_t idaapi del(sizevec_t* sel) override
+    {
+        review_queue_t::instance().set_state(*sel, REVIEW_REJECTED);
+        return ALL_CHANGED;
+    }
+
+    cbres_t idaapi edit(sizevec_t* sel) override
+    {
+        review_queue_t::instance().set_state(*sel, REVIEW_APPROVED);
+        return ALL_CHANGED;
+    }
+
+    cbres_t idaapi enter(sizevec_t* sel) override
+    {
+        if (sel != nullptr && !sel->empty() && sel->front() < get_count())
+        {
+            ea_t ea = review_queue_t::instance().at(sel->front()).ea;
+            if (ea != BADADDR)
+                jumpto(ea);
+        }
+        return NOTHING_CHANGED;
+    }
+
+    cbres_t idaapi refresh(sizevec_t* sel) override
+    {
+        review_queue_t::instance().clear_finished();
+        if (sel != nullptr)
+            sel->clear();
+        return ALL_CHANGED;
+    }
+};
+
+const int review_chooser_t::WIDTHS[] = { 9, 12, 16, 24, 30, 30, 6, 40 };
+const char* const review_chooser_t::HEADER[] = { "State", "Kind", "Address", "Function", "Old", "New", "Conf.", "Reason" };
+
+review_queue_t& review_queue_t::instance()
+{
+    static review_queue_t queue;
+    return queue;
+}
+
+void review_queue_t::add(review_item_t item)
+{
+    _items.push_back(std::move(item));
+    show();
+}
+
+void review_queue_t::add(std::vector<review_item_t> items)
+{
+    if (items.empty())
+        return;
+    _items.reserve(_items.size() + items.size());
+    for (auto& item : items)
+        _items.push_back(std::move(item));
+    show();
+}
+
+void review_queue_t::show()
+{
+    static review_chooser_t* chooser = new review_chooser_t();
+    if (find_widget(REVIEW_TITLE) != nullptr)
+        refresh_chooser(REVIEW_TITLE);
+    else
+        chooser->choose();
+}
+
+void review_queue_t::set_state(const sizevec_t& indices, review_state_t state)
+{
+    for (size_t n : indices)
+    {
+        if (n >= _items.size())
+            continue;
+        review_item_t& item = _items[n];
+        if (item.state == REVIEW_APPLIED)
+            continue;
+        item.state = state;
+    }
+}
+
+void review_queue_t::clear_finished()
+{
+    _items.erase(std::remove_if(_items.begin(), _items.end(), [](const review_item_t& item) {
+        return item.state == REVIEW_APPLIED || item.state == REVIEW_REJECTED;
+    }), _items.end());
+}
+
+size_t review_queue_t::apply_approved()
+{
+    std::vector<size_t> func_names;
+    std::vector<size_t> structs;
+    std::map<ea_t, std::vector<size_t>> renames;
+    std::map<ea_t, std::vector<size_t>> comments;
+
+    for (size_t i = 0; i < _items.size(); ++i)
+    {
+        const review_item_t& item = _items[i];
+        if (item.state != REVIEW_APPROVED)
+            continue;
+        switch (item.kind)
+        {
+        case REVIEW_FUNC_NAME: func_names.push_back(i); break;
+        case REVIEW_RENAME:    renames[item.func_ea].push_back(i); break;
+        case REVIEW_COMMENT:   comments[item.func_ea].push_back(i); break;
+        case REVIEW_STRUCT:    structs.push_back(i); break;
+        }
+    }
+
+    if (func_names.empty() && structs.empty() && renames.empty() && comments.empty())
+    {
+        msg("AiDA: No approved changes to apply.\n");
+        return 0;
+    }
+
+    size_t applied = 0;
+    auto finish = [&](size_t n, bool ok) {
+        _items[n].state = ok ? REVIEW_APPLIED : REVIEW_FAILED;
+        if (ok)
+            applied++;
+    };
+
+    ida_utils::undo_batch_t batch("AiDA: apply reviewed changes");
+
+    for (size_t n : func_names)
+    {
+        const review_item_t& item = _items[n];
+        finish(n, set_name(item.ea, item.new_value.c_str(), SN_FORCE | SN_NODUMMY));
+    }
+
+    for (const auto& [func_ea, indices] : renames)
+    {
+        std::vector<ida_utils::rename_suggestion_t> suggestions;
+        suggestions.reserve(indices.size());
+        for (size_t n : indices)
+            suggestions.push_back({ _items[n].old_value, _items[n].new_value, _items[n].reason });
+
+        std::vector<bool> results;
+        ida_utils::apply_renames(func_ea, suggestions, &results);
+        for (size_t i = 0; i < indices.size(); ++i)
+            finish(indices[i], results[i]);
+    }
+
+    for (const auto& [func_ea, indices] : comments)
+    {
+        std::vector<ida_utils::comment_suggestion_t> suggestions;
+        suggestions.reserve(indices.size());
+        for (size_t n : indices)
+            suggestions.push_back({ _items[n].ea, _items[n].new_value });
+
+        bool ok = ida_utils::apply_comments(func_ea, suggestions) > 0;
+        for (size_t n : indices)
+            finish(n, ok);
+    }
+
+    for (size_t n : structs)
+    {
+        // The reviewer already saw what gets replaced, so conflicts overwrite.
+        finish(n, ida_utils::apply_struct_from_cpp(_items[n].payload, _items[n].func_ea, ida_utils::STRUCT_CONFLICT_OVERWRITE));
+    }
+
+    ida_utils::schedule_refresh(BADADDR, IWID_DISASM | IWID_PSEUDOCODE | IWID_FUNCS);
+    msg("AiDA: Applied %d reviewed change(s).\n", (int)applied);
+    return applied;
+}
+
+double estimate_rename_confidence(const qstring& old_name, const qstring& new_name, const qstring& reason)
+{
+    static const std::regex dummy_re("^(sub|loc|unk|off|byte|word|dword|qword|field|a|v|arg|var)_?[0-9A-Fa-f]+$");
+
+    // Replacing an auto-generated name is low risk; overriding a name somebody chose is not.
+    double confidence = std::regex_match(old_name.c_str(), dummy_re) ? 0.8 : 0.4;
+    if (!reason.empty())
+        confidence += 0.1;
+    if (new_name.length() < 3 || std::regex_match(new_name.c_str(), dummy_re))
+        confidence -= 0.3;
+    return std::min(0.95, std::max(0.05, confidence));
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <ida.hpp>
+#include <kernwin.hpp>
+
+enum review_kind_t
+{
+    REVIEW_FUNC_NAME,
+    REVIEW_RENAME,
+    REVIEW_COMMENT,
+    REVIEW_STRUCT,
+};
+
+enum review_state_t
+{
+    REVIEW_PENDING,
+    REVIEW_APPROVED,
+    REVIEW_REJECTED,
+    REVIEW_APPLIED,
+    REVIEW_FAILED,
+};
+
+struct review_item_t
+{
+    review_kind_t kind;
+    review_state_t state = REVIEW_PENDING;
+    ea_t func_ea = BADADDR;
+    ea_t ea = BADADDR;
+    qstring old_value;
+    qstring new_value;
+    qstring reason;
+    double confidence = 0.5;
+    std::string payload; // full struct definition for REVIEW_STRUCT
+};
+
+// Collects AI-proposed changes from any number of requests so they can be reviewed
+// in one non-modal list and applied together instead of confirming each one.
+class review_queue_t
+{
+public:
+    static review_queue_t& instance();
+
+    void add(review_item_t item);
+    void add(std::vector<review_item_t> items);
+
+    void show();
+    void set_state(const sizevec_t& indices, review_state_t state);
+    size_t apply_approved();
+    void clear_finished();
+
+    size_t size() const { return _items.size(); }
+    const review_item_t& at(size_t n) const { return _items[n]; }
+
+private:
+    review_queue_t() = default;
+    std::vector<review_item_t> _items;
+};
+
+double estimate_rename_confidence(const qstring& old_name, const qstring& new_name, const qstring& reason);
@@ -0,0 +1,626 @@
+#include "aida_pro.hpp"
+#include <algorithm>
+#include <random>
+
+using json = nlohmann::json;
+
+namespace rpc
+{
+    enum error_code_t
+    {
+        PARSE_ERROR = -32700,
+        INVALID_REQUEST = -32600,
+        METHOD_NOT_FOUND = -32601,
+        INVALID_PARAMS = -32602,
+        INTERNAL_ERROR = -32603,
+        CALL_FAILED = -32000,  // the operation itself failed; message says why
+    };
+
+    struct rpc_error_t : public std::runtime_error
+    {
+        int code;
+        rpc_error_t(int c, const std::string& message) : std::runtime_error(message), code(c) {}
+    };
+
+    // Runs jobs on the main thread. Jobs submitted while a drain is already queued ride
+    // along with it, so concurrent connections and batch entries share hops.
+    class main_queue_t : public std::enable_shared_from_this<main_queue_t>
+    {
+    public:
+        // Blocks until every job has run, or until shutdown() gave up on them.
+        void run(const std::vector<std::function<void()>>& jobs);
+        void shutdown();
+
+    private:
+        struct job_t
+        {
+            std::function<void()> fn;
+            std::promise<void> done;
+        };
+        struct drain_request_t;
+
+        std::mutex _mutex;
+        std::vector<std::shared_ptr<job_t>> _pending;
+        bool _drain_posted = false;
+        bool _closed = false;
+
+        void _drain();
+    };
+
+    struct main_queue_t::drain_request_t : public exec_request_t
+    {
+        std::shared_ptr<main_queue_t> queue;
+
+        explicit drain_request_t(std::shared_ptr<main_queue_t> q) : queue(std::move(q)) {}
+
+        ssize_t idaapi execute() override
+        {
+            queue->_drain();
+            delete this;
+            return 0;
+        }
+    };
+
+    void main_queue_t::run(const std::vector<std::function<void()>>& jobs)
+    {
+        if (jobs.empty())
+            return;
+
+        std::vector<std::future<void>> waits;
+        bool post = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_closed)
+                return;
+            for (const auto& fn : jobs)
+            {
+                auto job = std::make_shared<job_t>();
+                job->fn = fn;
+                waits.push_back(job->done.get_future());
+                _pending.push_back(std::move(job));
+            }
+            if (!_drain_posted)
+                post = _drain_posted = true;
+        }
+
+        if (post)
+            execute_sync(*new drain_request_t(shared_from_this()), MFF_WRITE | MFF_NOWAIT);
+        for (auto& w : waits)
+            w.wait();
+    }
+
+    void main_queue_t::shutdown()
+    {
+        std::vector<std::shared_ptr<job_t>> abandoned;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            abandoned.swap(_pending);
+        }
+        // Their callers keep the "not run" response they were created with.
+        for (auto& job : abandoned)
+            job->done.set_value();
+    }
+
+    void main_queue_t::_drain()
+    {
+        std::vector<std::shared_ptr<job_t>> jobs;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            jobs.swap(_pending);
+            _drain_posted = false;
+        }
+
+        for (auto& job : jobs)
+        {
+            job->fn();
+            job->done.set_value();
+        }
+        if (!jobs.empty())
+            ida_utils::flush_refresh();
+    }
+
+    // --- parameters ---
+
+    static const json& param(const json& params, const char* key)
+    {
+        if (!params.is_object() || !params.contains(key))
+            throw rpc_error_t(INVALID_PARAMS, std::string("Missing parameter '") + key + "'.");
+        return params[key];
+    }
+
+    static std::string param_string(const json& params, const char* key)
+    {
+        const json& value = param(params, key);
+        if (!value.is_string())
+            throw rpc_error_t(INVALID_PARAMS, std::string("Parameter '") + key + "' must be a string.");
+        return value.get<std::string>();
+    }
+
+    // An address as a number, a hex string ("0x140001000") or a name.
+    static ea_t param_ea(const json& params, const char* key = "ea")
+    {
+        const json& value = param(params, key);
+        if (value.is_number_unsigned() || value.is_number_integer())
+            return (ea_t)value.get<uint64>();
+        if (value.is_string())
+        {
+            const std::string text = value.get<std::string>();
+            char* end = nullptr;
+            uint64 ea = strtoull(text.c_str(), &end, 16);
+            if (!text.empty() && *end == '\0')
+                return (ea_t)ea;
+            ea_t named = get_name_ea(BADADDR, text.c_str());
+            if (named != BADADDR)
+                return named;
+        }
+        throw rpc_error_t(INVALID_PARAMS, std::string("Parameter '") + key + "' is not an address or a known name.");
+    }
+
+    static std::string hex(uint64 value)
+    {
+        char buf[32];
+        qsnprintf(buf, sizeof(buf), "0x%llx", value);
+        return buf;
+    }
+
+    // --- methods ---
+
+    static json m_get_function_code(const json& params)
+    {
+        auto code = ida_utils::get_function_code(param_ea(params),
+            params.value("max_len", (size_t)0), params.value("assembly", false));
+        if (code.second == "Error")
+            throw rpc_error_t(CALL_FAILED, code.first);
+        return { {"code", code.first}, {"language", code.second} };
+    }
+
+    static json m_get_context(const json& params)
+    {
+        json context = ida_utils::get_context_for_prompt(param_ea(params),
+            params.value("struct_context", false), params.value("max_len", (size_t)0));
+        if (!context["ok"].get<bool>())
+            throw rpc_error_t(CALL_FAILED, context["message"].get<std::string>());
+        context.erase("ok");
+        return context;
+    }
+
+    static json m_get_class_context(const json& params)
+    {
+        ea_t ea = param_ea(params);
+        return unreal::function_context(ea) + rtti::class_context(ea);
+    }
+
+    static json m_find_vtable(const json& params)
+    {
+        rtti::class_info_t cls;
+        rtti::vtable_t vt;
+        if (!rtti::find_vtable(param_ea(params), &cls, &vt))
+            return nullptr;
+        json methods = json::array();
+        for (ea_t method : vt.methods)
+            methods.push_back(hex(method));
+        json bases = json::array();
+        for (const auto& base : cls.bases)
+            bases.push_back(base.name.c_str());
+        return { {"vtable", hex(vt.ea)}, {"class", cls.name.c_str()}, {"bases", bases},
+                 {"offset", vt.offset}, {"methods", methods} };
+    }
+
+    static json m_apply_renames(const json& params)
+    {
+        std::string error;
+        qstring summary = ida_utils::apply_renames_from_ai(param_ea(params), param_string(params, "text"), &error);
+        if (summary.empty() && !error.empty())
+            throw rpc_error_t(CALL_FAILED, error);
+        return { {"summary", summary.c_str()} };
+    }
+
+    static json m_apply_comments(const json& params)
+    {
+        ea_t func_ea = param_ea(params);
+        std::vector<ida_utils::comment_suggestion_t> comments;
+        if (params.contains("comments"))
+        {
+            const json& items = param(params, "comments");
+            if (!items.is_array())
+                throw rpc_error_t(INVALID_PARAMS, "Parameter 'comments' must be an array.");
+            for (const auto& item : items)
+            {
+                ida_utils::comment_suggestion_t comment;
+                if (ida_utils::parse_comment_item(item, &comment))
+                    comments.push_back(std::move(comment));
+            }
+        }
+        else
+        {
+            comments = ida_utils::parse_comment_suggestions(param_string(params, "text"));
+        }
+        return { {"applied", ida_utils::apply_comments(func_ea, comments)} };
+    }
+
+    static json m_apply_struct(const json& params)
+    {
+        ea_t ea = param_ea(params);
+        std::string code = param_string(params, "code");
+        if (code.find("```") == std::string::npos)
+            code = "```cpp\n" + code + "\n```";
+        // Never a dialog (conflict question or warning): nobody is at the keyboard for these calls.
+        const bool rename = params.value("on_conflict", std::string("overwrite")) == "rename";
+        std::string error;
+        if (!ida_utils::apply_struct_from_cpp(code, ea, rename ? ida_utils::STRUCT_CONFLICT_RENAME : ida_utils::STRUCT_CONFLICT_OVERWRITE, &error))
+            throw rpc_error_t(CALL_FAILED, error.empty() ? "The struct could not be applied." : error);
+        return true;
+    }
+
+    static json m_function_digests(const json& params)
+    {
+        std::vector<global_query::shard_t> shards;
+        size_t func_count = 0;
+        global_query::build_shards(&shards, &func_count, params.value("max_chars", (size_t)96000), false);
+        json out = json::array();
+        for (const auto& shard : shards)
+        {
+            json funcs = json::array();
+            for (ea_t ea : shard.funcs)
+                funcs.push_back(hex(ea));
+            out.push_back({ {"hash", hex(shard.hash)}, {"funcs", funcs}, {"text", shard.text} });
+        }
+        return { {"functions", func_count}, {"shards", out} };
+    }
+
+    static json m_map_cache_lookup(const json& params)
+    {
+        std::string hash_text = param_string(params, "shard_hash");
+        uint64 hash = strtoull(hash_text.c_str(), nullptr, 16);
+        auto& cache = global_query::map_cache_t::instance();
+        cache.load();
+        std::vector<global_query::candidate_t> found;
+        if (!cache.lookup(global_query::question_keywords(param_string(params, "question")), hash, &found))
+            return nullptr;
+        json out = json::array();
+        for (const auto& cand : found)
+            out.push_back({ {"ea", hex(cand.ea)}, {"score", cand.score}, {"why", cand.reason} });
+        return out;
+    }
+
+    using handler_t = json (*)(const json& params);
+
+    struct method_t
+    {
+        const char* name;
+        handler_t handler;
+        bool main_thread;  // touches the database
+    };
+
+    static json m_list_methods(const json& params);
+
+    static json m_ping(const json&)
+    {
+        return "pong";
+    }
+
+    static const method_t methods[] = {
+        { "ping",               m_ping,               false },
+        { "list_methods",       m_list_methods,       false },
+        { "get_function_code",  m_get_function_code,  true },
+        { "get_context",        m_get_context,        true },
+        { "get_class_context",  m_get_class_context,  true },
+        { "find_vtable",        m_find_vtable,        true },
+        { "apply_renames",      m_apply_renames,      true },
+        { "apply_comments",     m_apply_comments,     true },
+        { "apply_struct",       m_apply_struct,       true },
+        { "function_digests",   m_function_digests,   true },
+        { "map_cache_lookup",   m_map_cache_lookup,   true },
+    };
+
+    static json m_list_methods(const json&)
+    {
+        json out = json::array();
+        for (const auto& m : methods)
+            out.push_back(m.name);
+        return out;
+    }
+
+    static const method_t* find_method(const std::string& name)
+    {
+        for (const auto& m : methods)
+        {
+            if (name == m.name)
+                return &m;
+        }
+        return nullptr;
+    }
+
+    // --- dispatch ---
+
+    static json error_response(const json& id, int code, const std::string& message)
+    {
+        return { {"jsonrpc", "2.0"}, {"id", id}, {"error", {{"code", code}, {"message", message}}} };
+    }
+
+    struct call_t
+    {
+        json id;
+        bool notification = false;
+        const method_t* method = nullptr;
+        json params;
+        json response;
+
+        void invoke()
+        {
+            try
+            {
+                response = { {"jsonrpc", "2.0"}, {"id", id}, {"result", method->handler(params)} };
+            }
+            catch (const rpc_error_t& e)
+            {
+                response = error_response(id, e.code, e.what());
+            }
+            catch (const std::exception& e)
+            {
+                response = error_response(id, INTERNAL_ERROR, e.what());
+            }
+        }
+    };
+
+    static void prepare(const json& request, call_t* call)
+    {
+        if (!request.is_object() || request.value("jsonrpc", "") != "2.0"
+            || !request.contains("method") || !request["method"].is_string())
+        {
+            call->response = error_response(request.is_object() && request.contains("id") ? request["id"] : json(), INVALID_REQUEST, "Invalid request.");
+            return;
+        }
+        call->notification = !request.contains("id");
+        call->id = call->notification ? json() : request["id"];
+        call->params = request.value("params", json::object());
+        call->method = find_method(request["method"].get<std::string>());
+        if (call->method == nullptr)
+            call->response = error_response(call->id, METHOD_NOT_FOUND, "Unknown method '" + request["method"].get<std::string>() + "'.");
+        else
+            call->response = error_response(call->id, INTERNAL_ERROR, "The database is closing; the call did not run.");
+    }
+
+    // A batch costs one main-thread hop, however many database calls it holds.
+    static std::string dispatch(main_queue_t& queue, const std::string& body)
+    {
+        json request = json::parse(body, nullptr, false);
+        if (request.is_discarded())
+            return error_response(nullptr, PARSE_ERROR, "Parse error.").dump();
+
+        const bool batch = request.is_array();
+        if (batch && request.empty())
+            return error_response(nullptr, INVALID_REQUEST, "Empty batch.").dump();
+
+        std::vector<call_t> calls(batch ? request.size() : 1);
+        for (size_t i = 0; i < calls.size(); ++i)
+            prepare(batch ? request[i] : request, &calls[i]);
+
+        std::vector<std::function<void()>> jobs;
+        for (auto& call : calls)
+        {
+            if (call.method == nullptr)
+                continue;
+            if (call.method->main_thread)
+                jobs.push_back([&call]() { call.invoke(); });
+            else
+                call.invoke();
+        }
+        queue.run(jobs);
+
+        json out = json::array();
+        for (auto& call : calls)
+        {
+            if (!call.notification)
+                out.push_back(std::move(call.response));
+        }
+        if (out.empty())
+            return std::string();
+        // Decompiler output is not guaranteed to be valid UTF-8; a plain dump would throw.
+        const json& reply = batch ? out : out[0];
+        return reply.dump(-1, ' ', false, json::error_handler_t::replace);
+    }
+
+    // --- access ---
+
+    // Any web page can make a browser POST to 127.0.0.1: a text/plain form post needs no CORS
+    // preflight, and DNS rebinding can make a page look same-origin. Such requests carry an
+    // Origin header and the page's Host, and cannot set a JSON Content-Type or the token
+    // without a preflight, which this server never answers.
+    static int check_request(const httplib::Request& req, const std::string& token, bool check_host, const char** why)
+    {
+        if (req.has_header("Origin"))
+        {
+            *why = "Requests from web pages are not accepted.";
+            return 403;
+        }
+
+        if (check_host)
+        {
+            std::string host = req.get_header_value("Host");
+            if (!host.empty() && host.front() == '[')
+                host = host.substr(1, host.find(']') - 1);
+            else
+                host = host.substr(0, host.find(':'));
+            if (host != "127.0.0.1" && host != "localhost" && host != "::1")
+            {
+                *why = "The Host header must be a loopback address.";
+                return 403;
+            }
+        }
+
+        std::string type = req.get_header_value("Content-Type");
+        type = type.substr(0, type.find(';'));
+        std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c) { return (char)tolower(c); });
+        if (type != "application/json")
+        {
+            *why = "Content-Type must be application/json.";
+            return 415;
+        }
+
+        // Compared in constant time.
+        const std::string expected = "Bearer " + token;
+        const std::string given = req.get_header_value("Authorization");
+        uchar diff = given.size() == expected.size() ? 0 : 1;
+        for (size_t i = 0; i < given.size() && i < expected.size(); ++i)
+            diff |= (uchar)(given[i] ^ expected[i]);
+        if (diff != 0)
+        {
+            *why = "Missing or wrong token; send 'Authorization: Bearer <token>' with the token from the token file.";
+            return 401;
+        }
+        return 0;
+    }
+
+    static std::string make_token()
+    {
+        std::random_device rd;
+        qstring token;
+        for (int i = 0; i < 8; ++i)
+            token.cat_sprnt("%08x", (uint32)rd());
+        return token.c_str();
+    }
+
+    // Only the user who runs IDA can read it; a new token is written for every session.
+    static bool write_token_file(const std::string& path, const std::string& token)
+    {
+        qunlink(path.c_str());
+        int fd = qcreate(path.c_str(), 0600);
+        if (fd < 0)
+            return false;
+        const bool ok = qwrite(fd, token.data(), token.size()) == (ssize_t)token.size();
+        qclose(fd);
+        return ok;
+    }
+
+    // --- server ---
+
+    server_t::server_t() = default;
+
+    server_t::~server_t()
+    {
+        stop();
+    }
+
+    bool server_t::start(const std::string& listen)
+    {
+        stop();
+        if (listen.empty())
+            return false;
+
+        _server = std::make_unique<httplib::Server>();
+        _queue = std::make_shared<main_queue_t>();
+
+        bool bound = false;
+        if (listen.rfind("unix:", 0) == 0)
+        {
+#if !defined(_WIN32) || defined(CPPHTTPLIB_HAVE_AFUNIX_H)
+            _unix_path = listen.substr(5);
+            qunlink(_unix_path.c_str()); // a socket file left behind by an earlier session
+            _server->set_address_family(AF_UNIX);
+            bound = _server->bind_to_port(_unix_path, 80);
+#else
+            warning("AiDA: This build has no Unix domain socket support; use 127.0.0.1:<port> for rpc_listen.");
+#endif
+        }
+        else
+        {
+            // Every method can read or change the database, so only the local machine may connect.
+            size_t colon = listen.rfind(':');
+            std::string host = colon == std::string::npos ? listen : listen.substr(0, colon);
+            int port = colon == std::string::npos ? 0 : atoi(listen.c_str() + colon + 1);
+            if (host.size() > 2 && host.front() == '[' && host.back() == ']')
+                host = host.substr(1, host.size() - 2);
+            if (host != "127.0.0.1" && host != "localhost" && host != "::1")
+                warning("AiDA: rpc_listen must be a loopback address, not '%s'.", host.c_str());
+            else if (port <= 0 || port > 65535)
+                warning("AiDA: rpc_listen needs a port, e.g. 127.0.0.1:7321.");
+            else
+                bound = _server->bind_to_port(host, port);
+        }
+
+        if (!bound)
+        {
+            msg("AiDA: Could not start the JSON-RPC server on %s.\n", listen.c_str());
+            _server.reset();
+            _queue.reset();
+            _unix_path.clear();
+            return false;
+        }
+
+        // Next to the socket file, or per port in the user's IDA directory.
+        if (!_unix_path.empty())
+        {
+            _token_path = _unix_path + ".token";
+        }
+        else
+        {
+            qstring path;
+            path.sprnt("%s/aida_rpc_%s.token", get_user_idadir(), listen.substr(listen.rfind(':') + 1).c_str());
+            _token_path = path.c_str();
+        }
+        const std::string token = make_token();
+        if (!write_token_file(_token_path, token))
+        {
+            warning("AiDA: Could not write the JSON-RPC token file %s; the server stays off.", _token_path.c_str());
+            _server.reset();
+            _queue.reset();
+            _unix_path.clear();
+            _token_path.clear();
+            return false;
+        }
+
+        // Clients are expected to keep one connection open and pipeline over it.
+        _server->set_keep_alive_max_count(1000000);
+        _server->set_keep_alive_timeout(60);
+
+        std::shared_ptr<main_queue_t> queue = _queue;
+        const bool check_host = _unix_path.empty();
+        auto handler = [queue, token, check_host](const httplib::Request& req, httplib::Response& res) {
+            const char* why = nullptr;
+            if (int status = check_request(req, token, check_host, &why))
+            {
+                res.status = status;
+                res.set_content(error_response(nullptr, INVALID_REQUEST, why).dump(), "application/json");
+                return;
+            }
+            std::string body = dispatch(*queue, req.body);
+            if (body.empty())
+                res.status = 204;
+            else
+                res.set_content(body, "application/json");
+        };
+        _server->Post("/", handler);
+        _server->Post("/rpc", handler);
+
+        httplib::Server* server = _server.get();
+        _thread = std::thread([server]() { server->listen_after_bind(); });
+        msg("AiDA: JSON-RPC server listening on %s; the token is in %s.\n", listen.c_str(), _token_path.c_str());
+        return true;
+    }
+
+    void server_t::stop()
+    {
+        if (!_server)
+            return;
+
+        // Handlers blocked on the main thread (which is running this) must be let go first.
+        _queue->shutdown();
+        _server->stop();
+        if (_thread.joinable())
+            _thread.join();
+        _server.reset();
+        _queue.reset();
+        if (!_unix_path.empty())
+        {
+            qunlink(_unix_path.c_str());
+            _unix_path.clear();
+        }
+        if (!_token_path.empty())
+        {
+            qunlink(_token_path.c_str());
+            _token_path.clear();
+        }
+    }
+}
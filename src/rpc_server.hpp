@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace httplib { class Server; }
+
+namespace rpc
+{
+    class main_queue_t;
+
+    // JSON-RPC 2.0 over HTTP on localhost TCP or a Unix domain socket, for scripts that
+    // want AiDA's context extraction and apply operations without IDAPython. Batches and
+    // keep-alive connections are supported; database work from every connection is
+    // queued and run on the main thread in as few hops as possible.
+    class server_t
+    {
+    public:
+        server_t();
+        ~server_t();
+        server_t(const server_t&) = delete;
+        server_t& operator=(const server_t&) = delete;
+
+        // listen is "127.0.0.1:<port>", "localhost:<port>", "[::1]:<port>" or "unix:<path>".
+        bool start(const std::string& listen);
+        void stop();
+
+    private:
+        std::unique_ptr<httplib::Server> _server;
+        std::shared_ptr<main_queue_t> _queue;
+        std::thread _thread;
+        std::string _unix_path;
+        std::string _token_path;
+    };
+}
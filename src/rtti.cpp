@@ -0,0 +1,518 @@
+#include "aida_pro.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace rtti
+{
+    // MSVC x64 RTTICompleteObjectLocator. Every reference is an image-relative 32-bit offset.
+    struct col_t
+    {
+        uint32 signature;        // 1 on x64
+        uint32 offset;           // offset of this vftable's subobject in the complete class
+        uint32 cd_offset;
+        int32 type_descriptor;
+        int32 class_descriptor;
+        int32 self;
+    };
+
+    static const size_t MAX_VTABLE_SLOTS = 1024;
+    static const uint32 MAX_BASE_CLASSES = 256;
+    static const size_t MAX_TYPE_NAME = 512;
+    // A method found in more classes than this is a stub like _purecall, not a real override.
+    static const size_t MAX_SHARED_METHOD_CLASSES = 16;
+
+    struct method_ref_t
+    {
+        size_t class_index;
+        size_t vtable_index;
+        int slot;
+    };
+
+    using method_index_t = std::map<ea_t, std::vector<method_ref_t>>;
+
+    // The last scan, for class_context.
+    static std::vector<class_info_t> g_classes;
+    static method_index_t g_methods;
+
+    template <typename T>
+    static T load(const uint8* p)
+    {
+        T value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static bool is_code_ea(ea_t ea)
+    {
+        segment_t* seg = getseg(ea);
+        return seg != nullptr && ((seg->perm & SEGPERM_EXEC) != 0 || seg->type == SEG_CODE);
+    }
+
+    static bool read_col(ea_t ea, col_t* col)
+    {
+        if (get_bytes(col, sizeof(*col), ea, GMB_READALL) != sizeof(*col))
+            return false;
+        return col->signature == 1 && col->self == (int32)(ea - get_imagebase());
+    }
+
+    // TypeDescriptor: pVFTable, spare, then the decorated name (".?AVFoo@ns@@").
+    static bool read_type_name(ea_t td, qstring* out)
+    {
+        if (!is_mapped(td))
+            return false;
+        char buf[MAX_TYPE_NAME];
+        ssize_t len = get_bytes(buf, sizeof(buf) - 1, td + 16, GMB_READALL);
+        if (len <= 4)
+            return false;
+        buf[len] = '\0';
+        if (strncmp(buf, ".?AV", 4) != 0 && strncmp(buf, ".?AU", 4) != 0)
+            return false;
+        if (memchr(buf, '\0', len) == nullptr)
+            return false;
+        *out = buf;
+        return true;
+    }
+
+    static qstring demangle_class(const qstring& mangled)
+    {
+        // Demangling the matching vftable symbol gets namespaces and template arguments right.
+        qstring symbol;
+        symbol.sprnt("??_7%s6B@", mangled.c_str());
+        qstring out;
+        if (demangle_name(&out, symbol.c_str(), MNG_SHORT_FORM) > 0)
+        {
+            if (strncmp(out.c_str(), "const ", 6) == 0)
+                out.remove(0, 6);
+            size_t pos = out.find("::`vftable'");
+            if (pos != qstring::npos)
+            {
+                out.resize(pos);
+                return out;
+            }
+        }
+
+        // "Foo@ns@@" lists the scopes innermost first.
+        std::vector<qstring> scopes;
+        const char* p = mangled.c_str();
+        while (*p != '\0' && *p != '@')
+        {
+            const char* at = strchr(p, '@');
+            if (at == nullptr)
+                break;
+            scopes.emplace_back(p, at - p);
+            p = at + 1;
+        }
+        qstring result;
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it)
+        {
+            if (!result.empty())
+                result.append("::");
+            result.append(*it);
+        }
+        return result.empty() ? mangled : result;
+    }
+
+    // ClassHierarchyDescriptor: signature, attributes, numBaseClasses, pBaseClassArray.
+    // BaseClassDescriptor: pTypeDescriptor, numContainedBases, mdisp, pdisp, vdisp, attributes.
+    static void read_hierarchy(int32 chd_rva, class_info_t* cls)
+    {
+        const ea_t base = get_imagebase();
+        const ea_t chd = base + chd_rva;
+        if (!is_mapped(chd))
+            return;
+        uint32 count = get_dword(chd + 8);
+        ea_t array = base + (int32)get_dword(chd + 12);
+        if (count == 0 || count > MAX_BASE_CLASSES || !is_mapped(array))
+            return;
+
+        // Entry 0 describes the class itself.
+        for (uint32 i = 1; i < count; ++i)
+        {
+            ea_t bcd = base + (int32)get_dword(array + 4 * i);
+            qstring td_name;
+            if (!is_mapped(bcd) || !read_type_name(base + (int32)get_dword(bcd), &td_name))
+                continue;
+            base_class_t bc;
+            bc.mangled = td_name.substr(4);
+            bc.name = demangle_class(bc.mangled);
+            bc.mdisp = (int32)get_dword(bcd + 8);
+            cls->bases.push_back(std::move(bc));
+        }
+    }
+
+    static bool make_class(const col_t& col, class_info_t* cls)
+    {
+        const ea_t td = get_imagebase() + col.type_descriptor;
+        qstring td_name;
+        if (!read_type_name(td, &td_name))
+            return false;
+        cls->type_descriptor = td;
+        cls->mangled = td_name.substr(4);
+        cls->name = demangle_class(cls->mangled);
+        read_hierarchy(col.class_descriptor, cls);
+        return true;
+    }
+
+    static void read_methods(vtable_t* vt)
+    {
+        for (size_t slot = 0; slot < MAX_VTABLE_SLOTS; ++slot)
+        {
+            ea_t entry = vt->ea + slot * 8;
+            // Anything referencing a later entry means another table starts there.
+            if (slot > 0 && has_xref(get_flags(entry)))
+                break;
+            ea_t target = get_qword(entry);
+            if (!is_code_ea(target))
+                break;
+            vt->methods.push_back(target);
+        }
+    }
+
+    // Splits [0, size) into 8-aligned slices, one per thread, and concatenates what fn found.
+    template <typename Fn>
+    static std::vector<size_t> parallel_scan(size_t size, Fn fn)
+    {
+        // Below a few megabytes starting threads costs more than it saves.
+        size_t threads = 1;
+        if (size >= (4u << 20))
+            threads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), 16));
+        const size_t chunk = ((size + threads - 1) / threads + 7) & ~(size_t)7;
+
+        std::vector<std::vector<size_t>> parts(threads);
+        std::vector<std::thread> workers;
+        for (size_t t = 1; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]() {
+                fn(std::min(size, t * chunk), std::min(size, (t + 1) * chunk), &parts[t]);
+            });
+        }
+        fn(0, std::min(size, chunk), &parts[0]);
+        for (auto& worker : workers)
+            worker.join();
+
+        std::vector<size_t> hits;
+        for (const auto& part : parts)
+            hits.insert(hits.end(), part.begin(), part.end());
+        return hits;
+    }
+
+    static method_index_t build_method_index(const std::vector<class_info_t>& classes)
+    {
+        method_index_t index;
+        for (size_t c = 0; c < classes.size(); ++c)
+        {
+            for (size_t v = 0; v < classes[c].vtables.size(); ++v)
+            {
+                const std::vector<ea_t>& methods = classes[c].vtables[v].methods;
+                for (size_t slot = 0; slot < methods.size(); ++slot)
+                    index[methods[slot]].push_back({ c, v, (int)slot });
+            }
+        }
+        return index;
+    }
+
+    bool scan(std::vector<class_info_t>* classes, scan_stats_t* stats)
+    {
+        classes->clear();
+        *stats = scan_stats_t();
+        if (!inf_is_64bit())
+        {
+            msg("AiDA: The RTTI scanner supports x64 MSVC binaries only.\n");
+            return false;
+        }
+
+        scanner::image_t image;
+        if (!image.load(scanner::IMAGE_DATA))
+        {
+            msg("AiDA: No data segments to scan for RTTI.\n");
+            return false;
+        }
+
+        const ea_t base = get_imagebase();
+        const uint8* data = image.data();
+        const size_t size = image.size();
+
+        // Pass 1: locators carry signature 1 and their own RVA in pSelf. They are 4-byte
+        // aligned addresses, so each segment is stepped from its first aligned address.
+        std::vector<size_t> col_offsets = parallel_scan(size,
+            [&](size_t begin, size_t end, std::vector<size_t>* out) {
+                image.for_each_aligned(begin, end, 4, [&](size_t from, size_t to) {
+                    for (size_t off = from; off < to && off + sizeof(col_t) <= size; off += 4)
+                    {
+                        if (load<uint32>(data + off) != 1)
+                            continue;
+                        ea_t ea = image.to_ea(off);
+                        if (ea != BADADDR && load<int32>(data + off + offsetof(col_t, self)) == (int32)(ea - base))
+                            out->push_back(off);
+                    }
+                });
+            });
+
+        std::map<ea_t, size_t> class_by_td;
+        std::map<ea_t, size_t> class_by_col;
+        for (size_t off : col_offsets)
+        {
+            ea_t col_ea = image.to_ea(off);
+            col_t col;
+            if (!read_col(col_ea, &col))
+                continue;
+
+            ea_t td = base + col.type_descriptor;
+            auto it = class_by_td.find(td);
+            if (it == class_by_td.end())
+            {
+                class_info_t cls;
+                if (!make_class(col, &cls))
+                    continue;
+                it = class_by_td.emplace(td, classes->size()).first;
+                classes->push_back(std::move(cls));
+            }
+            class_by_col[col_ea] = it->second;
+            stats->locators++;
+        }
+
+        if (!class_by_col.empty())
+        {
+            // Pass 2: each vtable is preceded by an absolute pointer to its locator, at an
+            // 8-byte aligned address.
+            std::vector<ea_t> cols;
+            cols.reserve(class_by_col.size());
+            for (const auto& entry : class_by_col)
+                cols.push_back(entry.first);
+            const uint64 lo = cols.front();
+            const uint64 hi = cols.back();
+
+            std::vector<size_t> refs = parallel_scan(size,
+                [&](size_t begin, size_t end, std::vector<size_t>* out) {
+                    image.for_each_aligned(begin, end, 8, [&](size_t from, size_t to) {
+                        for (size_t off = from; off < to && off + 8 <= size; off += 8)
+                        {
+                            uint64 value = load<uint64>(data + off);
+                            if (value >= lo && value <= hi && std::binary_search(cols.begin(), cols.end(), (ea_t)value))
+                                out->push_back(off);
+                        }
+                    });
+                });
+
+            for (size_t off : refs)
+            {
+                ea_t ref_ea = image.to_ea(off);
+                if (ref_ea == BADADDR)
+                    continue;
+                vtable_t vt;
+                vt.ea = ref_ea + 8;
+                vt.col = (ea_t)load<uint64>(data + off);
+                vt.offset = get_dword(vt.col + offsetof(col_t, offset));
+                read_methods(&vt);
+                if (vt.methods.empty())
+                    continue;
+                (*classes)[class_by_col[vt.col]].vtables.push_back(std::move(vt));
+                stats->vtables++;
+            }
+        }
+
+        g_classes = *classes;
+        g_methods = build_method_index(g_classes);
+        return true;
+    }
+
+    void apply_names(const std::vector<class_info_t>& classes, scan_stats_t* stats)
+    {
+        ida_utils::undo_batch_t batch("AiDA: apply RTTI names");
+
+        for (const class_info_t& cls : classes)
+        {
+            for (const vtable_t& vt : cls.vtables)
+            {
+                if (has_user_name(get_flags(vt.ea)))
+                    continue;
+                // Secondary vftables are named after the base whose subobject they serve.
+                const base_class_t* sub = nullptr;
+                if (vt.offset != 0)
+                {
+                    for (const base_class_t& bc : cls.bases)
+                    {
+                        if (bc.mdisp == (int32)vt.offset)
+                        {
+                            sub = &bc;
+                            break;
+                        }
+                    }
+                }
+                qstring symbol;
+                if (sub != nullptr)
+                    symbol.sprnt("??_7%s6B%s@", cls.mangled.c_str(), sub->mangled.c_str());
+                else
+                    symbol.sprnt("??_7%s6B@", cls.mangled.c_str());
+                if (set_name(vt.ea, symbol.c_str(), SN_NOWARN))
+                    stats->named_vtables++;
+            }
+        }
+
+        for (const auto& [func_ea, refs] : build_method_index(classes))
+        {
+            std::set<size_t> owners;
+            for (const method_ref_t& ref : refs)
+                owners.insert(ref.class_index);
+            if (owners.size() > MAX_SHARED_METHOD_CLASSES)
+                continue;
+
+            func_t* pfn = get_func(func_ea);
+            if (pfn == nullptr || pfn->start_ea != func_ea || (pfn->flags & FUNC_LIB) != 0)
+                continue;
+            if (has_user_name(get_flags(func_ea)))
+                continue;
+
+            // Inherited methods show up in every derived vtable; the class with the fewest
+            // bases is the one that introduced the method.
+            const method_ref_t* owner = &refs.front();
+            for (const method_ref_t& ref : refs)
+            {
+                if (classes[ref.class_index].bases.size() < classes[owner->class_index].bases.size())
+                    owner = &ref;
+            }
+
+            qstring name;
+            name.sprnt("%s::vfunc_%d", classes[owner->class_index].name.c_str(), owner->slot);
+            if (set_name(func_ea, name.c_str(), SN_NOWARN | SN_NOCHECK | SN_FORCE))
+                stats->named_methods++;
+        }
+
+        ida_utils::schedule_refresh(BADADDR, IWID_DISASM | IWID_PSEUDOCODE | IWID_FUNCS | IWID_NAMES);
+    }
+
+    static void format_ref(qstring* out, const class_info_t& cls, const vtable_t& vt, int slot)
+    {
+        out->cat_sprnt("Virtual method #%d of class `%s` (vtable at 0x%llX", slot, cls.name.c_str(), (uint64)vt.ea);
+        if (vt.offset != 0)
+            out->cat_sprnt(", subobject at +0x%X", vt.offset);
+        out->append(")");
+        if (!cls.bases.empty())
+        {
+            out->append("; base classes: ");
+            for (size_t i = 0; i < cls.bases.size(); ++i)
+            {
+                if (i != 0)
+                    out->append(", ");
+                out->append(cls.bases[i].name);
+            }
+        }
+        out->append('\n');
+    }
+
+    // Walks from a slot back to the first entry of the table it belongs to.
+    static ea_t vtable_start(ea_t ref_ea)
+    {
+        ea_t start = ref_ea;
+        for (size_t n = 0; n < MAX_VTABLE_SLOTS && !has_xref(get_flags(start)); ++n)
+        {
+            if (!is_code_ea(get_qword(start - 8)))
+                break;
+            start -= 8;
+        }
+        return start;
+    }
+
+    // Decodes the vtable containing the slot at ref_ea, walking back to its first entry.
+    static bool find_vtable_slot(ea_t ref_ea, class_info_t* cls, vtable_t* vt, int* slot)
+    {
+        if (is_code_ea(ref_ea) || !is_code_ea(get_qword(ref_ea)))
+            return false;
+
+        ea_t start = vtable_start(ref_ea);
+        ea_t col_ea = get_qword(start - 8);
+        col_t col;
+        if (!is_mapped(col_ea) || !read_col(col_ea, &col) || !make_class(col, cls))
+            return false;
+        vt->ea = start;
+        vt->col = col_ea;
+        vt->offset = col.offset;
+        *slot = (int)((ref_ea - start) / 8);
+        return true;
+    }
+
+    bool find_vtable(ea_t ea, class_info_t* cls, vtable_t* vt)
+    {
+        std::vector<ea_t> slots;
+        if (is_code_ea(ea))
+        {
+            func_t* pfn = get_func(ea);
+            if (pfn == nullptr)
+                return false;
+            xrefblk_t xb;
+            for (bool ok = xb.first_to(pfn->start_ea, XREF_DATA); ok; ok = xb.next_to())
+            {
+                if (!is_code_ea(xb.from))
+                    slots.push_back(xb.from);
+            }
+        }
+        else if (is_code_ea(get_qword(ea)))
+        {
+            slots.push_back(ea);
+        }
+
+        // Prefer a table that has a locator, but take a bare one rather than nothing.
+        ea_t bare = BADADDR;
+        for (ea_t slot_ea : slots)
+        {
+            int slot;
+            if (find_vtable_slot(slot_ea, cls, vt, &slot))
+            {
+                vt->methods.clear();
+                read_methods(vt);
+                return true;
+            }
+            if (bare == BADADDR)
+                bare = vtable_start(slot_ea);
+        }
+        if (bare == BADADDR)
+            return false;
+
+        *cls = class_info_t();
+        *vt = vtable_t();
+        vt->ea = bare;
+        read_methods(vt);
+        return !vt->methods.empty();
+    }
+
+    std::string class_context(ea_t func_ea)
+    {
+        static const size_t MAX_LISTED = 4;
+
+        qstring out;
+        size_t listed = 0;
+        size_t total = 0;
+        auto it = g_methods.find(func_ea);
+        if (it != g_methods.end())
+        {
+            for (const method_ref_t& ref : it->second)
+            {
+                total++;
+                if (listed++ < MAX_LISTED)
+                {
+                    const class_info_t& cls = g_classes[ref.class_index];
+                    format_ref(&out, cls, cls.vtables[ref.vtable_index], ref.slot);
+                }
+            }
+        }
+        else
+        {
+            xrefblk_t xb;
+            for (bool ok = xb.first_to(func_ea, XREF_DATA); ok; ok = xb.next_to())
+            {
+                class_info_t cls;
+                vtable_t vt;
+                int slot;
+                if (!find_vtable_slot(xb.from, &cls, &vt, &slot))
+                    continue;
+                total++;
+                if (listed++ < MAX_LISTED)
+                    format_ref(&out, cls, vt, slot);
+            }
+        }
+
+        if (total > MAX_LISTED)
+            out.cat_sprnt("...and %d more vtable(s) share this function.\n", (int)(total - MAX_LISTED));
+        return out.c_str();
+    }
+}
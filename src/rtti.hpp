@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <ida.hpp>
+
+namespace rtti
+{
+    struct vtable_t
+    {
+        ea_t ea = BADADDR;   // first slot
+        ea_t col = BADADDR;  // the complete object locator stored right before it
+        uint32 offset = 0;   // offset of the subobject this vftable belongs to
+        std::vector<ea_t> methods;
+    };
+
+    struct base_class_t
+    {
+        qstring name;
+        qstring mangled;
+        int32 mdisp = 0;     // where the base lives inside the complete object
+    };
+
+    struct class_info_t
+    {
+        qstring name;        // demangled, e.g. "ns::Foo"
+        qstring mangled;     // type descriptor name without ".?AV", e.g. "Foo@ns@@"
+        ea_t type_descriptor = BADADDR;
+        std::vector<base_class_t> bases; // hierarchy order, the class itself excluded
+        std::vector<vtable_t> vtables;
+    };
+
+    struct scan_stats_t
+    {
+        size_t locators = 0;
+        size_t vtables = 0;
+        size_t named_vtables = 0;
+        size_t named_methods = 0;
+    };
+
+    // Finds the MSVC x64 complete object locators in the data segments, the vtables that
+    // point at them and each class hierarchy. The byte scans run on worker threads; the
+    // result is also kept for class_context.
+    bool scan(std::vector<class_info_t>* classes, scan_stats_t* stats);
+
+    // Gives vtables their ??_7 names and dummy-named virtual methods a Class::vfunc_N name.
+    void apply_names(const std::vector<class_info_t>& classes, scan_stats_t* stats);
+
+    // The vtable at or around ea: a slot in the table, or a function that is one of its
+    // methods. Without RTTI the table is still decoded and cls->name is left empty.
+    bool find_vtable(ea_t ea, class_info_t* cls, vtable_t* vt);
+
+    // What RTTI says about the class a function is a virtual method of; empty if nothing.
+    // Falls back to decoding the vtable around a data reference when no scan has run.
+    std::string class_context(ea_t func_ea);
+}
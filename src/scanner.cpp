@@ -0,0 +1,997 @@
+#include "aida_pro.hpp"
+
+#include <atomic>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace scanner
+{
+    // Below this many bytes the thread start-up costs more than the scan.
+    static const size_t PARALLEL_SCAN_THRESHOLD = 4 * 1024 * 1024;
+
+    // Rough rank of how often a byte shows up in x64 code; lower is more common.
+    static int byte_rarity(uint8 b)
+    {
+        static const uint8 common[] = {
+            0x00, 0xFF, 0x48, 0x8B, 0xCC, 0x89, 0x24, 0x4C, 0x8D, 0x0F,
+            0xE8, 0x44, 0x85, 0x01, 0xC0, 0x41, 0x83, 0x74, 0x49, 0x08,
+            0x10, 0x75, 0x90, 0xC3, 0x20, 0x33, 0x45, 0xC7, 0x4D, 0x28,
+        };
+        for (size_t i = 0; i < qnumber(common); ++i)
+        {
+            if (common[i] == b)
+                return (int)i;
+        }
+        return 256;
+    }
+
+    bool pattern_t::valid() const
+    {
+        if (bytes.empty() || bytes.size() != mask.size())
+            return false;
+        return std::any_of(mask.begin(), mask.end(), [](uint8 m) { return m != 0; });
+    }
+
+    std::string pattern_t::to_string() const
+    {
+        std::string out;
+        out.reserve(bytes.size() * 3);
+        static const char hex[] = "0123456789ABCDEF";
+        for (size_t i = 0; i < bytes.size(); ++i)
+        {
+            if (i != 0)
+                out += ' ';
+            if (mask[i] == 0)
+            {
+                out += '?';
+                continue;
+            }
+            out += hex[bytes[i] >> 4];
+            out += hex[bytes[i] & 0xF];
+        }
+        return out;
+    }
+
+    void finalize_pattern(pattern_t* pattern)
+    {
+        int best1 = -1;
+        int best2 = -1;
+        pattern->anchor1 = 0;
+        pattern->anchor2 = 0;
+        for (size_t i = 0; i < pattern->size(); ++i)
+        {
+            if (pattern->mask[i] == 0)
+            {
+                pattern->bytes[i] = 0;
+                continue;
+            }
+            int rarity = byte_rarity(pattern->bytes[i]);
+            if (rarity > best1)
+            {
+                best2 = best1;
+                pattern->anchor2 = pattern->anchor1;
+                best1 = rarity;
+                pattern->anchor1 = i;
+            }
+            else if (rarity > best2)
+            {
+                best2 = rarity;
+                pattern->anchor2 = i;
+            }
+        }
+        if (best2 < 0)
+            pattern->anchor2 = pattern->anchor1;
+    }
+
+    static int hex_value(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    bool parse_pattern(pattern_t* out, const char* text)
+    {
+        out->bytes.clear();
+        out->mask.clear();
+
+        const char* p = text;
+        while (*p != '\0')
+        {
+            if (qisspace(*p))
+            {
+                ++p;
+                continue;
+            }
+            if (*p == '?')
+            {
+                p += p[1] == '?' ? 2 : 1;
+                out->bytes.push_back(0);
+                out->mask.push_back(0);
+                continue;
+            }
+            int hi = hex_value(p[0]);
+            int lo = hi < 0 ? -1 : hex_value(p[1]);
+            if (lo < 0)
+                return false;
+            out->bytes.push_back((uint8)((hi << 4) | lo));
+            out->mask.push_back(0xFF);
+            p += 2;
+        }
+
+        if (!out->valid())
+            return false;
+        finalize_pattern(out);
+        return true;
+    }
+
+    static bool is_code_segment(const segment_t* seg)
+    {
+        return (seg->perm & SEGPERM_EXEC) != 0 || seg->type == SEG_CODE;
+    }
+
+    bool image_t::load(image_kind_t kind)
+    {
+        _data.clear();
+        _ranges.clear();
+
+        size_t total = 0;
+        for (int i = 0; i < get_segm_qty(); ++i)
+        {
+            segment_t* seg = getnseg(i);
+            if (seg == nullptr)
+                continue;
+            if (kind == IMAGE_CODE ? !is_code_segment(seg)
+                                   : is_code_segment(seg) || seg->type == SEG_BSS || seg->type == SEG_XTRN)
+                continue;
+            _ranges.push_back({ seg->start_ea, total, (size_t)seg->size() });
+            total += (size_t)seg->size();
+        }
+        if (total == 0)
+            return false;
+
+        _data.resize(total);
+        for (const range_t& r : _ranges)
+        {
+            if (get_bytes(&_data[r.offset], r.size, r.start_ea, GMB_READALL) < 0)
+                msg("AiDA: Could not read segment at 0x%a for scanning.\n", r.start_ea);
+        }
+        return true;
+    }
+
+    ea_t image_t::to_ea(size_t offset) const
+    {
+        auto it = std::upper_bound(_ranges.begin(), _ranges.end(), offset,
+            [](size_t off, const range_t& r) { return off < r.offset; });
+        if (it == _ranges.begin())
+            return BADADDR;
+        --it;
+        if (offset - it->offset >= it->size)
+            return BADADDR;
+        return it->start_ea + (ea_t)(offset - it->offset);
+    }
+
+    bool image_t::to_offset(ea_t ea, size_t* out) const
+    {
+        for (const range_t& r : _ranges)
+        {
+            if (ea >= r.start_ea && ea - r.start_ea < r.size)
+            {
+                *out = r.offset + (size_t)(ea - r.start_ea);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static inline bool matches_at(const uint8* p, const pattern_t& pattern)
+    {
+        const uint8* bytes = pattern.bytes.data();
+        const uint8* mask = pattern.mask.data();
+        for (size_t i = 0; i < pattern.size(); ++i)
+        {
+            if ((p[i] & mask[i]) != bytes[i])
+                return false;
+        }
+        return true;
+    }
+
+#ifdef SCANNER_SSE2
+    static inline unsigned lowest_bit(unsigned m)
+    {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanForward(&idx, m);
+        return (unsigned)idx;
+#else
+        return (unsigned)__builtin_ctz(m);
+#endif
+    }
+#endif
+
+    // Scans match start positions [begin, end). The caller guarantees end + pattern size - 1 <= data size.
+    static void scan_range(
+        const uint8* data,
+        const pattern_t& pattern,
+        size_t begin,
+        size_t end,
+        size_t limit,
+        std::atomic<size_t>* found,
+        std::vector<size_t>* out)
+    {
+        auto record = [&](size_t pos) {
+            out->push_back(pos);
+            return limit != 0 && found->fetch_add(1) + 1 >= limit;
+        };
+
+        size_t i = begin;
+#ifdef SCANNER_SSE2
+        const size_t a1 = pattern.anchor1;
+        const size_t a2 = pattern.anchor2;
+        const __m128i want1 = _mm_set1_epi8((char)pattern.bytes[a1]);
+        const __m128i want2 = _mm_set1_epi8((char)pattern.bytes[a2]);
+        size_t blocks = 0;
+        for (; i + 16 <= end; i += 16)
+        {
+            // Other threads may already have hit the limit; checking every 64 KiB is plenty.
+            if (limit != 0 && (++blocks & 0xFFF) == 0 && found->load(std::memory_order_relaxed) >= limit)
+                return;
+
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + a1));
+            __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + a2));
+            unsigned bits = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v1, want1), _mm_cmpeq_epi8(v2, want2)));
+            while (bits != 0)
+            {
+                size_t pos = i + lowest_bit(bits);
+                bits &= bits - 1;
+                if (matches_at(data + pos, pattern) && record(pos))
+                    return;
+            }
+        }
+#else
+        const size_t a1 = pattern.anchor1;
+        const uint8 want1 = pattern.bytes[a1];
+        while (i < end)
+        {
+            const void* hit = memchr(data + i + a1, want1, end - i);
+            if (hit == nullptr)
+                return;
+            size_t pos = (const uint8*)hit - data - a1;
+            if (matches_at(data + pos, pattern) && record(pos))
+                return;
+            i = pos + 1;
+        }
+#endif
+        for (; i < end; ++i)
+        {
+            if (matches_at(data + i, pattern) && record(i))
+                return;
+        }
+    }
+
+    static std::vector<size_t> scan_image(const image_t& image, const pattern_t& pattern, size_t limit)
+    {
+        std::vector<size_t> result;
+        if (!pattern.valid() || pattern.size() > image.size())
+            return result;
+
+        const size_t positions = image.size() - pattern.size() + 1;
+        size_t threads = 1;
+        if (image.size() >= PARALLEL_SCAN_THRESHOLD)
+            threads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), 16));
+
+        const size_t chunk = (positions + threads - 1) / threads;
+        std::vector<std::vector<size_t>> partial(threads);
+        std::atomic<size_t> found{0};
+
+        if (threads == 1)
+        {
+            scan_range(image.data(), pattern, 0, positions, limit, &found, &partial[0]);
+        }
+        else
+        {
+            std::vector<std::thread> workers;
+            workers.reserve(threads);
+            for (size_t t = 0; t < threads; ++t)
+            {
+                size_t begin = t * chunk;
+                size_t end = std::min(positions, begin + chunk);
+                if (begin >= end)
+                    break;
+                workers.emplace_back(scan_range, image.data(), std::cref(pattern), begin, end, limit, &found, &partial[t]);
+            }
+            for (auto& w : workers)
+                w.join();
+        }
+
+        for (auto& p : partial)
+            result.insert(result.end(), p.begin(), p.end());
+        if (limit != 0 && result.size() > limit)
+            result.resize(limit);
+        return result;
+    }
+
+    std::vector<size_t> find_all(const image_t& image, const pattern_t& pattern, size_t max_hits)
+    {
+        return scan_image(image, pattern, max_hits);
+    }
+
+    size_t count_matches(const image_t& image, const pattern_t& pattern, size_t limit)
+    {
+        return scan_image(image, pattern, limit).size();
+    }
+
+    ea_t resolve_rip_target(ea_t ea)
+    {
+        insn_t insn;
+        if (decode_insn(&insn, ea) <= 0)
+            return BADADDR;
+        for (int i = 0; i < UA_MAXOP; ++i)
+        {
+            const op_t& op = insn.ops[i];
+            if (op.type == o_void)
+                break;
+            // On x64 IDA reports [rip+disp32] as o_mem with the absolute address.
+            if (op.type == o_mem)
+                return op.addr;
+        }
+        return BADADDR;
+    }
+
+    // Calls to anything bigger than this are not treated as a pointer decryption stub.
+    static const asize_t MAX_STUB_SIZE = 0x100;
+
+    static bool is_first_arg_reg(const op_t& op)
+    {
+        return op.type == o_reg && (op.reg == R_cx || op.reg == R_di);
+    }
+
+    // Pattern B: the address is loaded into the first argument register and a small function is called
+    // within the next couple of instructions.
+    static void detect_decrypt_stub(rip_candidate_t* cand, const insn_t& load, ea_t func_end)
+    {
+        if (!is_first_arg_reg(load.ops[0]))
+            return;
+
+        ea_t ea = load.ea + load.size;
+        for (int i = 0; i < 3 && ea < func_end; ++i)
+        {
+            insn_t next;
+            if (decode_insn(&next, ea) <= 0)
+                return;
+            if (next.itype == NN_call)
+            {
+                func_t* callee = next.ops[0].type == o_near ? get_func(next.ops[0].addr) : nullptr;
+                if (callee != nullptr && callee->size() <= MAX_STUB_SIZE)
+                {
+                    cand->stub_ea = callee->start_ea;
+                    cand->stub_size = callee->size();
+                }
+                return;
+            }
+            // Stop if something else overwrites the argument register first.
+            if (next.ops[0].type == o_reg && next.ops[0].reg == load.ops[0].reg)
+                return;
+            ea += next.size;
+        }
+    }
+
+    std::vector<rip_candidate_t> collect_rip_candidates(ea_t func_ea, size_t max_count)
+    {
+        std::vector<rip_candidate_t> candidates;
+        func_t* pfn = get_func(func_ea);
+        if (pfn == nullptr)
+            return candidates;
+
+        std::set<ea_t> seen;
+        func_item_iterator_t fii;
+        for (bool ok = fii.set(pfn); ok && candidates.size() < max_count; ok = fii.next_code())
+        {
+            insn_t insn;
+            if (decode_insn(&insn, fii.current()) <= 0)
+                continue;
+            if (insn.itype != NN_lea && insn.itype != NN_mov)
+                continue;
+            // Loads only: the source operand is the RIP-relative one.
+            if (insn.ops[0].type != o_reg || insn.ops[1].type != o_mem)
+                continue;
+
+            rip_candidate_t cand;
+            cand.insn_ea = insn.ea;
+            cand.target = insn.ops[1].addr;
+            cand.itype = insn.itype;
+            if (!is_mapped(cand.target))
+                continue;
+            detect_decrypt_stub(&cand, insn, pfn->end_ea);
+
+            // The same global is often loaded several times; list it once, preferring a pattern B site.
+            if (!seen.insert(cand.target).second)
+            {
+                if (cand.stub_ea == BADADDR)
+                    continue;
+                auto it = std::find_if(candidates.begin(), candidates.end(),
+                    [&](const rip_candidate_t& c) { return c.target == cand.target; });
+                if (it == candidates.end() || it->stub_ea != BADADDR)
+                    continue;
+                candidates.erase(it);
+            }
+
+            generate_disasm_line(&cand.disasm, cand.insn_ea, GENDSM_REMOVE_TAGS);
+            cand.disasm.trim2();
+            candidates.push_back(std::move(cand));
+        }
+
+        std::sort(candidates.begin(), candidates.end(),
+            [](const rip_candidate_t& a, const rip_candidate_t& b) { return a.insn_ea < b.insn_ea; });
+        return candidates;
+    }
+
+    std::string format_rip_candidates(const std::vector<rip_candidate_t>& candidates)
+    {
+        qstring out;
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            const rip_candidate_t& c = candidates[i];
+            qstring target_name;
+            get_name(&target_name, c.target);
+            out.cat_sprnt("[%d] 0x%llX  %s  -> 0x%llX", (int)i + 1, (uint64)c.insn_ea, c.disasm.c_str(), (uint64)c.target);
+            if (!target_name.empty())
+                out.cat_sprnt(" (%s)", target_name.c_str());
+            if (c.stub_ea != BADADDR)
+            {
+                qstring stub_name;
+                get_func_name(&stub_name, c.stub_ea);
+                out.cat_sprnt("  [then calls %s, 0x%llX bytes: pattern B]", stub_name.c_str(), (uint64)c.stub_size);
+            }
+            out.append('\n');
+        }
+        return out.c_str();
+    }
+
+    void filter_matches(const image_t& image, const pattern_t& pattern, std::vector<size_t>* candidates)
+    {
+        const size_t len = pattern.size();
+        candidates->erase(std::remove_if(candidates->begin(), candidates->end(), [&](size_t off) {
+            return off + len > image.size() || !matches_at(image.data() + off, pattern);
+        }), candidates->end());
+    }
+
+    // An operand field runs from its offset to the next field of the instruction (or its end).
+    static int operand_field_end(const insn_t& insn, int from)
+    {
+        int end = insn.size;
+        for (int n = 0; n < UA_MAXOP; ++n)
+        {
+            const op_t& op = insn.ops[n];
+            if (op.type == o_void)
+                break;
+            if (op.offb > from && op.offb < end)
+                end = op.offb;
+            if (op.offo > from && op.offo < end)
+                end = op.offo;
+        }
+        return end;
+    }
+
+    // Appends the instruction at ea with every byte that depends on code or data placement wildcarded.
+    static bool has_data_xref(ea_t from, ea_t to)
+    {
+        xrefblk_t xb;
+        for (bool ok = xb.first_from(from, XREF_DATA); ok; ok = xb.next_from())
+        {
+            if (xb.to == to)
+                return true;
+        }
+        return false;
+    }
+
+    static bool append_insn(pattern_t* pattern, ea_t ea, insn_t* insn)
+    {
+        int len = decode_insn(insn, ea);
+        uint8 buf[32];
+        if (len <= 0 || len > (int)sizeof(buf))
+            return false;
+        if (get_bytes(buf, len, ea) != len)
+            return false;
+
+        const size_t base = pattern->size();
+        pattern->bytes.insert(pattern->bytes.end(), buf, buf + len);
+        pattern->mask.insert(pattern->mask.end(), (size_t)len, 0xFF);
+
+        auto wildcard = [&](int from, int to) {
+            for (int i = std::max(from, 0); i < to && i < len; ++i)
+                pattern->mask[base + i] = 0;
+        };
+
+        const flags64_t flags = get_flags(ea);
+        for (int n = 0; n < UA_MAXOP; ++n)
+        {
+            const op_t& op = insn->ops[n];
+            if (op.type == o_void)
+                break;
+
+            bool placement_dependent = false;
+            switch (op.type)
+            {
+            case o_mem:
+            case o_near:
+            case o_far:
+                placement_dependent = true;
+                break;
+            case o_displ:
+                // Stack-frame and struct-field displacements stay; only one that is itself a
+                // global address, as in [rcx*8+table], moves with the image.
+                placement_dependent = is_off(flags, n) || has_data_xref(ea, op.addr);
+                break;
+            case o_imm:
+                placement_dependent = is_off(flags, n) || (get_dtype_size(op.dtype) >= 4 && is_mapped(op.value));
+                break;
+            default:
+                break;
+            }
+            if (!placement_dependent)
+                continue;
+            if (op.offb != 0)
+                wildcard(op.offb, operand_field_end(*insn, op.offb));
+            if (op.offo != 0)
+                wildcard(op.offo, operand_field_end(*insn, op.offo));
+        }
+
+        for (ea_t f = get_next_fixup_ea(ea - 1); f != BADADDR && f < ea + len; f = get_next_fixup_ea(f))
+        {
+            fixup_data_t fd;
+            if (get_fixup(&fd, f))
+                wildcard((int)(f - ea), (int)(f - ea) + calc_fixup_size(fd.get_type()));
+        }
+        return true;
+    }
+
+    static void trim_trailing_wildcards(pattern_t* pattern)
+    {
+        while (!pattern->mask.empty() && pattern->mask.back() == 0)
+        {
+            pattern->mask.pop_back();
+            pattern->bytes.pop_back();
+        }
+        finalize_pattern(pattern);
+    }
+
+    bool make_signature(signature_t* out, const image_t& image, ea_t start, size_t max_len)
+    {
+        size_t self;
+        if (!image.to_offset(start, &self))
+            return false;
+
+        // Stay inside the function chunk; bytes past it belong to whatever the linker put next.
+        func_t* chunk = get_fchunk(start);
+        const ea_t limit = chunk != nullptr ? chunk->end_ea : BADADDR;
+
+        pattern_t pattern;
+        std::vector<size_t> candidates;
+        bool scanned = false;
+
+        auto is_unique = [&]() {
+            finalize_pattern(&pattern);
+            if (!scanned)
+            {
+                // One full scan once the prefix is selective; growing it further only has to re-check the survivors.
+                candidates = find_all(image, pattern);
+                scanned = true;
+            }
+            else
+            {
+                filter_matches(image, pattern, &candidates);
+            }
+            return candidates.size() == 1 && candidates[0] == self;
+        };
+
+        ea_t ea = start;
+        bool unique = false;
+        while (pattern.size() < max_len && (limit == BADADDR || ea < limit))
+        {
+            insn_t insn;
+            if (!append_insn(&pattern, ea, &insn))
+                break;
+            ea += insn.size;
+
+            if (!pattern.valid())
+                continue;
+            size_t fixed = std::count(pattern.mask.begin(), pattern.mask.end(), (uint8)0xFF);
+            if (!scanned && fixed < 6 && pattern.size() < 24)
+                continue;
+            if (is_unique())
+            {
+                unique = true;
+                break;
+            }
+            if (candidates.empty())
+                return false; // the item does not even match itself; the image is stale
+        }
+
+        if (!unique && !scanned && pattern.valid())
+            unique = is_unique();
+        if (!unique)
+            return false;
+
+        trim_trailing_wildcards(&pattern);
+        out->ea = start;
+        out->match_ea = start;
+        out->kind = SIG_DIRECT;
+        out->operand_offset = 0;
+        out->insn_size = 0;
+        out->pattern = std::move(pattern);
+        return true;
+    }
+
+    bool make_unique_signature(signature_t* out, const image_t& image, ea_t ea)
+    {
+        if (is_code(get_flags(ea)) && make_signature(out, image, ea))
+            return true;
+
+        // Sign a few of the instructions referencing ea and keep the shortest pattern.
+        static const int MAX_REFERENCE_SITES = 8;
+        bool found = false;
+        int tried = 0;
+        xrefblk_t xb;
+        for (bool ok = xb.first_to(ea, XREF_ALL); ok && tried < MAX_REFERENCE_SITES; ok = xb.next_to())
+        {
+            if (xb.iscode && xb.type == fl_F)
+                continue;
+            if (!is_code(get_flags(xb.from)))
+                continue;
+
+            insn_t insn;
+            if (decode_insn(&insn, xb.from) <= 0)
+                continue;
+
+            // Only rel32 / RIP-relative references can be followed back to the item.
+            int operand_offset = 0;
+            for (int n = 0; n < UA_MAXOP && insn.ops[n].type != o_void; ++n)
+            {
+                const op_t& op = insn.ops[n];
+                if ((op.type == o_mem || op.type == o_near) && op.addr == ea && op.offb != 0
+                    && operand_field_end(insn, op.offb) - op.offb == 4)
+                {
+                    operand_offset = op.offb;
+                    break;
+                }
+            }
+            if (operand_offset == 0)
+                continue;
+
+            tried++;
+            signature_t sig;
+            if (!make_signature(&sig, image, xb.from))
+                continue;
+            if (!found || sig.pattern.size() < out->pattern.size())
+            {
+                *out = std::move(sig);
+                out->kind = SIG_REFERENCE;
+                out->operand_offset = operand_offset;
+                out->insn_size = insn.size;
+                found = true;
+            }
+        }
+
+        if (found)
+            out->ea = ea;
+        return found;
+    }
+
+    static std::string make_identifier(ea_t ea, std::set<std::string>* used)
+    {
+        qstring name;
+        get_name(&name, ea);
+
+        std::string id;
+        id.reserve(name.length());
+        for (size_t i = 0; i < name.length(); ++i)
+        {
+            char c = name[i];
+            bool ok = qisalnum(c) || c == '_';
+            if (ok)
+                id += c;
+            else if (!id.empty() && id.back() != '_')
+                id += '_';
+        }
+        while (!id.empty() && id.back() == '_')
+            id.pop_back();
+        if (id.empty())
+        {
+            qstring fallback;
+            fallback.sprnt("item_%llX", (uint64)ea);
+            id = fallback.c_str();
+        }
+        if (qisdigit(id[0]))
+            id.insert(0, "_");
+
+        std::string unique_id = id;
+        for (int n = 2; !used->insert(unique_id).second; ++n)
+            unique_id = id + "_" + std::to_string(n);
+        return unique_id;
+    }
+
+    static std::string describe_signature(const signature_t& sig)
+    {
+        qstring name;
+        get_name(&name, sig.ea);
+        qstring line;
+        if (sig.kind == SIG_DIRECT)
+            line.sprnt("// %s @ 0x%llX", name.c_str(), (uint64)sig.ea);
+        else
+            line.sprnt("// %s @ 0x%llX, via reference at 0x%llX (rel32 at +%d, instruction size %d)",
+                name.c_str(), (uint64)sig.ea, (uint64)sig.match_ea, sig.operand_offset, sig.insn_size);
+        return line.c_str();
+    }
+
+    std::string format_signatures(const std::vector<signature_t>& signatures, signature_format_t format)
+    {
+        char root_name[QMAXPATH];
+        get_root_filename(root_name, sizeof(root_name));
+
+        std::set<std::string> used;
+        std::string out;
+        out += "#pragma once\n\n";
+
+        if (format == SIG_FORMAT_CPP_HEADER)
+        {
+            out += "// Byte signatures generated by AiDA for ";
+            out += root_name;
+            out += ".\n// '?' is a wildcard byte. A reference signature matches an instruction pointing at the item:\n"
+                   "// read the int32 at match + rel32 offset and add it to match + instruction size.\n\n"
+                   "namespace signatures\n{\n";
+            for (const signature_t& sig : signatures)
+            {
+                std::string id = make_identifier(sig.ea, &used);
+                out += "    " + describe_signature(sig) + "\n";
+                out += "    inline constexpr const char " + id + "[] = \"" + sig.pattern.to_string() + "\";\n";
+            }
+            out += "}\n";
+            return out;
+        }
+
+        out += "#include <MinHook.h>\n\n"
+               "// Hook scaffolding generated by AiDA for ";
+        out += root_name;
+        out += ".\n"
+               "// FindPattern must return the first match of an IDA-style pattern in the module, or nullptr.\n"
+               "void* FindPattern(const char* pattern);\n\n"
+               "template <typename Fn>\n"
+               "inline bool CreateHookByPattern(const char* pattern, Fn detour, Fn* original, int rel32_offset = -1, int insn_size = 0)\n"
+               "{\n"
+               "    auto* match = static_cast<unsigned char*>(FindPattern(pattern));\n"
+               "    if (match == nullptr)\n"
+               "        return false;\n"
+               "    void* target = match;\n"
+               "    if (rel32_offset >= 0)\n"
+               "        target = match + insn_size + *reinterpret_cast<const int*>(match + rel32_offset);\n"
+               "    return MH_CreateHook(target, reinterpret_cast<void*>(detour), reinterpret_cast<void**>(original)) == MH_OK;\n"
+               "}\n";
+
+        for (const signature_t& sig : signatures)
+        {
+            std::string id = make_identifier(sig.ea, &used);
+            out += "\n" + describe_signature(sig) + "\n";
+            out += "inline constexpr const char " + id + "_pattern[] = \"" + sig.pattern.to_string() + "\";\n";
+
+            if (get_func(sig.ea) == nullptr)
+                continue;
+
+            std::string type_name = id + "_t";
+            tinfo_t tif;
+            qstring decl;
+            if ((get_tinfo(&tif, sig.ea) || guess_tinfo(&tif, sig.ea) == GUESS_FUNC_OK) && tif.is_func())
+            {
+                tinfo_t ptr;
+                ptr.create_ptr(tif);
+                ptr.print(&decl, type_name.c_str(), PRTYPE_1LINE);
+            }
+            if (decl.empty())
+                decl.sprnt("void (*%s)()", type_name.c_str());
+
+            out += "typedef ";
+            out += decl.c_str();
+            out += ";\n";
+            out += "inline " + type_name + " " + id + "_original = nullptr;\n";
+            if (sig.kind == SIG_DIRECT)
+                out += "// CreateHookByPattern(" + id + "_pattern, &" + id + "_detour, &" + id + "_original);\n";
+            else
+                out += "// CreateHookByPattern(" + id + "_pattern, &" + id + "_detour, &" + id + "_original, "
+                    + std::to_string(sig.operand_offset) + ", " + std::to_string(sig.insn_size) + ");\n";
+        }
+        return out;
+    }
+
+    const std::vector<engine_pattern_t>& unreal_patterns()
+    {
+        static const std::vector<engine_pattern_t> patterns = {
+            { "GWorld",   "UE4.2x/UE5 GWorld null check",              "48 8B 1D ? ? ? ? 48 85 DB 74 ? 41 B0 01", 0 },
+            { "GWorld",   "UE4/UE5 GWorld load before world context",   "48 8B 05 ? ? ? ? 48 3B C3 48 0F 44 C6", 0 },
+            { "GNames",   "UE4.23+ FNamePool construction",            "48 8D 0D ? ? ? ? E8 ? ? ? ? C6 05 ? ? ? ? 01 0F 10 03", 0 },
+            { "GNames",   "UE5 FNamePool lazy init",                   "48 8D 05 ? ? ? ? EB ? 48 8D 0D ? ? ? ? E8 ? ? ? ? C6 05", 0 },
+            { "GNames",   "UE4 <4.23 TNameEntryArray allocation",       "48 8B 05 ? ? ? ? 48 85 C0 75 ? B9 08 04 00 00", 0 },
+            { "GObjects", "UE4.21+/UE5 FChunkedFixedUObjectArray index", "48 8B 05 ? ? ? ? 48 8B 0C C8 48 8D 04 D1", 0 },
+            { "GObjects", "UE4.21+/UE5 FChunkedFixedUObjectArray index", "48 8B 05 ? ? ? ? 48 8B 0C C8 4C 8D 04 D1", 0 },
+            { "GObjects", "UE4 <4.21 FFixedUObjectArray index",         "48 8B 05 ? ? ? ? 48 8D 14 C8 EB", 0 },
+        };
+        return patterns;
+    }
+
+    std::vector<scan_hit_t> scan_unreal_globals(const image_t& image)
+    {
+        // A useful signature matches a handful of times; anything above this is noise.
+        static const size_t MAX_HITS_PER_PATTERN = 32;
+
+        std::vector<scan_hit_t> hits;
+        for (const engine_pattern_t& ep : unreal_patterns())
+        {
+            pattern_t pattern;
+            if (!parse_pattern(&pattern, ep.pattern))
+            {
+                msg("AiDA: Skipping malformed pattern for %s: %s\n", ep.target, ep.pattern);
+                continue;
+            }
+
+            for (size_t offset : find_all(image, pattern, MAX_HITS_PER_PATTERN))
+            {
+                scan_hit_t hit;
+                hit.target = ep.target;
+                hit.description = ep.description;
+                hit.match_ea = image.to_ea(offset);
+                if (hit.match_ea == BADADDR)
+                    continue;
+                hit.resolved_ea = resolve_rip_target(hit.match_ea + ep.insn_offset);
+                if (hit.resolved_ea != BADADDR && !is_mapped(hit.resolved_ea))
+                    hit.resolved_ea = BADADDR;
+                hits.push_back(std::move(hit));
+            }
+        }
+        return hits;
+    }
+
+    struct root_strings_t
+    {
+        const char* target;
+        std::vector<const char*> needles;
+    };
+
+    static const std::vector<const char*>* root_strings(const char* target)
+    {
+        static const std::vector<root_strings_t> table = {
+            { "GWorld",   { "SeamlessTravel", "PersistentLevel", "WorldSettings", "/Game/Maps/", "LoadMap" } },
+            { "GNames",   { "ByteProperty", "IntProperty", "EnumProperty", "MulticastDelegateProperty" } },
+            { "GObjects", { "/Script/CoreUObject", "MaxObjectsNotConsideredByGC", "MaxObjectsInGame", "UObjectArray" } },
+        };
+        for (const auto& entry : table)
+            if (streq(entry.target, target))
+                return &entry.needles;
+        return nullptr;
+    }
+
+    static int count_data_xrefs(ea_t ea, int limit)
+    {
+        int count = 0;
+        xrefblk_t xb;
+        for (bool ok = xb.first_to(ea, XREF_DATA); ok && count < limit; ok = xb.next_to())
+            count++;
+        return count;
+    }
+
+    // How much a RIP-relative load looks like an access to the target; negative rules it out.
+    static int score_global(const rip_candidate_t& cand, const char* target, std::map<ea_t, int>* fan_in)
+    {
+        segment_t* seg = getseg(cand.target);
+        if (seg == nullptr || (seg->perm & SEGPERM_EXEC) != 0 || seg->type == SEG_CODE)
+            return -1;
+        flags64_t flags = get_flags(cand.target);
+        if (is_strlit(flags))
+            return -1;
+
+        int score = 0;
+        // Engine globals are filled in at startup, so they live in writable data or .bss.
+        if ((seg->perm & SEGPERM_WRITE) != 0 || seg->type == SEG_BSS)
+            score += 2;
+
+        auto it = fan_in->find(cand.target);
+        if (it == fan_in->end())
+            it = fan_in->emplace(cand.target, count_data_xrefs(cand.target, 256)).first;
+        for (int threshold : { 4, 16, 64, 256 })
+            if (it->second >= threshold)
+                score++;
+
+        // GWorld is a UWorld* and gets dereferenced; GNames/GObjects are structures whose
+        // address is taken, although older engines keep pointers to them as well.
+        bool is_lea = cand.itype == NN_lea;
+        if (streq(target, "GWorld"))
+            score += is_lea ? -1 : 2;
+        else
+            score += is_lea ? 2 : 1;
+
+        if (cand.stub_ea != BADADDR)
+            score += 2;
+
+        if (has_user_name(flags))
+        {
+            qstring name;
+            get_name(&name, cand.target);
+            score += name == target ? 5 : -3;
+        }
+        return score;
+    }
+
+    std::vector<root_candidate_t> rank_root_functions(const char* target, size_t max_scan, size_t max_candidates)
+    {
+        std::vector<root_candidate_t> ranked;
+        const std::vector<const char*>* needles = root_strings(target);
+        if (needles == nullptr || max_scan == 0 || max_candidates == 0)
+            return ranked;
+
+        if (get_strlist_qty() == 0)
+            build_strlist();
+
+        // Functions referencing the engine strings, in discovery order, with their hit counts.
+        std::vector<ea_t> order;
+        std::map<ea_t, int> string_hits;
+        const size_t qty = get_strlist_qty();
+        for (size_t i = 0; i < qty && order.size() < max_scan; ++i)
+        {
+            string_info_t si;
+            if (!get_strlist_item(&si, i))
+                continue;
+            qstring text;
+            if (get_strlit_contents(&text, si.ea, si.length, si.type) <= 0)
+                continue;
+            if (std::none_of(needles->begin(), needles->end(),
+                    [&](const char* needle) { return strstr(text.c_str(), needle) != nullptr; }))
+                continue;
+
+            xrefblk_t xb;
+            for (bool ok = xb.first_to(si.ea, XREF_DATA); ok && order.size() < max_scan; ok = xb.next_to())
+            {
+                func_t* pfn = get_func(xb.from);
+                if (pfn == nullptr)
+                    continue;
+                if (string_hits[pfn->start_ea]++ == 0)
+                    order.push_back(pfn->start_ea);
+            }
+        }
+
+        std::map<ea_t, int> fan_in;
+        for (ea_t func_ea : order)
+        {
+            root_candidate_t cand;
+            cand.func_ea = func_ea;
+            cand.string_hits = string_hits[func_ea];
+
+            int best = -1;
+            for (const rip_candidate_t& load : collect_rip_candidates(func_ea))
+            {
+                int score = score_global(load, target, &fan_in);
+                if (score > best)
+                {
+                    best = score;
+                    cand.best_global = load.target;
+                }
+            }
+            if (best < 0)
+                continue; // nothing the target could be loaded from
+            cand.score = 3 * std::min(cand.string_hits, 4) + best;
+            ranked.push_back(cand);
+        }
+
+        std::stable_sort(ranked.begin(), ranked.end(),
+            [](const root_candidate_t& a, const root_candidate_t& b) { return a.score > b.score; });
+        if (ranked.size() > max_candidates)
+            ranked.resize(max_candidates);
+        return ranked;
+    }
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <ida.hpp>
+
+namespace scanner
+{
+    // A byte pattern in IDA notation ("48 8B 05 ? ? ? ?"). mask[i] is 0xFF for a fixed
+    // byte and 0 for a wildcard. The two anchors are the least common fixed bytes; the
+    // vectorized prefilter only looks at those two positions.
+    struct pattern_t
+    {
+        std::vector<uint8> bytes;
+        std::vector<uint8> mask;
+        size_t anchor1 = 0;
+        size_t anchor2 = 0;
+
+        size_t size() const { return bytes.size(); }
+        bool valid() const;
+        std::string to_string() const;
+    };
+
+    bool parse_pattern(pattern_t* out, const char* text);
+    void finalize_pattern(pattern_t* pattern);
+
+    enum image_kind_t
+    {
+        IMAGE_CODE, // executable segments
+        IMAGE_DATA, // initialized non-executable segments (.rdata, .data)
+    };
+
+    // Flat copy of every segment of one kind. Building it needs the database (main thread);
+    // scanning it does not, so the scan itself can run on worker threads.
+    class image_t
+    {
+    public:
+        bool load(image_kind_t kind = IMAGE_CODE);
+        bool empty() const { return _data.empty(); }
+        size_t size() const { return _data.size(); }
+        const uint8* data() const { return _data.data(); }
+        ea_t to_ea(size_t offset) const;
+        bool to_offset(ea_t ea, size_t* out) const;
+
+        // Calls fn(from, to) for the part of each segment inside [begin, end), with from moved
+        // up to the first address that is a multiple of align. Segments need not be aligned.
+        template <typename Fn>
+        void for_each_aligned(size_t begin, size_t end, size_t align, Fn fn) const
+        {
+            for (const range_t& r : _ranges)
+            {
+                size_t from = std::max(begin, r.offset);
+                const size_t to = std::min(end, r.offset + r.size);
+                if (from >= to)
+                    continue;
+                const size_t misalign = (size_t)((r.start_ea + (from - r.offset)) % align);
+                if (misalign != 0)
+                    from += align - misalign;
+                if (from < to)
+                    fn(from, to);
+            }
+        }
+
+    private:
+        struct range_t
+        {
+            ea_t start_ea;
+            size_t offset;
+            size_t size;
+        };
+        std::vector<uint8> _data;
+        std::vector<range_t> _ranges;
+    };
+
+    // Image offsets of the matches in ascending order. max_hits == 0 means no limit;
+    // otherwise the scan stops once that many matches were seen, and which of the
+    // matches are returned is unspecified.
+    std::vector<size_t> find_all(const image_t& image, const pattern_t& pattern, size_t max_hits = 0);
+    size_t count_matches(const image_t& image, const pattern_t& pattern, size_t limit);
+
+    // Target of the first RIP-relative memory operand of the instruction at ea.
+    ea_t resolve_rip_target(ea_t ea);
+
+    // A RIP-relative LEA/MOV load in a function, with its target already computed.
+    struct rip_candidate_t
+    {
+        ea_t insn_ea = BADADDR;
+        ea_t target = BADADDR;
+        uint16 itype = 0;       // NN_lea or NN_mov
+        qstring disasm;
+        ea_t stub_ea = BADADDR; // set when the address goes to RCX/RDI and a small function is called right after (pattern B)
+        asize_t stub_size = 0;
+    };
+
+    std::vector<rip_candidate_t> collect_rip_candidates(ea_t func_ea, size_t max_count = 48);
+    std::string format_rip_candidates(const std::vector<rip_candidate_t>& candidates);
+
+    // Drops the candidates (image offsets) at which pattern no longer matches.
+    void filter_matches(const image_t& image, const pattern_t& pattern, std::vector<size_t>* candidates);
+
+    enum signature_kind_t
+    {
+        SIG_DIRECT,    // the match is the item itself
+        SIG_REFERENCE, // the match is an instruction whose rel32/RIP operand points at the item
+    };
+
+    struct signature_t
+    {
+        ea_t ea = BADADDR;       // the signed item
+        ea_t match_ea = BADADDR; // where the pattern starts
+        signature_kind_t kind = SIG_DIRECT;
+        int operand_offset = 0;  // SIG_REFERENCE: offset of the 32-bit displacement in the pattern
+        int insn_size = 0;       // SIG_REFERENCE: the displacement is relative to match + insn_size
+        pattern_t pattern;
+    };
+
+    // Grows a pattern from start one decoded instruction at a time, wildcarding relocations,
+    // displacements and branch/RIP-relative operands, until it matches exactly once.
+    bool make_signature(signature_t* out, const image_t& image, ea_t start, size_t max_len = 96);
+    // Signs ea directly when it is code, otherwise (or if that fails) through the shortest
+    // unique signature of an instruction referencing it.
+    bool make_unique_signature(signature_t* out, const image_t& image, ea_t ea);
+
+    enum signature_format_t
+    {
+        SIG_FORMAT_CPP_HEADER,
+        SIG_FORMAT_MINHOOK,
+    };
+
+    std::string format_signatures(const std::vector<signature_t>& signatures, signature_format_t format);
+
+    struct engine_pattern_t
+    {
+        const char* target;      // GWorld, GNames, GObjects
+        const char* description;
+        const char* pattern;
+        int insn_offset;         // offset of the RIP-relative instruction inside the pattern
+    };
+
+    const std::vector<engine_pattern_t>& unreal_patterns();
+
+    struct scan_hit_t
+    {
+        qstring target;
+        qstring description;
+        ea_t match_ea = BADADDR;
+        ea_t resolved_ea = BADADDR;
+    };
+
+    std::vector<scan_hit_t> scan_unreal_globals(const image_t& image);
+
+    // A function worth asking the AI about when the signatures did not find a target.
+    struct root_candidate_t
+    {
+        ea_t func_ea = BADADDR;
+        int string_hits = 0;          // references to engine strings typical for the target
+        ea_t best_global = BADADDR;   // the highest-scoring global the function loads
+        int score = 0;
+    };
+
+    // Ranks functions that reference the target's engine strings by how much the globals
+    // they load look like the target (segment, fan-in, LEA vs MOV, decrypt stubs). At most
+    // max_scan functions are examined and the best max_candidates returned.
+    std::vector<root_candidate_t> rank_root_functions(const char* target, size_t max_scan, size_t max_candidates);
+}
@@ -136,6 +136,8 @@ static void to_json(nlohmann::json& j, const settings_t& s)
         {"anthropic_base_url", s.anthropic_base_url},
         {"copilot_proxy_address", s.copilot_proxy_address},
         {"copilot_model_name", s.copilot_model_name},
+        {"local_server_address", s.local_server_address},
+        {"local_model_name", s.local_model_name},
         {"xref_context_count", s.xref_context_count},
         {"xref_analysis_depth", s.xref_analysis_depth},
         {"xref_code_snippet_lines", s.xref_code_snippet_lines},
@@ -143,7 +145,15 @@ static void to_json(nlohmann::json& j, const settings_t& s)
         {"max_prompt_tokens", s.max_prompt_tokens},
         {"max_root_func_scan_count", s.max_root_func_scan_count},
         {"max_root_func_candidates", s.max_root_func_candidates},
-        {"temperature", s.temperature}
+        {"query_shard_tokens", s.query_shard_tokens},
+        {"query_shortlist_size", s.query_shortlist_size},
+        {"temperature", s.temperature},
+        {"review_changes", s.review_changes},
+        {"stream_responses", s.stream_responses},
+        {"http2", s.http2},
+        {"agent_mode", s.agent_mode},
+        {"agent_max_turns", s.agent_max_turns},
+        {"rpc_listen", s.rpc_listen}
     };
 }
 
@@ -170,6 +180,9 @@ static void from_json(const nlohmann::json& j, settings_t& s)
     s.copilot_proxy_address = j.value("copilot_proxy_address", d.copilot_proxy_address);
     s.copilot_model_name = j.value("copilot_model_name", d.copilot_model_name);
 
+    s.local_server_address = get_trimmed_json_string(j, "local_server_address", d.local_server_address);
+    s.local_model_name = get_trimmed_json_string(j, "local_model_name", d.local_model_name);
+
     s.xref_context_count = j.value("xref_context_count", d.xref_context_count);
     s.xref_analysis_depth = j.value("xref_analysis_depth", d.xref_analysis_depth);
     s.xref_code_snippet_lines = j.value("xref_code_snippet_lines", d.xref_code_snippet_lines);
@@ -180,7 +193,18 @@ static void from_json(const nlohmann::json& j, settings_t& s)
     s.max_root_func_scan_count = j.value("max_root_func_scan_count", d.max_root_func_scan_count);
     s.max_root_func_candidates = j.value("max_root_func_candidates", d.max_root_func_candidates);
 
+    s.query_shard_tokens = j.value("query_shard_tokens", d.query_shard_tokens);
+    s.query_shortlist_size = j.value("query_shortlist_size", d.query_shortlist_size);
+
     s.temperature = j.value("temperature", d.temperature);
+
+    s.review_changes = j.value("review_changes", d.review_changes);
+    s.stream_responses = j.value("stream_responses", d.stream_responses);
+    s.http2 = j.value("http2", d.http2);
+    s.agent_mode = j.value("agent_mode", d.agent_mode);
+    s.agent_max_turns = j.value("agent_max_turns", d.agent_max_turns);
+
+    s.rpc_listen = j.value("rpc_listen", d.rpc_listen);
 }
 
 static qstring get_config_file()
@@ -259,10 +283,15 @@ static bool load_settings_from_file(settings_t& settings, const qstring& path)
         req("openrouter_api_key"); req("openrouter_model_name");
         req("anthropic_api_key"); req("anthropic_model_name"); req("anthropic_base_url");
         req("copilot_proxy_address"); req("copilot_model_name");
+        req("local_server_address"); req("local_model_name");
         req("xref_context_count"); req("xref_analysis_depth"); req("xref_code_snippet_lines");
         req("bulk_processing_delay"); req("max_prompt_tokens");
         req("max_root_func_scan_count"); req("max_root_func_candidates");
+        req("query_shard_tokens"); req("query_shortlist_size");
         req("temperature");
+        req("review_changes"); req("stream_responses"); req("http2");
+        req("agent_mode"); req("agent_max_turns");
+        req("rpc_listen");
 
         settings = j.get<settings_t>();
 
@@ -296,6 +325,8 @@ settings_t::settings_t() :
     anthropic_base_url(""),
     copilot_proxy_address("http://127.0.0.1:4141"),
     copilot_model_name("gpt-4.1"),
+    local_server_address("http://127.0.0.1:8080"),
+    local_model_name(""),
     xref_context_count(5),
     xref_analysis_depth(3),
     xref_code_snippet_lines(30),
@@ -303,7 +334,15 @@ settings_t::settings_t() :
     max_prompt_tokens(1048576),
     max_root_func_scan_count(40),
     max_root_func_candidates(40),
-    temperature(0.1)
+    query_shard_tokens(24000),
+    query_shortlist_size(12),
+    temperature(0.1),
+    review_changes(false),
+    stream_responses(false),
+    http2(true),
+    agent_mode(false),
+    agent_max_turns(8),
+    rpc_listen("")
 {
 }
 
@@ -312,7 +351,7 @@ void settings_t::save()
     save_settings_to_file(*this, get_config_file());
 }
 
-void settings_t::load(aida_plugin_t* plugin_instance)
+bool settings_t::load_env_keys()
 {
     bool has_env_keys = false;
     qstring val;
@@ -347,6 +386,13 @@ void settings_t::load(aida_plugin_t* plugin_instance)
         msg("AI Assistant: Loaded one or more API keys from environment variables.\n");
     }
 
+    return has_env_keys;
+}
+
+void settings_t::load(aida_plugin_t* plugin_instance)
+{
+    load_env_keys();
+
     bool config_exists_and_valid = load_from_file();
 
     if (!config_exists_and_valid || api_provider.empty())
@@ -367,6 +413,24 @@ void settings_t::load(aida_plugin_t* plugin_instance)
     }
 }
 
+bool settings_t::load_headless()
+{
+    // File first, so the environment fills in whatever keys the file leaves empty.
+    const bool loaded = load_from_file();
+    load_env_keys();
+    if (!loaded || api_provider.empty())
+    {
+        msg("AI Assistant: No provider configured in %s.\n", get_config_file().c_str());
+        return false;
+    }
+    if (get_active_api_key().empty())
+    {
+        msg("AI Assistant: No API key for %s; set it in the settings file or the environment.\n", api_provider.c_str());
+        return false;
+    }
+    return true;
+}
+
 bool settings_t::load_from_file()
 {
     return load_settings_from_file(*this, get_config_file());
@@ -380,6 +444,7 @@ std::string settings_t::get_active_api_key() const
     if (provider == "openrouter") return openrouter_api_key;
     if (provider == "anthropic") return anthropic_api_key;
     if (provider == "copilot") return copilot_proxy_address;
+    if (provider == "local") return local_server_address;
     return "";
 }
 
@@ -392,6 +457,11 @@ void settings_t::prompt_for_api_key()
         warning("AI Assistant: Copilot provider is selected, but the proxy address is not configured. Please set it in the settings dialog.");
         return;
     }
+    if (provider == "local")
+    {
+        warning("AI Assistant: Local provider is selected, but the server address is not configured. Please set it in the settings dialog.");
+        return;
+    }
 
     qstring provider_name = api_provider.c_str();
     if (!provider_name.empty())
@@ -29,6 +29,9 @@ public:
     std::string copilot_proxy_address;
     std::string copilot_model_name;
 
+    std::string local_server_address;
+    std::string local_model_name;   // empty: the first model the server lists
+
     int xref_context_count;
     int xref_analysis_depth;
     int xref_code_snippet_lines;
@@ -37,8 +40,18 @@ public:
 
     int max_root_func_scan_count;
     int max_root_func_candidates;
+    int query_shard_tokens;
+    int query_shortlist_size;
     double temperature;
 
+    bool review_changes;
+    bool stream_responses;
+    bool http2;
+    bool agent_mode;
+    int agent_max_turns;
+
+    std::string rpc_listen;
+
     static const std::vector<std::string> gemini_models;
     static const std::vector<std::string> openai_models;
     static const std::vector<std::string> openrouter_models;
@@ -48,10 +61,16 @@ public:
     settings_t();
     void save();
     void load(aida_plugin_t* plugin_instance);
+    // For idalib runs: environment keys and the settings file only, never a dialog.
+    // False when no provider is configured.
+    bool load_headless();
+    // The settings file alone, for runs that build contexts but send no requests. False
+    // when there is no usable file; the defaults stay in place.
+    bool load_from_file();
     std::string get_active_api_key() const;
 
 private:
-    bool load_from_file();
+    bool load_env_keys();
     void prompt_for_api_key();
 };
 
@@ -105,6 +105,9 @@ void SettingsForm::show_and_apply(aida_plugin_t* plugin_instance)
         "<Bulk Processing Delay (sec):q5:10:10::>\n"
         "<Max Prompt Tokens:D6:10:10::>\n"
         "<Model Temperature:q7:10:10::>\n"
+        "<#Queue AI changes in a review list instead of applying them#Review changes before applying:C8>>\n"
+        "<#Apply comments and renames while the response is still arriving#Stream responses:C9>>\n"
+        "<#Send a small prompt and let the AI fetch callers, callees and types through tool calls#Agent mode:C10>>\n"
         "<=:General>100>\n" // tab ctrl is 100
 
         // --- gemini ---
@@ -133,9 +136,14 @@ void SettingsForm::show_and_apply(aida_plugin_t* plugin_instance)
         // --- copilot ---
         "<Proxy Address:q41:64:64::>\n"
         "<Model Name:b42:0:40::>\n"
-        "<=:Copilot>100>\n";
+        "<=:Copilot>100>\n"
 
-    static const char* const providers_list_items[] = { "Gemini", "OpenAI", "OpenRouter", "Anthropic", "Copilot" };
+        // --- local (llama.cpp server, vLLM) ---
+        "<Server Address:q51:64:64::>\n"
+        "<#Leave empty to use the first model the server lists#Model Name (optional):q52:64:64::>\n"
+        "<=:Local>100>\n";
+
+    static const char* const providers_list_items[] = { "Gemini", "OpenAI", "OpenRouter", "Anthropic", "Copilot", "Local" };
     qstrvec_t providers_qstrvec;
     for (const auto& p : providers_list_items)
         providers_qstrvec.push_back(p);
@@ -147,6 +155,7 @@ void SettingsForm::show_and_apply(aida_plugin_t* plugin_instance)
     else if (provider_setting == "openrouter") provider_idx = 2;
     else if (provider_setting == "anthropic") provider_idx = 3;
     else if (provider_setting == "copilot") provider_idx = 4;
+    else if (provider_setting == "local") provider_idx = 5;
 
     auto find_model_index = [](const std::vector<std::string>& models, const std::string& name) -> int {
         auto it = std::find(models.begin(), models.end(), name);
@@ -188,6 +197,8 @@ void SettingsForm::show_and_apply(aida_plugin_t* plugin_instance)
     qstring anthropic_key = g_settings.anthropic_api_key.c_str();
     qstring anthropic_base_url = g_settings.anthropic_base_url.c_str();
     qstring copilot_proxy_addr = g_settings.copilot_proxy_address.c_str();
+    qstring local_server_addr = g_settings.local_server_address.c_str();
+    qstring local_model = g_settings.local_model_name.c_str();
     qstring bulk_delay_str;
     bulk_delay_str.sprnt("%.2f", g_settings.bulk_processing_delay);
     qstring temp_str;
@@ -198,13 +209,18 @@ void SettingsForm::show_and_apply(aida_plugin_t* plugin_instance)
     sval_t snippet_lines = g_settings.xref_code_snippet_lines;
     sval_t max_tokens = g_settings.max_prompt_tokens;
 
+    ushort review_flags = g_settings.review_changes ? 1 : 0;
+    ushort stream_flags = g_settings.stream_responses ? 1 : 0;
+    ushort agent_flags = g_settings.agent_mode ? 1 : 0;
+
     int selected_tab = 0;
 
     if (ask_form(form_str,
-        // general tab (8 args)
+        // general tab (11 args)
         &providers_qstrvec, &provider_idx,
         &xref_count, &xref_depth, &snippet_lines,
         &bulk_delay_str, &max_tokens, &temp_str,
+        &review_flags, &stream_flags, &agent_flags,
         // gemini tab (4 args)
         &gemini_key, &gemini_models_qsv, &gemini_model_idx, &gemini_base_url,
         // openai tab (4 args)
@@ -215,6 +231,8 @@ void SettingsForm::show_and_apply(aida_plugin_t* plugin_instance)
         &anthropic_key, &anthropic_models_qsv, &anthropic_model_idx, &anthropic_base_url,
         // copilot tab (3 args)
         &copilot_proxy_addr, &copilot_models_qsv, &copilot_model_idx,
+        // local tab (2 args)
+        &local_server_addr, &local_model,
         // tab control (1 arg)
         &selected_tab
     ) > 0)
@@ -244,10 +262,16 @@ void SettingsForm::show_and_apply(aida_plugin_t* plugin_instance)
         if (copilot_model_idx < settings_t::copilot_models.size())
             g_settings.copilot_model_name = settings_t::copilot_models[copilot_model_idx];
 
+        g_settings.local_server_address = local_server_addr.c_str();
+        g_settings.local_model_name = local_model.c_str();
+
         g_settings.xref_context_count = static_cast<int>(xref_count);
         g_settings.xref_analysis_depth = static_cast<int>(xref_depth);
         g_settings.xref_code_snippet_lines = static_cast<int>(snippet_lines);
         g_settings.max_prompt_tokens = static_cast<int>(max_tokens);
+        g_settings.review_changes = (review_flags & 1) != 0;
+        g_settings.stream_responses = (stream_flags & 1) != 0;
+        g_settings.agent_mode = (agent_flags & 1) != 0;
 
         try { g_settings.bulk_processing_delay = std::stod(bulk_delay_str.c_str()); }
         catch (...) { warning("AI Assistant: Invalid value for bulk processing delay."); }
@@ -265,10 +289,91 @@ void SettingsForm::show_and_apply(aida_plugin_t* plugin_instance)
     }
 }
 
-void idaapi close_handler(TWidget* /*cv*/, void* ud)
+// A result viewer's text. Lines are kept raw and tagged with addresses when they are first
+// drawn, so opening a long answer costs one split instead of a markup pass over all of it.
+struct text_viewer_t
+{
+    strvec_t lines;
+    std::vector<bool> marked;
+    ida_utils::address_markup_t space;
+    bool refresh_posted = false;
+};
+
+static std::map<const TWidget*, text_viewer_t*> g_text_viewers;
+
+// Lines past the drawn ones that are tagged with them, so a page of scrolling rarely needs a
+// second redraw.
+static const size_t MARKUP_AHEAD = 100;
+
+static bool mark_lines(text_viewer_t* tv, size_t first, size_t last)
+{
+    bool changed = false;
+    last = std::min(last, tv->lines.size());
+    for (size_t i = first; i < last; ++i)
+    {
+        if (tv->marked[i])
+            continue;
+        tv->marked[i] = true;
+        qstring& line = tv->lines[i].line;
+        std::string tagged = ida_utils::markup_line_with_addresses(line.c_str(), line.length(), tv->space);
+        if (tagged.length() != line.length())
+        {
+            line = tagged.c_str();
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static int idaapi text_viewer_refresh_cb(void* ud)
+{
+    TWidget* viewer = static_cast<TWidget*>(ud);
+    auto it = g_text_viewers.find(viewer);
+    if (it != g_text_viewers.end())
+    {
+        it->second->refresh_posted = false;
+        refresh_custom_viewer(viewer);
+    }
+    return -1; // one-shot
+}
+
+// Called for every repaint; tags what is on screen and redraws once if that changed anything.
+static void on_text_viewer_render(const TWidget* widget, const lines_rendering_input_t* info)
+{
+    auto it = g_text_viewers.find(widget);
+    if (it == g_text_viewers.end() || info == nullptr)
+        return;
+    text_viewer_t* tv = it->second;
+
+    size_t first = SIZE_MAX;
+    size_t last = 0;
+    for (const auto& section : info->sections_lines)
+    {
+        for (const twinline_t* line : section)
+        {
+            if (line == nullptr || line->at == nullptr)
+                continue;
+            const size_t n = static_cast<const simpleline_place_t*>(line->at)->n;
+            first = std::min(first, n);
+            last = std::max(last, n);
+        }
+    }
+    if (first == SIZE_MAX)
+        return;
+
+    first = first > MARKUP_AHEAD ? first - MARKUP_AHEAD : 0;
+    if (mark_lines(tv, first, last + 1 + MARKUP_AHEAD) && !tv->refresh_posted)
+    {
+        // Not from inside the repaint itself.
+        tv->refresh_posted = true;
+        register_timer(0, text_viewer_refresh_cb, const_cast<TWidget*>(widget));
+    }
+}
+
+void idaapi close_handler(TWidget* cv, void* ud)
 {
-    strvec_t* lines_ptr = (strvec_t*)ud;
-    delete lines_ptr;
+    g_text_viewers.erase(cv);
+    delete static_cast<text_viewer_t*>(ud);
 }
 
 void show_text_in_viewer(const char* title, const std::string& text_content)
@@ -285,26 +390,29 @@ void show_text_in_viewer(const char* title, const std::string& text_content)
         close_widget(existing_viewer, WCLS_SAVE);
     }
 
-    strvec_t* lines_ptr = new strvec_t();
-
-    std::string marked_up_content = ida_utils::markup_text_with_addresses(text_content);
-
-    std::stringstream ss(marked_up_content);
-    std::string line;
-    while (std::getline(ss, line, '\n'))
+    text_viewer_t* tv = new text_viewer_t();
+    const char* p = text_content.c_str();
+    const char* end = p + text_content.length();
+    while (p < end)
     {
-        lines_ptr->push_back(simpleline_t(line.c_str()));
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* line_end = nl != nullptr ? nl : end;
+        tv->lines.push_back(simpleline_t(qstring(p, line_end - p)));
+        p = line_end + 1;
     }
+    tv->marked.resize(tv->lines.size(), false);
+    // The first screen is tagged up front so it does not flash untagged.
+    mark_lines(tv, 0, 2 * MARKUP_AHEAD);
 
     simpleline_place_t s1;
     simpleline_place_t s2;
-    s2.n = lines_ptr->empty() ? 0 : static_cast<uint32>(lines_ptr->size() - 1);
+    s2.n = tv->lines.empty() ? 0 : static_cast<uint32>(tv->lines.size() - 1);
 
-    TWidget* viewer = create_custom_viewer(title, &s1, &s2, &s1, nullptr, lines_ptr, nullptr, nullptr);
+    TWidget* viewer = create_custom_viewer(title, &s1, &s2, &s1, nullptr, &tv->lines, nullptr, nullptr);
     if (viewer == nullptr)
     {
         warning("Could not create viewer '%s'.", title);
-        delete lines_ptr;
+        delete tv;
         return;
     }
 
@@ -322,7 +430,8 @@ void show_text_in_viewer(const char* title, const std::string& text_content)
         nullptr, // location_changed
         nullptr); // can_navigate
 
-    set_custom_viewer_handlers(viewer, &handlers, lines_ptr);
+    set_custom_viewer_handlers(viewer, &handlers, tv);
+    g_text_viewers[viewer] = tv;
 
     display_widget(viewer, WOPN_DP_TAB | WOPN_RESTORE);
 }
@@ -344,11 +453,19 @@ static int idaapi finish_populating_widget_popup(TWidget* widget, TPopupMenu* po
         { "ai_assistant:rename_all",   "Analyze/" },
         { "ai_assistant:comment",      "Analyze/" },
         { "ai_assistant:gen_struct",   "Generate/" },
+        { "ai_assistant:reconstruct_class", "Generate/" },
         { "ai_assistant:gen_hook",     "Generate/" },
+        { "ai_assistant:gen_signature", "Generate/" },
         { nullptr,                     nullptr }, // Separator
         { "ai_assistant:scan_for_offsets", "" },
+        { "ai_assistant:scan_rtti",    "" },
+        { "ai_assistant:ue_reflection", "" },
         { "ai_assistant:custom_query", "" },
+        { "ai_assistant:global_query", "" },
         { "ai_assistant:copy_context", "" },
+        { "ai_assistant:export_contexts", "" },
+        { "ai_assistant:import_results", "" },
+        { "ai_assistant:review_queue", "" },
         { nullptr,                     nullptr }, // Separator
         { "ai_assistant:settings",     "" },
     };
@@ -375,5 +492,12 @@ ssize_t idaapi ui_callback(void* /*user_data*/, int notification_code, va_list v
         const action_activation_ctx_t* ctx = va_arg(va, const action_activation_ctx_t*);
         return finish_populating_widget_popup(widget, popup_handle, ctx);
     }
+    if (notification_code == ui_get_lines_rendering_info)
+    {
+        va_arg(va, lines_rendering_output_t*);
+        const TWidget* widget = va_arg(va, const TWidget*);
+        const lines_rendering_input_t* info = va_arg(va, const lines_rendering_input_t*);
+        on_text_viewer_render(widget, info);
+    }
     return 0;
 }
\ No newline at end of file
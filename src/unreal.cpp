@@ -0,0 +1,437 @@
+#include "aida_pro.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+namespace unreal
+{
+    // UObjectBase on x64, unchanged from UE4.0 through UE5.
+    static const int UOBJECT_INDEX = 0x0C;
+    static const int UOBJECT_CLASS = 0x10;
+    static const int UOBJECT_NAME = 0x18;
+    static const int UOBJECT_OUTER = 0x20;
+
+    static const uint32 MAX_OBJECTS = 8 * 1024 * 1024;
+    static const size_t MAX_NAME_LEN = 1024;
+    static const int MAX_OUTER_DEPTH = 32;
+    // UFunction::Func moved a lot between versions; probe this range and let the samples vote.
+    static const int FUNC_PROBE_BEGIN = 0x80;
+    static const int FUNC_PROBE_END = 0x180;
+    static const size_t FUNC_PROBE_SAMPLES = 512;
+
+    // Native thunk -> the reflected function it implements, from the last walk.
+    static std::map<ea_t, reflected_function_t> g_natives;
+
+    static bool is_code_ea(ea_t ea)
+    {
+        segment_t* seg = getseg(ea);
+        return seg != nullptr && ((seg->perm & SEGPERM_EXEC) != 0 || seg->type == SEG_CODE);
+    }
+
+    static ea_t read_ptr(ea_t ea)
+    {
+        if (!is_mapped(ea))
+            return BADADDR;
+        ea_t value = get_qword(ea);
+        return value != 0 && is_mapped(value) ? value : BADADDR;
+    }
+
+    enum names_kind_t
+    {
+        NAMES_POOL,   // UE4.23+ and UE5: FNamePool blocks of FNameEntry with a 2-byte header
+        NAMES_ARRAY,  // before UE4.23: TNameEntryArray chunks of FNameEntry pointers
+    };
+
+    class name_table_t
+    {
+    public:
+        bool init(ea_t gnames, qstring* layout)
+        {
+            // The global is either the table or a pointer to it, depending on the version.
+            ea_t bases[] = { gnames, read_ptr(gnames) };
+            for (ea_t base : bases)
+            {
+                if (base == BADADDR)
+                    continue;
+                for (int blocks_offset : { 0x10, 0x08 })
+                {
+                    if (try_layout(NAMES_POOL, base, blocks_offset))
+                    {
+                        layout->sprnt("FNamePool at 0x%a (blocks at +0x%X)", base, blocks_offset);
+                        return true;
+                    }
+                }
+                if (try_layout(NAMES_ARRAY, base, 0))
+                {
+                    layout->sprnt("TNameEntryArray at 0x%a", base);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // FName: ComparisonIndex plus a Number that becomes a "_N" suffix when non-zero.
+        bool get(ea_t fname_ea, qstring* out)
+        {
+            uint32 index = get_dword(fname_ea);
+            uint32 number = get_dword(fname_ea + 4);
+            if (!lookup(index, out))
+                return false;
+            if (number != 0)
+                out->cat_sprnt("_%u", number - 1);
+            return true;
+        }
+
+        bool lookup(uint32 index, qstring* out)
+        {
+            auto it = _cache.find(index);
+            if (it != _cache.end())
+            {
+                *out = it->second;
+                return !out->empty();
+            }
+            qstring name;
+            decode(index, &name);
+            _cache.emplace(index, name);
+            *out = name;
+            return !name.empty();
+        }
+
+    private:
+        names_kind_t _kind = NAMES_POOL;
+        ea_t _base = BADADDR;
+        int _blocks_offset = 0;
+        std::unordered_map<uint32, qstring> _cache;
+
+        bool try_layout(names_kind_t kind, ea_t base, int blocks_offset)
+        {
+            _kind = kind;
+            _base = base;
+            _blocks_offset = blocks_offset;
+            _cache.clear();
+            // Index 0 is "None" in every engine version.
+            qstring none;
+            return decode(0, &none) && none == "None";
+        }
+
+        static bool read_chars(ea_t ea, size_t len, bool wide, qstring* out)
+        {
+            if (len == 0 || len > MAX_NAME_LEN)
+                return false;
+            if (wide)
+            {
+                qvector<wchar16_t> chars;
+                chars.resize(len);
+                if (get_bytes(chars.begin(), len * 2, ea, GMB_READALL) != (ssize_t)(len * 2))
+                    return false;
+                return utf16_utf8(out, chars.begin(), (int)len);
+            }
+            out->resize(len);
+            return get_bytes(out->begin(), len, ea, GMB_READALL) == (ssize_t)len;
+        }
+
+        bool decode(uint32 index, qstring* out) const
+        {
+            if (_kind == NAMES_POOL)
+            {
+                // FNameEntryHandle: block in the high 16 bits, offset in 2-byte units below.
+                uint32 block = index >> 16;
+                if (block >= 8192)
+                    return false;
+                ea_t block_ea = read_ptr(_base + _blocks_offset + block * 8);
+                if (block_ea == BADADDR)
+                    return false;
+                ea_t entry = block_ea + (index & 0xFFFF) * 2;
+                // FNameEntryHeader: bIsWide:1, LowercaseProbeHash:5, Len:10.
+                uint16 header = get_word(entry);
+                return read_chars(entry + 2, header >> 6, (header & 1) != 0, out);
+            }
+
+            // 16384 FNameEntry pointers per chunk; the entry keeps Index << 1 | bIsWide.
+            ea_t chunk = read_ptr(_base + (index / 16384) * 8);
+            if (chunk == BADADDR)
+                return false;
+            ea_t entry = read_ptr(chunk + (index % 16384) * 8);
+            if (entry == BADADDR)
+                return false;
+            bool wide = (get_dword(entry) & 1) != 0;
+            char buf[MAX_NAME_LEN];
+            ssize_t got = get_bytes(buf, sizeof(buf), entry + 0x10, GMB_READALL);
+            if (got <= 0)
+                return false;
+            size_t len = 0;
+            if (wide)
+            {
+                while (len * 2 + 1 < (size_t)got && (buf[len * 2] != 0 || buf[len * 2 + 1] != 0))
+                    len++;
+            }
+            else
+            {
+                while (len < (size_t)got && buf[len] != 0)
+                    len++;
+            }
+            return read_chars(entry + 0x10, len, wide, out);
+        }
+    };
+
+    struct objects_layout_t
+    {
+        const char* description;
+        bool chunked;
+        int objects_offset;   // FUObjectItem array (or chunk table)
+        int count_offset;     // NumElements
+        int item_size;        // sizeof(FUObjectItem)
+    };
+
+    static const objects_layout_t OBJECT_LAYOUTS[] = {
+        { "FChunkedFixedUObjectArray (UE4.21+/UE5)",  true,  0x10, 0x24, 0x18 },
+        { "FChunkedFixedUObjectArray, 16-byte items", true,  0x10, 0x24, 0x10 },
+        { "FFixedUObjectArray (UE4 <4.21)",           false, 0x10, 0x1C, 0x18 },
+        { "FFixedUObjectArray, 16-byte items",        false, 0x10, 0x1C, 0x10 },
+    };
+
+    class object_array_t
+    {
+    public:
+        bool init(ea_t gobjects, qstring* layout)
+        {
+            // Engine signatures often resolve to ObjObjects (GObjects+0x10) rather than GUObjectArray.
+            const objects_layout_t* best_layout = nullptr;
+            ea_t best_base = BADADDR;
+            int best_score = 0;
+            for (ea_t base : { gobjects, gobjects - 0x10 })
+            {
+                for (const objects_layout_t& l : OBJECT_LAYOUTS)
+                {
+                    _layout = &l;
+                    _base = base;
+                    int score = validate();
+                    if (score > best_score)
+                    {
+                        best_score = score;
+                        best_layout = &l;
+                        best_base = base;
+                    }
+                }
+            }
+            // The first objects are the engine's own packages and classes, all densely indexed.
+            if (best_score < 8)
+                return false;
+            _layout = best_layout;
+            _base = best_base;
+            layout->sprnt("%s at 0x%a", _layout->description, _base);
+            return true;
+        }
+
+        uint32 count() const
+        {
+            uint32 n = get_dword(_base + _layout->count_offset);
+            return std::min(n, MAX_OBJECTS);
+        }
+
+        ea_t object(uint32 index) const
+        {
+            ea_t item;
+            if (_layout->chunked)
+            {
+                // 64K items per chunk.
+                ea_t table = read_ptr(_base + _layout->objects_offset);
+                if (table == BADADDR)
+                    return BADADDR;
+                ea_t chunk = read_ptr(table + (index / 65536) * 8);
+                if (chunk == BADADDR)
+                    return BADADDR;
+                item = chunk + (ea_t)(index % 65536) * _layout->item_size;
+            }
+            else
+            {
+                ea_t items = read_ptr(_base + _layout->objects_offset);
+                if (items == BADADDR)
+                    return BADADDR;
+                item = items + (ea_t)index * _layout->item_size;
+            }
+            return read_ptr(item);
+        }
+
+    private:
+        const objects_layout_t* _layout = nullptr;
+        ea_t _base = BADADDR;
+
+        int validate() const
+        {
+            uint32 n = get_dword(_base + _layout->count_offset);
+            if (n == 0 || n > MAX_OBJECTS)
+                return 0;
+            int score = 0;
+            for (uint32 i = 0; i < std::min<uint32>(n, 64); ++i)
+            {
+                ea_t obj = object(i);
+                if (obj != BADADDR && get_dword(obj + UOBJECT_INDEX) == i)
+                    score++;
+            }
+            return score;
+        }
+    };
+
+    static qstring class_name_of(name_table_t& names, ea_t obj)
+    {
+        qstring name;
+        ea_t cls = read_ptr(obj + UOBJECT_CLASS);
+        if (cls != BADADDR)
+            names.get(cls + UOBJECT_NAME, &name);
+        return name;
+    }
+
+    static qstring outermost_name(name_table_t& names, ea_t obj)
+    {
+        qstring name;
+        ea_t outer = obj;
+        for (int depth = 0; depth < MAX_OUTER_DEPTH; ++depth)
+        {
+            ea_t next = read_ptr(outer + UOBJECT_OUTER);
+            if (next == BADADDR)
+                break;
+            outer = next;
+        }
+        if (outer != obj)
+            names.get(outer + UOBJECT_NAME, &name);
+        return name;
+    }
+
+    // Picks the offset at which most sampled UFunctions hold a pointer into code.
+    static int detect_func_offset(const std::vector<ea_t>& functions)
+    {
+        int best_offset = 0;
+        size_t best_hits = 0;
+        size_t samples = std::min(functions.size(), FUNC_PROBE_SAMPLES);
+        for (int off = FUNC_PROBE_BEGIN; off < FUNC_PROBE_END; off += 8)
+        {
+            size_t hits = 0;
+            for (size_t i = 0; i < samples; ++i)
+            {
+                if (is_code_ea(get_qword(functions[i] + off)))
+                    hits++;
+            }
+            if (hits > best_hits)
+            {
+                best_hits = hits;
+                best_offset = off;
+            }
+        }
+        return best_hits * 2 > samples ? best_offset : 0;
+    }
+
+    bool walk(ea_t gnames, ea_t gobjects, walk_result_t* out, qstring* error)
+    {
+        *out = walk_result_t();
+        if (gnames == BADADDR || gobjects == BADADDR)
+        {
+            *error = "GNames and GObjects must both be known; run the engine pointer scan first.";
+            return false;
+        }
+
+        name_table_t names;
+        if (!names.init(gnames, &out->names_layout))
+        {
+            error->sprnt("Could not decode name 0 (\"None\") from GNames at 0x%a. "
+                "The name table is built at runtime, so the database must come from a process dump that includes the heap.", gnames);
+            return false;
+        }
+
+        object_array_t objects;
+        if (!objects.init(gobjects, &out->objects_layout))
+        {
+            error->sprnt("GObjects at 0x%a does not match any known FUObjectArray layout, or its items are not in the database.", gobjects);
+            return false;
+        }
+
+        std::vector<ea_t> functions;
+        const uint32 count = objects.count();
+        for (uint32 i = 0; i < count; ++i)
+        {
+            if ((i & 0xFFF) == 0 && user_cancelled())
+            {
+                *error = "Cancelled.";
+                return false;
+            }
+            ea_t obj = objects.object(i);
+            if (obj == BADADDR)
+                continue;
+            out->objects++;
+            qstring cls = class_name_of(names, obj);
+            if (cls == "Class")
+                out->classes++;
+            else if (cls == "Function")
+                functions.push_back(obj);
+        }
+        out->functions = functions.size();
+
+        out->func_offset = detect_func_offset(functions);
+        if (out->func_offset == 0)
+        {
+            *error = "Could not locate UFunction::Func in the sampled functions.";
+            return false;
+        }
+
+        // Blueprint functions all share UObject::ProcessInternal; only unique pointers are native thunks.
+        std::map<ea_t, int> uses;
+        for (ea_t fn : functions)
+        {
+            ea_t code = get_qword(fn + out->func_offset);
+            if (is_code_ea(code))
+                uses[code]++;
+        }
+
+        for (ea_t fn : functions)
+        {
+            reflected_function_t rf;
+            rf.func = get_qword(fn + out->func_offset);
+            if (!is_code_ea(rf.func) || uses[rf.func] != 1)
+                continue;
+            ea_t owner = read_ptr(fn + UOBJECT_OUTER);
+            if (owner == BADADDR || !names.get(fn + UOBJECT_NAME, &rf.name) || !names.get(owner + UOBJECT_NAME, &rf.owner))
+                continue;
+            rf.package = outermost_name(names, owner);
+            out->natives.push_back(std::move(rf));
+        }
+
+        g_natives.clear();
+        for (const reflected_function_t& rf : out->natives)
+            g_natives[rf.func] = rf;
+        return true;
+    }
+
+    size_t apply_names(const walk_result_t& result)
+    {
+        ida_utils::undo_batch_t batch("AiDA: apply Unreal reflection names");
+
+        size_t named = 0;
+        for (const reflected_function_t& rf : result.natives)
+        {
+            if (get_func(rf.func) == nullptr)
+                add_func(rf.func);
+            if (has_user_name(get_flags(rf.func)))
+                continue;
+            qstring name;
+            name.sprnt("%s::exec%s", rf.owner.c_str(), rf.name.c_str());
+            if (set_name(rf.func, name.c_str(), SN_NOWARN | SN_NOCHECK | SN_FORCE))
+                named++;
+        }
+
+        ida_utils::schedule_refresh(BADADDR, IWID_DISASM | IWID_PSEUDOCODE | IWID_FUNCS | IWID_NAMES);
+        return named;
+    }
+
+    std::string function_context(ea_t func_ea)
+    {
+        auto it = g_natives.find(func_ea);
+        if (it == g_natives.end())
+            return std::string();
+        const reflected_function_t& rf = it->second;
+        qstring out;
+        out.sprnt("Native thunk (execXxx) of the reflected UFunction `%s::%s`", rf.owner.c_str(), rf.name.c_str());
+        if (!rf.package.empty())
+            out.cat_sprnt(" in package `%s`", rf.package.c_str());
+        out.append(". It unpacks the script parameters from FFrame and calls the C++ implementation.\n");
+        return out.c_str();
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <ida.hpp>
+
+namespace unreal
+{
+    struct reflected_function_t
+    {
+        ea_t func = BADADDR;  // UFunction::Func, the native execXxx thunk
+        qstring owner;        // the UClass the function belongs to
+        qstring name;         // the reflected function name
+        qstring package;      // e.g. "/Script/Engine"
+    };
+
+    struct walk_result_t
+    {
+        qstring names_layout;
+        qstring objects_layout;
+        int func_offset = 0;   // offset of UFunction::Func that was detected
+        size_t objects = 0;
+        size_t classes = 0;
+        size_t functions = 0;
+        std::vector<reflected_function_t> natives;
+    };
+
+    // Decodes GNames (FNamePool or TNameEntryArray) and GObjects (chunked or fixed
+    // FUObjectArray) straight from the database bytes, which only hold them when the
+    // database was made from a process dump. Fails with a message in *error otherwise.
+    bool walk(ea_t gnames, ea_t gobjects, walk_result_t* out, qstring* error);
+
+    // Names every native thunk Owner::execName in one undo step; returns how many were named.
+    size_t apply_names(const walk_result_t& result);
+
+    // The reflected function a native thunk implements, for prompts; empty if unknown.
+    std::string function_context(ea_t func_ea);
+}
@@ -0,0 +1,119 @@
+// Exercises the HTTP/2 transport against a local h2 server; tests/http2_test.sh starts
+// nghttpd and runs this with its base URL. Prints one line per check and exits non-zero
+// if any of them failed.
+
+#include "aida_pro.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+// Sizes of the files tests/http2_test.sh puts in the server's document root.
+static const size_t SMALL_SIZE = 1000;
+static const size_t BIG_SIZE = 20000000;
+
+static int g_failed = 0;
+
+static void check(bool ok, const char* what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok)
+        g_failed++;
+}
+
+static void sleep_ms(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: http2_test <https base url>\n");
+        return 2;
+    }
+    const std::string base = argv[1];
+    const httplib::Headers headers = { { "Authorization", "Bearer test" } };
+
+    check(http2::available(), "libcurl supports HTTP/2");
+
+    // Many concurrent posts; the script checks the server saw only a couple of sessions.
+    {
+        std::atomic<int> good{ 0 };
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 64; ++i)
+        {
+            threads.emplace_back([&]() {
+                http2::result_t res = http2::post(base + "/small.json", headers, std::string(100000, 'x'));
+                if (res.error.empty() && res.status == 200 && res.body.size() == SMALL_SIZE)
+                    good++;
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+        check(good == 64, "64 concurrent posts");
+    }
+
+    // A receiver that stops reading holds back its own stream only: the other one on the
+    // same connection still completes (or the test hangs and ctest times it out).
+    {
+        std::atomic<bool> fast_done{ false };
+        size_t fast_got = 0;
+        std::thread stalled([&]() {
+            http2::post(base + "/big.bin", headers, "{}", [&](int, const char*, size_t) {
+                while (!fast_done)
+                    sleep_ms(10);
+                return false;
+            });
+        });
+        sleep_ms(100);
+        http2::result_t res = http2::post(base + "/big.bin", headers, "{}", [&](int, const char*, size_t len) {
+            fast_got += len;
+            return true;
+        });
+        fast_done = true;
+        stalled.join();
+        check(res.error.empty() && res.status == 200 && fast_got == BIG_SIZE, "stream next to a stalled one");
+    }
+
+    // keep_going turning false resets the stream and reports it as cancelled.
+    {
+        std::atomic<bool> stop{ false };
+        std::thread canceller([&]() {
+            sleep_ms(200);
+            stop = true;
+            http2::wake();
+        });
+        http2::result_t res = http2::post(base + "/big.bin", headers, "{}",
+            [&](int, const char*, size_t) {
+                while (!stop)
+                    sleep_ms(10);
+                return true;
+            },
+            [&]() { return !stop.load(); });
+        canceller.join();
+        check(res.cancelled, "cancel via keep_going");
+    }
+
+    // A receiver returning false ends the exchange with an error.
+    {
+        size_t got = 0;
+        http2::result_t res = http2::post(base + "/big.bin", headers, "{}", [&](int, const char*, size_t len) {
+            got += len;
+            return got < 300000;
+        });
+        check(!res.error.empty() && got < BIG_SIZE, "receiver abort");
+    }
+
+    check(http2::post(base + "/missing", headers, "{}").status == 404, "status of a missing path");
+
+    // The plugin stops the transport when a database closes; the next one must get it back.
+    http2::shutdown();
+    {
+        http2::result_t res = http2::post(base + "/small.json", headers, "{}");
+        check(res.error.empty() && res.status == 200, "request after shutdown");
+    }
+    http2::shutdown();
+
+    return g_failed == 0 ? 0 : 1;
+}
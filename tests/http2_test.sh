@@ -0,0 +1,59 @@
+#!/bin/sh
+# Runs http2_test against nghttpd on 127.0.0.1 with a throwaway self-signed certificate.
+# usage: http2_test.sh <path to http2_test> [port]
+# Exits 77 (skipped) when nghttpd or openssl is not installed.
+
+set -u
+TEST_BIN=$1
+PORT=${2:-18443}
+
+for tool in nghttpd openssl; do
+    if ! command -v "$tool" >/dev/null 2>&1; then
+        echo "http2_test: $tool not found, skipping."
+        exit 77
+    fi
+done
+
+WORK=$(mktemp -d)
+SERVER_PID=
+cleanup() {
+    [ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=127.0.0.1 \
+    -addext subjectAltName=IP:127.0.0.1 \
+    -keyout "$WORK/key.pem" -out "$WORK/cert.pem" >/dev/null 2>&1 || exit 1
+
+# Sizes match SMALL_SIZE and BIG_SIZE in http2_test.cpp.
+mkdir "$WORK/www"
+head -c 1000 /dev/zero | tr '\0' 'a' > "$WORK/www/small.json"
+head -c 20000000 /dev/zero > "$WORK/www/big.bin"
+
+nghttpd -v -d "$WORK/www" "$PORT" "$WORK/key.pem" "$WORK/cert.pem" > "$WORK/server.log" 2>&1 &
+SERVER_PID=$!
+tries=0
+until grep -q "listen" "$WORK/server.log" 2>/dev/null; do
+    tries=$((tries + 1))
+    if [ $tries -gt 50 ]; then
+        echo "http2_test: nghttpd did not start:"
+        cat "$WORK/server.log"
+        exit 1
+    fi
+    sleep 0.1
+done
+
+CURL_CA_BUNDLE="$WORK/cert.pem" "$TEST_BIN" "https://127.0.0.1:$PORT"
+rc=$?
+
+# Two connections per host before the restart and two after it at most; HTTP/1.1 would
+# have needed one per concurrent request.
+sessions=$(grep -o '^\[id=[0-9]*\]' "$WORK/server.log" | sort -u | wc -l)
+if [ "$sessions" -gt 4 ]; then
+    echo "FAILED: the server saw $sessions sessions"
+    rc=1
+else
+    echo "ok: the server saw $sessions sessions"
+fi
+exit $rc